@@ -0,0 +1,33 @@
+#include "arena.h"
+#include "log.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+void arena_init(Arena* arena, size_t capacity) {
+    arena->base = (uint8_t*)malloc(capacity);
+    arena->capacity = capacity;
+    arena->used = 0;
+    arena->peak = 0;
+}
+
+void arena_free(Arena* arena) {
+    free(arena->base);
+    *arena = {};
+}
+
+void* arena_push(Arena* arena, size_t size, size_t alignment) {
+    size_t offset = (arena->used + alignment - 1) & ~(alignment - 1);
+    if (offset + size > arena->capacity) {
+        LOG_ERROR(LOG_CATEGORY_MEMORY, "🔸Scratch arena out of space (%zu of %zu bytes used, %zu requested)\n", arena->used, arena->capacity, size);
+        log_flush();
+        exit(EXIT_FAILURE);
+    }
+    arena->used = offset + size;
+    if (arena->used > arena->peak) {
+        arena->peak = arena->used;
+    }
+    void* pointer = arena->base + offset;
+    memset(pointer, 0, size);
+    return pointer;
+}
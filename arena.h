@@ -0,0 +1,32 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Linear allocator for short lived arrays, such as what Vulkan enumeration calls fill in. Pushes
+// bump a pointer through one block reserved up front. Take a mark before pushing and reset to it
+// when done, which frees everything pushed since in one go. Not thread safe.
+struct Arena {
+    uint8_t* base;
+    size_t capacity;
+    size_t used;
+    size_t peak;
+};
+
+void arena_init(Arena* arena, size_t capacity);
+void arena_free(Arena* arena);
+
+// Zeroed. The capacity is a fixed budget, running out of it exits.
+void* arena_push(Arena* arena, size_t size, size_t alignment);
+
+template <typename T>
+T* arena_push_array(Arena* arena, size_t count) {
+    return (T*)arena_push(arena, sizeof(T) * count, alignof(T));
+}
+
+inline size_t arena_mark(const Arena* arena) {
+    return arena->used;
+}
+
+inline void arena_reset(Arena* arena, size_t mark) {
+    arena->used = mark;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// On-disk layout of the packed asset archive written by pack_assets and mapped by assets.cpp.
+//
+//   [Asset_Archive_Header][Asset_Archive_Entry x entry_count][data][data]...
+//
+// The header and every entry are 64 bytes, and every data blob starts on an
+// ASSET_ARCHIVE_ALIGNMENT boundary, so pointers into the mapping can be used in place: SPIR-V
+// goes straight to vkCreateShaderModule. Entries are sorted by name hash for binary search.
+
+static constexpr uint32_t ASSET_ARCHIVE_MAGIC = 0x4b415041; // "APAK"
+static constexpr uint32_t ASSET_ARCHIVE_VERSION = 1;
+static constexpr uint64_t ASSET_ARCHIVE_ALIGNMENT = 64;
+static constexpr uint32_t ASSET_NAME_SIZE = 32;
+
+struct Asset_Archive_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t entry_count;
+    uint32_t reserved;
+    uint64_t file_size;
+    uint64_t toc_hash;      // hash of the entry table
+    uint8_t padding[32];
+};
+
+struct Asset_Archive_Entry {
+    char name[ASSET_NAME_SIZE];     // relative path, nul terminated
+    uint64_t name_hash;
+    uint64_t offset;
+    uint64_t size;
+    uint64_t content_hash;
+};
+
+static_assert(sizeof(Asset_Archive_Header) == 64, "archive header must stay 64 bytes");
+static_assert(sizeof(Asset_Archive_Entry) == 64, "archive entries must stay 64 bytes");
+
+inline uint64_t asset_hash(const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
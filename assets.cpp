@@ -1,38 +1,177 @@
 #include "assets.h"
+#include "asset_archive.h"
+#include "log.h"
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-void assets_load_shaders(Shader_Data* shaders, const char* vert_path, const char* frag_path) {
-    FILE* vert_file = fopen(vert_path, "rb");
-    if (!vert_file) {
-        fprintf(stderr, "Failed to open vertex shader file: %s\n", vert_path);
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+static bool map_file(Asset_Archive* archive, const char* path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    GetFileSizeEx(file, &size);
+    HANDLE mapping = size.QuadPart ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    CloseHandle(file);
+    if (!mapping) {
+        return false;
+    }
+    archive->data = (const uint8_t*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    archive->size = size.QuadPart;
+    archive->mapping = mapping;
+    return archive->data != nullptr;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+    // The mapping keeps the file alive, the descriptor is not needed past this point.
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        return false;
+    }
+    archive->data = (const uint8_t*)data;
+    archive->size = st.st_size;
+    return true;
+#endif
+}
+
+static void unmap_file(Asset_Archive* archive) {
+#ifdef _WIN32
+    UnmapViewOfFile(archive->data);
+    CloseHandle((HANDLE)archive->mapping);
+#else
+    munmap((void*)archive->data, archive->size);
+#endif
+}
+
+static bool validate_archive(const Asset_Archive* archive, bool verify_contents) {
+    if (archive->size < sizeof(Asset_Archive_Header)) {
+        return false;
+    }
+    const Asset_Archive_Header* header = (const Asset_Archive_Header*)archive->data;
+    if (header->magic != ASSET_ARCHIVE_MAGIC || header->version != ASSET_ARCHIVE_VERSION || header->file_size != archive->size) {
+        return false;
+    }
+
+    uint64_t toc_size = (uint64_t)header->entry_count * sizeof(Asset_Archive_Entry);
+    if (sizeof(Asset_Archive_Header) + toc_size > archive->size ||
+        asset_hash(archive->data + sizeof(Asset_Archive_Header), toc_size) != header->toc_hash) {
+        return false;
+    }
+
+    const Asset_Archive_Entry* entries = (const Asset_Archive_Entry*)(archive->data + sizeof(Asset_Archive_Header));
+    for (uint32_t i = 0; i < header->entry_count; i++) {
+        const Asset_Archive_Entry* entry = &entries[i];
+        if (entry->offset % ASSET_ARCHIVE_ALIGNMENT != 0 || entry->offset > archive->size || entry->size > archive->size - entry->offset) {
+            return false;
+        }
+        if (verify_contents && asset_hash(archive->data + entry->offset, entry->size) != entry->content_hash) {
+            LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Asset %.*s does not match its hash\n", (int)ASSET_NAME_SIZE, entry->name);
+            return false;
+        }
+    }
+    return true;
+}
+
+bool assets_open_archive(Asset_Archive* archive, const char* path, bool verify_contents) {
+    *archive = {};
+    if (!map_file(archive, path)) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Failed to open asset archive: %s\n", path);
+        return false;
+    }
+    if (!validate_archive(archive, verify_contents)) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Asset archive %s is corrupt or from another version\n", path);
+        unmap_file(archive);
+        *archive = {};
+        return false;
+    }
+
+    const Asset_Archive_Header* header = (const Asset_Archive_Header*)archive->data;
+    archive->entries = (const Asset_Archive_Entry*)(archive->data + sizeof(Asset_Archive_Header));
+    archive->entry_count = header->entry_count;
+
+    LOG_INFO(LOG_CATEGORY_ASSETS, "• Asset archive %s mapped (%u assets, %llu bytes).\n", path, archive->entry_count, (unsigned long long)archive->size);
+    return true;
+}
+
+void assets_close_archive(Asset_Archive* archive) {
+    if (archive->data) {
+        unmap_file(archive);
+    }
+    *archive = {};
+}
+
+bool assets_find(const Asset_Archive* archive, const char* name, Asset_View* view) {
+    size_t name_length = strlen(name);
+    uint64_t name_hash = asset_hash(name, name_length);
+
+    // Lower bound on the hash, then walk the (rarely more than one) entries sharing it.
+    uint32_t low = 0;
+    uint32_t high = archive->entry_count;
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+        if (archive->entries[middle].name_hash < name_hash) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    for (uint32_t i = low; i < archive->entry_count && archive->entries[i].name_hash == name_hash; i++) {
+        const Asset_Archive_Entry* entry = &archive->entries[i];
+        if (name_length < ASSET_NAME_SIZE && strncmp(entry->name, name, ASSET_NAME_SIZE) == 0) {
+            view->data = archive->data + entry->offset;
+            view->size = entry->size;
+            return true;
+        }
+    }
+    return false;
+}
+
+static const uint32_t* find_spirv(const Asset_Archive* archive, const char* name, uint32_t* size) {
+    Asset_View view;
+    if (!assets_find(archive, name, &view)) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Shader not found in asset archive: %s\n", name);
+        log_flush();
         exit(EXIT_FAILURE);
     }
-    fseek(vert_file, 0, SEEK_END);
-    shaders->vert_size = ftell(vert_file);
-    fseek(vert_file, 0, SEEK_SET);
-    shaders->vert_source = (char*)malloc(shaders->vert_size + 1);
-    fread((void*)shaders->vert_source, 1, shaders->vert_size, vert_file);
-    shaders->vert_source[shaders->vert_size] = '\0';
-    fclose(vert_file);
-
-    FILE* frag_file = fopen(frag_path, "rb");
-    if (!frag_file) {
-        fprintf(stderr, "Failed to open fragment shader file: %s\n", frag_path);
-        free((void*)shaders->vert_source);
+    const uint32_t* code = (const uint32_t*)view.data;
+    if (view.size < 4 || view.size % 4 != 0 || code[0] != SPIRV_MAGIC) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Asset is not SPIR-V: %s\n", name);
+        log_flush();
         exit(EXIT_FAILURE);
     }
-    fseek(frag_file, 0, SEEK_END);
-    shaders->frag_size = ftell(frag_file);
-    fseek(frag_file, 0, SEEK_SET);
-    shaders->frag_source = (char*)malloc(shaders->frag_size + 1);
-    fread((void*)shaders->frag_source, 1, shaders->frag_size, frag_file);
-    shaders->frag_source[shaders->frag_size] = '\0';
-    fclose(frag_file);
+    *size = (uint32_t)view.size;
+    return code;
+}
+
+void assets_load_shaders(const Asset_Archive* archive, Shader_Data* shaders, const char* vert_name, const char* frag_name) {
+    shaders->vert_code = find_spirv(archive, vert_name, &shaders->vert_size);
+    shaders->frag_code = find_spirv(archive, frag_name, &shaders->frag_size);
 }
 
-void assets_free_shaders(Shader_Data* shaders) {
-    free((void*)shaders->vert_source);
-    free((void*)shaders->frag_source);
-}
\ No newline at end of file
+void assets_load_compute_shader(const Asset_Archive* archive, Compute_Shader_Data* shader, const char* name) {
+    shader->code = find_spirv(archive, name, &shader->size);
+}
@@ -1,5 +1,29 @@
 #pragma once
 #include "common.h"
 
-void assets_load_shaders(Shader_Data* shaders, const char* vert_path, const char* frag_path);
-void assets_free_shaders(Shader_Data* shaders);
\ No newline at end of file
+struct Asset_Archive_Entry;
+
+// Read-only view of the packed asset archive. The file is memory mapped once, lookups return
+// pointers into the mapping, so nothing is read or copied until the pages are touched.
+struct Asset_Archive {
+    const uint8_t* data;
+    uint64_t size;
+    const Asset_Archive_Entry* entries;
+    uint32_t entry_count;
+    void* mapping;  // platform handle, only used on Windows
+};
+
+struct Asset_View {
+    const void* data;   // ASSET_ARCHIVE_ALIGNMENT aligned, valid until the archive is closed
+    uint64_t size;
+};
+
+// Checks the header and table of contents. With `verify_contents` every blob is hashed against
+// its table entry as well, which touches the whole file.
+bool assets_open_archive(Asset_Archive* archive, const char* path, bool verify_contents);
+void assets_close_archive(Asset_Archive* archive);
+bool assets_find(const Asset_Archive* archive, const char* name, Asset_View* view);
+
+// Points `shaders` at the SPIR-V of two archive entries. Exits if either is missing or not SPIR-V.
+void assets_load_shaders(const Asset_Archive* archive, Shader_Data* shaders, const char* vert_name, const char* frag_name);
+void assets_load_compute_shader(const Asset_Archive* archive, Compute_Shader_Data* shader, const char* name);
@@ -0,0 +1,140 @@
+#version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Frustum and optional Hi-Z occlusion culling, one object per invocation. Survivors are appended
+// to their material's range of indirect commands. Struct layouts mirror culling.h.
+
+layout(local_size_x = 64) in;
+
+// Off for the frustum only modes, and until the first pyramid exists.
+layout(constant_id = 0) const bool OCCLUSION = false;
+
+struct Object {
+    vec4 sphere;
+    uint index_count;
+    uint first_index;
+    int vertex_offset;
+    uint first_instance;
+    uint bucket;
+    uint command_base;
+    uint padding0;
+    uint padding1;
+};
+
+struct Draw_Command {
+    uint index_count;
+    uint instance_count;
+    uint first_index;
+    int vertex_offset;
+    uint first_instance;
+};
+
+layout(set = 0, binding = 1) readonly buffer Bindless_Buffer { uint words[]; } bindless_buffers[];
+layout(set = 0, binding = 1) readonly buffer Object_Buffer { Object objects[]; } object_buffers[];
+layout(set = 0, binding = 1) buffer Command_Buffer { Draw_Command commands[]; } command_buffers[];
+layout(set = 0, binding = 1) buffer Count_Buffer { uint counts[]; } count_buffers[];
+
+layout(push_constant) uniform Draw { uint uniform_offset; uint material[4]; } draw;
+
+// Cull_Params, read word by word out of the upload ring.
+const uint PARAM_VIEW_PROJECTION = 0;
+const uint PARAM_PLANES = 16;
+const uint PARAM_OBJECT_COUNT = 40;
+const uint PARAM_OBJECTS_BUFFER = 41;
+const uint PARAM_COMMANDS_BUFFER = 42;
+const uint PARAM_COUNTS_BUFFER = 43;
+const uint PARAM_HIZ_BUFFER = 44;
+const uint PARAM_HIZ_WIDTH = 45;
+const uint PARAM_HIZ_HEIGHT = 46;
+const uint PARAM_HIZ_LEVELS = 47;
+const uint PARAM_HIZ_LEVEL_OFFSETS = 48;
+
+uint param(uint word) {
+    return bindless_buffers[0].words[draw.uniform_offset / 4 + word];
+}
+
+float param_float(uint word) {
+    return uintBitsToFloat(param(word));
+}
+
+vec4 param_vec4(uint word) {
+    return vec4(param_float(word), param_float(word + 1), param_float(word + 2), param_float(word + 3));
+}
+
+float hiz_texel(uint hiz, uint level, uvec2 size, ivec2 texel) {
+    texel = clamp(texel, ivec2(0), ivec2(size) - 1);
+    uint offset = param(PARAM_HIZ_LEVEL_OFFSETS + level);
+    return uintBitsToFloat(bindless_buffers[nonuniformEXT(hiz)].words[offset + texel.y * size.x + texel.x]);
+}
+
+// True if the sphere lies entirely behind last frame's depth. Conservative: anything touching the
+// near plane or landing off screen counts as visible.
+bool occluded(vec3 center, float radius, uint hiz) {
+    mat4 view_projection = mat4(param_vec4(PARAM_VIEW_PROJECTION), param_vec4(PARAM_VIEW_PROJECTION + 4),
+        param_vec4(PARAM_VIEW_PROJECTION + 8), param_vec4(PARAM_VIEW_PROJECTION + 12));
+
+    vec2 uv_min = vec2(1.0);
+    vec2 uv_max = vec2(0.0);
+    float nearest = 0.0;
+    for (uint corner = 0; corner < 8; corner++) {
+        vec3 offset = vec3((corner & 1) != 0 ? radius : -radius, (corner & 2) != 0 ? radius : -radius, (corner & 4) != 0 ? radius : -radius);
+        vec4 clip = view_projection * vec4(center + offset, 1.0);
+        if (clip.w <= 1e-5) {
+            return false;
+        }
+        vec3 ndc = clip.xyz / clip.w;
+        // The viewport is flipped, NDC +y is the top row.
+        vec2 uv = vec2(ndc.x * 0.5 + 0.5, 0.5 - ndc.y * 0.5);
+        uv_min = min(uv_min, uv);
+        uv_max = max(uv_max, uv);
+        nearest = max(nearest, ndc.z);
+    }
+    uv_min = clamp(uv_min, 0.0, 1.0);
+    uv_max = clamp(uv_max, 0.0, 1.0);
+
+    // The level where the rectangle spans at most two texels each way, so four reads cover it.
+    uvec2 size = uvec2(param(PARAM_HIZ_WIDTH), param(PARAM_HIZ_HEIGHT));
+    vec2 extent = (uv_max - uv_min) * vec2(size);
+    uint level = min(uint(ceil(log2(max(max(extent.x, extent.y), 1.0)))), param(PARAM_HIZ_LEVELS) - 1);
+    // Every level rounds its size up, which comes out the same as rounding once from level 0.
+    size = (size + (1u << level) - 1) >> level;
+
+    ivec2 texel_min = ivec2(uv_min * vec2(size));
+    ivec2 texel_max = ivec2(uv_max * vec2(size));
+    float farthest = min(min(hiz_texel(hiz, level, size, texel_min), hiz_texel(hiz, level, size, ivec2(texel_max.x, texel_min.y))),
+        min(hiz_texel(hiz, level, size, ivec2(texel_min.x, texel_max.y)), hiz_texel(hiz, level, size, texel_max)));
+
+    // Reverse-Z: larger is closer.
+    return nearest < farthest;
+}
+
+void main() {
+    uint index = gl_GlobalInvocationID.x;
+    if (index >= param(PARAM_OBJECT_COUNT)) {
+        return;
+    }
+
+    Object object = object_buffers[nonuniformEXT(param(PARAM_OBJECTS_BUFFER))].objects[index];
+    vec3 center = object.sphere.xyz;
+    float radius = object.sphere.w;
+
+    for (uint p = 0; p < 6; p++) {
+        vec4 plane = param_vec4(PARAM_PLANES + p * 4);
+        if (dot(plane.xyz, center) + plane.w < -radius) {
+            return;
+        }
+    }
+
+    if (OCCLUSION && occluded(center, radius, param(PARAM_HIZ_BUFFER))) {
+        return;
+    }
+
+    uint slot = atomicAdd(count_buffers[nonuniformEXT(param(PARAM_COUNTS_BUFFER))].counts[object.bucket], 1);
+    Draw_Command command;
+    command.index_count = object.index_count;
+    command.instance_count = 1;
+    command.first_index = object.first_index;
+    command.vertex_offset = object.vertex_offset;
+    command.first_instance = object.first_instance;
+    command_buffers[nonuniformEXT(param(PARAM_COMMANDS_BUFFER))].commands[object.command_base + slot] = command;
+}
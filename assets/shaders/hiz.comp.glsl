@@ -0,0 +1,53 @@
+#version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
+#extension GL_EXT_samplerless_texture_functions : require
+
+// Builds one level of the Hi-Z pyramid (see culling.h): each texel keeps the farthest depth of the
+// 2x2 texels under it, from the depth buffer for level 0 and from the level above otherwise.
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(set = 0, binding = 0) uniform texture2D bindless_images[];
+layout(set = 0, binding = 1) buffer Bindless_Buffer { uint words[]; } bindless_buffers[];
+
+// material[0]: depth image, material[1]: pyramid buffer.
+layout(push_constant) uniform Draw { uint uniform_offset; uint material[4]; } draw;
+
+// Hiz_Params, read word by word out of the upload ring.
+const uint PARAM_SOURCE_WIDTH = 0;
+const uint PARAM_SOURCE_HEIGHT = 1;
+const uint PARAM_SOURCE_OFFSET = 2;
+const uint PARAM_DESTINATION_WIDTH = 3;
+const uint PARAM_DESTINATION_HEIGHT = 4;
+const uint PARAM_DESTINATION_OFFSET = 5;
+const uint PARAM_FROM_DEPTH = 6;
+
+uint param(uint word) {
+    return bindless_buffers[0].words[draw.uniform_offset / 4 + word];
+}
+
+float source_texel(ivec2 texel) {
+    if (param(PARAM_FROM_DEPTH) != 0) {
+        return texelFetch(bindless_images[nonuniformEXT(draw.material[0])], texel, 0).r;
+    }
+    uint index = param(PARAM_SOURCE_OFFSET) + texel.y * param(PARAM_SOURCE_WIDTH) + texel.x;
+    return uintBitsToFloat(bindless_buffers[nonuniformEXT(draw.material[1])].words[index]);
+}
+
+void main() {
+    uvec2 texel = gl_GlobalInvocationID.xy;
+    uint width = param(PARAM_DESTINATION_WIDTH);
+    if (texel.x >= width || texel.y >= param(PARAM_DESTINATION_HEIGHT)) {
+        return;
+    }
+
+    // Clamping at odd edges reads the last texel twice, which is harmless for a min.
+    ivec2 last = ivec2(param(PARAM_SOURCE_WIDTH), param(PARAM_SOURCE_HEIGHT)) - 1;
+    ivec2 source = ivec2(texel * 2);
+    ivec2 source_next = min(source + 1, last);
+    float depth = min(min(source_texel(source), source_texel(ivec2(source_next.x, source.y))),
+        min(source_texel(ivec2(source.x, source_next.y)), source_texel(source_next)));
+
+    uint index = param(PARAM_DESTINATION_OFFSET) + texel.y * width + texel.x;
+    bindless_buffers[nonuniformEXT(draw.material[1])].words[index] = floatBitsToUint(depth);
+}
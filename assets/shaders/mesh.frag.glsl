@@ -0,0 +1,31 @@
+#version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
+
+layout(location = 0) in vec3 in_normal;
+layout(location = 1) in vec2 in_uv;
+
+layout(location = 0) out vec4 fragColor;
+
+layout(set = 0, binding = 0) uniform texture2D bindless_images[];
+layout(set = 0, binding = 2) uniform sampler bindless_samplers[];
+
+// material[0]: bindless image, material[1]: bindless sampler. Only read when TEXTURED.
+layout(push_constant) uniform Draw { uint uniform_offset; uint material[4]; } draw;
+
+// Directional diffuse lighting, flat color without.
+layout(constant_id = 0) const bool LIT = false;
+// Color from the material's texture, flat color while it is still streaming in.
+layout(constant_id = 1) const bool TEXTURED = false;
+
+void main() {
+    vec3 color = vec3(1.0, 0.5, 0.2);
+    if (TEXTURED && draw.material[0] != 0xffffffffu) {
+        color = texture(sampler2D(bindless_images[nonuniformEXT(draw.material[0])], bindless_samplers[draw.material[1]]), in_uv).rgb;
+    }
+    if (LIT) {
+        vec3 light = normalize(vec3(0.4, 0.8, 0.3));
+        float diffuse = max(dot(normalize(in_normal), light), 0.0);
+        color *= 0.2 + 0.8 * diffuse;
+    }
+    fragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,52 @@
+#version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Meshes from mesh_build() drawn through render_draw_scene() with VERTEX_LAYOUT_MESH. Positions
+// are relative to the mesh's bounding sphere, so the object's sphere places and scales them.
+// gl_InstanceIndex is the object's first_instance, the index of its Scene_Object.
+
+layout(location = 0) in vec4 in_position;   // R16G16B16A16_SNORM
+layout(location = 1) in vec2 in_normal;     // R16G16_SNORM, octahedral
+layout(location = 2) in vec2 in_uv;         // R16G16_SFLOAT
+
+layout(location = 0) out vec3 out_normal;
+layout(location = 1) out vec2 out_uv;
+
+layout(set = 0, binding = 1) readonly buffer Bindless_Buffer { uint words[]; } bindless_buffers[];
+
+layout(push_constant) uniform Draw { uint uniform_offset; uint material[4]; } draw;
+
+// Scene_View: mat4 view_projection, then the bindless slot of the object buffer.
+const uint VIEW_OBJECTS_BUFFER = 16;
+const uint OBJECT_WORDS = 12;
+
+float view_float(uint word) {
+    return uintBitsToFloat(bindless_buffers[0].words[draw.uniform_offset / 4 + word]);
+}
+
+vec3 decode_octahedral(vec2 e) {
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+    return normalize(n);
+}
+
+void main() {
+    mat4 view_projection;
+    for (uint column = 0; column < 4; column++) {
+        view_projection[column] = vec4(view_float(column * 4), view_float(column * 4 + 1), view_float(column * 4 + 2), view_float(column * 4 + 3));
+    }
+
+    uint objects = bindless_buffers[0].words[draw.uniform_offset / 4 + VIEW_OBJECTS_BUFFER];
+    uint base = gl_InstanceIndex * OBJECT_WORDS;
+    vec4 sphere = vec4(
+        uintBitsToFloat(bindless_buffers[nonuniformEXT(objects)].words[base]),
+        uintBitsToFloat(bindless_buffers[nonuniformEXT(objects)].words[base + 1]),
+        uintBitsToFloat(bindless_buffers[nonuniformEXT(objects)].words[base + 2]),
+        uintBitsToFloat(bindless_buffers[nonuniformEXT(objects)].words[base + 3]));
+
+    out_normal = decode_octahedral(in_normal);
+    out_uv = in_uv;
+    gl_Position = view_projection * vec4(sphere.xyz + in_position.xyz * sphere.w, 1.0);
+}
@@ -0,0 +1,41 @@
+#version 460 core
+#extension GL_EXT_nonuniform_qualifier : require
+
+// Scene objects for render_draw_scene(): the triangle from triangle.vert, placed and scaled by the
+// object's bounding sphere. gl_InstanceIndex is the object's first_instance, the index of its
+// Scene_Object.
+
+layout(set = 0, binding = 1) readonly buffer Bindless_Buffer { uint words[]; } bindless_buffers[];
+
+layout(push_constant) uniform Draw { uint uniform_offset; uint material[4]; } draw;
+
+// Scene_View: mat4 view_projection, then the bindless slot of the object buffer.
+const uint VIEW_OBJECTS_BUFFER = 16;
+const uint OBJECT_WORDS = 12;
+
+const vec3 positions[] = {
+    vec3(-0.5, -0.5, 0.0),
+    vec3( 0.0,  0.5, 0.0),
+    vec3( 0.5, -0.5, 0.0)
+};
+
+float view_float(uint word) {
+    return uintBitsToFloat(bindless_buffers[0].words[draw.uniform_offset / 4 + word]);
+}
+
+void main() {
+    mat4 view_projection;
+    for (uint column = 0; column < 4; column++) {
+        view_projection[column] = vec4(view_float(column * 4), view_float(column * 4 + 1), view_float(column * 4 + 2), view_float(column * 4 + 3));
+    }
+
+    uint objects = bindless_buffers[0].words[draw.uniform_offset / 4 + VIEW_OBJECTS_BUFFER];
+    uint base = gl_InstanceIndex * OBJECT_WORDS;
+    vec4 sphere = vec4(
+        uintBitsToFloat(bindless_buffers[nonuniformEXT(objects)].words[base]),
+        uintBitsToFloat(bindless_buffers[nonuniformEXT(objects)].words[base + 1]),
+        uintBitsToFloat(bindless_buffers[nonuniformEXT(objects)].words[base + 2]),
+        uintBitsToFloat(bindless_buffers[nonuniformEXT(objects)].words[base + 3]));
+
+    gl_Position = view_projection * vec4(sphere.xyz + positions[gl_VertexIndex % 3] * sphere.w, 1.0);
+}
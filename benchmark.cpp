@@ -0,0 +1,463 @@
+// Renderer benchmarks. Headless, so they run the same on a CI machine with a software ICD:
+//
+//   VK_ICD_FILENAMES=/usr/share/vulkan/icd.d/lvp_icd.x86_64.json render_benchmark [options]
+//
+//   --assets PATH        asset archive, default build/assets.pak
+//   --output PATH        write the results as JSON
+//   --baseline PATH      compare against an earlier --output, exit 1 on a regression, 2 if the
+//                        baseline can't be read
+//   --threshold F        p50 slowdown that counts as a regression, default 0.10 (10%)
+//   --filter TEXT        only run benchmarks whose name contains TEXT
+//   --iterations N       measured iterations of every benchmark, overriding the defaults
+//
+// Every benchmark runs its warmup iterations unmeasured, then times each measured iteration on
+// its own. Frame benchmarks time render_begin_frame() to render_end_frame(), one frame per
+// iteration, so they include the wait for the frame frames_in_flight back: with the GPU busy
+// they measure the GPU, otherwise the CPU's recording and submit. Baselines only mean something
+// on the machine and driver they were recorded with.
+//
+// The cull/ benchmarks draw the same scene under each cull mode and also report the last frame's
+// draw calls and visible objects, and the GPU frame time p50 over their measured frames.
+
+#include "assets.h"
+#include "common.h"
+#include "render.h"
+#include "shader_features.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr uint32_t MAX_RESULTS = 64;
+static constexpr uint32_t MAX_BENCHMARK_MATERIALS = 128;
+static constexpr uint32_t MATERIAL_BENCHMARK_DRAWS = 1024;
+static constexpr uint32_t CULL_BENCHMARK_SIDE = 128;
+// The profiler's frame time window: without --iterations the GPU percentiles only cover the
+// benchmark's own frames.
+static constexpr uint32_t CULL_BENCHMARK_ITERATIONS = 512;
+
+struct Benchmark_Result {
+    char name[64];
+    uint32_t warmup;
+    uint32_t iterations;
+    uint32_t operations;    // per iteration, e.g. draws per frame
+    double mean_ms;
+    double min_ms;
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double max_ms;
+    // Scene benchmarks only, as of the last measured frame.
+    uint32_t draw_calls;
+    uint32_t indirect_draw_calls;
+    uint32_t objects;
+    uint32_t visible;
+    double gpu_p50_ms;
+};
+
+// What the benchmarks share, set up once.
+struct Benchmark_Context {
+    Asset_Archive archive;
+    const char* archive_path;
+    Shader_Data shader_data;
+    Shader_Data mesh_shader_data;
+    Shader shader;
+    Shader mesh_shader;
+    Material materials[MAX_BENCHMARK_MATERIALS];
+    Shader_Data scene_shader_data;
+    Shader scene_shader;
+    Material scene_material;
+    Buffer* scene_indices;
+    Scene* scene;
+    float view_projection[16];
+    uint32_t count;         // the scale of the current benchmark
+};
+
+typedef void (*Benchmark_Run)(Benchmark_Context* context);
+
+static Benchmark_Result results[MAX_RESULTS];
+static uint32_t result_count;
+static const char* filter;
+static uint32_t iteration_override;
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Nearest rank on sorted samples.
+static double percentile(const double* sorted, uint32_t count, double p) {
+    uint32_t rank = (uint32_t)(p * count + 0.999999);
+    return sorted[std::clamp(rank, 1u, count) - 1];
+}
+
+// Returns the result, or null if the benchmark was filtered out.
+static Benchmark_Result* run_benchmark(const char* name, Benchmark_Run run, Benchmark_Context* context, uint32_t count, uint32_t operations,
+    uint32_t warmup, uint32_t iterations) {
+    if ((filter && !strstr(name, filter)) || result_count == MAX_RESULTS) {
+        return nullptr;
+    }
+    iterations = iteration_override ? iteration_override : iterations;
+    context->count = count;
+
+    for (uint32_t i = 0; i < warmup; i++) {
+        run(context);
+    }
+    double* samples = (double*)malloc(sizeof(double) * iterations);
+    for (uint32_t i = 0; i < iterations; i++) {
+        uint64_t begin_ns = now_ns();
+        run(context);
+        samples[i] = (now_ns() - begin_ns) / 1e6;
+    }
+    std::sort(samples, samples + iterations);
+
+    Benchmark_Result* result = &results[result_count++];
+    *result = {};
+    snprintf(result->name, sizeof(result->name), "%s", name);
+    result->warmup = warmup;
+    result->iterations = iterations;
+    result->operations = operations;
+    double sum = 0.0;
+    for (uint32_t i = 0; i < iterations; i++) {
+        sum += samples[i];
+    }
+    result->mean_ms = sum / iterations;
+    result->min_ms = samples[0];
+    result->p50_ms = percentile(samples, iterations, 0.50);
+    result->p90_ms = percentile(samples, iterations, 0.90);
+    result->p99_ms = percentile(samples, iterations, 0.99);
+    result->max_ms = samples[iterations - 1];
+    free(samples);
+
+    printf("• %-24s p50 %9.4f ms  p90 %9.4f ms  p99 %9.4f ms", result->name, result->p50_ms, result->p90_ms, result->p99_ms);
+    if (operations > 1) {
+        printf("  (%.3f us per op)", result->p50_ms * 1000.0 / operations);
+    }
+    printf("\n");
+    return result;
+}
+
+static void shader_create(Benchmark_Context* context) {
+    Shader shader;
+    render_create_shader(&shader, &context->shader_data);
+    render_destroy_shader(shader);
+}
+
+// The device and the in-memory pipeline cache have seen the pipeline after the warmup, so this
+// is the cost of a cache hit plus what the driver does regardless.
+static void pipeline_create(Benchmark_Context* context) {
+    Material material;
+    render_create_material(&material, context->mesh_shader, VERTEX_LAYOUT_MESH, Mesh_Frag_Key{Mesh_Frag_Feature::LIT});
+    render_destroy_material(material);
+}
+
+static void archive_open(Benchmark_Context* context) {
+    Asset_Archive archive;
+    if (!assets_open_archive(&archive, context->archive_path, context->count != 0)) {
+        exit(EXIT_FAILURE);
+    }
+    Shader_Data shader_data;
+    assets_load_shaders(&archive, &shader_data, "shaders/triangle.vert.spv", "shaders/triangle.frag.spv");
+    assets_close_archive(&archive);
+}
+
+static void frame_empty(Benchmark_Context*) {
+    render_begin_frame();
+    render_end_frame();
+}
+
+static void frame_draws(uint32_t draws, const Material* materials, uint32_t material_count) {
+    render_begin_frame();
+    for (uint32_t i = 0; i < draws; i++) {
+        render_draw(materials[i % material_count]);
+    }
+    render_end_frame();
+}
+
+// `count` draws of one material.
+static void frame_draws_one_material(Benchmark_Context* context) {
+    frame_draws(context->count, context->materials, 1);
+}
+
+// MATERIAL_BENCHMARK_DRAWS draws, round robin over `count` materials.
+static void frame_draws_many_materials(Benchmark_Context* context) {
+    frame_draws(MATERIAL_BENCHMARK_DRAWS, context->materials, context->count);
+}
+
+// Standing in the middle of the grid looking down -Z, with main.cpp's reverse-Z infinite
+// projection: most of the grid is behind the camera or outside the frustum, and the nearer rows
+// hide the ones behind them from the Hi-Z test.
+static void scene_camera(float aspect, float view_projection[16]) {
+    const float eye[3] = {0.0f, 0.5f, 0.0f};
+    const float near = 0.1f;
+    float focal = 1.0f / tanf(0.5f * 1.0472f);
+    // The projection times a translation by -eye.
+    float columns[16] = {
+        focal / aspect, 0.0f, 0.0f, 0.0f,
+        0.0f, -focal, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, -1.0f,
+        -focal / aspect * eye[0], focal * eye[1], near, eye[2],
+    };
+    memcpy(view_projection, columns, sizeof(columns));
+}
+
+// A CULL_BENCHMARK_SIDE square grid of triangles around the origin, the way main.cpp builds its
+// scene without a --mesh.
+static void create_scene(Benchmark_Context* context) {
+    static const uint32_t triangle_indices[3] = {0, 1, 2};
+    render_create_buffer(&context->scene_indices, sizeof(triangle_indices), BUFFER_USAGE_INDEX | BUFFER_USAGE_TRANSFER_DST, MEMORY_GPU);
+    Stream_Source index_source = {};
+    index_source.data = triangle_indices;
+    index_source.size = sizeof(triangle_indices);
+    render_stream_buffer(context->scene_indices, &index_source, STREAM_PRIORITY_HIGH);
+
+    render_create_shader(&context->scene_shader, &context->scene_shader_data);
+    render_create_material(&context->scene_material, context->scene_shader);
+    uint32_t object_count = CULL_BENCHMARK_SIDE * CULL_BENCHMARK_SIDE;
+    render_create_scene(&context->scene, context->scene_indices, nullptr, object_count);
+    for (uint32_t i = 0; i < object_count; i++) {
+        Scene_Object object = {};
+        object.center[0] = ((float)(i % CULL_BENCHMARK_SIDE) - 0.5f * CULL_BENCHMARK_SIDE) * 2.0f;
+        object.center[2] = ((float)(i / CULL_BENCHMARK_SIDE) - 0.5f * CULL_BENCHMARK_SIDE) * 2.0f;
+        object.radius = 0.75f;
+        object.index_count = 3;
+        object.first_instance = i;
+        render_scene_add(context->scene, context->scene_material, &object);
+    }
+    scene_camera(1280.0f / 720.0f, context->view_projection);
+
+    while (!render_buffer_ready(context->scene_indices)) {
+        render_begin_frame();
+        render_end_frame();
+    }
+}
+
+static void destroy_scene(Benchmark_Context* context) {
+    render_destroy_scene(context->scene);
+    render_destroy_buffer(context->scene_indices);
+    render_destroy_material(context->scene_material);
+    render_destroy_shader(context->scene_shader);
+}
+
+static void frame_scene(Benchmark_Context* context) {
+    render_begin_frame();
+    render_draw_scene(context->scene, context->view_projection);
+    render_end_frame();
+}
+
+static const char* json_find_result(const char* json, const char* name) {
+    char key[96];
+    snprintf(key, sizeof(key), "\"name\": \"%s\"", name);
+    return strstr(json, key);
+}
+
+static bool json_read_number(const char* object, const char* field, double* value) {
+    char key[64];
+    snprintf(key, sizeof(key), "\"%s\":", field);
+    const char* end = strchr(object, '}');
+    const char* found = strstr(object, key);
+    if (!found || (end && found > end)) {
+        return false;
+    }
+    *value = strtod(found + strlen(key), nullptr);
+    return true;
+}
+
+static bool write_json(const char* path) {
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "🔸Failed to write results: %s\n", path);
+        return false;
+    }
+    fprintf(file, "{\n  \"version\": 1,\n  \"results\": [\n");
+    for (uint32_t i = 0; i < result_count; i++) {
+        const Benchmark_Result* result = &results[i];
+        fprintf(file, "    {\"name\": \"%s\", \"warmup\": %u, \"iterations\": %u, \"operations\": %u, "
+            "\"mean_ms\": %.6f, \"min_ms\": %.6f, \"p50_ms\": %.6f, \"p90_ms\": %.6f, \"p99_ms\": %.6f, \"max_ms\": %.6f, "
+            "\"draw_calls\": %u, \"indirect_draw_calls\": %u, \"objects\": %u, \"visible\": %u, \"gpu_p50_ms\": %.6f}%s\n",
+            result->name, result->warmup, result->iterations, result->operations, result->mean_ms, result->min_ms,
+            result->p50_ms, result->p90_ms, result->p99_ms, result->max_ms, result->draw_calls, result->indirect_draw_calls,
+            result->objects, result->visible, result->gpu_p50_ms, i + 1 < result_count ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    return fclose(file) == 0;
+}
+
+static constexpr int EXIT_NO_BASELINE = 2;
+
+// Compares medians, the tails are too noisy on shared CI machines to gate on. Benchmarks missing
+// from the baseline are reported but never fail. Returns false if the baseline can't be read.
+static bool compare_baseline(const char* path, double threshold, uint32_t* regressions) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (size < 0) {
+        fclose(file);
+        return false;
+    }
+    char* json = (char*)malloc(size + 1);
+    json[fread(json, 1, size, file)] = 0;
+    fclose(file);
+    // Not something --output wrote.
+    if (!strstr(json, "\"results\":")) {
+        free(json);
+        return false;
+    }
+
+    *regressions = 0;
+    printf("• Against %s (threshold %+.0f%%):\n", path, threshold * 100.0);
+    for (uint32_t i = 0; i < result_count; i++) {
+        const Benchmark_Result* result = &results[i];
+        const char* object = json_find_result(json, result->name);
+        double baseline_ms;
+        if (!object || !json_read_number(object, "p50_ms", &baseline_ms) || baseline_ms <= 0.0) {
+            printf("  %-24s new\n", result->name);
+            continue;
+        }
+        double change = result->p50_ms / baseline_ms - 1.0;
+        bool regressed = change > threshold;
+        *regressions += regressed;
+        printf("  %-24s %9.4f -> %9.4f ms  %+6.1f%%%s\n", result->name, baseline_ms, result->p50_ms, change * 100.0,
+            regressed ? "  🔸regression" : "");
+    }
+    free(json);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    const char* archive_path = "build/assets.pak";
+    const char* output_path = nullptr;
+    const char* baseline_path = nullptr;
+    double threshold = 0.10;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--assets") == 0 && i + 1 < argc) {
+            archive_path = argv[++i];
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output_path = argv[++i];
+        } else if (strcmp(argv[i], "--baseline") == 0 && i + 1 < argc) {
+            baseline_path = argv[++i];
+        } else if (strcmp(argv[i], "--threshold") == 0 && i + 1 < argc) {
+            threshold = strtod(argv[++i], nullptr);
+        } else if (strcmp(argv[i], "--filter") == 0 && i + 1 < argc) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+            iteration_override = std::max(1u, (uint32_t)strtoul(argv[++i], nullptr, 10));
+        } else {
+            fprintf(stderr, "usage: %s [--assets PATH] [--output PATH] [--baseline PATH] [--threshold F] [--filter TEXT] [--iterations N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // No pipeline cache file, a leftover from another run would skew pipeline creation.
+    Render_Config config;
+    config.headless = true;
+    config.width = 1280;
+    config.height = 720;
+    config.pipeline_cache_path = nullptr;
+    render_init(&config);
+
+    Benchmark_Context context = {};
+    context.archive_path = archive_path;
+    if (!assets_open_archive(&context.archive, archive_path, false)) {
+        fprintf(stderr, "🔸Failed to open asset archive: %s\n", archive_path);
+        return EXIT_FAILURE;
+    }
+    assets_load_shaders(&context.archive, &context.shader_data, "shaders/triangle.vert.spv", "shaders/triangle.frag.spv");
+    assets_load_shaders(&context.archive, &context.mesh_shader_data, "shaders/mesh.vert.spv", "shaders/mesh.frag.spv");
+    assets_load_shaders(&context.archive, &context.scene_shader_data, "shaders/scene.vert.spv", "shaders/triangle.frag.spv");
+    Compute_Shader_Data cull_shader_data;
+    Compute_Shader_Data hiz_shader_data;
+    assets_load_compute_shader(&context.archive, &cull_shader_data, "shaders/cull.comp.spv");
+    assets_load_compute_shader(&context.archive, &hiz_shader_data, "shaders/hiz.comp.spv");
+    render_init_gpu_culling(&cull_shader_data, &hiz_shader_data);
+    render_create_shader(&context.shader, &context.shader_data);
+    render_create_shader(&context.mesh_shader, &context.mesh_shader_data);
+    for (uint32_t i = 0; i < MAX_BENCHMARK_MATERIALS; i++) {
+        render_create_material(&context.materials[i], context.shader);
+    }
+
+    run_benchmark("shader/create", shader_create, &context, 0, 1, 10, 200);
+    run_benchmark("pipeline/create", pipeline_create, &context, 0, 1, 5, 100);
+    run_benchmark("assets/open", archive_open, &context, 0, 1, 10, 200);
+    run_benchmark("assets/open_verified", archive_open, &context, 1, 1, 5, 100);
+    run_benchmark("frame/empty", frame_empty, &context, 0, 1, 30, 300);
+
+    static const uint32_t draw_counts[] = {100, 1000, 10000};
+    for (uint32_t count : draw_counts) {
+        char name[64];
+        snprintf(name, sizeof(name), "draws/%u", count);
+        run_benchmark(name, frame_draws_one_material, &context, count, count, 30, count >= 10000 ? 100 : 300);
+    }
+    static const uint32_t material_counts[] = {1, 16, MAX_BENCHMARK_MATERIALS};
+    for (uint32_t count : material_counts) {
+        char name[64];
+        snprintf(name, sizeof(name), "materials/%u", count);
+        run_benchmark(name, frame_draws_many_materials, &context, count, MATERIAL_BENCHMARK_DRAWS, 30, 300);
+    }
+
+    struct Cull_Benchmark {
+        const char* name;
+        Cull_Mode mode;
+    };
+    static const Cull_Benchmark cull_benchmarks[] = {
+        {"cull/cpu", CULL_MODE_CPU},
+        {"cull/gpu", CULL_MODE_GPU},
+        {"cull/gpu_occlusion", CULL_MODE_GPU_OCCLUSION},
+    };
+    create_scene(&context);
+    for (const Cull_Benchmark& benchmark : cull_benchmarks) {
+        render_set_cull_mode(benchmark.mode);
+        Benchmark_Result* result = run_benchmark(benchmark.name, frame_scene, &context, 0,
+            CULL_BENCHMARK_SIDE * CULL_BENCHMARK_SIDE, 30, CULL_BENCHMARK_ITERATIONS);
+        if (!result) {
+            continue;
+        }
+
+        Draw_Stats draw_stats;
+        Cull_Stats cull_stats;
+        Frame_Time_Stats frame_stats;
+        render_get_draw_stats(&draw_stats);
+        render_get_cull_stats(&cull_stats);
+        render_get_frame_time_stats(&frame_stats);
+        result->draw_calls = draw_stats.draw_calls;
+        result->indirect_draw_calls = draw_stats.indirect_draw_calls;
+        result->objects = cull_stats.objects;
+        result->visible = cull_stats.visible;
+        result->gpu_p50_ms = frame_stats.gpu_p50_ms;
+        printf("  %u draw calls, %u indirect, %u of %u objects visible, GPU p50 %.4f ms%s\n", result->draw_calls,
+            result->indirect_draw_calls, result->visible, result->objects, result->gpu_p50_ms,
+            cull_stats.mode != benchmark.mode ? "  🔸fell back to CPU culling" : "");
+    }
+
+    render_wait_idle();
+    destroy_scene(&context);
+    for (uint32_t i = 0; i < MAX_BENCHMARK_MATERIALS; i++) {
+        render_destroy_material(context.materials[i]);
+    }
+    render_destroy_shader(context.mesh_shader);
+    render_destroy_shader(context.shader);
+    assets_close_archive(&context.archive);
+    render_shutdown();
+
+    if (output_path && write_json(output_path)) {
+        printf("• Results written to %s.\n", output_path);
+    }
+    if (baseline_path) {
+        uint32_t regressions;
+        if (!compare_baseline(baseline_path, threshold, &regressions)) {
+            fprintf(stderr, "🔸No baseline to compare against, failed to read %s\n", baseline_path);
+            return EXIT_NO_BASELINE;
+        }
+        if (regressions) {
+            printf("🔸%u benchmarks regressed.\n", regressions);
+            return EXIT_FAILURE;
+        }
+    }
+    return EXIT_SUCCESS;
+}
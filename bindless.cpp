@@ -0,0 +1,245 @@
+#include "bindless.h"
+#include "log.h"
+
+#include <algorithm>
+#include <mutex>
+#include <stdlib.h>
+
+// Upper bounds for each array, lowered to what the device allows for update-after-bind.
+static constexpr uint32_t MAX_BINDLESS_IMAGES = 16384;
+static constexpr uint32_t MAX_BINDLESS_BUFFERS = 16384;
+static constexpr uint32_t MAX_BINDLESS_SAMPLERS = 256;
+
+struct Pending_Free {
+    uint32_t index;
+    uint64_t retire_serial;
+};
+
+// Slots below next_index have been handed out at least once. Freed slots wait in `pending` for
+// their frame to complete, then move to the free stack.
+struct Bindless_Array {
+    uint32_t capacity;
+    uint32_t next_index;
+    uint32_t* free_indices;
+    uint32_t free_count;
+    Pending_Free* pending;
+    uint32_t pending_count;
+    uint32_t pending_capacity;
+    uint32_t used_count;
+};
+
+static VkDevice device;
+static VkDescriptorSetLayout set_layout;
+static VkDescriptorPool descriptor_pool;
+static VkDescriptorSet descriptor_set;
+
+// Guards the arrays and descriptor writes, the set must be externally synchronized for updates.
+static std::mutex table_mutex;
+static Bindless_Array arrays[BINDLESS_TYPE_COUNT];
+static VkSampler* samplers;
+
+static const VkDescriptorType descriptor_types[BINDLESS_TYPE_COUNT] = {
+    VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE,
+    VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+    VK_DESCRIPTOR_TYPE_SAMPLER,
+};
+
+void bindless_init(VkDevice vk_device, VkPhysicalDevice physical_device) {
+    device = vk_device;
+
+    VkPhysicalDeviceVulkan12Properties properties12{};
+    properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+    VkPhysicalDeviceProperties2 properties{};
+    properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+    properties.pNext = &properties12;
+    vkGetPhysicalDeviceProperties2(physical_device, &properties);
+
+    uint32_t samplers_capacity = std::min({MAX_BINDLESS_SAMPLERS,
+        properties12.maxDescriptorSetUpdateAfterBindSamplers, properties12.maxPerStageDescriptorUpdateAfterBindSamplers});
+    // All three arrays count against one per-stage resource limit, split what the samplers leave.
+    uint32_t shared_limit = (properties12.maxPerStageUpdateAfterBindResources - samplers_capacity) / 2;
+    arrays[BINDLESS_IMAGE].capacity = std::min({MAX_BINDLESS_IMAGES, shared_limit,
+        properties12.maxDescriptorSetUpdateAfterBindSampledImages, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages});
+    arrays[BINDLESS_BUFFER].capacity = std::min({MAX_BINDLESS_BUFFERS, shared_limit,
+        properties12.maxDescriptorSetUpdateAfterBindStorageBuffers, properties12.maxPerStageDescriptorUpdateAfterBindStorageBuffers});
+    arrays[BINDLESS_SAMPLER].capacity = samplers_capacity;
+
+    VkDescriptorSetLayoutBinding bindings[BINDLESS_TYPE_COUNT]{};
+    VkDescriptorBindingFlags binding_flags[BINDLESS_TYPE_COUNT];
+    VkDescriptorPoolSize pool_sizes[BINDLESS_TYPE_COUNT];
+    for (uint32_t i = 0; i < BINDLESS_TYPE_COUNT; i++) {
+        Bindless_Array* array = &arrays[i];
+        array->free_indices = (uint32_t*)malloc(sizeof(uint32_t) * array->capacity);
+
+        bindings[i].binding = i;
+        bindings[i].descriptorType = descriptor_types[i];
+        bindings[i].descriptorCount = array->capacity;
+        bindings[i].stageFlags = VK_SHADER_STAGE_ALL;
+        // Slots nobody has written yet are never read, and writes never disturb frames in flight.
+        binding_flags[i] = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+            VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+        pool_sizes[i] = {descriptor_types[i], array->capacity};
+    }
+    samplers = (VkSampler*)calloc(arrays[BINDLESS_SAMPLER].capacity, sizeof(VkSampler));
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info{};
+    flags_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+    flags_info.bindingCount = BINDLESS_TYPE_COUNT;
+    flags_info.pBindingFlags = binding_flags;
+
+    VkDescriptorSetLayoutCreateInfo layout_info{};
+    layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layout_info.pNext = &flags_info;
+    layout_info.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+    layout_info.bindingCount = BINDLESS_TYPE_COUNT;
+    layout_info.pBindings = bindings;
+
+    vkCreateDescriptorSetLayout(device, &layout_info, nullptr, &set_layout);
+
+    VkDescriptorPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+    pool_info.maxSets = 1;
+    pool_info.poolSizeCount = BINDLESS_TYPE_COUNT;
+    pool_info.pPoolSizes = pool_sizes;
+
+    vkCreateDescriptorPool(device, &pool_info, nullptr, &descriptor_pool);
+
+    VkDescriptorSetAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    alloc_info.descriptorPool = descriptor_pool;
+    alloc_info.descriptorSetCount = 1;
+    alloc_info.pSetLayouts = &set_layout;
+
+    vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set);
+
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Bindless table created (%u images, %u buffers, %u samplers).\n",
+        arrays[BINDLESS_IMAGE].capacity, arrays[BINDLESS_BUFFER].capacity, arrays[BINDLESS_SAMPLER].capacity);
+}
+
+void bindless_shutdown() {
+    for (uint32_t i = 0; i < arrays[BINDLESS_SAMPLER].next_index; i++) {
+        vkDestroySampler(device, samplers[i], nullptr);
+    }
+    free(samplers);
+
+    for (uint32_t i = 0; i < BINDLESS_TYPE_COUNT; i++) {
+        free(arrays[i].free_indices);
+        free(arrays[i].pending);
+        arrays[i] = {};
+    }
+
+    vkDestroyDescriptorPool(device, descriptor_pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, set_layout, nullptr);
+}
+
+VkDescriptorSetLayout bindless_set_layout() {
+    return set_layout;
+}
+
+VkDescriptorSet bindless_set() {
+    return descriptor_set;
+}
+
+// Moves slots whose frames have completed onto the free stack.
+static void recycle_pending(Bindless_Type type, uint64_t completed_serial) {
+    Bindless_Array* array = &arrays[type];
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < array->pending_count; i++) {
+        Pending_Free pending = array->pending[i];
+        if (pending.retire_serial > completed_serial) {
+            array->pending[kept++] = pending;
+            continue;
+        }
+        if (type == BINDLESS_SAMPLER) {
+            vkDestroySampler(device, samplers[pending.index], nullptr);
+            samplers[pending.index] = VK_NULL_HANDLE;
+        }
+        array->free_indices[array->free_count++] = pending.index;
+    }
+    array->pending_count = kept;
+}
+
+uint32_t bindless_allocate(Bindless_Type type, uint64_t completed_serial) {
+    std::lock_guard<std::mutex> lock(table_mutex);
+    Bindless_Array* array = &arrays[type];
+
+    recycle_pending(type, completed_serial);
+
+    uint32_t index = BINDLESS_INVALID_INDEX;
+    if (array->free_count > 0) {
+        index = array->free_indices[--array->free_count];
+    } else if (array->next_index < array->capacity) {
+        index = array->next_index++;
+    } else {
+        LOG_WARN(LOG_CATEGORY_RENDER, "🔸Bindless table full (type %d, %u slots)\n", type, array->capacity);
+        return index;
+    }
+    array->used_count++;
+    return index;
+}
+
+void bindless_free(Bindless_Type type, uint32_t index, uint64_t retire_serial) {
+    if (index == BINDLESS_INVALID_INDEX) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(table_mutex);
+    Bindless_Array* array = &arrays[type];
+    if (array->pending_count == array->pending_capacity) {
+        array->pending_capacity = array->pending_capacity ? array->pending_capacity * 2 : 64;
+        array->pending = (Pending_Free*)realloc(array->pending, sizeof(Pending_Free) * array->pending_capacity);
+    }
+    array->pending[array->pending_count++] = {index, retire_serial};
+    array->used_count--;
+}
+
+static void write_descriptor(Bindless_Type type, uint32_t index, const VkDescriptorImageInfo* image_info, const VkDescriptorBufferInfo* buffer_info) {
+    VkWriteDescriptorSet write{};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = descriptor_set;
+    write.dstBinding = type;
+    write.dstArrayElement = index;
+    write.descriptorCount = 1;
+    write.descriptorType = descriptor_types[type];
+    write.pImageInfo = image_info;
+    write.pBufferInfo = buffer_info;
+
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+}
+
+void bindless_write_image(uint32_t index, VkImageView image_view) {
+    VkDescriptorImageInfo image_info{};
+    image_info.imageView = image_view;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    std::lock_guard<std::mutex> lock(table_mutex);
+    write_descriptor(BINDLESS_IMAGE, index, &image_info, nullptr);
+}
+
+void bindless_write_buffer(uint32_t index, VkBuffer buffer, VkDeviceSize range) {
+    VkDescriptorBufferInfo buffer_info{};
+    buffer_info.buffer = buffer;
+    buffer_info.offset = 0;
+    buffer_info.range = range;
+
+    std::lock_guard<std::mutex> lock(table_mutex);
+    write_descriptor(BINDLESS_BUFFER, index, nullptr, &buffer_info);
+}
+
+void bindless_write_sampler(uint32_t index, VkSampler sampler) {
+    VkDescriptorImageInfo image_info{};
+    image_info.sampler = sampler;
+
+    std::lock_guard<std::mutex> lock(table_mutex);
+    samplers[index] = sampler;
+    write_descriptor(BINDLESS_SAMPLER, index, &image_info, nullptr);
+}
+
+void bindless_get_stats(Bindless_Stats* stats) {
+    std::lock_guard<std::mutex> lock(table_mutex);
+    for (uint32_t i = 0; i < BINDLESS_TYPE_COUNT; i++) {
+        stats->used[i] = arrays[i].used_count;
+        stats->capacity[i] = arrays[i].capacity;
+    }
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "render.h"
+
+#include <vulkan/vulkan_core.h>
+
+// One global descriptor set holding every sampled image, storage buffer and sampler. It is bound
+// once per command buffer and never changes binding: resources are written into free slots with
+// update-after-bind, and shaders index the arrays with numbers passed in push constants. The GLSL
+// side (GL_EXT_nonuniform_qualifier):
+//
+//   layout(set = 0, binding = 0) uniform texture2D bindless_images[];
+//   layout(set = 0, binding = 1) readonly buffer Bindless_Buffer { uint words[]; } bindless_buffers[];
+//   layout(set = 0, binding = 2) uniform sampler bindless_samplers[];
+//
+// A freed slot is only handed out again once the frame serial it was freed at has completed,
+// so frames still in flight never see a descriptor change under them.
+
+void bindless_init(VkDevice device, VkPhysicalDevice physical_device);
+void bindless_shutdown();
+
+VkDescriptorSetLayout bindless_set_layout();
+VkDescriptorSet bindless_set();
+
+// Returns BINDLESS_INVALID_INDEX when the array is full. `completed_serial` is the last frame the
+// GPU has finished, slots freed up to it are reused first.
+uint32_t bindless_allocate(Bindless_Type type, uint64_t completed_serial);
+// `retire_serial` is the last frame that may still read the slot.
+void bindless_free(Bindless_Type type, uint32_t index, uint64_t retire_serial);
+
+void bindless_write_image(uint32_t index, VkImageView image_view);
+void bindless_write_buffer(uint32_t index, VkBuffer buffer, VkDeviceSize range);
+// The table takes ownership of the sampler and destroys it once its slot is recycled.
+void bindless_write_sampler(uint32_t index, VkSampler sampler);
+
+void bindless_get_stats(Bindless_Stats* stats);
@@ -1,9 +1,53 @@
 #pragma once
+#include <initializer_list>
 #include <stdint.h>
 
+// SPIR-V for one vertex/fragment pair. The code is borrowed, typically from the asset archive
+// mapping, and only has to stay valid until render_create_shader() returns.
 struct Shader_Data {
-    char* vert_source;
-    char* frag_source;
+    const uint32_t* vert_code;
+    const uint32_t* frag_code;
     uint32_t vert_size;
     uint32_t frag_size;
-};
\ No newline at end of file
+};
+
+// SPIR-V for a single compute shader, borrowed the same way.
+struct Compute_Shader_Data {
+    const uint32_t* code;
+    uint32_t size;
+};
+
+static constexpr uint32_t MAX_SHADER_FEATURES = 32;
+
+// The features a pipeline turns on: bit N sets the bool specialization constant with constant_id N
+// in every stage of the shader. Features default to false, so the empty variant is the shader as
+// written. Drivers fold the constants and drop the code behind the off branches.
+struct Shader_Variant {
+    uint32_t features;
+};
+
+// Typed way to build a Shader_Variant. compile_shaders generates a feature enum and a key alias per
+// shader (shader_features.h), e.g. Mesh_Frag_Key{Mesh_Frag_Feature::LIT}, so a feature the shader
+// doesn't declare doesn't compile.
+template <typename Feature>
+struct Shader_Key {
+    uint32_t features = 0;
+
+    constexpr Shader_Key() = default;
+    constexpr Shader_Key(std::initializer_list<Feature> list) {
+        for (Feature feature : list) {
+            features |= 1u << (uint32_t)feature;
+        }
+    }
+    constexpr Shader_Key with(Feature feature, bool enabled = true) const {
+        Shader_Key key = *this;
+        key.features = enabled ? key.features | 1u << (uint32_t)feature : key.features & ~(1u << (uint32_t)feature);
+        return key;
+    }
+    constexpr bool has(Feature feature) const {
+        return (features >> (uint32_t)feature) & 1;
+    }
+    constexpr operator Shader_Variant() const {
+        return {features};
+    }
+};
@@ -0,0 +1,282 @@
+// Build-time tool: compiles GLSL to SPIR-V and generates the typed feature keys (see Shader_Key).
+//
+//   compile_shaders <source directory> <output directory> <features header> <source>...
+//
+// "mesh.frag.glsl" in the source directory becomes "mesh.frag.spv" in the output directory.
+// Sources compile in parallel, one glslangValidator per hardware thread. Next to each output goes
+// a hash of the source and the command that compiled it, a source whose hash still matches is
+// skipped, so touching a file or switching branches back and forth recompiles nothing.
+//
+// Features are declared in the shaders themselves as bool specialization constants:
+//
+//   layout(constant_id = 0) const bool LIT = false;
+//
+// and end up in the header as `enum class Mesh_Frag_Feature : uint32_t { LIT = 0 }` with
+// `using Mesh_Frag_Key = Shader_Key<Mesh_Frag_Feature>`. A variant is a pipeline created with some
+// of them on, from the one SPIR-V module, so variants cost no build time and no archive space.
+// The header is only rewritten when it changes, so shader edits don't recompile the C++ using it.
+
+#include "common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static constexpr const char* COMPILE_COMMAND = "glslangValidator -V";
+static constexpr uint32_t MAX_NAME = 64;
+
+struct Feature {
+    char name[MAX_NAME];
+    uint32_t id;
+};
+
+struct Shader_Job {
+    const char* name;               // relative to the source directory
+    char source_path[1024];
+    char output_path[1024];
+    char* source;
+    uint64_t source_size;
+    uint64_t hash;
+    Feature features[MAX_SHADER_FEATURES];
+    uint32_t feature_count;
+    bool up_to_date;
+    bool failed;
+};
+
+static void* read_file(const char* path, uint64_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return nullptr;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* data = (char*)malloc(*size + 1);
+    bool read = fread(data, 1, *size, file) == *size;
+    fclose(file);
+    if (!read) {
+        free(data);
+        return nullptr;
+    }
+    data[*size] = 0;
+    return data;
+}
+
+static uint64_t hash_fnv1a(uint64_t hash, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+// "mesh.frag.glsl" -> "Mesh_Frag"
+static void make_type_name(char* type_name, size_t capacity, const char* name) {
+    const char* base = strrchr(name, '/');
+    base = base ? base + 1 : name;
+    size_t length = 0;
+    bool word_start = true;
+    for (const char* c = base; *c && strcmp(c, ".glsl") != 0 && length + 1 < capacity; c++) {
+        bool alnum = (*c >= 'a' && *c <= 'z') || (*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9');
+        if (!alnum) {
+            type_name[length++] = '_';
+            word_start = true;
+        } else {
+            type_name[length++] = word_start && *c >= 'a' && *c <= 'z' ? *c - 'a' + 'A' : *c;
+            word_start = false;
+        }
+    }
+    type_name[length] = 0;
+}
+
+// Picks the bool specialization constants out of the source. Other specialization constants are
+// tuning values, not features, and are left alone. A feature has to default to false, pipelines
+// only specialize the features they turn on.
+static bool parse_features(Shader_Job* job) {
+    for (const char* line = job->source; line && *line; line = strchr(line, '\n'), line = line ? line + 1 : nullptr) {
+        uint32_t id;
+        char name[MAX_NAME];
+        char value[16];
+        if (sscanf(line, " layout ( constant_id = %u ) const bool %63[A-Za-z0-9_] = %15[a-z]", &id, name, value) != 3) {
+            continue;
+        }
+        if (strcmp(value, "false") != 0) {
+            fprintf(stderr, "🔸%s: feature %s must default to false\n", job->source_path, name);
+            return false;
+        }
+        if (id >= MAX_SHADER_FEATURES) {
+            fprintf(stderr, "🔸%s: feature %s has constant_id %u, the limit is %u\n", job->source_path, name, id, MAX_SHADER_FEATURES - 1);
+            return false;
+        }
+        for (uint32_t i = 0; i < job->feature_count; i++) {
+            if (job->features[i].id == id) {
+                fprintf(stderr, "🔸%s: features %s and %s share constant_id %u\n", job->source_path, job->features[i].name, name, id);
+                return false;
+            }
+        }
+        Feature* feature = &job->features[job->feature_count++];
+        snprintf(feature->name, sizeof(feature->name), "%s", name);
+        feature->id = id;
+    }
+    return true;
+}
+
+static void hash_path(char* path, size_t capacity, const char* output_path) {
+    snprintf(path, capacity, "%s.hash", output_path);
+}
+
+static bool output_up_to_date(const Shader_Job* job) {
+    FILE* output = fopen(job->output_path, "rb");
+    if (!output) {
+        return false;
+    }
+    fclose(output);
+
+    char path[1040];
+    hash_path(path, sizeof(path), job->output_path);
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return false;
+    }
+    unsigned long long stored = 0;
+    bool read = fscanf(file, "%llx", &stored) == 1;
+    fclose(file);
+    return read && stored == job->hash;
+}
+
+static void compile(Shader_Job* job) {
+    char command[2200];
+    snprintf(command, sizeof(command), "%s \"%s\" -o \"%s\"", COMPILE_COMMAND, job->source_path, job->output_path);
+    if (system(command) != 0) {
+        job->failed = true;
+        return;
+    }
+
+    char path[1040];
+    hash_path(path, sizeof(path), job->output_path);
+    FILE* file = fopen(path, "wb");
+    if (file) {
+        fprintf(file, "%016llx\n", (unsigned long long)job->hash);
+        fclose(file);
+    }
+}
+
+// Returns false if the header couldn't be written. Leaves it alone if nothing changed.
+static bool write_features_header(const char* path, const Shader_Job* jobs, uint32_t job_count) {
+    size_t capacity = 4096;
+    for (uint32_t i = 0; i < job_count; i++) {
+        capacity += 256 + jobs[i].feature_count * (MAX_NAME + 32);
+    }
+    char* text = (char*)malloc(capacity);
+    size_t length = 0;
+    length += snprintf(text + length, capacity - length, "// Generated by compile_shaders, do not edit.\n#pragma once\n#include \"common.h\"\n");
+    for (uint32_t i = 0; i < job_count; i++) {
+        const Shader_Job* job = &jobs[i];
+        if (job->feature_count == 0) {
+            continue;
+        }
+        char type_name[MAX_NAME];
+        make_type_name(type_name, sizeof(type_name), job->name);
+        length += snprintf(text + length, capacity - length, "\n// %s\nenum class %s_Feature : uint32_t {\n", job->name, type_name);
+        for (uint32_t f = 0; f < job->feature_count; f++) {
+            length += snprintf(text + length, capacity - length, "    %s = %u,\n", job->features[f].name, job->features[f].id);
+        }
+        length += snprintf(text + length, capacity - length, "};\nusing %s_Key = Shader_Key<%s_Feature>;\n", type_name, type_name);
+    }
+
+    uint64_t existing_size = 0;
+    char* existing = (char*)read_file(path, &existing_size);
+    bool unchanged = existing && existing_size == length && memcmp(existing, text, length) == 0;
+    free(existing);
+    bool written = true;
+    if (!unchanged) {
+        FILE* file = fopen(path, "wb");
+        written = file && fwrite(text, 1, length, file) == length;
+        written = file && fclose(file) == 0 && written;
+    }
+    free(text);
+    return written;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 5) {
+        fprintf(stderr, "usage: %s <source directory> <output directory> <features header> <source>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    auto start = std::chrono::steady_clock::now();
+    const char* source_directory = argv[1];
+    const char* output_directory = argv[2];
+    const char* header_path = argv[3];
+    uint32_t job_count = argc - 4;
+
+    Shader_Job* jobs = (Shader_Job*)calloc(job_count, sizeof(Shader_Job));
+    for (uint32_t i = 0; i < job_count; i++) {
+        Shader_Job* job = &jobs[i];
+        job->name = argv[4 + i];
+        snprintf(job->source_path, sizeof(job->source_path), "%s/%s", source_directory, job->name);
+        size_t name_length = strlen(job->name);
+        if (name_length > 5 && strcmp(job->name + name_length - 5, ".glsl") == 0) {
+            name_length -= 5;
+        }
+        snprintf(job->output_path, sizeof(job->output_path), "%s/%.*s.spv", output_directory, (int)name_length, job->name);
+
+        job->source = (char*)read_file(job->source_path, &job->source_size);
+        if (!job->source) {
+            fprintf(stderr, "🔸Failed to read shader: %s\n", job->source_path);
+            return EXIT_FAILURE;
+        }
+        if (!parse_features(job)) {
+            return EXIT_FAILURE;
+        }
+        job->hash = hash_fnv1a(0xcbf29ce484222325ull, COMPILE_COMMAND, strlen(COMPILE_COMMAND));
+        job->hash = hash_fnv1a(job->hash, job->source, job->source_size);
+        job->up_to_date = output_up_to_date(job);
+    }
+
+    if (!write_features_header(header_path, jobs, job_count)) {
+        fprintf(stderr, "🔸Failed to write header: %s\n", header_path);
+        return EXIT_FAILURE;
+    }
+
+    // Workers pull the next stale shader until none are left.
+    std::atomic<uint32_t> next{0};
+    uint32_t worker_count = std::max(1u, std::min(std::thread::hardware_concurrency(), job_count));
+    std::thread* workers = new std::thread[worker_count];
+    for (uint32_t w = 0; w < worker_count; w++) {
+        workers[w] = std::thread([&]() {
+            for (uint32_t i = next++; i < job_count; i = next++) {
+                if (!jobs[i].up_to_date) {
+                    compile(&jobs[i]);
+                }
+            }
+        });
+    }
+    for (uint32_t w = 0; w < worker_count; w++) {
+        workers[w].join();
+    }
+    delete[] workers;
+
+    uint32_t compiled = 0;
+    uint32_t failed = 0;
+    uint32_t feature_count = 0;
+    for (uint32_t i = 0; i < job_count; i++) {
+        compiled += !jobs[i].up_to_date && !jobs[i].failed;
+        failed += jobs[i].failed;
+        feature_count += jobs[i].feature_count;
+        if (jobs[i].failed) {
+            fprintf(stderr, "🔸Failed to compile shader: %s\n", jobs[i].source_path);
+        }
+        free(jobs[i].source);
+    }
+    free(jobs);
+
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    printf("• Shaders: %u compiled, %u up to date, %u features (%u workers, %.0f ms).\n",
+        compiled, job_count - compiled - failed, feature_count, worker_count, ms);
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
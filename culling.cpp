@@ -0,0 +1,169 @@
+#include "culling.h"
+#include "jobs.h"
+#include "log.h"
+#include "shader_features.h"
+#include "shader_variant.h"
+
+#include <atomic>
+#include <math.h>
+
+static constexpr uint32_t CPU_CULL_CHUNK = 4096;
+
+static VkDevice device;
+static VkPipeline cull_pipeline;
+static VkPipeline cull_occlusion_pipeline;
+static VkPipeline hiz_pipeline;
+
+static VkPipeline create_compute_pipeline(VkPipelineCache pipeline_cache, VkPipelineLayout pipeline_layout, const Compute_Shader_Data* shader,
+    Shader_Variant variant = {}) {
+    Pipeline_Specialization specialization;
+
+    VkShaderModuleCreateInfo module_info{};
+    module_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    module_info.codeSize = shader->size;
+    module_info.pCode = shader->code;
+
+    VkShaderModule module;
+    vkCreateShaderModule(device, &module_info, nullptr, &module);
+
+    VkComputePipelineCreateInfo pipeline_info{};
+    pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipeline_info.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipeline_info.stage.module = module;
+    pipeline_info.stage.pName = "main";
+    pipeline_info.stage.pSpecializationInfo = pipeline_specialization(variant, &specialization);
+    pipeline_info.layout = pipeline_layout;
+
+    VkPipeline pipeline;
+    vkCreateComputePipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, &pipeline);
+    vkDestroyShaderModule(device, module, nullptr);
+    return pipeline;
+}
+
+void culling_init(VkDevice vk_device, VkPipelineCache pipeline_cache, VkPipelineLayout pipeline_layout,
+    const Compute_Shader_Data* cull_shader, const Compute_Shader_Data* hiz_shader) {
+    device = vk_device;
+    cull_pipeline = create_compute_pipeline(pipeline_cache, pipeline_layout, cull_shader);
+    cull_occlusion_pipeline = create_compute_pipeline(pipeline_cache, pipeline_layout, cull_shader, Cull_Comp_Key{Cull_Comp_Feature::OCCLUSION});
+    hiz_pipeline = create_compute_pipeline(pipeline_cache, pipeline_layout, hiz_shader);
+    LOG_INFO(LOG_CATEGORY_RENDER, "• GPU culling pipelines created.\n");
+}
+
+void culling_shutdown() {
+    if (cull_pipeline != VK_NULL_HANDLE) {
+        vkDestroyPipeline(device, cull_pipeline, nullptr);
+        vkDestroyPipeline(device, cull_occlusion_pipeline, nullptr);
+        vkDestroyPipeline(device, hiz_pipeline, nullptr);
+        cull_pipeline = VK_NULL_HANDLE;
+        cull_occlusion_pipeline = VK_NULL_HANDLE;
+        hiz_pipeline = VK_NULL_HANDLE;
+    }
+}
+
+bool culling_gpu_available() {
+    return cull_pipeline != VK_NULL_HANDLE;
+}
+
+VkPipeline culling_cull_pipeline(bool occlusion) {
+    return occlusion ? cull_occlusion_pipeline : cull_pipeline;
+}
+
+VkPipeline culling_hiz_pipeline() {
+    return hiz_pipeline;
+}
+
+void culling_extract_planes(const float m[16], float planes[6][4]) {
+    // Gribb/Hartmann: each plane is a sum of matrix rows. Column major, so column c holds
+    // rows 0 to 3 at m[c * 4 + 0..3].
+    for (uint32_t c = 0; c < 4; c++) {
+        float row0 = m[c * 4 + 0];
+        float row1 = m[c * 4 + 1];
+        float row2 = m[c * 4 + 2];
+        float row3 = m[c * 4 + 3];
+        planes[0][c] = row3 + row0;     // left
+        planes[1][c] = row3 - row0;     // right
+        planes[2][c] = row3 + row1;     // bottom
+        planes[3][c] = row3 - row1;     // top
+        planes[4][c] = row2;            // z >= 0
+        planes[5][c] = row3 - row2;     // z <= w
+    }
+
+    for (uint32_t p = 0; p < 6; p++) {
+        float length = sqrtf(planes[p][0] * planes[p][0] + planes[p][1] * planes[p][1] + planes[p][2] * planes[p][2]);
+        if (length < 1e-6f) {
+            planes[p][0] = 0.0f;
+            planes[p][1] = 0.0f;
+            planes[p][2] = 0.0f;
+            planes[p][3] = 1.0f;
+            continue;
+        }
+        for (uint32_t i = 0; i < 4; i++) {
+            planes[p][i] /= length;
+        }
+    }
+}
+
+struct Cpu_Cull_Job {
+    const Gpu_Scene_Object* objects;
+    uint32_t count;
+    const float (*planes)[4];
+    uint8_t* visible;
+    std::atomic<uint32_t> visible_count;
+};
+
+static void cull_chunk(uint32_t index, uint32_t, void* data) {
+    Cpu_Cull_Job* job = (Cpu_Cull_Job*)data;
+    uint32_t begin = index * CPU_CULL_CHUNK;
+    uint32_t end = begin + CPU_CULL_CHUNK < job->count ? begin + CPU_CULL_CHUNK : job->count;
+
+    uint32_t visible_count = 0;
+    for (uint32_t i = begin; i < end; i++) {
+        const Gpu_Scene_Object* object = &job->objects[i];
+        bool visible = true;
+        for (uint32_t p = 0; p < 6 && visible; p++) {
+            const float* plane = job->planes[p];
+            float distance = plane[0] * object->center[0] + plane[1] * object->center[1] + plane[2] * object->center[2] + plane[3];
+            visible = distance >= -object->radius;
+        }
+        job->visible[i] = visible;
+        visible_count += visible;
+    }
+    job->visible_count.fetch_add(visible_count, std::memory_order_relaxed);
+}
+
+uint32_t culling_cpu(const Gpu_Scene_Object* objects, uint32_t count, const float planes[6][4], uint8_t* visible) {
+    Cpu_Cull_Job job;
+    job.objects = objects;
+    job.count = count;
+    job.planes = planes;
+    job.visible = visible;
+    job.visible_count = 0;
+
+    jobs_parallel_for((count + CPU_CULL_CHUNK - 1) / CPU_CULL_CHUNK, cull_chunk, &job);
+    return job.visible_count.load(std::memory_order_relaxed);
+}
+
+uint32_t culling_hiz_layout(uint32_t depth_width, uint32_t depth_height, uint32_t* level_count,
+    uint32_t widths[MAX_HIZ_LEVELS], uint32_t heights[MAX_HIZ_LEVELS], uint32_t offsets[MAX_HIZ_LEVELS]) {
+    // Rounding sizes up means every source texel lands under some destination texel, which keeps
+    // the pyramid conservative for odd sizes.
+    uint32_t width = (depth_width + 1) / 2;
+    uint32_t height = (depth_height + 1) / 2;
+    uint32_t total = 0;
+    uint32_t levels = 0;
+    while (levels < MAX_HIZ_LEVELS) {
+        widths[levels] = width;
+        heights[levels] = height;
+        offsets[levels] = total;
+        total += width * height;
+        levels++;
+        if (width == 1 && height == 1) {
+            break;
+        }
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    *level_count = levels;
+    return total;
+}
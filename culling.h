@@ -0,0 +1,85 @@
+#pragma once
+#include "render.h"
+
+#include <vulkan/vulkan_core.h>
+
+// Visibility for scenes drawn with render_draw_scene(). The CPU path tests bounding spheres against
+// the frustum on the job system. The GPU path runs the same test in cull.comp, optionally followed
+// by an occlusion test against a Hi-Z pyramid of the previous frame's depth, and compacts the
+// survivors into VkDrawIndexedIndirectCommands, one contiguous range and one count per material.
+//
+// The pyramid lives in a storage buffer rather than a mip chain, so both compute shaders reach
+// everything through the bindless table: level 0 is the depth buffer halved, each level after
+// that halves again, levels are stored back to back as floats. Depth is reverse-Z, a texel holds
+// the farthest (smallest) depth under it.
+
+static constexpr uint32_t MAX_HIZ_LEVELS = 16;
+static constexpr uint32_t CULL_GROUP_SIZE = 64;
+static constexpr uint32_t HIZ_GROUP_SIZE = 8;
+
+// std430 mirrors of the shader side structs, keep in sync with cull.comp.glsl and hiz.comp.glsl.
+struct Gpu_Scene_Object {
+    float center[3];
+    float radius;
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    uint32_t first_instance;
+    uint32_t bucket;        // material slot in the scene, selects the count
+    uint32_t command_base;  // first command of the bucket's range
+    uint32_t padding[2];
+};
+
+// Read by cull.comp through Draw_Push_Constants::uniform_offset.
+struct Cull_Params {
+    float view_projection[16];
+    float planes[6][4];
+    uint32_t object_count;
+    uint32_t objects_buffer;    // bindless buffer slots
+    uint32_t commands_buffer;
+    uint32_t counts_buffer;
+    uint32_t hiz_buffer;        // read by the occlusion variant only
+    uint32_t hiz_width;         // level 0
+    uint32_t hiz_height;
+    uint32_t hiz_levels;
+    uint32_t hiz_level_offsets[MAX_HIZ_LEVELS];     // in floats
+};
+
+// Pushed for the draws of a scene, read by scene.vert.
+struct Scene_View {
+    float view_projection[16];
+    uint32_t objects_buffer;
+};
+
+// One per pyramid level, read by hiz.comp.
+struct Hiz_Params {
+    uint32_t source_width;
+    uint32_t source_height;
+    uint32_t source_offset;     // in floats, unused when reading the depth image
+    uint32_t destination_width;
+    uint32_t destination_height;
+    uint32_t destination_offset;
+    uint32_t from_depth;
+    uint32_t padding;
+};
+
+// Shared layout only, the pipelines are created against the bindless pipeline layout.
+void culling_init(VkDevice device, VkPipelineCache pipeline_cache, VkPipelineLayout pipeline_layout,
+    const Compute_Shader_Data* cull_shader, const Compute_Shader_Data* hiz_shader);
+void culling_shutdown();
+bool culling_gpu_available();
+// The occlusion variant of cull.comp, or the frustum only one.
+VkPipeline culling_cull_pipeline(bool occlusion);
+VkPipeline culling_hiz_pipeline();
+
+// Normalized planes from a column major view projection, for Vulkan's [0, w] clip depth. A plane
+// that degenerates, such as the far plane of an infinite projection, becomes always inside.
+void culling_extract_planes(const float view_projection[16], float planes[6][4]);
+
+// Writes 1 into `visible` for every sphere inside the frustum, 0 otherwise. Split across the job
+// system. Returns how many were visible.
+uint32_t culling_cpu(const Gpu_Scene_Object* objects, uint32_t count, const float planes[6][4], uint8_t* visible);
+
+// Sizes and offsets of the pyramid for a depth buffer of the given size. Returns the total floats.
+uint32_t culling_hiz_layout(uint32_t depth_width, uint32_t depth_height, uint32_t* level_count,
+    uint32_t widths[MAX_HIZ_LEVELS], uint32_t heights[MAX_HIZ_LEVELS], uint32_t offsets[MAX_HIZ_LEVELS]);
@@ -0,0 +1,106 @@
+// Build-time tool: turns compiled SPIR-V into a header of constexpr arrays (see embedded_shaders.h).
+//
+//   embed_shaders <output header> <root directory> <relative path>...
+//
+// Each shader is registered under its path relative to the root, e.g. "shaders/triangle.vert.spv",
+// the same name it has in the asset archive.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+static void* read_file(const char* path, uint64_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return nullptr;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void* data = malloc(*size ? *size : 1);
+    bool read = fread(data, 1, *size, file) == *size;
+    fclose(file);
+    if (!read) {
+        free(data);
+        return nullptr;
+    }
+    return data;
+}
+
+// "shaders/triangle.vert.spv" -> "embedded_shaders_triangle_vert_spv"
+static void make_identifier(char* identifier, size_t capacity, const char* name) {
+    size_t length = snprintf(identifier, capacity, "embedded_%s", name);
+    for (size_t i = 0; i < length && i < capacity; i++) {
+        char c = identifier[i];
+        bool valid = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+        if (!valid) {
+            identifier[i] = '_';
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <output header> <root directory> <relative path>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char* output_path = argv[1];
+    const char* root = argv[2];
+    uint32_t shader_count = argc - 3;
+
+    FILE* file = fopen(output_path, "wb");
+    if (!file) {
+        fprintf(stderr, "🔸Failed to write header: %s\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    fprintf(file, "// Generated by embed_shaders, do not edit.\n");
+    fprintf(file, "#pragma once\n\n");
+
+    uint64_t total_size = 0;
+    for (uint32_t i = 0; i < shader_count; i++) {
+        const char* name = argv[3 + i];
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", root, name);
+        uint64_t size = 0;
+        uint32_t* code = (uint32_t*)read_file(path, &size);
+        if (!code) {
+            fprintf(stderr, "🔸Failed to read shader: %s\n", path);
+            return EXIT_FAILURE;
+        }
+        // Rejecting bad input here means the runtime never has to check.
+        if (size < 4 || size % 4 != 0 || code[0] != SPIRV_MAGIC) {
+            fprintf(stderr, "🔸Not SPIR-V: %s\n", path);
+            return EXIT_FAILURE;
+        }
+
+        char identifier[256];
+        make_identifier(identifier, sizeof(identifier), name);
+        fprintf(file, "alignas(16) inline constexpr uint32_t %s[] = {", identifier);
+        for (uint64_t word = 0; word < size / 4; word++) {
+            fprintf(file, "%s0x%08x,", word % 8 == 0 ? "\n    " : " ", code[word]);
+        }
+        fprintf(file, "\n};\n\n");
+        total_size += size;
+        free(code);
+    }
+
+    fprintf(file, "inline constexpr Embedded_Shader EMBEDDED_SHADERS[] = {\n");
+    for (uint32_t i = 0; i < shader_count; i++) {
+        char identifier[256];
+        make_identifier(identifier, sizeof(identifier), argv[3 + i]);
+        fprintf(file, "    {\"%s\", %s, sizeof(%s)},\n", argv[3 + i], identifier, identifier);
+    }
+    fprintf(file, "};\n");
+
+    if (fclose(file) != 0) {
+        fprintf(stderr, "🔸Failed to write header: %s\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    printf("• Embedded %u shaders into %s (%llu bytes of SPIR-V).\n", shader_count, output_path, (unsigned long long)total_size);
+    return EXIT_SUCCESS;
+}
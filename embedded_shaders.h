@@ -0,0 +1,44 @@
+#pragma once
+#include "common.h"
+
+// SPIR-V compiled into the executable. With -DEMBED_SHADERS=ON the build runs embed_shaders over
+// the compiled shaders and this header pulls in the result: one constexpr array per shader and a
+// registry keyed by the same names the asset archive uses. Lookups with a literal name resolve at
+// compile time, so a missing shader is a build error and loading one touches no file at all.
+
+struct Embedded_Shader {
+    const char* name;
+    const uint32_t* code;
+    uint32_t size;      // bytes
+};
+
+#ifdef EMBED_SHADERS
+#include "embedded_shaders_data.h"
+#else
+inline constexpr Embedded_Shader EMBEDDED_SHADERS[] = {{"", nullptr, 0}};
+#endif
+
+constexpr bool embedded_name_equal(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
+    }
+    return *a == *b;
+}
+
+constexpr const Embedded_Shader* embedded_shader_find(const char* name) {
+    for (const Embedded_Shader& shader : EMBEDDED_SHADERS) {
+        if (shader.code && embedded_name_equal(shader.name, name)) {
+            return &shader;
+        }
+    }
+    return nullptr;
+}
+
+constexpr bool embedded_shader_exists(const char* name) {
+    return embedded_shader_find(name) != nullptr;
+}
+
+constexpr Shader_Data embedded_shader_data(const Embedded_Shader* vert, const Embedded_Shader* frag) {
+    return Shader_Data{vert->code, frag->code, vert->size, frag->size};
+}
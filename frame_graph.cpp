@@ -0,0 +1,719 @@
+#include "frame_graph.h"
+#include "gpu_memory.h"
+#include "log.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+struct Access_Info {
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+    VkImageLayout layout;   // for images
+};
+
+static const Access_Info access_infos[GRAPH_ACCESS_COUNT] = {
+    {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_UNDEFINED},
+    {VK_PIPELINE_STAGE_2_DRAW_INDIRECT_BIT, VK_ACCESS_2_INDIRECT_COMMAND_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED},
+    {VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT, VK_IMAGE_LAYOUT_UNDEFINED},
+    {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_SAMPLED_READ_BIT, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+    {VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT, VK_IMAGE_LAYOUT_GENERAL},
+    {VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL},
+    {VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL},
+    {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL},
+    {VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL},
+    {VK_PIPELINE_STAGE_2_HOST_BIT, VK_ACCESS_2_HOST_READ_BIT, VK_IMAGE_LAYOUT_GENERAL},
+    // Presentation waits on the submit's semaphore, the barrier only has to change the layout.
+    {VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR},
+};
+
+// Only writes have to be made available, reads are just waited for.
+static constexpr VkAccessFlags2 WRITE_ACCESS = VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_TRANSFER_WRITE_BIT;
+
+struct Graph_Resource {
+    const char* name;
+    VkImage image;
+    VkImageView image_view;
+    VkImageAspectFlags aspect;
+    VkBuffer buffer;
+    Frame_Graph_State* state;           // imported, nullptr for transients
+    Frame_Graph_State transient_state;
+
+    // Transients only.
+    bool transient;
+    uint32_t width;
+    uint32_t height;
+    VkFormat format;
+    VkImageUsageFlags usage;
+    uint32_t transient_slot;            // in the placement, FRAME_GRAPH_INVALID when culled
+
+    bool exported;
+    Graph_Access export_access;
+};
+
+struct Graph_Use {
+    uint32_t resource;
+    Graph_Access access;
+    bool write;
+    bool discard;
+    bool needed_after;      // a later live pass or an export depends on this pass's result
+};
+
+struct Graph_Pass {
+    const char* name;
+    Frame_Graph_Execute execute;
+    void* data;
+    uint32_t first_use;
+    uint32_t use_count;
+    bool live;
+};
+
+// Placed transient images. The set is kept from frame to frame and only rebuilt when the transients
+// change or their lifetimes overlap in a way the current placement doesn't allow.
+struct Transient_Image {
+    uint32_t width;
+    uint32_t height;
+    VkFormat format;
+    VkImageUsageFlags usage;
+    VkImageAspectFlags aspect;
+    VkImage image;
+    VkImageView image_view;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t first_pass;    // lifetime this frame, in live pass order
+    uint32_t last_pass;
+};
+
+struct Transient_Heap {
+    Transient_Image* images;
+    uint32_t image_count;
+    Gpu_Allocation allocation;
+    uint64_t retire_serial;     // retired heaps only
+};
+
+static constexpr uint32_t MAX_RETIRED_HEAPS = 8;
+
+static VkDevice device;
+
+static Graph_Resource* resources;
+static uint32_t resource_count;
+static uint32_t resource_capacity;
+
+static Graph_Pass* passes;
+static uint32_t pass_count;
+static uint32_t pass_capacity;
+
+static Graph_Use* uses;
+static uint32_t use_count;
+static uint32_t use_capacity;
+
+static VkSemaphore frame_timeline;
+
+static Transient_Heap heap;
+static Transient_Heap retired_heaps[MAX_RETIRED_HEAPS];
+static uint32_t retired_heap_count;
+
+// What last touched transient memory, whichever image it belonged to. The first use of a transient
+// in a frame waits for it.
+static VkPipelineStageFlags2 transient_tail_stages;
+static VkAccessFlags2 transient_tail_access;
+
+static uint32_t executing_pass = FRAME_GRAPH_INVALID;
+
+// One batch per pass boundary: any number of image barriers plus one merged global barrier.
+static VkImageMemoryBarrier2* image_barriers;
+static uint32_t image_barrier_count;
+static uint32_t image_barrier_capacity;
+static VkMemoryBarrier2 global_barrier;
+
+static Graph_Stats stats;
+
+static void destroy_heap(Transient_Heap* destroyed) {
+    for (uint32_t i = 0; i < destroyed->image_count; i++) {
+        vkDestroyImageView(device, destroyed->images[i].image_view, nullptr);
+        vkDestroyImage(device, destroyed->images[i].image, nullptr);
+    }
+    if (destroyed->allocation.memory != VK_NULL_HANDLE) {
+        gpu_memory_free(&destroyed->allocation);
+    }
+    free(destroyed->images);
+    *destroyed = {};
+}
+
+void frame_graph_init(VkDevice vk_device, VkSemaphore timeline) {
+    device = vk_device;
+    frame_timeline = timeline;
+}
+
+void frame_graph_shutdown() {
+    destroy_heap(&heap);
+    for (uint32_t i = 0; i < retired_heap_count; i++) {
+        destroy_heap(&retired_heaps[i]);
+    }
+    retired_heap_count = 0;
+    free(resources);
+    free(passes);
+    free(uses);
+    free(image_barriers);
+    resources = nullptr;
+    passes = nullptr;
+    uses = nullptr;
+    image_barriers = nullptr;
+    resource_capacity = pass_capacity = use_capacity = image_barrier_capacity = 0;
+}
+
+void frame_graph_begin(uint64_t completed_serial) {
+    resource_count = 0;
+    pass_count = 0;
+    use_count = 0;
+
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < retired_heap_count; i++) {
+        if (retired_heaps[i].retire_serial <= completed_serial) {
+            destroy_heap(&retired_heaps[i]);
+        } else {
+            retired_heaps[kept++] = retired_heaps[i];
+        }
+    }
+    retired_heap_count = kept;
+}
+
+static uint32_t add_resource(const char* name) {
+    if (resource_count == resource_capacity) {
+        resource_capacity = resource_capacity ? resource_capacity * 2 : 32;
+        resources = (Graph_Resource*)realloc(resources, sizeof(Graph_Resource) * resource_capacity);
+    }
+    Graph_Resource* resource = &resources[resource_count];
+    *resource = {};
+    resource->name = name;
+    resource->transient_slot = FRAME_GRAPH_INVALID;
+    return resource_count++;
+}
+
+static uint32_t find_import(const Frame_Graph_State* state) {
+    for (uint32_t i = 0; i < resource_count; i++) {
+        if (resources[i].state == state) {
+            return i;
+        }
+    }
+    return FRAME_GRAPH_INVALID;
+}
+
+uint32_t frame_graph_import_image(const char* name, VkImage image, VkImageView image_view, VkImageAspectFlags aspect, Frame_Graph_State* state) {
+    uint32_t index = find_import(state);
+    if (index != FRAME_GRAPH_INVALID) {
+        return index;
+    }
+    index = add_resource(name);
+    resources[index].image = image;
+    resources[index].image_view = image_view;
+    resources[index].aspect = aspect;
+    resources[index].state = state;
+    return index;
+}
+
+uint32_t frame_graph_import_buffer(const char* name, VkBuffer buffer, Frame_Graph_State* state) {
+    uint32_t index = find_import(state);
+    if (index != FRAME_GRAPH_INVALID) {
+        return index;
+    }
+    index = add_resource(name);
+    resources[index].buffer = buffer;
+    resources[index].state = state;
+    return index;
+}
+
+uint32_t frame_graph_create_image(const char* name, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage) {
+    uint32_t index = add_resource(name);
+    Graph_Resource* resource = &resources[index];
+    resource->transient = true;
+    resource->width = width;
+    resource->height = height;
+    resource->format = format;
+    resource->usage = usage;
+    resource->aspect = usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    return index;
+}
+
+void frame_graph_export(uint32_t resource, Graph_Access access) {
+    resources[resource].exported = true;
+    resources[resource].export_access = access;
+}
+
+void frame_graph_add_pass(const char* name, Frame_Graph_Execute execute, void* data) {
+    if (pass_count == pass_capacity) {
+        pass_capacity = pass_capacity ? pass_capacity * 2 : 16;
+        passes = (Graph_Pass*)realloc(passes, sizeof(Graph_Pass) * pass_capacity);
+    }
+    Graph_Pass* pass = &passes[pass_count++];
+    *pass = {};
+    pass->name = name;
+    pass->execute = execute;
+    pass->data = data;
+    pass->first_use = use_count;
+}
+
+static void add_use(uint32_t resource, Graph_Access access, bool write, bool discard) {
+    Graph_Pass* pass = &passes[pass_count - 1];
+    // A second declaration of the same resource widens the first one.
+    for (uint32_t i = pass->first_use; i < use_count; i++) {
+        Graph_Use* use = &uses[i];
+        if (use->resource == resource) {
+            if (use->access != access) {
+                LOG_ERROR(LOG_CATEGORY_RENDER, "🔸Frame graph pass '%s' uses '%s' in two different ways\n", pass->name, resources[resource].name);
+            }
+            use->write |= write;
+            use->discard &= discard;
+            return;
+        }
+    }
+
+    if (use_count == use_capacity) {
+        use_capacity = use_capacity ? use_capacity * 2 : 64;
+        uses = (Graph_Use*)realloc(uses, sizeof(Graph_Use) * use_capacity);
+    }
+    uses[use_count++] = {resource, access, write, discard, false};
+    pass->use_count++;
+}
+
+void frame_graph_read(uint32_t resource, Graph_Access access) {
+    add_use(resource, access, false, false);
+}
+
+void frame_graph_write(uint32_t resource, Graph_Access access, bool discard) {
+    add_use(resource, access, true, discard);
+}
+
+// Walks back from the exports. A pass lives if it writes something still needed, and then needs
+// what it reads, plus what it writes unless it overwrites all of it.
+static void cull_passes() {
+    bool* needed = (bool*)calloc(resource_count ? resource_count : 1, sizeof(bool));
+    for (uint32_t i = 0; i < resource_count; i++) {
+        needed[i] = resources[i].exported;
+    }
+
+    for (uint32_t p = pass_count; p-- > 0;) {
+        Graph_Pass* pass = &passes[p];
+        for (uint32_t u = pass->first_use; u < pass->first_use + pass->use_count; u++) {
+            uses[u].needed_after = needed[uses[u].resource];
+            pass->live |= uses[u].write && needed[uses[u].resource];
+        }
+        if (!pass->live) {
+            continue;
+        }
+        for (uint32_t u = pass->first_use; u < pass->first_use + pass->use_count; u++) {
+            if (uses[u].write && uses[u].discard) {
+                needed[uses[u].resource] = false;
+            }
+        }
+        for (uint32_t u = pass->first_use; u < pass->first_use + pass->use_count; u++) {
+            if (!uses[u].write || !uses[u].discard) {
+                needed[uses[u].resource] = true;
+            }
+        }
+    }
+    free(needed);
+}
+
+static bool lifetimes_overlap(const Transient_Image* a, const Transient_Image* b) {
+    return a->first_pass <= b->last_pass && b->first_pass <= a->last_pass;
+}
+
+static bool ranges_overlap(const Transient_Image* a, const Transient_Image* b) {
+    return a->offset < b->offset + b->size && b->offset < a->offset + a->size;
+}
+
+// The current heap still works if it holds the same images and no two of them that are alive at
+// the same time share memory.
+static bool heap_fits(const Transient_Image* wanted, uint32_t count) {
+    if (heap.image_count != count) {
+        return false;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const Transient_Image* image = &heap.images[i];
+        if (image->width != wanted[i].width || image->height != wanted[i].height ||
+            image->format != wanted[i].format || image->usage != wanted[i].usage) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        for (uint32_t j = i + 1; j < count; j++) {
+            if (lifetimes_overlap(&wanted[i], &wanted[j]) && ranges_overlap(&heap.images[i], &heap.images[j])) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Creates the images, then places them largest first, each at the lowest offset that is clear of
+// every image already placed whose lifetime overlaps its own.
+static void build_heap(Transient_Image* wanted, uint32_t count, uint64_t serial) {
+    if (heap.image_count || heap.allocation.memory != VK_NULL_HANDLE) {
+        if (retired_heap_count == MAX_RETIRED_HEAPS) {
+            // Rebuilding every frame for this long means something keeps changing, wait for the
+            // oldest to retire. Its frame has long been submitted.
+            VkSemaphoreWaitInfo wait_info{};
+            wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+            wait_info.semaphoreCount = 1;
+            wait_info.pSemaphores = &frame_timeline;
+            wait_info.pValues = &retired_heaps[0].retire_serial;
+            vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+            destroy_heap(&retired_heaps[0]);
+            memmove(&retired_heaps[0], &retired_heaps[1], sizeof(Transient_Heap) * --retired_heap_count);
+        }
+        // The previous frame was the last to use it.
+        heap.retire_serial = serial - 1;
+        retired_heaps[retired_heap_count++] = heap;
+        heap = {};
+    }
+    if (count == 0) {
+        return;
+    }
+
+    heap.images = (Transient_Image*)malloc(sizeof(Transient_Image) * count);
+    memcpy(heap.images, wanted, sizeof(Transient_Image) * count);
+    heap.image_count = count;
+
+    VkMemoryRequirements heap_requirements{};
+    heap_requirements.memoryTypeBits = ~0u;
+    uint32_t* order = (uint32_t*)malloc(sizeof(uint32_t) * count);
+    VkDeviceSize* alignments = (VkDeviceSize*)malloc(sizeof(VkDeviceSize) * count);
+    for (uint32_t i = 0; i < count; i++) {
+        Transient_Image* image = &heap.images[i];
+        VkImageCreateInfo image_info{};
+        image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+        image_info.imageType = VK_IMAGE_TYPE_2D;
+        image_info.format = image->format;
+        image_info.extent = {image->width, image->height, 1};
+        image_info.mipLevels = 1;
+        image_info.arrayLayers = 1;
+        image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+        image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+        image_info.usage = image->usage;
+        image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+        image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        vkCreateImage(device, &image_info, nullptr, &image->image);
+
+        VkMemoryRequirements requirements;
+        vkGetImageMemoryRequirements(device, image->image, &requirements);
+        image->size = requirements.size;
+        alignments[i] = requirements.alignment;
+        heap_requirements.memoryTypeBits &= requirements.memoryTypeBits;
+        heap_requirements.alignment = std::max(heap_requirements.alignment, requirements.alignment);
+        order[i] = i;
+    }
+
+    // Insertion sort, there are only ever a handful.
+    for (uint32_t i = 1; i < count; i++) {
+        uint32_t index = order[i];
+        uint32_t j = i;
+        for (; j > 0 && heap.images[order[j - 1]].size < heap.images[index].size; j--) {
+            order[j] = order[j - 1];
+        }
+        order[j] = index;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        Transient_Image* image = &heap.images[order[i]];
+        VkDeviceSize offset = 0;
+        bool moved = true;
+        while (moved) {
+            moved = false;
+            for (uint32_t j = 0; j < i; j++) {
+                Transient_Image* placed = &heap.images[order[j]];
+                image->offset = offset;
+                if (lifetimes_overlap(image, placed) && ranges_overlap(image, placed)) {
+                    offset = (placed->offset + placed->size + alignments[order[i]] - 1) / alignments[order[i]] * alignments[order[i]];
+                    moved = true;
+                }
+            }
+        }
+        image->offset = offset;
+        heap_requirements.size = std::max(heap_requirements.size, offset + image->size);
+    }
+    free(order);
+    free(alignments);
+
+    if (heap_requirements.memoryTypeBits == 0 ||
+        !gpu_memory_allocate(&heap_requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, GPU_RESOURCE_OPTIMAL, &heap.allocation)) {
+        LOG_ERROR(LOG_CATEGORY_MEMORY, "🔸Out of GPU memory placing %u transient images (%llu KiB)\n",
+            count, (unsigned long long)heap_requirements.size / 1024);
+        log_flush();
+        exit(EXIT_FAILURE);
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        Transient_Image* image = &heap.images[i];
+        vkBindImageMemory(device, image->image, heap.allocation.memory, heap.allocation.offset + image->offset);
+
+        VkImageViewCreateInfo view_info{};
+        view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+        view_info.image = image->image;
+        view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        view_info.format = image->format;
+        view_info.subresourceRange.aspectMask = image->aspect;
+        view_info.subresourceRange.baseMipLevel = 0;
+        view_info.subresourceRange.levelCount = 1;
+        view_info.subresourceRange.baseArrayLayer = 0;
+        view_info.subresourceRange.layerCount = 1;
+        vkCreateImageView(device, &view_info, nullptr, &image->image_view);
+    }
+
+    LOG_DEBUG(LOG_CATEGORY_MEMORY, "• Frame graph: %u transient images placed in %llu KiB.\n",
+        count, (unsigned long long)heap_requirements.size / 1024);
+}
+
+// Lifetimes of the transients live passes use, then the heap they go in.
+static void place_transients(uint64_t serial) {
+    Transient_Image* wanted = (Transient_Image*)malloc(sizeof(Transient_Image) * (resource_count ? resource_count : 1));
+    uint32_t count = 0;
+
+    for (uint32_t p = 0; p < pass_count; p++) {
+        Graph_Pass* pass = &passes[p];
+        if (!pass->live) {
+            continue;
+        }
+        for (uint32_t u = pass->first_use; u < pass->first_use + pass->use_count; u++) {
+            Graph_Resource* resource = &resources[uses[u].resource];
+            if (!resource->transient) {
+                continue;
+            }
+            if (resource->transient_slot == FRAME_GRAPH_INVALID) {
+                resource->transient_slot = count;
+                Transient_Image* image = &wanted[count++];
+                *image = {};
+                image->width = resource->width;
+                image->height = resource->height;
+                image->format = resource->format;
+                image->usage = resource->usage;
+                image->aspect = resource->aspect;
+                image->first_pass = p;
+            }
+            wanted[resource->transient_slot].last_pass = p;
+        }
+    }
+
+    if (!heap_fits(wanted, count)) {
+        build_heap(wanted, count, serial);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        heap.images[i].first_pass = wanted[i].first_pass;
+        heap.images[i].last_pass = wanted[i].last_pass;
+    }
+    free(wanted);
+
+    stats.transient_images = count;
+    stats.transient_bytes = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        stats.transient_bytes += heap.images[i].size;
+    }
+    stats.transient_heap_bytes = count ? heap.allocation.size : 0;
+
+    for (uint32_t i = 0; i < resource_count; i++) {
+        Graph_Resource* resource = &resources[i];
+        if (resource->transient && resource->transient_slot != FRAME_GRAPH_INVALID) {
+            resource->image = heap.images[resource->transient_slot].image;
+            resource->image_view = heap.images[resource->transient_slot].image_view;
+            // Whatever shared the memory last frame has to finish first, earlier transients of
+            // this frame are added by inherit_aliased_state(). Nothing is kept, so the layout
+            // starts out undefined.
+            resource->transient_state = {};
+            resource->transient_state.write_stages = transient_tail_stages;
+            resource->transient_state.write_access = transient_tail_access;
+        }
+    }
+}
+
+// Transients first used in `pass` also wait for the last use of every transient placed over the
+// same memory earlier this frame. Those are done by now, their state is final.
+static void inherit_aliased_state(uint32_t pass) {
+    for (uint32_t i = 0; i < resource_count; i++) {
+        Graph_Resource* resource = &resources[i];
+        if (!resource->transient || resource->transient_slot == FRAME_GRAPH_INVALID ||
+            heap.images[resource->transient_slot].first_pass != pass) {
+            continue;
+        }
+        const Transient_Image* image = &heap.images[resource->transient_slot];
+        for (uint32_t j = 0; j < resource_count; j++) {
+            const Graph_Resource* other = &resources[j];
+            if (j == i || !other->transient || other->transient_slot == FRAME_GRAPH_INVALID) {
+                continue;
+            }
+            const Transient_Image* other_image = &heap.images[other->transient_slot];
+            if (other_image->last_pass < pass && ranges_overlap(image, other_image)) {
+                resource->transient_state.write_stages |= other->transient_state.write_stages | other->transient_state.read_stages;
+                resource->transient_state.write_access |= other->transient_state.write_access;
+            }
+        }
+    }
+}
+
+static Frame_Graph_State* resource_state(Graph_Resource* resource) {
+    return resource->transient ? &resource->transient_state : resource->state;
+}
+
+// Adds what `access` needs after the resource's current state to the pending batch, then moves
+// the state on.
+static void synchronize(Graph_Resource* resource, Graph_Access access, bool write, bool discard) {
+    const Access_Info* info = &access_infos[access];
+    Frame_Graph_State* state = resource_state(resource);
+    bool image = resource->image != VK_NULL_HANDLE;
+    bool transition = image && info->layout != state->layout;
+
+    VkPipelineStageFlags2 src_stages = VK_PIPELINE_STAGE_2_NONE;
+    VkAccessFlags2 src_access = VK_ACCESS_2_NONE;
+    if (write || transition) {
+        // Writes and layout changes wait for everything since the last write, reads included.
+        src_stages = state->write_stages | state->read_stages;
+        src_access = state->write_access;
+    } else if (state->write_stages && ((info->stages & ~state->visible_stages) || (info->access & ~state->visible_access))) {
+        // A read that doesn't see the last write yet.
+        src_stages = state->write_stages;
+        src_access = state->write_access;
+    }
+
+    if (transition) {
+        if (image_barrier_count == image_barrier_capacity) {
+            image_barrier_capacity = image_barrier_capacity ? image_barrier_capacity * 2 : 16;
+            image_barriers = (VkImageMemoryBarrier2*)realloc(image_barriers, sizeof(VkImageMemoryBarrier2) * image_barrier_capacity);
+        }
+        VkImageMemoryBarrier2* barrier = &image_barriers[image_barrier_count++];
+        *barrier = {};
+        barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+        barrier->srcStageMask = src_stages;
+        barrier->srcAccessMask = src_access;
+        barrier->dstStageMask = info->stages;
+        barrier->dstAccessMask = info->access;
+        barrier->oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state->layout;
+        barrier->newLayout = info->layout;
+        barrier->srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier->dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier->image = resource->image;
+        barrier->subresourceRange.aspectMask = resource->aspect;
+        barrier->subresourceRange.baseMipLevel = 0;
+        barrier->subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+        barrier->subresourceRange.baseArrayLayer = 0;
+        barrier->subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+        state->layout = info->layout;
+    } else if (src_stages) {
+        global_barrier.srcStageMask |= src_stages;
+        global_barrier.srcAccessMask |= src_access;
+        global_barrier.dstStageMask |= info->stages;
+        global_barrier.dstAccessMask |= info->access;
+    }
+
+    if (write) {
+        state->write_stages = info->stages;
+        state->write_access = info->access & WRITE_ACCESS;
+        state->visible_stages = VK_PIPELINE_STAGE_2_NONE;
+        state->visible_access = VK_ACCESS_2_NONE;
+        state->read_stages = VK_PIPELINE_STAGE_2_NONE;
+    } else if (transition) {
+        // The transition counts as a write the reading stages already see.
+        state->write_stages = info->stages;
+        state->write_access = VK_ACCESS_2_NONE;
+        state->visible_stages = info->stages;
+        state->visible_access = info->access;
+        state->read_stages = info->stages;
+    } else {
+        if (src_stages) {
+            state->visible_stages |= info->stages;
+            state->visible_access |= info->access;
+        }
+        state->read_stages |= info->stages;
+    }
+}
+
+static void flush_barriers(VkCommandBuffer command_buffer) {
+    bool global = global_barrier.srcStageMask || global_barrier.srcAccessMask;
+    if (!global && image_barrier_count == 0) {
+        return;
+    }
+
+    VkDependencyInfo dependency_info{};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.memoryBarrierCount = global ? 1 : 0;
+    dependency_info.pMemoryBarriers = &global_barrier;
+    dependency_info.imageMemoryBarrierCount = image_barrier_count;
+    dependency_info.pImageMemoryBarriers = image_barriers;
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+
+    stats.barrier_batches++;
+    stats.memory_barriers += global ? 1 : 0;
+    stats.image_barriers += image_barrier_count;
+    image_barrier_count = 0;
+    global_barrier = {};
+    global_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+}
+
+void frame_graph_execute(VkCommandBuffer command_buffer, uint64_t serial) {
+    stats = {};
+    stats.passes = pass_count;
+    global_barrier = {};
+    global_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+
+    cull_passes();
+    place_transients(serial);
+
+    for (uint32_t p = 0; p < pass_count; p++) {
+        Graph_Pass* pass = &passes[p];
+        if (!pass->live) {
+            stats.culled_passes++;
+            LOG_DEBUG(LOG_CATEGORY_FRAME, "• Frame graph: pass '%s' culled.\n", pass->name);
+            continue;
+        }
+        inherit_aliased_state(p);
+        for (uint32_t u = pass->first_use; u < pass->first_use + pass->use_count; u++) {
+            synchronize(&resources[uses[u].resource], uses[u].access, uses[u].write, uses[u].discard);
+        }
+        flush_barriers(command_buffer);
+
+        executing_pass = p;
+        pass->execute(command_buffer, pass->data);
+        executing_pass = FRAME_GRAPH_INVALID;
+    }
+
+    // Exports end up where the frame's consumer expects them, in one last batch.
+    for (uint32_t i = 0; i < resource_count; i++) {
+        Graph_Resource* resource = &resources[i];
+        if (resource->exported && resource->export_access != GRAPH_ACCESS_NONE && !resource->transient) {
+            synchronize(resource, resource->export_access, false, false);
+        }
+    }
+    flush_barriers(command_buffer);
+
+    transient_tail_stages = VK_PIPELINE_STAGE_2_NONE;
+    transient_tail_access = VK_ACCESS_2_NONE;
+    for (uint32_t i = 0; i < resource_count; i++) {
+        Graph_Resource* resource = &resources[i];
+        if (resource->transient && resource->transient_slot != FRAME_GRAPH_INVALID) {
+            transient_tail_stages |= resource->transient_state.write_stages | resource->transient_state.read_stages;
+            transient_tail_access |= resource->transient_state.write_access;
+        }
+    }
+}
+
+VkImage frame_graph_image(uint32_t resource) {
+    return resources[resource].image;
+}
+
+VkImageView frame_graph_image_view(uint32_t resource) {
+    return resources[resource].image_view;
+}
+
+bool frame_graph_store_needed(uint32_t resource) {
+    const Graph_Pass* pass = &passes[executing_pass];
+    for (uint32_t u = pass->first_use; u < pass->first_use + pass->use_count; u++) {
+        if (uses[u].resource == resource) {
+            return uses[u].needed_after;
+        }
+    }
+    return true;
+}
+
+void frame_graph_get_stats(Graph_Stats* out_stats) {
+    *out_stats = stats;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include "render.h"
+
+#include <vulkan/vulkan_core.h>
+
+// Per-frame pass graph. Every frame the renderer declares its passes in submission order, each with
+// the resources it reads and writes, then executes the graph into the frame's command buffer:
+//
+//   1. Passes whose writes nothing downstream reads are culled, walking back from the exported
+//      resources (presented, read back or kept for the next frame).
+//   2. Transient images get memory only for the span of passes that use them. Transients whose
+//      spans don't overlap share memory, placed largest first into one allocation.
+//   3. Before each pass the graph records at most one vkCmdPipelineBarrier2, holding an image
+//      barrier per layout change and a single merged global barrier for everything else.
+//      Reads that already see the last write, and reads following reads, get no barrier.
+//
+// Imported resources keep their Frame_Graph_State across frames, so the first barrier of a frame
+// waits on exactly what the previous frame did last. Work inside a pass, such as one dispatch
+// reading the previous one's output, is still the pass's own business.
+
+// How a pass touches a resource. Each maps to stages, access flags and, for images, a layout.
+enum Graph_Access {
+    GRAPH_ACCESS_NONE,                  // exports only: keep the writers, no final barrier
+    GRAPH_ACCESS_INDIRECT_READ,         // draw parameters and counts
+    GRAPH_ACCESS_VERTEX_SHADER_READ,    // storage buffer read by vertex shaders
+    GRAPH_ACCESS_COMPUTE_READ,          // storage buffer or sampled image read by compute
+    GRAPH_ACCESS_COMPUTE_WRITE,         // storage buffer read and written by compute
+    GRAPH_ACCESS_COLOR_ATTACHMENT,
+    GRAPH_ACCESS_DEPTH_ATTACHMENT,
+    GRAPH_ACCESS_TRANSFER_READ,
+    GRAPH_ACCESS_TRANSFER_WRITE,
+    GRAPH_ACCESS_HOST_READ,
+    GRAPH_ACCESS_PRESENT,
+    GRAPH_ACCESS_COUNT,
+};
+
+// What last happened to a resource, as far as barriers are concerned. Zero initialized means
+// untouched. Owned by whoever owns the resource and updated by frame_graph_execute().
+struct Frame_Graph_State {
+    VkPipelineStageFlags2 write_stages;     // last write, or layout transition
+    VkAccessFlags2 write_access;
+    VkPipelineStageFlags2 visible_stages;   // already synchronized with the last write
+    VkAccessFlags2 visible_access;
+    VkPipelineStageFlags2 read_stages;      // reads since the last write, a write waits for them
+    VkImageLayout layout;
+};
+
+typedef void (*Frame_Graph_Execute)(VkCommandBuffer command_buffer, void* data);
+
+static constexpr uint32_t FRAME_GRAPH_INVALID = UINT32_MAX;
+
+// `frame_timeline` is signaled with each frame's serial once the frame has finished.
+void frame_graph_init(VkDevice device, VkSemaphore frame_timeline);
+// The device must be idle.
+void frame_graph_shutdown();
+
+// Starts declaring a frame. Transient memory retired by earlier frames is released once
+// `completed_serial` has passed them.
+void frame_graph_begin(uint64_t completed_serial);
+
+// Importing the same state twice in a frame returns the same resource.
+uint32_t frame_graph_import_image(const char* name, VkImage image, VkImageView image_view, VkImageAspectFlags aspect, Frame_Graph_State* state);
+uint32_t frame_graph_import_buffer(const char* name, VkBuffer buffer, Frame_Graph_State* state);
+// Contents don't survive the frame. Image and view exist only while the graph executes.
+uint32_t frame_graph_create_image(const char* name, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage);
+// Keeps the resource's writers alive and leaves it in `access` at the end of the frame.
+void frame_graph_export(uint32_t resource, Graph_Access access);
+
+// Passes run in the order they are added. Reads and writes apply to the last pass added. A discarding
+// write overwrites everything, earlier contents are neither kept nor waited on for layout.
+void frame_graph_add_pass(const char* name, Frame_Graph_Execute execute, void* data);
+void frame_graph_read(uint32_t resource, Graph_Access access);
+void frame_graph_write(uint32_t resource, Graph_Access access, bool discard = false);
+
+// Culls, places transients, then records every live pass with its barriers in front of it.
+// `serial` is the frame serial the command buffer is submitted with.
+void frame_graph_execute(VkCommandBuffer command_buffer, uint64_t serial);
+
+// From inside a pass.
+VkImage frame_graph_image(uint32_t resource);
+VkImageView frame_graph_image_view(uint32_t resource);
+// Whether a later live pass or an export still needs what the current pass writes. False means an
+// attachment can be left unstored.
+bool frame_graph_store_needed(uint32_t resource);
+
+void frame_graph_get_stats(Graph_Stats* stats);
@@ -0,0 +1,629 @@
+#include "gpu_memory.h"
+
+#include <bit>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every offset and size inside a block is a multiple of the granularity, so alignments up to it
+// come for free and the size classes below only need to cover whole granules.
+static constexpr VkDeviceSize GRANULARITY = 256;
+static constexpr VkDeviceSize DEFAULT_BLOCK_SIZE = 64ull << 20;
+
+// TLSF size classes: the first level is the power of two of the size in granules, the second
+// level splits each power of two into SL_COUNT linear steps.
+static constexpr uint32_t SL_LOG2 = 5;
+static constexpr uint32_t SL_COUNT = 1u << SL_LOG2;
+static constexpr uint32_t FL_COUNT = 64;
+static constexpr uint32_t INVALID_NODE = UINT32_MAX;
+
+struct Tlsf_Node {
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    uint32_t prev_physical;
+    uint32_t next_physical;
+    uint32_t prev_free;
+    uint32_t next_free; // also links recycled nodes
+    bool free;
+};
+
+struct Gpu_Block {
+    VkDeviceMemory memory;
+    VkDeviceSize size;
+    void* mapped;
+    uint32_t memory_type;
+    Gpu_Resource_Kind kind;
+    bool evacuating;
+
+    Tlsf_Node* nodes;
+    uint32_t node_count;
+    uint32_t node_capacity;
+    uint32_t recycled_nodes;
+
+    uint64_t fl_bitmap;
+    uint32_t sl_bitmaps[FL_COUNT];
+    uint32_t free_heads[FL_COUNT][SL_COUNT];
+
+    VkDeviceSize used;
+    uint32_t allocation_count;
+};
+
+// Without VK_EXT_memory_budget this share of a heap stands in for its budget.
+static constexpr double FALLBACK_BUDGET_SHARE = 0.8;
+
+static VkDevice device;
+static VkPhysicalDevice physical_device;
+static VkPhysicalDeviceMemoryProperties memory_properties;
+static VkDeviceSize non_coherent_atom_size;
+static bool memory_budget;
+
+// Resources are created from worker threads as well as the main thread.
+static std::mutex allocator_mutex;
+
+static Gpu_Block** blocks;
+static uint32_t block_count;
+static uint32_t block_capacity;
+
+static uint32_t dedicated_count;
+static VkDeviceSize dedicated_bytes;
+// Allocated from the driver, blocks and dedicated allocations.
+static VkDeviceSize heap_bytes[VK_MAX_MEMORY_HEAPS];
+
+static bool defragmenting;
+
+static VkDeviceSize align_up(VkDeviceSize value, VkDeviceSize alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static uint32_t bit_scan_reverse(uint64_t value) {
+    return 63 - std::countl_zero(value);
+}
+
+static void mapping(VkDeviceSize size, uint32_t* fl, uint32_t* sl) {
+    uint64_t granules = size / GRANULARITY;
+    if (granules < SL_COUNT) {
+        *fl = 0;
+        *sl = (uint32_t)granules;
+        return;
+    }
+    uint32_t msb = bit_scan_reverse(granules);
+    *fl = msb - SL_LOG2 + 1;
+    *sl = (uint32_t)(granules >> (msb - SL_LOG2)) & (SL_COUNT - 1);
+}
+
+// Rounds a request up to the start of the next size class, so that any free node found in that
+// class or above is guaranteed to fit without walking the list.
+static VkDeviceSize round_up_to_class(VkDeviceSize size) {
+    uint64_t granules = size / GRANULARITY;
+    if (granules >= SL_COUNT) {
+        granules += (1ull << (bit_scan_reverse(granules) - SL_LOG2)) - 1;
+    }
+    return granules * GRANULARITY;
+}
+
+static uint32_t new_node(Gpu_Block* block) {
+    if (block->recycled_nodes != INVALID_NODE) {
+        uint32_t index = block->recycled_nodes;
+        block->recycled_nodes = block->nodes[index].next_free;
+        return index;
+    }
+    if (block->node_count == block->node_capacity) {
+        block->node_capacity = block->node_capacity ? block->node_capacity * 2 : 64;
+        block->nodes = (Tlsf_Node*)realloc(block->nodes, sizeof(Tlsf_Node) * block->node_capacity);
+    }
+    return block->node_count++;
+}
+
+static void recycle_node(Gpu_Block* block, uint32_t index) {
+    block->nodes[index].next_free = block->recycled_nodes;
+    block->recycled_nodes = index;
+}
+
+static void insert_free(Gpu_Block* block, uint32_t index) {
+    Tlsf_Node* node = &block->nodes[index];
+    uint32_t fl, sl;
+    mapping(node->size, &fl, &sl);
+
+    node->free = true;
+    node->prev_free = INVALID_NODE;
+    node->next_free = block->free_heads[fl][sl];
+    if (node->next_free != INVALID_NODE) {
+        block->nodes[node->next_free].prev_free = index;
+    }
+    block->free_heads[fl][sl] = index;
+    block->fl_bitmap |= 1ull << fl;
+    block->sl_bitmaps[fl] |= 1u << sl;
+}
+
+static void remove_free(Gpu_Block* block, uint32_t index) {
+    Tlsf_Node* node = &block->nodes[index];
+    uint32_t fl, sl;
+    mapping(node->size, &fl, &sl);
+
+    if (node->prev_free != INVALID_NODE) {
+        block->nodes[node->prev_free].next_free = node->next_free;
+    } else {
+        block->free_heads[fl][sl] = node->next_free;
+    }
+    if (node->next_free != INVALID_NODE) {
+        block->nodes[node->next_free].prev_free = node->prev_free;
+    }
+    if (block->free_heads[fl][sl] == INVALID_NODE) {
+        block->sl_bitmaps[fl] &= ~(1u << sl);
+        if (block->sl_bitmaps[fl] == 0) {
+            block->fl_bitmap &= ~(1ull << fl);
+        }
+    }
+    node->free = false;
+}
+
+static uint32_t find_free(Gpu_Block* block, VkDeviceSize size) {
+    uint32_t fl, sl;
+    mapping(round_up_to_class(size), &fl, &sl);
+    if (fl >= FL_COUNT) {
+        return INVALID_NODE;
+    }
+
+    uint32_t sl_map = block->sl_bitmaps[fl] & (~0u << sl);
+    if (sl_map == 0) {
+        if (fl + 1 >= FL_COUNT) {
+            return INVALID_NODE;
+        }
+        uint64_t fl_map = block->fl_bitmap & (~0ull << (fl + 1));
+        if (fl_map == 0) {
+            return INVALID_NODE;
+        }
+        fl = std::countr_zero(fl_map);
+        sl_map = block->sl_bitmaps[fl];
+    }
+    sl = std::countr_zero(sl_map);
+    return block->free_heads[fl][sl];
+}
+
+static uint32_t block_allocate(Gpu_Block* block, VkDeviceSize size, VkDeviceSize alignment) {
+    size = align_up(size, GRANULARITY);
+    if (alignment < GRANULARITY) {
+        alignment = GRANULARITY;
+    }
+
+    // Leave room to slide the allocation forward to a larger alignment.
+    uint32_t index = find_free(block, size + alignment - GRANULARITY);
+    if (index == INVALID_NODE) {
+        return INVALID_NODE;
+    }
+    remove_free(block, index);
+
+    // Free nodes never border each other, so the padding and the tail both become standalone
+    // free nodes.
+    VkDeviceSize offset = block->nodes[index].offset;
+    VkDeviceSize aligned_offset = align_up(offset, alignment);
+    if (aligned_offset > offset) {
+        uint32_t padding = new_node(block);
+        Tlsf_Node* node = &block->nodes[index];
+        Tlsf_Node* padding_node = &block->nodes[padding];
+        padding_node->offset = offset;
+        padding_node->size = aligned_offset - offset;
+        padding_node->prev_physical = node->prev_physical;
+        padding_node->next_physical = index;
+        if (node->prev_physical != INVALID_NODE) {
+            block->nodes[node->prev_physical].next_physical = padding;
+        }
+        node->prev_physical = padding;
+        node->offset = aligned_offset;
+        node->size -= padding_node->size;
+        insert_free(block, padding);
+    }
+
+    if (block->nodes[index].size > size) {
+        uint32_t tail = new_node(block);
+        Tlsf_Node* node = &block->nodes[index];
+        Tlsf_Node* tail_node = &block->nodes[tail];
+        tail_node->offset = node->offset + size;
+        tail_node->size = node->size - size;
+        tail_node->prev_physical = index;
+        tail_node->next_physical = node->next_physical;
+        if (node->next_physical != INVALID_NODE) {
+            block->nodes[node->next_physical].prev_physical = tail;
+        }
+        node->next_physical = tail;
+        node->size = size;
+        insert_free(block, tail);
+    }
+
+    block->used += size;
+    block->allocation_count++;
+    return index;
+}
+
+static void block_free(Gpu_Block* block, uint32_t index) {
+    block->used -= block->nodes[index].size;
+    block->allocation_count--;
+
+    uint32_t prev = block->nodes[index].prev_physical;
+    if (prev != INVALID_NODE && block->nodes[prev].free) {
+        remove_free(block, prev);
+        block->nodes[prev].size += block->nodes[index].size;
+        block->nodes[prev].next_physical = block->nodes[index].next_physical;
+        if (block->nodes[index].next_physical != INVALID_NODE) {
+            block->nodes[block->nodes[index].next_physical].prev_physical = prev;
+        }
+        recycle_node(block, index);
+        index = prev;
+    }
+
+    uint32_t next = block->nodes[index].next_physical;
+    if (next != INVALID_NODE && block->nodes[next].free) {
+        remove_free(block, next);
+        block->nodes[index].size += block->nodes[next].size;
+        block->nodes[index].next_physical = block->nodes[next].next_physical;
+        if (block->nodes[next].next_physical != INVALID_NODE) {
+            block->nodes[block->nodes[next].next_physical].prev_physical = index;
+        }
+        recycle_node(block, next);
+    }
+
+    insert_free(block, index);
+}
+
+static VkDeviceSize block_largest_free(const Gpu_Block* block) {
+    if (block->fl_bitmap == 0) {
+        return 0;
+    }
+    uint32_t fl = bit_scan_reverse(block->fl_bitmap);
+    uint32_t sl = bit_scan_reverse(block->sl_bitmaps[fl]);
+
+    VkDeviceSize largest = 0;
+    for (uint32_t i = block->free_heads[fl][sl]; i != INVALID_NODE; i = block->nodes[i].next_free) {
+        if (block->nodes[i].size > largest) {
+            largest = block->nodes[i].size;
+        }
+    }
+    return largest;
+}
+
+static VkDeviceSize block_size_for_type(uint32_t memory_type) {
+    VkDeviceSize heap_size = memory_properties.memoryHeaps[memory_properties.memoryTypes[memory_type].heapIndex].size;
+    VkDeviceSize size = heap_size / 8 < DEFAULT_BLOCK_SIZE ? heap_size / 8 : DEFAULT_BLOCK_SIZE;
+    return size & ~(GRANULARITY - 1);
+}
+
+static uint32_t heap_index(uint32_t memory_type) {
+    return memory_properties.memoryTypes[memory_type].heapIndex;
+}
+
+static bool is_host_visible(uint32_t memory_type) {
+    return memory_properties.memoryTypes[memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+}
+
+static Gpu_Block* create_block(uint32_t memory_type, Gpu_Resource_Kind kind) {
+    VkDeviceSize size = block_size_for_type(memory_type);
+
+    VkMemoryAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    alloc_info.allocationSize = size;
+    alloc_info.memoryTypeIndex = memory_type;
+
+    VkDeviceMemory memory;
+    if (vkAllocateMemory(device, &alloc_info, nullptr, &memory) != VK_SUCCESS) {
+        return nullptr;
+    }
+
+    Gpu_Block* block = (Gpu_Block*)calloc(1, sizeof(Gpu_Block));
+    block->memory = memory;
+    block->size = size;
+    block->memory_type = memory_type;
+    block->kind = kind;
+    block->recycled_nodes = INVALID_NODE;
+    heap_bytes[heap_index(memory_type)] += size;
+    memset(block->free_heads, 0xff, sizeof(block->free_heads));
+
+    if (is_host_visible(memory_type)) {
+        vkMapMemory(device, memory, 0, VK_WHOLE_SIZE, 0, &block->mapped);
+    }
+
+    uint32_t root = new_node(block);
+    block->nodes[root].offset = 0;
+    block->nodes[root].size = size;
+    block->nodes[root].prev_physical = INVALID_NODE;
+    block->nodes[root].next_physical = INVALID_NODE;
+    insert_free(block, root);
+
+    if (block_count == block_capacity) {
+        block_capacity = block_capacity ? block_capacity * 2 : 16;
+        blocks = (Gpu_Block**)realloc(blocks, sizeof(Gpu_Block*) * block_capacity);
+    }
+    blocks[block_count++] = block;
+    return block;
+}
+
+static void destroy_block(uint32_t block_index) {
+    Gpu_Block* block = blocks[block_index];
+    heap_bytes[heap_index(block->memory_type)] -= block->size;
+    vkFreeMemory(device, block->memory, nullptr);
+    free(block->nodes);
+    free(block);
+
+    blocks[block_index] = blocks[--block_count];
+}
+
+static bool allocate_from_type(uint32_t memory_type, const VkMemoryRequirements* requirements, Gpu_Resource_Kind kind, Gpu_Allocation* allocation) {
+    VkDeviceSize block_size = block_size_for_type(memory_type);
+
+    // Anything larger than half a block gets its own memory object rather than wasting the rest.
+    if (requirements->size > block_size / 2) {
+        VkMemoryAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+        alloc_info.allocationSize = requirements->size;
+        alloc_info.memoryTypeIndex = memory_type;
+
+        *allocation = {};
+        if (vkAllocateMemory(device, &alloc_info, nullptr, &allocation->memory) != VK_SUCCESS) {
+            return false;
+        }
+        if (is_host_visible(memory_type)) {
+            vkMapMemory(device, allocation->memory, 0, VK_WHOLE_SIZE, 0, &allocation->mapped);
+        }
+        allocation->size = requirements->size;
+        allocation->memory_type = memory_type;
+        dedicated_count++;
+        dedicated_bytes += requirements->size;
+        heap_bytes[heap_index(memory_type)] += requirements->size;
+        return true;
+    }
+
+    for (uint32_t i = 0; i < block_count + 1; i++) {
+        Gpu_Block* block;
+        if (i < block_count) {
+            block = blocks[i];
+            if (block->memory_type != memory_type || block->kind != kind || block->evacuating) {
+                continue;
+            }
+        } else {
+            // Defragmentation must only ever pack into existing blocks.
+            if (defragmenting) {
+                return false;
+            }
+            block = create_block(memory_type, kind);
+            if (!block) {
+                return false;
+            }
+        }
+
+        uint32_t node = block_allocate(block, requirements->size, requirements->alignment);
+        if (node == INVALID_NODE) {
+            continue;
+        }
+
+        allocation->memory = block->memory;
+        allocation->offset = block->nodes[node].offset;
+        allocation->size = block->nodes[node].size;
+        allocation->mapped = block->mapped ? (uint8_t*)block->mapped + allocation->offset : nullptr;
+        allocation->block = block;
+        allocation->node = node;
+        allocation->memory_type = memory_type;
+        return true;
+    }
+    return false;
+}
+
+void gpu_memory_init(VkDevice vk_device, VkPhysicalDevice vk_physical_device, bool memory_budget_extension) {
+    device = vk_device;
+    physical_device = vk_physical_device;
+    memory_budget = memory_budget_extension;
+    vkGetPhysicalDeviceMemoryProperties(physical_device, &memory_properties);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    non_coherent_atom_size = properties.limits.nonCoherentAtomSize;
+}
+
+void gpu_memory_shutdown() {
+    while (block_count > 0) {
+        destroy_block(block_count - 1);
+    }
+    free(blocks);
+    blocks = nullptr;
+    block_capacity = 0;
+}
+
+bool gpu_memory_allocate(const VkMemoryRequirements* requirements, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred, Gpu_Resource_Kind kind, Gpu_Allocation* allocation) {
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+
+    for (uint32_t pass = 0; pass < 2; pass++) {
+        VkMemoryPropertyFlags flags = pass == 0 ? required | preferred : required;
+        if (pass == 1 && preferred == 0) {
+            break;
+        }
+
+        for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+            if (!(requirements->memoryTypeBits & (1u << i)) || (memory_properties.memoryTypes[i].propertyFlags & flags) != flags) {
+                continue;
+            }
+            if (allocate_from_type(i, requirements, kind, allocation)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void gpu_memory_free(Gpu_Allocation* allocation) {
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+
+    if (!allocation->block) {
+        vkFreeMemory(device, allocation->memory, nullptr);
+        dedicated_count--;
+        dedicated_bytes -= allocation->size;
+        heap_bytes[heap_index(allocation->memory_type)] -= allocation->size;
+        *allocation = {};
+        return;
+    }
+
+    Gpu_Block* block = allocation->block;
+    block_free(block, allocation->node);
+    *allocation = {};
+
+    // Keep one empty block per memory type around so alloc/free churn does not hit the driver.
+    if (block->allocation_count == 0 && !defragmenting) {
+        for (uint32_t i = 0; i < block_count; i++) {
+            Gpu_Block* other = blocks[i];
+            if (other != block && other->memory_type == block->memory_type && other->kind == block->kind) {
+                for (uint32_t j = 0; j < block_count; j++) {
+                    if (blocks[j] == block) {
+                        destroy_block(j);
+                        break;
+                    }
+                }
+                break;
+            }
+        }
+    }
+}
+
+bool gpu_memory_is_coherent(const Gpu_Allocation* allocation) {
+    return memory_properties.memoryTypes[allocation->memory_type].propertyFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+}
+
+// Non-coherent ranges must be aligned to nonCoherentAtomSize and stay inside the memory object.
+static VkMappedMemoryRange atom_aligned_range(const Gpu_Allocation* allocation, VkDeviceSize offset, VkDeviceSize size) {
+    VkDeviceSize memory_size = allocation->block ? allocation->block->size : allocation->size;
+    if (size == VK_WHOLE_SIZE) {
+        size = allocation->size - offset;
+    }
+
+    VkDeviceSize begin = (allocation->offset + offset) & ~(non_coherent_atom_size - 1);
+    VkDeviceSize end = align_up(allocation->offset + offset + size, non_coherent_atom_size);
+    if (end > memory_size) {
+        end = memory_size;
+    }
+
+    VkMappedMemoryRange range{};
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = allocation->memory;
+    range.offset = begin;
+    range.size = end - begin;
+    return range;
+}
+
+void gpu_memory_flush(const Gpu_Allocation* allocation, VkDeviceSize offset, VkDeviceSize size) {
+    if (gpu_memory_is_coherent(allocation)) {
+        return;
+    }
+    VkMappedMemoryRange range = atom_aligned_range(allocation, offset, size);
+    vkFlushMappedMemoryRanges(device, 1, &range);
+}
+
+void gpu_memory_invalidate(const Gpu_Allocation* allocation, VkDeviceSize offset, VkDeviceSize size) {
+    if (gpu_memory_is_coherent(allocation)) {
+        return;
+    }
+    VkMappedMemoryRange range = atom_aligned_range(allocation, offset, size);
+    vkInvalidateMappedMemoryRanges(device, 1, &range);
+}
+
+void gpu_memory_get_stats(Gpu_Memory_Stats* stats) {
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+
+    *stats = {};
+    stats->block_count = block_count;
+    stats->dedicated_count = dedicated_count;
+    stats->allocation_count = dedicated_count;
+    stats->block_bytes = dedicated_bytes;
+    stats->used_bytes = dedicated_bytes;
+
+    for (uint32_t i = 0; i < block_count; i++) {
+        Gpu_Block* block = blocks[i];
+        stats->allocation_count += block->allocation_count;
+        stats->block_bytes += block->size;
+        stats->used_bytes += block->used;
+
+        VkDeviceSize largest = block_largest_free(block);
+        if (largest > stats->largest_free_range) {
+            stats->largest_free_range = largest;
+        }
+    }
+}
+
+void gpu_memory_begin_defragment() {
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+    defragmenting = true;
+
+    // Sort fullest first, so the fullest blocks become the destinations.
+    for (uint32_t i = 1; i < block_count; i++) {
+        Gpu_Block* block = blocks[i];
+        uint32_t j = i;
+        while (j > 0 && blocks[j - 1]->used < block->used) {
+            blocks[j] = blocks[j - 1];
+            j--;
+        }
+        blocks[j] = block;
+    }
+
+    // Walking from fullest to emptiest, evacuate a block when everything in it fits into the free
+    // space of the blocks kept so far. Fragmentation can still make single moves fail, those
+    // allocations simply stay where they are.
+    for (uint32_t i = 0; i < block_count; i++) {
+        Gpu_Block* block = blocks[i];
+        VkDeviceSize kept_free = 0;
+        for (uint32_t j = 0; j < i; j++) {
+            Gpu_Block* other = blocks[j];
+            if (other->memory_type != block->memory_type || other->kind != block->kind) {
+                continue;
+            }
+            if (other->evacuating) {
+                kept_free -= other->used;
+            } else {
+                kept_free += other->size - other->used;
+            }
+        }
+        block->evacuating = block->used <= kept_free;
+    }
+}
+
+bool gpu_memory_is_evacuating(const Gpu_Allocation* allocation) {
+    return allocation->block && allocation->block->evacuating;
+}
+
+void gpu_memory_end_defragment() {
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+    defragmenting = false;
+
+    for (uint32_t i = block_count; i > 0; i--) {
+        Gpu_Block* block = blocks[i - 1];
+        bool release = block->evacuating && block->allocation_count == 0;
+        block->evacuating = false;
+        if (release) {
+            destroy_block(i - 1);
+        }
+    }
+}
+
+void gpu_memory_get_budget(Gpu_Memory_Budget* budget) {
+    VkPhysicalDeviceMemoryBudgetPropertiesEXT budget_properties{};
+    budget_properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+    if (memory_budget) {
+        VkPhysicalDeviceMemoryProperties2 properties{};
+        properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+        properties.pNext = &budget_properties;
+        vkGetPhysicalDeviceMemoryProperties2(physical_device, &properties);
+    }
+
+    std::lock_guard<std::mutex> lock(allocator_mutex);
+    *budget = {};
+    budget->from_driver = memory_budget;
+    for (uint32_t heap = 0; heap < memory_properties.memoryHeapCount; heap++) {
+        if (!(memory_properties.memoryHeaps[heap].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)) {
+            continue;
+        }
+        budget->allocated += heap_bytes[heap];
+        if (memory_budget) {
+            budget->budget += budget_properties.heapBudget[heap];
+            budget->usage += budget_properties.heapUsage[heap];
+        } else {
+            budget->budget += (VkDeviceSize)(memory_properties.memoryHeaps[heap].size * FALLBACK_BUDGET_SHARE);
+            budget->usage += heap_bytes[heap];
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+// Sub-allocates buffers and images out of large VkDeviceMemory blocks, one set of blocks per
+// memory type. Placement inside a block uses a two level segregated fit (TLSF) free list, so
+// allocation and free are O(1). Linear resources (buffers) and optimal images live in separate
+// blocks, which keeps them from ever sharing a bufferImageGranularity page.
+
+struct Gpu_Block;
+
+struct Gpu_Allocation {
+    VkDeviceMemory memory;
+    VkDeviceSize offset;
+    VkDeviceSize size;
+    void* mapped;           // persistently mapped pointer for host visible memory, else nullptr
+    Gpu_Block* block;       // nullptr for dedicated allocations
+    uint32_t node;
+    uint32_t memory_type;
+};
+
+enum Gpu_Resource_Kind {
+    GPU_RESOURCE_LINEAR,    // buffers and linear images
+    GPU_RESOURCE_OPTIMAL,   // optimally tiled images
+};
+
+struct Gpu_Memory_Stats {
+    uint32_t block_count;
+    uint32_t dedicated_count;
+    uint32_t allocation_count;
+    VkDeviceSize block_bytes;
+    VkDeviceSize used_bytes;
+    VkDeviceSize largest_free_range;
+};
+
+// Device local memory against what the device is willing to give this process, summed over the
+// device local heaps. With VK_EXT_memory_budget both come from the driver and usage counts
+// everything the process allocated, otherwise the budget is most of the heap size and usage is
+// what this allocator holds.
+struct Gpu_Memory_Budget {
+    VkDeviceSize budget;
+    VkDeviceSize usage;
+    VkDeviceSize allocated;     // by this allocator
+    bool from_driver;
+};
+
+// `memory_budget_extension`: VK_EXT_memory_budget is enabled on the device.
+void gpu_memory_init(VkDevice device, VkPhysicalDevice physical_device, bool memory_budget_extension);
+void gpu_memory_shutdown();
+
+// Picks a memory type with all `required` flags, favouring one that also has `preferred`.
+bool gpu_memory_allocate(const VkMemoryRequirements* requirements, VkMemoryPropertyFlags required,
+    VkMemoryPropertyFlags preferred, Gpu_Resource_Kind kind, Gpu_Allocation* allocation);
+void gpu_memory_free(Gpu_Allocation* allocation);
+
+bool gpu_memory_is_coherent(const Gpu_Allocation* allocation);
+// Flush host writes / invalidate for host reads. No-ops for coherent memory.
+void gpu_memory_flush(const Gpu_Allocation* allocation, VkDeviceSize offset, VkDeviceSize size);
+void gpu_memory_invalidate(const Gpu_Allocation* allocation, VkDeviceSize offset, VkDeviceSize size);
+
+void gpu_memory_get_stats(Gpu_Memory_Stats* stats);
+void gpu_memory_get_budget(Gpu_Memory_Budget* budget);
+
+// Defragmentation: begin marks the sparsest blocks as evacuating. While they are marked, new
+// allocations avoid them and no new blocks are created, so anything reallocated during the pass
+// packs into the remaining blocks. The caller moves the resources, then end releases every block
+// that became empty.
+void gpu_memory_begin_defragment();
+bool gpu_memory_is_evacuating(const Gpu_Allocation* allocation);
+void gpu_memory_end_defragment();
\ No newline at end of file
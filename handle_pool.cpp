@@ -0,0 +1,42 @@
+#include "handle_pool.h"
+
+#include <stdlib.h>
+
+void handle_pool_init(Handle_Pool* pool, uint32_t capacity) {
+    pool->capacity = capacity < MAX_HANDLE_POOL_CAPACITY ? capacity : MAX_HANDLE_POOL_CAPACITY;
+    pool->generations = (uint16_t*)malloc(sizeof(uint16_t) * pool->capacity);
+    pool->free_slots = (uint32_t*)malloc(sizeof(uint32_t) * pool->capacity);
+    // Slot 0 is handed out first.
+    for (uint32_t i = 0; i < pool->capacity; i++) {
+        pool->generations[i] = 1;
+        pool->free_slots[i] = pool->capacity - 1 - i;
+    }
+    pool->free_count = pool->capacity;
+    pool->live_count = 0;
+}
+
+void handle_pool_shutdown(Handle_Pool* pool) {
+    free(pool->generations);
+    free(pool->free_slots);
+    *pool = {};
+}
+
+uint32_t handle_pool_allocate(Handle_Pool* pool) {
+    if (pool->free_count == 0) {
+        return 0;
+    }
+    uint32_t slot = pool->free_slots[--pool->free_count];
+    pool->live_count++;
+    return (uint32_t)pool->generations[slot] << HANDLE_SLOT_BITS | slot;
+}
+
+void handle_pool_invalidate(Handle_Pool* pool, uint32_t handle) {
+    uint32_t slot = handle & HANDLE_SLOT_MASK;
+    // Generation 0 would let slot 0 produce the null handle.
+    pool->generations[slot] = pool->generations[slot] == UINT16_MAX ? 1 : pool->generations[slot] + 1;
+}
+
+void handle_pool_release(Handle_Pool* pool, uint32_t slot) {
+    pool->free_slots[pool->free_count++] = slot;
+    pool->live_count--;
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <stdint.h>
+
+// Slot bookkeeping behind the renderer's 32-bit handles. A handle is a slot index in the low
+// HANDLE_SLOT_BITS and the slot's generation above them. Invalidating a handle bumps the slot's
+// generation, so copies of it stop resolving instead of reaching whatever lives there next.
+// Generations start at 1, which leaves 0 to mean no handle.
+//
+// The pool only hands out slots. Its owner keeps the objects as one array per field, indexed by
+// slot and `capacity` long, so a loop over one field walks contiguous memory.
+static constexpr uint32_t HANDLE_SLOT_BITS = 16;
+static constexpr uint32_t HANDLE_SLOT_MASK = (1u << HANDLE_SLOT_BITS) - 1;
+static constexpr uint32_t MAX_HANDLE_POOL_CAPACITY = 1u << HANDLE_SLOT_BITS;
+
+struct Handle_Pool {
+    uint16_t* generations;
+    uint32_t* free_slots;       // a stack, the most recently released slot is reused first
+    uint32_t free_count;
+    uint32_t capacity;
+    uint32_t live_count;        // allocated and not yet released
+};
+
+void handle_pool_init(Handle_Pool* pool, uint32_t capacity);
+void handle_pool_shutdown(Handle_Pool* pool);
+
+// 0 if every slot is taken.
+uint32_t handle_pool_allocate(Handle_Pool* pool);
+// Stale handles stop resolving from here on, the slot stays taken.
+void handle_pool_invalidate(Handle_Pool* pool, uint32_t handle);
+// Gives the slot of an invalidated handle back, once nothing reads its fields anymore.
+void handle_pool_release(Handle_Pool* pool, uint32_t slot);
+
+inline uint32_t handle_slot(uint32_t handle) {
+    return handle & HANDLE_SLOT_MASK;
+}
+
+inline bool handle_pool_valid(const Handle_Pool* pool, uint32_t handle) {
+    uint32_t slot = handle & HANDLE_SLOT_MASK;
+    return handle != 0 && slot < pool->capacity && pool->generations[slot] == handle >> HANDLE_SLOT_BITS;
+}
@@ -0,0 +1,173 @@
+#include "jobs.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdlib.h>
+#include <thread>
+
+struct Job {
+    Job_Function function;
+    void* data;
+};
+
+static std::thread* workers;
+static uint32_t worker_count;
+static thread_local uint32_t thread_index;
+
+static std::mutex queue_mutex;
+static std::condition_variable queue_condition;
+static bool stopping;
+
+// Ring buffer of pending jobs, grown when full.
+static Job* queue;
+static uint32_t queue_capacity;
+static uint32_t queue_head;
+static uint32_t queue_count;
+
+// Shared by the caller of jobs_parallel_for() and the helper jobs it submits. Helpers can start
+// after the loop has already finished, so the last one out frees it.
+struct Parallel_For {
+    Parallel_For_Function function;
+    void* data;
+    uint32_t count;
+    std::atomic<uint32_t> next;
+    std::atomic<uint32_t> completed;
+    std::atomic<uint32_t> references;
+};
+
+static void release_parallel_for(Parallel_For* parallel_for) {
+    if (parallel_for->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        delete parallel_for;
+    }
+}
+
+static void run_parallel_for(Parallel_For* parallel_for) {
+    for (;;) {
+        uint32_t index = parallel_for->next.fetch_add(1, std::memory_order_relaxed);
+        if (index >= parallel_for->count) {
+            break;
+        }
+        parallel_for->function(index, thread_index, parallel_for->data);
+        parallel_for->completed.fetch_add(1, std::memory_order_release);
+    }
+}
+
+static void parallel_for_helper(void* data) {
+    Parallel_For* parallel_for = (Parallel_For*)data;
+    run_parallel_for(parallel_for);
+    release_parallel_for(parallel_for);
+}
+
+static void worker_main(uint32_t index) {
+    thread_index = index;
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex);
+            queue_condition.wait(lock, [] { return queue_count > 0 || stopping; });
+            if (queue_count == 0) {
+                return;
+            }
+            job = queue[queue_head];
+            queue_head = (queue_head + 1) % queue_capacity;
+            queue_count--;
+        }
+        job.function(job.data);
+    }
+}
+
+void jobs_init(uint32_t count) {
+    if (count == 0) {
+        uint32_t cores = std::thread::hardware_concurrency();
+        count = cores > 1 ? cores - 1 : 1;
+    }
+
+    stopping = false;
+    worker_count = count;
+    workers = new std::thread[worker_count];
+    for (uint32_t i = 0; i < worker_count; i++) {
+        workers[i] = std::thread(worker_main, i + 1);
+    }
+}
+
+void jobs_shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        stopping = true;
+    }
+    queue_condition.notify_all();
+
+    for (uint32_t i = 0; i < worker_count; i++) {
+        workers[i].join();
+    }
+    delete[] workers;
+    workers = nullptr;
+    worker_count = 0;
+
+    free(queue);
+    queue = nullptr;
+    queue_capacity = 0;
+    queue_head = 0;
+    queue_count = 0;
+}
+
+void jobs_submit(Job_Function function, void* data) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex);
+        if (queue_count == queue_capacity) {
+            uint32_t new_capacity = queue_capacity ? queue_capacity * 2 : 64;
+            Job* new_queue = (Job*)malloc(sizeof(Job) * new_capacity);
+            for (uint32_t i = 0; i < queue_count; i++) {
+                new_queue[i] = queue[(queue_head + i) % queue_capacity];
+            }
+            free(queue);
+            queue = new_queue;
+            queue_capacity = new_capacity;
+            queue_head = 0;
+        }
+        queue[(queue_head + queue_count) % queue_capacity] = {function, data};
+        queue_count++;
+    }
+    queue_condition.notify_one();
+}
+
+uint32_t jobs_worker_count() {
+    return worker_count;
+}
+
+uint32_t jobs_thread_index() {
+    return thread_index;
+}
+
+void jobs_parallel_for(uint32_t count, Parallel_For_Function function, void* data) {
+    if (count == 0) {
+        return;
+    }
+
+    uint32_t helper_count = count - 1 < worker_count ? count - 1 : worker_count;
+    if (helper_count == 0) {
+        for (uint32_t i = 0; i < count; i++) {
+            function(i, thread_index, data);
+        }
+        return;
+    }
+
+    Parallel_For* parallel_for = new Parallel_For();
+    parallel_for->function = function;
+    parallel_for->data = data;
+    parallel_for->count = count;
+    parallel_for->references = helper_count + 1;
+
+    for (uint32_t i = 0; i < helper_count; i++) {
+        jobs_submit(parallel_for_helper, parallel_for);
+    }
+
+    run_parallel_for(parallel_for);
+
+    // Every index has been claimed, wait for the ones still running on workers.
+    while (parallel_for->completed.load(std::memory_order_acquire) < count) {
+        std::this_thread::yield();
+    }
+    release_parallel_for(parallel_for);
+}
@@ -0,0 +1,25 @@
+#pragma once
+#include <stdint.h>
+
+// A small pool of worker threads for fire-and-forget background work such as pipeline
+// compilation. Jobs run in submission order, one per free worker.
+
+typedef void (*Job_Function)(void* data);
+typedef void (*Parallel_For_Function)(uint32_t index, uint32_t thread_index, void* data);
+
+// Starts `worker_count` workers, 0 picks one per core minus one for the main thread.
+void jobs_init(uint32_t worker_count);
+// Runs every job still queued, then joins the workers.
+void jobs_shutdown();
+
+void jobs_submit(Job_Function function, void* data);
+uint32_t jobs_worker_count();
+
+// 0 on the thread that called jobs_init(), 1..jobs_worker_count() on the workers. Lets callers
+// keep per-thread state such as command pools in a plain array.
+uint32_t jobs_thread_index();
+
+// Calls `function` for every index in [0, count) and returns once all calls have finished. The
+// calling thread works through indices too, so this completes even while every worker is busy
+// with long running jobs.
+void jobs_parallel_for(uint32_t count, Parallel_For_Function function, void* data);
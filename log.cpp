@@ -0,0 +1,214 @@
+#include "log.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+// Per-thread ring of variable sized records. The producer only writes `head`, the drain thread
+// only writes `tail`, so neither side ever waits on the other.
+static constexpr uint32_t RING_SIZE = 64 * 1024;
+static constexpr uint32_t MAX_LOG_THREADS = 64;
+static constexpr uint32_t MAX_MESSAGE_SIZE = 1024;
+
+struct Log_Record_Header {
+    uint32_t size;      // message bytes, the record is padded to 8 after them
+    uint32_t level;
+};
+
+struct Log_Ring {
+    alignas(64) std::atomic<uint64_t> head;
+    alignas(64) std::atomic<uint64_t> tail;
+    std::atomic<uint32_t> dropped;
+    std::atomic<bool> owned;    // a live thread is producing into it
+    char data[RING_SIZE];
+};
+
+// Rings are never freed, the drain thread may be reading them. A thread hands its ring back when it
+// exits and the next thread to log takes it over, records still in it are drained as usual.
+struct Thread_Ring {
+    Log_Ring* ring;
+
+    ~Thread_Ring() {
+        if (ring) {
+            ring->owned.store(false, std::memory_order_release);
+            ring = nullptr;
+        }
+    }
+};
+
+static std::atomic<Log_Ring*> rings[MAX_LOG_THREADS];
+static std::atomic<uint32_t> ring_count;
+static std::atomic<uint32_t> unregistered_dropped;
+static thread_local Thread_Ring thread_ring;
+
+// Serializes consumers only, the drain thread against log_flush(). Producers never take it.
+static std::mutex drain_mutex;
+static std::thread drain_thread;
+static std::atomic<bool> draining;
+
+static Log_Ring* acquire_thread_ring() {
+    if (thread_ring.ring) {
+        return thread_ring.ring;
+    }
+
+    uint32_t count = ring_count.load(std::memory_order_acquire);
+    if (count > MAX_LOG_THREADS) {
+        count = MAX_LOG_THREADS;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        Log_Ring* ring = rings[i].load(std::memory_order_acquire);
+        bool owned = false;
+        // Acquire so the previous owner's last head is seen.
+        if (ring && ring->owned.compare_exchange_strong(owned, true, std::memory_order_acquire, std::memory_order_relaxed)) {
+            thread_ring.ring = ring;
+            return ring;
+        }
+    }
+
+    if (count == MAX_LOG_THREADS) {
+        return nullptr;
+    }
+    uint32_t index = ring_count.fetch_add(1, std::memory_order_relaxed);
+    if (index >= MAX_LOG_THREADS) {
+        return nullptr;
+    }
+    Log_Ring* ring = new Log_Ring();
+    ring->owned.store(true, std::memory_order_relaxed);
+    rings[index].store(ring, std::memory_order_release);
+    thread_ring.ring = ring;
+    return ring;
+}
+
+static void ring_copy_in(Log_Ring* ring, uint64_t position, const void* source, uint32_t size) {
+    uint32_t offset = position % RING_SIZE;
+    uint32_t first = size < RING_SIZE - offset ? size : RING_SIZE - offset;
+    memcpy(ring->data + offset, source, first);
+    memcpy(ring->data, (const char*)source + first, size - first);
+}
+
+static void ring_copy_out(Log_Ring* ring, uint64_t position, void* destination, uint32_t size) {
+    uint32_t offset = position % RING_SIZE;
+    uint32_t first = size < RING_SIZE - offset ? size : RING_SIZE - offset;
+    memcpy(destination, ring->data + offset, first);
+    memcpy((char*)destination + first, ring->data, size - first);
+}
+
+void log_write(Log_Level level, Log_Category, const char* format, ...) {
+    char message[MAX_MESSAGE_SIZE];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    if (length < 0) {
+        return;
+    }
+    if (length >= (int)sizeof(message)) {
+        length = sizeof(message) - 1;
+    }
+
+    Log_Ring* ring = acquire_thread_ring();
+    if (!ring) {
+        unregistered_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    Log_Record_Header header = {(uint32_t)length, (uint32_t)level};
+    uint32_t record_size = (sizeof(header) + length + 7) & ~7u;
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    if (head - tail + record_size > RING_SIZE) {
+        ring->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    ring_copy_in(ring, head, &header, sizeof(header));
+    ring_copy_in(ring, head + sizeof(header), message, length);
+    ring->head.store(head + record_size, std::memory_order_release);
+}
+
+// Writes out everything currently in the rings. Returns true if there was anything.
+static bool drain_rings() {
+    std::lock_guard<std::mutex> lock(drain_mutex);
+
+    bool wrote = false;
+    bool wrote_error = false;
+    uint32_t count = ring_count.load(std::memory_order_acquire);
+    if (count > MAX_LOG_THREADS) {
+        count = MAX_LOG_THREADS;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        // Registered but not yet published, it will be picked up next pass.
+        Log_Ring* ring = rings[i].load(std::memory_order_acquire);
+        if (!ring) {
+            continue;
+        }
+
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        while (tail < head) {
+            Log_Record_Header header;
+            char message[MAX_MESSAGE_SIZE];
+            ring_copy_out(ring, tail, &header, sizeof(header));
+            ring_copy_out(ring, tail + sizeof(header), message, header.size);
+
+            bool error = header.level >= LOG_LEVEL_WARN;
+            fwrite(message, 1, header.size, error ? stderr : stdout);
+            wrote_error |= error;
+            wrote = true;
+
+            tail += (sizeof(header) + header.size + 7) & ~7ull;
+        }
+        ring->tail.store(tail, std::memory_order_release);
+
+        uint32_t dropped = ring->dropped.exchange(0, std::memory_order_relaxed);
+        if (dropped) {
+            fprintf(stderr, "🔸%u log messages dropped, log ring %u was full\n", dropped, i);
+            wrote_error = true;
+        }
+    }
+
+    uint32_t dropped = unregistered_dropped.exchange(0, std::memory_order_relaxed);
+    if (dropped) {
+        fprintf(stderr, "🔸%u log messages dropped, more than %u threads logging at once\n", dropped, MAX_LOG_THREADS);
+        wrote_error = true;
+    }
+
+    if (wrote) {
+        fflush(stdout);
+    }
+    if (wrote_error) {
+        fflush(stderr);
+    }
+    return wrote || wrote_error;
+}
+
+static void drain_loop() {
+    while (draining.load(std::memory_order_relaxed)) {
+        if (!drain_rings()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+    }
+}
+
+void log_init() {
+    draining.store(true, std::memory_order_relaxed);
+    drain_thread = std::thread(drain_loop);
+}
+
+void log_shutdown() {
+    draining.store(false, std::memory_order_relaxed);
+    if (drain_thread.joinable()) {
+        drain_thread.join();
+    }
+    drain_rings();
+}
+
+void log_flush() {
+    drain_rings();
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+
+// Asynchronous logging. A log call formats its message on the calling thread into that thread's
+// own ring buffer (one producer, one consumer, no locks) and returns. A background thread drains
+// the rings to stdout, or stderr for warnings and errors. Messages from one thread keep their
+// order. When a ring is full the message is dropped and counted, the caller never blocks.
+//
+// Messages below LOG_MIN_LEVEL or outside LOG_CATEGORIES are compiled out, arguments included.
+
+enum Log_Level {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARN,
+    LOG_LEVEL_ERROR,
+};
+
+enum Log_Category : uint32_t {
+    LOG_CATEGORY_APP = 1 << 0,
+    LOG_CATEGORY_RENDER = 1 << 1,   // device, swapchain and resource setup
+    LOG_CATEGORY_FRAME = 1 << 2,    // once per frame, the noisy one
+    LOG_CATEGORY_PIPELINE = 1 << 3,
+    LOG_CATEGORY_MEMORY = 1 << 4,
+    LOG_CATEGORY_ASSETS = 1 << 5,
+};
+
+#ifndef LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define LOG_MIN_LEVEL LOG_LEVEL_INFO
+#else
+#define LOG_MIN_LEVEL LOG_LEVEL_DEBUG
+#endif
+#endif
+
+#ifndef LOG_CATEGORIES
+#define LOG_CATEGORIES 0xffffffffu
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define LOG_PRINTF_FORMAT(format_index, args_index) __attribute__((format(printf, format_index, args_index)))
+#else
+#define LOG_PRINTF_FORMAT(format_index, args_index)
+#endif
+
+// Messages logged before log_init() are kept and written once the drain thread starts.
+void log_init();
+// Drains everything still buffered and stops the drain thread.
+void log_shutdown();
+// Blocks until everything logged so far has reached the sink. Call before exiting on an error.
+void log_flush();
+
+void log_write(Log_Level level, Log_Category category, const char* format, ...) LOG_PRINTF_FORMAT(3, 4);
+
+#define LOG(level, category, ...)                                                        \
+    do {                                                                                 \
+        if constexpr ((level) >= LOG_MIN_LEVEL && ((category) & LOG_CATEGORIES) != 0) {  \
+            log_write(level, category, __VA_ARGS__);                                     \
+        }                                                                                \
+    } while (0)
+
+#define LOG_DEBUG(category, ...) LOG(LOG_LEVEL_DEBUG, category, __VA_ARGS__)
+#define LOG_INFO(category, ...) LOG(LOG_LEVEL_INFO, category, __VA_ARGS__)
+#define LOG_WARN(category, ...) LOG(LOG_LEVEL_WARN, category, __VA_ARGS__)
+#define LOG_ERROR(category, ...) LOG(LOG_LEVEL_ERROR, category, __VA_ARGS__)
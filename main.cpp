@@ -1,29 +1,430 @@
 #include "assets.h"
 #include "common.h"
+#include "embedded_shaders.h"
+#include "log.h"
+#include "mesh.h"
+#include "profiler.h"
 #include "render.h"
+#include "shader_features.h"
 
-int main() {
-    render_init();
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
 
+// Column major, out = a * b.
+static void multiply_matrices(const float a[16], const float b[16], float out[16]) {
+    for (int column = 0; column < 4; column++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += a[k * 4 + row] * b[column * 4 + k];
+            }
+            out[column * 4 + row] = sum;
+        }
+    }
+}
+
+// Orbits the origin looking at it, infinite far plane and reverse-Z: depth is 1 at `near` and
+// tends to 0 with distance. Y is flipped for Vulkan's clip space.
+static void orbit_camera(float angle, float distance, float height, float aspect, float eye[3], float view_projection[16]) {
+    eye[0] = sinf(angle) * distance;
+    eye[1] = height;
+    eye[2] = cosf(angle) * distance;
+    float eye_length = sqrtf(eye[0] * eye[0] + eye[1] * eye[1] + eye[2] * eye[2]);
+    float back[3] = {eye[0] / eye_length, eye[1] / eye_length, eye[2] / eye_length};
+    float right[3] = {back[2], 0.0f, -back[0]};
+    float right_length = sqrtf(right[0] * right[0] + right[2] * right[2]);
+    right[0] /= right_length;
+    right[2] /= right_length;
+    float up[3] = {
+        back[1] * right[2] - back[2] * right[1],
+        back[2] * right[0] - back[0] * right[2],
+        back[0] * right[1] - back[1] * right[0],
+    };
+
+    float view[16] = {
+        right[0], up[0], back[0], 0.0f,
+        right[1], up[1], back[1], 0.0f,
+        right[2], up[2], back[2], 0.0f,
+        -(right[0] * eye[0] + right[1] * eye[1] + right[2] * eye[2]),
+        -(up[0] * eye[0] + up[1] * eye[1] + up[2] * eye[2]),
+        -(back[0] * eye[0] + back[1] * eye[1] + back[2] * eye[2]),
+        1.0f,
+    };
+
+    const float near = 0.1f;
+    float focal = 1.0f / tanf(0.5f * 1.0472f);
+    float projection[16] = {
+        focal / aspect, 0.0f, 0.0f, 0.0f,
+        0.0f, -focal, 0.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, -1.0f,
+        0.0f, 0.0f, near, 0.0f,
+    };
+    multiply_matrices(projection, view, view_projection);
+}
+
+int main(int argc, char** argv) {
+    Render_Config config;
+    const char* trace_path = nullptr;
+    uint32_t scene_objects = 0;
+    const char* mesh_path = nullptr;
+    const char* texture_name = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            config.headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            config.max_frames = strtoull(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            trace_path = argv[++i];
+        } else if (strcmp(argv[i], "--profile-draws") == 0) {
+            config.profile_draws = true;
+        } else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "relaxed") == 0) {
+                config.present_mode = PRESENT_MODE_FIFO_RELAXED;
+            } else if (strcmp(mode, "mailbox") == 0) {
+                config.present_mode = PRESENT_MODE_MAILBOX;
+            } else if (strcmp(mode, "immediate") == 0) {
+                config.present_mode = PRESENT_MODE_IMMEDIATE;
+            } else {
+                config.present_mode = PRESENT_MODE_FIFO;
+            }
+        } else if (strcmp(argv[i], "--swapchain-images") == 0 && i + 1 < argc) {
+            config.swapchain_images = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--frames-in-flight") == 0 && i + 1 < argc) {
+            config.frames_in_flight = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--adaptive-pacing") == 0) {
+            config.adaptive_pacing = true;
+        } else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+            scene_objects = strtoul(argv[++i], nullptr, 10);
+        } else if (strcmp(argv[i], "--mesh") == 0 && i + 1 < argc) {
+            mesh_path = argv[++i];
+        } else if (strcmp(argv[i], "--texture") == 0 && i + 1 < argc) {
+            texture_name = argv[++i];
+        } else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc) {
+            config.texture_budget_bytes = strtoull(argv[++i], nullptr, 10) << 20;
+        } else if (strcmp(argv[i], "--cull") == 0 && i + 1 < argc) {
+            const char* mode = argv[++i];
+            if (strcmp(mode, "cpu") == 0) {
+                config.cull_mode = CULL_MODE_CPU;
+            } else if (strcmp(mode, "occlusion") == 0) {
+                config.cull_mode = CULL_MODE_GPU_OCCLUSION;
+            } else {
+                config.cull_mode = CULL_MODE_GPU;
+            }
+        } else if (strcmp(argv[i], "--dynamic-resolution") == 0 && i + 1 < argc) {
+            config.dynamic_resolution = true;
+            config.target_gpu_ms = strtof(argv[++i], nullptr);
+        } else if (strcmp(argv[i], "--render-thread") == 0) {
+            config.render_thread = true;
+        } else if (strcmp(argv[i], "--render-queue") == 0 && i + 1 < argc) {
+            config.render_queue_frames = strtoul(argv[++i], nullptr, 10);
+        }
+    }
+
+#ifndef EMBED_SHADERS
+    // Hashing every asset is only worth it while developing.
+#ifdef NDEBUG
+    bool verify_assets = false;
+#else
+    bool verify_assets = true;
+#endif
+    // The archive is mapped, verified and its shaders looked up while render_init() creates the
+    // device, shader modules and pipelines are only created once both are done.
+    Asset_Archive archive;
+    bool archive_opened = false;
+    double archive_ms = 0.0;
     Shader_Data shader_data;
-    assets_load_shaders(&shader_data, 
-        "build/assets/shaders/triangle.vert.spv", 
-        "build/assets/shaders/triangle.frag.spv");
+    Shader_Data scene_shader_data;
+    Shader_Data mesh_shader_data;
+    Compute_Shader_Data cull_shader_data;
+    Compute_Shader_Data hiz_shader_data;
+    std::thread asset_thread([&]() {
+        uint64_t begin_ns = profiler_now_ns();
+        archive_opened = assets_open_archive(&archive, "build/assets.pak", verify_assets);
+        if (archive_opened) {
+            assets_load_shaders(&archive, &shader_data, "shaders/triangle.vert.spv", "shaders/triangle.frag.spv");
+            assets_load_shaders(&archive, &scene_shader_data, "shaders/scene.vert.spv", "shaders/triangle.frag.spv");
+            assets_load_shaders(&archive, &mesh_shader_data, "shaders/mesh.vert.spv", "shaders/mesh.frag.spv");
+            assets_load_compute_shader(&archive, &cull_shader_data, "shaders/cull.comp.spv");
+            assets_load_compute_shader(&archive, &hiz_shader_data, "shaders/hiz.comp.spv");
+        }
+        archive_ms = (profiler_now_ns() - begin_ns) / 1e6;
+    });
+#endif
+
+    render_init(&config);
+
+#ifdef EMBED_SHADERS
+    static_assert(embedded_shader_exists("shaders/triangle.vert.spv") && embedded_shader_exists("shaders/triangle.frag.spv"),
+        "triangle shaders are not embedded");
+    constexpr Shader_Data shader_data = embedded_shader_data(
+        embedded_shader_find("shaders/triangle.vert.spv"), embedded_shader_find("shaders/triangle.frag.spv"));
+
+    Shader shader;
+    render_create_shader(&shader, &shader_data);
+
+    static_assert(embedded_shader_exists("shaders/scene.vert.spv") && embedded_shader_exists("shaders/cull.comp.spv") &&
+        embedded_shader_exists("shaders/hiz.comp.spv"), "scene shaders are not embedded");
+    constexpr Shader_Data scene_shader_data = embedded_shader_data(
+        embedded_shader_find("shaders/scene.vert.spv"), embedded_shader_find("shaders/triangle.frag.spv"));
+    constexpr const Embedded_Shader* cull_shader = embedded_shader_find("shaders/cull.comp.spv");
+    constexpr const Embedded_Shader* hiz_shader = embedded_shader_find("shaders/hiz.comp.spv");
+    constexpr Compute_Shader_Data cull_shader_data = {cull_shader->code, cull_shader->size};
+    constexpr Compute_Shader_Data hiz_shader_data = {hiz_shader->code, hiz_shader->size};
 
-    Shader* shader;
+    Shader scene_shader;
+    render_create_shader(&scene_shader, &scene_shader_data);
+    render_init_gpu_culling(&cull_shader_data, &hiz_shader_data);
+
+    static_assert(embedded_shader_exists("shaders/mesh.vert.spv") && embedded_shader_exists("shaders/mesh.frag.spv"),
+        "mesh shaders are not embedded");
+    constexpr Shader_Data mesh_shader_data = embedded_shader_data(
+        embedded_shader_find("shaders/mesh.vert.spv"), embedded_shader_find("shaders/mesh.frag.spv"));
+    Shader mesh_shader;
+    render_create_shader(&mesh_shader, &mesh_shader_data);
+#else
+    asset_thread.join();
+    if (!archive_opened) {
+        render_shutdown();
+        return EXIT_FAILURE;
+    }
+    LOG_INFO(LOG_CATEGORY_APP, "• Archive loaded in %.2f ms, alongside render_init.\n", archive_ms);
+
+    Shader shader;
     render_create_shader(&shader, &shader_data);
-    Material* material = nullptr;
+    Shader scene_shader;
+    render_create_shader(&scene_shader, &scene_shader_data);
+    Shader mesh_shader;
+    render_create_shader(&mesh_shader, &mesh_shader_data);
+    render_init_gpu_culling(&cull_shader_data, &hiz_shader_data);
+#endif
+    Material material;
     render_create_material(&material, shader);
 
+    // Benchmark scene: a grid of triangles, or of the --mesh, around the origin, orbited by the camera.
+    static const uint32_t triangle_indices[3] = {0, 1, 2};
+    Mesh mesh = {};
+    if (mesh_path) {
+        Mesh_Source mesh_source;
+        if (mesh_load_obj(mesh_path, &mesh_source)) {
+            Mesh_Build_Config mesh_config;
+            mesh_build(&mesh_source, &mesh_config, &mesh);
+            mesh_free_source(&mesh_source);
+            mesh_log_report(mesh_path, &mesh);
+            scene_objects = scene_objects ? scene_objects : 1;
+        }
+    }
+
+#ifdef EMBED_SHADERS
+    // The shaders are in the executable, the archive is only needed for a texture.
+    Asset_Archive archive;
+    bool archive_opened = texture_name && assets_open_archive(&archive, "build/assets.pak", false);
+#endif
+    // Applied to the --mesh, straight out of the mapped archive, which stays open for as long as
+    // the texture lives.
+    Texture* texture = nullptr;
+    uint32_t texture_sampler = 0;
+    if (mesh.vertices && texture_name && archive_opened) {
+        char texture_asset[256];
+        snprintf(texture_asset, sizeof(texture_asset), "textures/%s", texture_name);
+        Asset_View texture_view;
+        if (assets_find(&archive, texture_asset, &texture_view)) {
+            render_create_texture(&texture, texture_view.data, texture_view.size);
+        } else {
+            LOG_ERROR(LOG_CATEGORY_APP, "🔸Texture not in the archive: %s\n", texture_asset);
+        }
+    }
+
+    Buffer* scene_indices = nullptr;
+    Buffer* scene_vertices = nullptr;
+    Material scene_material = {};
+    Scene* scene = nullptr;
+    uint8_t* object_lods = nullptr;
+    if (scene_objects) {
+        const void* index_data = mesh.vertices ? (const void*)mesh.indices : (const void*)triangle_indices;
+        uint64_t index_size = mesh.vertices ? mesh.index_count * sizeof(uint32_t) : sizeof(triangle_indices);
+        render_create_buffer(&scene_indices, index_size, BUFFER_USAGE_INDEX | BUFFER_USAGE_TRANSFER_DST, MEMORY_GPU);
+        Stream_Source index_source = {};
+        index_source.data = index_data;
+        index_source.size = index_size;
+        render_stream_buffer(scene_indices, &index_source, STREAM_PRIORITY_HIGH);
+
+        if (mesh.vertices) {
+            uint64_t vertex_size = mesh.vertex_count * sizeof(Mesh_Vertex);
+            render_create_buffer(&scene_vertices, vertex_size, BUFFER_USAGE_VERTEX | BUFFER_USAGE_TRANSFER_DST, MEMORY_GPU);
+            Stream_Source vertex_source = {};
+            vertex_source.data = mesh.vertices;
+            vertex_source.size = vertex_size;
+            render_stream_buffer(scene_vertices, &vertex_source, STREAM_PRIORITY_HIGH);
+            Mesh_Frag_Key key = Mesh_Frag_Key{Mesh_Frag_Feature::LIT}.with(Mesh_Frag_Feature::TEXTURED, texture != nullptr);
+            render_create_material(&scene_material, mesh_shader, VERTEX_LAYOUT_MESH, key);
+            if (texture) {
+                texture_sampler = render_create_sampler(SAMPLER_FILTER_LINEAR, SAMPLER_ADDRESS_REPEAT);
+                render_set_material_texture(scene_material, 0, texture);
+                render_set_material_index(scene_material, 1, texture_sampler);
+            }
+            object_lods = (uint8_t*)calloc(scene_objects, 1);
+        } else {
+            render_create_material(&scene_material, scene_shader);
+        }
+
+        render_create_scene(&scene, scene_indices, scene_vertices, scene_objects);
+        uint32_t side = (uint32_t)ceilf(sqrtf((float)scene_objects));
+        for (uint32_t i = 0; i < scene_objects; i++) {
+            Scene_Object object = {};
+            object.center[0] = ((float)(i % side) - 0.5f * side) * 2.0f;
+            object.center[2] = ((float)(i / side) - 0.5f * side) * 2.0f;
+            object.radius = mesh.vertices ? 0.9f : 0.75f;
+            object.index_count = mesh.vertices ? mesh.lods[0].index_count : 3;
+            object.first_instance = i;
+            render_scene_add(scene, scene_material, &object);
+        }
+    }
+
+    float camera_angle = 0.0f;
     while (!render_should_close()) {
         render_begin_frame();
         render_draw(material);
+        if (scene && render_buffer_ready(scene_indices) && (!scene_vertices || render_buffer_ready(scene_vertices))) {
+            float eye[3];
+            float view_projection[16];
+            float extent = sqrtf((float)scene_objects);
+            orbit_camera(camera_angle, extent * 0.75f + 4.0f, 2.0f, (float)config.width / (float)config.height, eye, view_projection);
+
+            // Coarser levels further out, only objects whose level changed are updated.
+            uint32_t side = (uint32_t)ceilf(extent);
+            for (uint32_t i = 0; object_lods && i < scene_objects; i++) {
+                Scene_Object object = {};
+                object.center[0] = ((float)(i % side) - 0.5f * side) * 2.0f;
+                object.center[2] = ((float)(i / side) - 0.5f * side) * 2.0f;
+                object.radius = 0.9f;
+                float dx = object.center[0] - eye[0];
+                float dy = object.center[1] - eye[1];
+                float dz = object.center[2] - eye[2];
+                uint32_t lod = mesh_select_lod(&mesh, object.radius, sqrtf(dx * dx + dy * dy + dz * dz), 0.002f);
+                if (lod != object_lods[i]) {
+                    object_lods[i] = (uint8_t)lod;
+                    object.first_index = mesh.lods[lod].first_index;
+                    object.index_count = mesh.lods[lod].index_count;
+                    object.first_instance = i;
+                    render_scene_update(scene, i, &object);
+                }
+            }
+
+            if (texture) {
+                render_use_texture(texture);
+            }
+            render_draw_scene(scene, view_projection);
+            camera_angle += 0.01f;
+        }
         render_end_frame();
     }
 
     render_wait_idle();
 
-    render_destroy_shader(shader);
+    Startup_Stats startup_stats;
+    render_get_startup_stats(&startup_stats);
+    LOG_INFO(LOG_CATEGORY_APP, "• Startup: first frame after %.2f ms, render_init %.2f ms, validation %s.\n",
+        startup_stats.first_frame_ms, startup_stats.init_ms, startup_stats.validation ? "on" : "off");
+
+    Pipeline_Cache_Stats cache_stats;
+    render_get_pipeline_cache_stats(&cache_stats);
+    LOG_INFO(LOG_CATEGORY_APP, "• Pipelines: %u cache hits, %u misses, %.2f ms compiling.\n", cache_stats.hits, cache_stats.misses, cache_stats.compile_ms);
+
+    Frame_Time_Stats frame_stats;
+    render_get_frame_time_stats(&frame_stats);
+    LOG_INFO(LOG_CATEGORY_APP, "• Frame time p50/p95/p99: CPU %.2f/%.2f/%.2f ms, GPU %.2f/%.2f/%.2f ms.\n",
+        frame_stats.cpu_p50_ms, frame_stats.cpu_p95_ms, frame_stats.cpu_p99_ms,
+        frame_stats.gpu_p50_ms, frame_stats.gpu_p95_ms, frame_stats.gpu_p99_ms);
+    LOG_INFO(LOG_CATEGORY_APP, "• CPU wait for GPU p50/p95/p99: %.2f/%.2f/%.2f ms, pacing delay %.2f ms.\n",
+        frame_stats.cpu_wait_p50_ms, frame_stats.cpu_wait_p95_ms, frame_stats.cpu_wait_p99_ms, frame_stats.pacing_delay_ms);
+    if (frame_stats.latency_frame_count) {
+        LOG_INFO(LOG_CATEGORY_APP, "• Input to present p50/p95/p99: %.2f/%.2f/%.2f ms.\n",
+            frame_stats.latency_p50_ms, frame_stats.latency_p95_ms, frame_stats.latency_p99_ms);
+    }
+    if (trace_path && render_write_profile_trace(trace_path)) {
+        LOG_INFO(LOG_CATEGORY_APP, "• Profile trace written to %s.\n", trace_path);
+    }
+
+    if (scene) {
+        Cull_Stats cull_stats;
+        render_get_cull_stats(&cull_stats);
+        static const char* cull_mode_names[] = {"CPU", "GPU", "GPU occlusion"};
+        LOG_INFO(LOG_CATEGORY_APP, "• Culling (%s): %u of %u objects visible, %.3f ms CPU.\n",
+            cull_mode_names[cull_stats.mode], cull_stats.visible, cull_stats.objects, cull_stats.cpu_ms);
+    }
+
+    Draw_Stats draw_stats;
+    render_get_draw_stats(&draw_stats);
+    LOG_INFO(LOG_CATEGORY_APP, "• Last frame: %u draw calls, %u indirect draw calls, %u pipeline binds.\n",
+        draw_stats.draw_calls, draw_stats.indirect_draw_calls, draw_stats.pipeline_binds);
+
+    Graph_Stats graph_stats;
+    render_get_graph_stats(&graph_stats);
+    LOG_INFO(LOG_CATEGORY_APP, "• Frame graph: %u of %u passes run, %u barrier batches (%u image, %u global barriers), %u transient images in %llu of %llu KiB.\n",
+        graph_stats.passes - graph_stats.culled_passes, graph_stats.passes, graph_stats.barrier_batches,
+        graph_stats.image_barriers, graph_stats.memory_barriers, graph_stats.transient_images,
+        (unsigned long long)graph_stats.transient_heap_bytes / 1024, (unsigned long long)graph_stats.transient_bytes / 1024);
+
+    Resolution_Stats resolution_stats;
+    render_get_resolution_stats(&resolution_stats);
+    if (resolution_stats.enabled) {
+        LOG_INFO(LOG_CATEGORY_APP, "• Dynamic resolution: %.0f%% (%u x %u of %u x %u), %u scale changes, last GPU frame %.2f ms.\n",
+            resolution_stats.render_scale * 100.0f, resolution_stats.width, resolution_stats.height,
+            resolution_stats.output_width, resolution_stats.output_height, resolution_stats.scale_changes, resolution_stats.last_gpu_ms);
+    }
+
+    Render_Thread_Stats thread_stats;
+    render_get_render_thread_stats(&thread_stats);
+    if (thread_stats.enabled) {
+        LOG_INFO(LOG_CATEGORY_APP, "• Render thread: %llu frames, main thread %.0f%% busy (%.0f ms waiting), render thread %.0f%% busy (%.0f ms idle, %.0f ms waiting for the GPU).\n",
+            (unsigned long long)thread_stats.frames, thread_stats.main_utilization * 100.0f, thread_stats.main_wait_ms,
+            thread_stats.render_utilization * 100.0f, thread_stats.render_idle_ms, thread_stats.render_gpu_wait_ms);
+    }
+
+    Memory_Stats memory_stats;
+    render_get_memory_stats(&memory_stats);
+    LOG_INFO(LOG_CATEGORY_APP, "• GPU memory: %llu / %llu KiB used in %u blocks (+%u dedicated), %.0f%% fragmented.\n",
+        (unsigned long long)memory_stats.used_bytes / 1024, (unsigned long long)memory_stats.reserved_bytes / 1024,
+        memory_stats.block_count, memory_stats.dedicated_count, memory_stats.fragmentation * 100.0f);
+    LOG_INFO(LOG_CATEGORY_APP, "• Device local: %llu / %llu MiB (%s budget).\n",
+        (unsigned long long)memory_stats.budget_usage_bytes >> 20, (unsigned long long)memory_stats.budget_bytes >> 20,
+        memory_stats.driver_budget ? "driver" : "estimated");
+
+    if (texture) {
+        Texture_Stats texture_stats;
+        render_get_texture_stats(&texture_stats);
+        LOG_INFO(LOG_CATEGORY_APP, "• Textures: %u resident (%u reduced, %u with generated mips), %llu KiB, %.1fx smaller than RGBA8, %u levels dropped, %u restores.\n",
+            texture_stats.resident, texture_stats.reduced, texture_stats.generated_mips,
+            (unsigned long long)texture_stats.resident_bytes / 1024,
+            texture_stats.resident_bytes ? (double)texture_stats.rgba8_bytes / (double)texture_stats.resident_bytes : 0.0,
+            texture_stats.levels_dropped, texture_stats.restores);
+    }
+
+    if (scene) {
+        render_destroy_scene(scene);
+        render_destroy_material(scene_material);
+        render_destroy_buffer(scene_indices);
+        if (scene_vertices) {
+            render_destroy_buffer(scene_vertices);
+        }
+    }
+    if (texture) {
+        render_destroy_texture(texture);
+        render_destroy_sampler(texture_sampler);
+    }
+    free(object_lods);
+    mesh_free(&mesh);
     render_destroy_material(material);
-    assets_free_shaders(&shader_data);
-}
\ No newline at end of file
+    render_destroy_shader(mesh_shader);
+    render_destroy_shader(scene_shader);
+    render_destroy_shader(shader);
+
+    render_shutdown();
+    if (archive_opened) {
+        assets_close_archive(&archive);
+    }
+}
@@ -0,0 +1,1281 @@
+#include "mesh.h"
+#include "jobs.h"
+#include "log.h"
+#include "profiler.h"
+#include "radix_sort.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define MESH_SIMD_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define MESH_SIMD_SSE2 1
+#endif
+
+static constexpr uint32_t MAX_CACHE_SIZE = 32;
+static constexpr uint32_t MAX_VALENCE_SCORE = 32;
+static constexpr uint32_t SIMPLIFY_ATTEMPTS = 6;
+static constexpr uint32_t QUANTIZE_CHUNK = 16384;
+// Vertex fetch model for the report: a direct mapped 16 KiB cache of 64 byte lines.
+static constexpr uint32_t FETCH_LINE_SIZE = 64;
+static constexpr uint32_t FETCH_CACHE_LINES = 256;
+
+static uint32_t next_power_of_two(uint32_t value) {
+    uint32_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+static uint64_t hash_u64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+}
+
+// Maps floats onto uint32 keys that sort in the same order.
+static uint32_t sortable_float(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : bits | 0x80000000u;
+}
+
+// ---------------------------------------------------------------------------------------------
+// OBJ import
+
+struct Obj_Corner {
+    int32_t position;
+    int32_t uv;
+    int32_t normal;
+};
+
+struct Float_Array {
+    float* data;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+struct Corner_Array {
+    Obj_Corner* data;
+    uint32_t count;
+    uint32_t capacity;
+};
+
+static void push_floats(Float_Array* array, const float* values, uint32_t count) {
+    if (array->count + count > array->capacity) {
+        array->capacity = std::max(array->capacity * 2, 1024u);
+        array->data = (float*)realloc(array->data, sizeof(float) * array->capacity);
+    }
+    memcpy(array->data + array->count, values, sizeof(float) * count);
+    array->count += count;
+}
+
+static void push_corner(Corner_Array* array, Obj_Corner corner) {
+    if (array->count == array->capacity) {
+        array->capacity = std::max(array->capacity * 2, 1024u);
+        array->data = (Obj_Corner*)realloc(array->data, sizeof(Obj_Corner) * array->capacity);
+    }
+    array->data[array->count++] = corner;
+}
+
+static const char* parse_floats(const char* p, float* values, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        char* end;
+        values[i] = strtof(p, &end);
+        p = end;
+    }
+    return p;
+}
+
+// OBJ indices are 1 based, negative ones count back from the newest element, 0 means absent.
+static int32_t resolve_obj_index(long index, uint32_t count) {
+    // Compared as long, negating LONG_MIN or truncating to 32 bits would accept garbage.
+    if (index > 0 && index <= (long)count) {
+        return (int32_t)(index - 1);
+    }
+    if (index < 0 && index >= -(long)count) {
+        return (int32_t)((long)count + index);
+    }
+    return -1;
+}
+
+bool mesh_load_obj(const char* path, Mesh_Source* source) {
+    *source = {};
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Failed to open mesh %s\n", path);
+        return false;
+    }
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char* text = (char*)malloc(file_size + 1);
+    size_t read_size = fread(text, 1, file_size, file);
+    fclose(file);
+    text[read_size] = 0;
+
+    Float_Array positions = {};
+    Float_Array uvs = {};
+    Float_Array normals = {};
+    Corner_Array corners = {};
+
+    const char* p = text;
+    while (*p) {
+        float values[3];
+        if (p[0] == 'v' && p[1] == ' ') {
+            p = parse_floats(p + 2, values, 3);
+            push_floats(&positions, values, 3);
+        } else if (p[0] == 'v' && p[1] == 't' && p[2] == ' ') {
+            p = parse_floats(p + 3, values, 2);
+            push_floats(&uvs, values, 2);
+        } else if (p[0] == 'v' && p[1] == 'n' && p[2] == ' ') {
+            p = parse_floats(p + 3, values, 3);
+            push_floats(&normals, values, 3);
+        } else if (p[0] == 'f' && p[1] == ' ') {
+            // Polygons become fans around their first corner.
+            p += 2;
+            Obj_Corner first = {};
+            Obj_Corner previous = {};
+            uint32_t polygon_count = 0;
+            for (;;) {
+                while (*p == ' ' || *p == '\t') {
+                    p++;
+                }
+                char* end;
+                long position = strtol(p, &end, 10);
+                if (end == p) {
+                    break;
+                }
+                p = end;
+
+                Obj_Corner corner = {resolve_obj_index(position, positions.count / 3), -1, -1};
+                if (*p == '/') {
+                    p++;
+                    if (*p != '/') {
+                        corner.uv = resolve_obj_index(strtol(p, &end, 10), uvs.count / 2);
+                        p = end;
+                    }
+                    if (*p == '/') {
+                        p++;
+                        corner.normal = resolve_obj_index(strtol(p, &end, 10), normals.count / 3);
+                        p = end;
+                    }
+                }
+
+                if (polygon_count == 0) {
+                    first = corner;
+                } else if (polygon_count >= 2 && first.position >= 0 && previous.position >= 0 && corner.position >= 0) {
+                    push_corner(&corners, first);
+                    push_corner(&corners, previous);
+                    push_corner(&corners, corner);
+                }
+                previous = corner;
+                polygon_count++;
+            }
+        }
+        while (*p && *p != '\n') {
+            p++;
+        }
+        if (*p) {
+            p++;
+        }
+    }
+    free(text);
+
+    if (corners.count == 0) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Mesh %s has no faces\n", path);
+        free(positions.data);
+        free(uvs.data);
+        free(normals.data);
+        return false;
+    }
+
+    // Corners that share position, uv and normal become one vertex.
+    uint32_t table_size = next_power_of_two(corners.count * 2);
+    uint32_t* table = (uint32_t*)malloc(sizeof(uint32_t) * table_size);
+    memset(table, 0xff, sizeof(uint32_t) * table_size);
+    Obj_Corner* unique = (Obj_Corner*)malloc(sizeof(Obj_Corner) * corners.count);
+
+    source->index_count = corners.count;
+    source->indices = (uint32_t*)malloc(sizeof(uint32_t) * corners.count);
+    for (uint32_t i = 0; i < corners.count; i++) {
+        Obj_Corner corner = corners.data[i];
+        uint64_t key = ((uint64_t)(uint32_t)corner.position << 32) ^ ((uint64_t)(uint32_t)corner.uv << 16) ^ (uint32_t)corner.normal;
+        uint32_t slot = (uint32_t)hash_u64(key) & (table_size - 1);
+        while (table[slot] != UINT32_MAX) {
+            Obj_Corner other = unique[table[slot]];
+            if (other.position == corner.position && other.uv == corner.uv && other.normal == corner.normal) {
+                break;
+            }
+            slot = (slot + 1) & (table_size - 1);
+        }
+        if (table[slot] == UINT32_MAX) {
+            table[slot] = source->vertex_count;
+            unique[source->vertex_count++] = corner;
+        }
+        source->indices[i] = table[slot];
+    }
+    free(table);
+    free(corners.data);
+
+    uint32_t vertex_count = source->vertex_count;
+    source->positions = (float*)malloc(sizeof(float) * 3 * vertex_count);
+    source->normals = normals.count ? (float*)calloc(3 * vertex_count, sizeof(float)) : nullptr;
+    source->uvs = uvs.count ? (float*)calloc(2 * vertex_count, sizeof(float)) : nullptr;
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        Obj_Corner corner = unique[i];
+        memcpy(&source->positions[i * 3], &positions.data[corner.position * 3], sizeof(float) * 3);
+        if (source->normals && corner.normal >= 0) {
+            memcpy(&source->normals[i * 3], &normals.data[corner.normal * 3], sizeof(float) * 3);
+        }
+        if (source->uvs && corner.uv >= 0) {
+            memcpy(&source->uvs[i * 2], &uvs.data[corner.uv * 2], sizeof(float) * 2);
+        }
+    }
+    free(unique);
+    free(positions.data);
+    free(uvs.data);
+    free(normals.data);
+
+    LOG_INFO(LOG_CATEGORY_ASSETS, "• Loaded mesh %s (%u vertices, %u triangles).\n", path, vertex_count, source->index_count / 3);
+    return true;
+}
+
+void mesh_free_source(Mesh_Source* source) {
+    free(source->positions);
+    free(source->normals);
+    free(source->uvs);
+    free(source->indices);
+    *source = {};
+}
+
+// ---------------------------------------------------------------------------------------------
+// Geometry kernels
+
+static void compute_bounds(const float* positions, uint32_t vertex_count, float center[3], float* radius) {
+#if MESH_SIMD_SSE2
+    __m128 min = _mm_set1_ps(INFINITY);
+    __m128 max = _mm_set1_ps(-INFINITY);
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        const float* p = &positions[i * 3];
+        __m128 v = _mm_set_ps(0.0f, p[2], p[1], p[0]);
+        min = _mm_min_ps(min, v);
+        max = _mm_max_ps(max, v);
+    }
+    __m128 middle = _mm_mul_ps(_mm_add_ps(min, max), _mm_set1_ps(0.5f));
+    __m128 farthest = _mm_setzero_ps();
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        const float* p = &positions[i * 3];
+        __m128 d = _mm_sub_ps(_mm_set_ps(0.0f, p[2], p[1], p[0]), middle);
+        d = _mm_mul_ps(d, d);
+        // x + y + z lands in the low lane.
+        d = _mm_add_ps(d, _mm_shuffle_ps(d, d, _MM_SHUFFLE(2, 3, 0, 1)));
+        d = _mm_add_ss(d, _mm_movehl_ps(d, d));
+        farthest = _mm_max_ss(farthest, d);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, middle);
+    memcpy(center, lanes, sizeof(float) * 3);
+    *radius = sqrtf(_mm_cvtss_f32(farthest));
+#else
+    float min[3] = {INFINITY, INFINITY, INFINITY};
+    float max[3] = {-INFINITY, -INFINITY, -INFINITY};
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        for (uint32_t k = 0; k < 3; k++) {
+            min[k] = std::min(min[k], positions[i * 3 + k]);
+            max[k] = std::max(max[k], positions[i * 3 + k]);
+        }
+    }
+    float farthest = 0.0f;
+    for (uint32_t k = 0; k < 3; k++) {
+        center[k] = (min[k] + max[k]) * 0.5f;
+    }
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        const float* p = &positions[i * 3];
+        float dx = p[0] - center[0];
+        float dy = p[1] - center[1];
+        float dz = p[2] - center[2];
+        farthest = std::max(farthest, dx * dx + dy * dy + dz * dz);
+    }
+    *radius = sqrtf(farthest);
+#endif
+}
+
+// Area weighted vertex normals for sources without them. Expects counter-clockwise triangles.
+static float* compute_normals(const float* positions, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count) {
+    float* normals = (float*)calloc(vertex_count * 3, sizeof(float));
+    for (uint32_t i = 0; i + 2 < index_count; i += 3) {
+        const float* a = &positions[indices[i] * 3];
+        const float* b = &positions[indices[i + 1] * 3];
+        const float* c = &positions[indices[i + 2] * 3];
+        float e1[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float e2[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        float n[3] = {e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0]};
+        for (uint32_t k = 0; k < 3; k++) {
+            float* normal = &normals[indices[i + k] * 3];
+            normal[0] += n[0];
+            normal[1] += n[1];
+            normal[2] += n[2];
+        }
+    }
+    for (uint32_t i = 0; i < vertex_count; i++) {
+        float* n = &normals[i * 3];
+        float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (length > 0.0f) {
+            n[0] /= length;
+            n[1] /= length;
+            n[2] /= length;
+        }
+    }
+    return normals;
+}
+
+// Area weighted centroid and outward normal sums over clockwise triangles [begin, end).
+static void sum_triangles(const float* positions, const uint32_t* indices, uint32_t begin, uint32_t end, float centroid[3], float normal[3], float* area) {
+#if MESH_SIMD_SSE2
+    __m128 centroid_sum = _mm_setzero_ps();
+    __m128 normal_sum = _mm_setzero_ps();
+    __m128 area_sum = _mm_setzero_ps();
+    for (uint32_t t = begin; t < end; t++) {
+        const float* pa = &positions[indices[t * 3] * 3];
+        const float* pb = &positions[indices[t * 3 + 1] * 3];
+        const float* pc = &positions[indices[t * 3 + 2] * 3];
+        __m128 a = _mm_set_ps(0.0f, pa[2], pa[1], pa[0]);
+        __m128 b = _mm_set_ps(0.0f, pb[2], pb[1], pb[0]);
+        __m128 c = _mm_set_ps(0.0f, pc[2], pc[1], pc[0]);
+        // Clockwise, so (c - a) x (b - a) faces out.
+        __m128 u = _mm_sub_ps(c, a);
+        __m128 v = _mm_sub_ps(b, a);
+        __m128 u_yzx = _mm_shuffle_ps(u, u, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 v_yzx = _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 0, 2, 1));
+        __m128 n = _mm_sub_ps(_mm_mul_ps(u, v_yzx), _mm_mul_ps(u_yzx, v));
+        n = _mm_shuffle_ps(n, n, _MM_SHUFFLE(3, 0, 2, 1));
+
+        __m128 length = _mm_mul_ps(n, n);
+        length = _mm_add_ps(length, _mm_shuffle_ps(length, length, _MM_SHUFFLE(2, 3, 0, 1)));
+        length = _mm_add_ss(length, _mm_movehl_ps(length, length));
+        length = _mm_sqrt_ss(length);
+        __m128 weight = _mm_shuffle_ps(length, length, 0);
+
+        centroid_sum = _mm_add_ps(centroid_sum, _mm_mul_ps(_mm_add_ps(_mm_add_ps(a, b), c), weight));
+        normal_sum = _mm_add_ps(normal_sum, n);
+        area_sum = _mm_add_ss(area_sum, length);
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, centroid_sum);
+    memcpy(centroid, lanes, sizeof(float) * 3);
+    _mm_storeu_ps(lanes, normal_sum);
+    memcpy(normal, lanes, sizeof(float) * 3);
+    *area = _mm_cvtss_f32(area_sum);
+#else
+    centroid[0] = centroid[1] = centroid[2] = 0.0f;
+    normal[0] = normal[1] = normal[2] = 0.0f;
+    *area = 0.0f;
+    for (uint32_t t = begin; t < end; t++) {
+        const float* a = &positions[indices[t * 3] * 3];
+        const float* b = &positions[indices[t * 3 + 1] * 3];
+        const float* c = &positions[indices[t * 3 + 2] * 3];
+        float u[3] = {c[0] - a[0], c[1] - a[1], c[2] - a[2]};
+        float v[3] = {b[0] - a[0], b[1] - a[1], b[2] - a[2]};
+        float n[3] = {u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+        float weight = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        for (uint32_t k = 0; k < 3; k++) {
+            centroid[k] += (a[k] + b[k] + c[k]) * weight;
+            normal[k] += n[k];
+        }
+        *area += weight;
+    }
+#endif
+    // The weights were twice the area and each centroid three times too large, both cancel out.
+    if (*area > 0.0f) {
+        for (uint32_t k = 0; k < 3; k++) {
+            centroid[k] /= *area * 3.0f;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+// Vertex cache and overdraw
+
+// Post-transform FIFO cache. `timestamps` holds one zeroed entry per vertex and is left marking
+// every vertex referenced. Returns the misses, i.e. vertex shader invocations.
+static uint32_t simulate_vertex_cache(const uint32_t* indices, uint32_t index_count, uint32_t cache_size, uint32_t* timestamps) {
+    uint32_t time = cache_size + 1;
+    uint32_t misses = 0;
+    for (uint32_t i = 0; i < index_count; i++) {
+        uint32_t vertex = indices[i];
+        if (time - timestamps[vertex] > cache_size) {
+            timestamps[vertex] = time++;
+            misses++;
+        }
+    }
+    return misses;
+}
+
+struct Cache_Scores {
+    float cache[MAX_CACHE_SIZE + 3];
+    float valence[MAX_VALENCE_SCORE];
+};
+
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation" scoring.
+static void init_cache_scores(Cache_Scores* scores, uint32_t cache_size) {
+    for (uint32_t i = 0; i < MAX_CACHE_SIZE + 3; i++) {
+        if (i < 3) {
+            scores->cache[i] = 0.75f;   // the last triangle, a fixed score discourages strips
+        } else if (i < cache_size) {
+            scores->cache[i] = powf(1.0f - (float)(i - 3) / (float)(cache_size - 3), 1.5f);
+        } else {
+            scores->cache[i] = 0.0f;
+        }
+    }
+    scores->valence[0] = 0.0f;
+    for (uint32_t i = 1; i < MAX_VALENCE_SCORE; i++) {
+        scores->valence[i] = 2.0f / sqrtf((float)i);
+    }
+}
+
+static float vertex_score(const Cache_Scores* scores, int32_t cache_position, uint32_t valence) {
+    if (valence == 0) {
+        return -1.0f;
+    }
+    float score = cache_position >= 0 ? scores->cache[cache_position] : 0.0f;
+    return score + scores->valence[std::min(valence, MAX_VALENCE_SCORE - 1)];
+}
+
+static void optimize_vertex_cache(uint32_t* indices, uint32_t index_count, uint32_t vertex_count, uint32_t cache_size) {
+    uint32_t triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return;
+    }
+    Cache_Scores scores;
+    init_cache_scores(&scores, cache_size);
+
+    // Triangles around each vertex. `valence` counts the ones not yet emitted, which stay at the
+    // front of the vertex's adjacency range.
+    uint32_t* valence = (uint32_t*)calloc(vertex_count, sizeof(uint32_t));
+    uint32_t* offsets = (uint32_t*)malloc(sizeof(uint32_t) * vertex_count);
+    uint32_t* adjacency = (uint32_t*)malloc(sizeof(uint32_t) * index_count);
+    for (uint32_t i = 0; i < index_count; i++) {
+        valence[indices[i]]++;
+    }
+    uint32_t offset = 0;
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        offsets[v] = offset;
+        offset += valence[v];
+        valence[v] = 0;
+    }
+    for (uint32_t i = 0; i < index_count; i++) {
+        uint32_t v = indices[i];
+        adjacency[offsets[v] + valence[v]++] = i / 3;
+    }
+
+    int32_t* cache_position = (int32_t*)malloc(sizeof(int32_t) * vertex_count);
+    float* vertex_scores = (float*)malloc(sizeof(float) * vertex_count);
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        cache_position[v] = -1;
+        vertex_scores[v] = vertex_score(&scores, -1, valence[v]);
+    }
+
+    float* triangle_scores = (float*)malloc(sizeof(float) * triangle_count);
+    uint8_t* emitted = (uint8_t*)calloc(triangle_count, 1);
+    uint32_t best = 0;
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        triangle_scores[t] = vertex_scores[indices[t * 3]] + vertex_scores[indices[t * 3 + 1]] + vertex_scores[indices[t * 3 + 2]];
+        if (triangle_scores[t] > triangle_scores[best]) {
+            best = t;
+        }
+    }
+
+    uint32_t* output = (uint32_t*)malloc(sizeof(uint32_t) * index_count);
+    uint32_t cache[MAX_CACHE_SIZE + 3];
+    uint32_t cache_count = 0;
+    uint32_t dead_end_cursor = 0;
+
+    for (uint32_t emitted_count = 0; emitted_count < triangle_count; emitted_count++) {
+        if (best == UINT32_MAX) {
+            // Nothing in the cache has triangles left, carry on in input order.
+            while (emitted[dead_end_cursor]) {
+                dead_end_cursor++;
+            }
+            best = dead_end_cursor;
+        }
+        const uint32_t* triangle = &indices[best * 3];
+        memcpy(&output[emitted_count * 3], triangle, sizeof(uint32_t) * 3);
+        emitted[best] = 1;
+
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = triangle[k];
+            uint32_t* list = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < valence[v]; j++) {
+                if (list[j] == best) {
+                    list[j] = list[valence[v] - 1];
+                    break;
+                }
+            }
+            valence[v]--;
+        }
+
+        // The triangle's vertices move to the front, whatever falls off the end is evicted.
+        uint32_t new_cache[MAX_CACHE_SIZE + 3];
+        uint32_t new_count = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            if ((k == 0 || triangle[k] != triangle[0]) && (k < 2 || triangle[k] != triangle[1])) {
+                new_cache[new_count++] = triangle[k];
+            }
+        }
+        for (uint32_t i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) {
+                new_cache[new_count++] = v;
+            }
+        }
+
+        for (uint32_t i = 0; i < new_count; i++) {
+            uint32_t v = new_cache[i];
+            cache_position[v] = i < cache_size ? (int32_t)i : -1;
+            float score = vertex_score(&scores, cache_position[v], valence[v]);
+            float delta = score - vertex_scores[v];
+            vertex_scores[v] = score;
+            const uint32_t* list = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < valence[v]; j++) {
+                triangle_scores[list[j]] += delta;
+            }
+        }
+        cache_count = std::min(new_count, cache_size);
+        memcpy(cache, new_cache, sizeof(uint32_t) * cache_count);
+
+        best = UINT32_MAX;
+        float best_score = -INFINITY;
+        for (uint32_t i = 0; i < cache_count; i++) {
+            uint32_t v = cache[i];
+            const uint32_t* list = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < valence[v]; j++) {
+                if (triangle_scores[list[j]] > best_score) {
+                    best_score = triangle_scores[list[j]];
+                    best = list[j];
+                }
+            }
+        }
+    }
+
+    memcpy(indices, output, sizeof(uint32_t) * index_count);
+    free(output);
+    free(emitted);
+    free(triangle_scores);
+    free(vertex_scores);
+    free(cache_position);
+    free(adjacency);
+    free(offsets);
+    free(valence);
+}
+
+// Cuts the cache optimized order into clusters (Sander et al., "Fast Triangle Reordering for
+// Vertex Locality and Reduced Overdraw"), then draws clusters that sit further out along their
+// own normal first, since they tend to cover the rest. Returns the cluster count.
+static uint32_t optimize_overdraw(uint32_t* indices, uint32_t index_count, const float* positions, uint32_t vertex_count,
+    const float center[3], const Mesh_Build_Config* config) {
+    uint32_t triangle_count = index_count / 3;
+    if (triangle_count == 0) {
+        return 0;
+    }
+
+    uint32_t* timestamps = (uint32_t*)calloc(vertex_count, sizeof(uint32_t));
+    float level_acmr = (float)simulate_vertex_cache(indices, index_count, config->cache_size, timestamps) / triangle_count;
+    memset(timestamps, 0, sizeof(uint32_t) * vertex_count);
+
+    uint32_t* cluster_starts = (uint32_t*)malloc(sizeof(uint32_t) * (triangle_count + 1));
+    uint32_t cluster_count = 0;
+    cluster_starts[cluster_count++] = 0;
+    uint32_t cluster_misses = 0;
+    uint32_t time = config->cache_size + 1;
+    for (uint32_t t = 0; t < triangle_count; t++) {
+        uint32_t misses = 0;
+        for (uint32_t k = 0; k < 3; k++) {
+            uint32_t v = indices[t * 3 + k];
+            if (time - timestamps[v] > config->cache_size) {
+                timestamps[v] = time++;
+                misses++;
+            }
+        }
+        uint32_t length = t - cluster_starts[cluster_count - 1];
+        if (length >= config->overdraw_cluster_triangles &&
+            (misses == 3 || cluster_misses <= config->overdraw_threshold * level_acmr * length)) {
+            cluster_starts[cluster_count++] = t;
+            cluster_misses = 0;
+        }
+        cluster_misses += misses;
+    }
+    cluster_starts[cluster_count] = triangle_count;
+    free(timestamps);
+
+    uint32_t* keys = (uint32_t*)malloc(sizeof(uint32_t) * cluster_count * 3);
+    uint32_t* order = keys + cluster_count;
+    uint32_t* scratch = order + cluster_count;
+    for (uint32_t c = 0; c < cluster_count; c++) {
+        float centroid[3];
+        float normal[3];
+        float area;
+        sum_triangles(positions, indices, cluster_starts[c], cluster_starts[c + 1], centroid, normal, &area);
+        float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+        float distance = 0.0f;
+        if (length > 0.0f) {
+            distance = ((centroid[0] - center[0]) * normal[0] + (centroid[1] - center[1]) * normal[1] + (centroid[2] - center[2]) * normal[2]) / length;
+        }
+        // Descending distance.
+        keys[c] = sortable_float(-distance);
+    }
+    radix_sort_keys(cluster_count, keys, order, scratch);
+
+    uint32_t* output = (uint32_t*)malloc(sizeof(uint32_t) * index_count);
+    uint32_t written = 0;
+    for (uint32_t i = 0; i < cluster_count; i++) {
+        uint32_t c = order[i];
+        uint32_t count = (cluster_starts[c + 1] - cluster_starts[c]) * 3;
+        memcpy(&output[written], &indices[cluster_starts[c] * 3], sizeof(uint32_t) * count);
+        written += count;
+    }
+    memcpy(indices, output, sizeof(uint32_t) * index_count);
+
+    free(output);
+    free(keys);
+    free(cluster_starts);
+    return cluster_count;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Levels of detail
+
+struct Cluster_Scratch {
+    uint32_t table_size;
+    uint64_t* table_keys;
+    uint32_t* table_cells;
+    uint32_t* vertex_cells;
+    float* cell_sums;           // xyz sum and count per cell
+    uint32_t* representatives;
+    float* best_distances;
+};
+
+// Snaps every vertex to the most central vertex of its grid cell and drops the triangles that
+// collapse. Writes the surviving indices and returns their count. `error` gets the largest snap.
+static uint32_t cluster_vertices(const float* positions, uint32_t vertex_count, const uint32_t* indices, uint32_t index_count,
+    const float min[3], float cell_size, uint32_t grid, Cluster_Scratch* scratch, uint32_t* output, float* error) {
+    memset(scratch->table_keys, 0xff, sizeof(uint64_t) * scratch->table_size);
+    uint32_t cell_count = 0;
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        const float* p = &positions[v * 3];
+        uint64_t cell_coordinates[3];
+        for (uint32_t k = 0; k < 3; k++) {
+            float cell = (p[k] - min[k]) / cell_size;
+            cell_coordinates[k] = std::min((uint64_t)std::max(cell, 0.0f), (uint64_t)grid - 1);
+        }
+        uint64_t key = (cell_coordinates[0] * grid + cell_coordinates[1]) * grid + cell_coordinates[2];
+        uint32_t slot = (uint32_t)hash_u64(key) & (scratch->table_size - 1);
+        while (scratch->table_keys[slot] != UINT64_MAX && scratch->table_keys[slot] != key) {
+            slot = (slot + 1) & (scratch->table_size - 1);
+        }
+        if (scratch->table_keys[slot] == UINT64_MAX) {
+            scratch->table_keys[slot] = key;
+            scratch->table_cells[slot] = cell_count;
+            memset(&scratch->cell_sums[cell_count * 4], 0, sizeof(float) * 4);
+            scratch->best_distances[cell_count] = INFINITY;
+            cell_count++;
+        }
+        uint32_t cell = scratch->table_cells[slot];
+        scratch->vertex_cells[v] = cell;
+        float* sum = &scratch->cell_sums[cell * 4];
+        sum[0] += p[0];
+        sum[1] += p[1];
+        sum[2] += p[2];
+        sum[3] += 1.0f;
+    }
+
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        uint32_t cell = scratch->vertex_cells[v];
+        const float* sum = &scratch->cell_sums[cell * 4];
+        const float* p = &positions[v * 3];
+        float dx = p[0] - sum[0] / sum[3];
+        float dy = p[1] - sum[1] / sum[3];
+        float dz = p[2] - sum[2] / sum[3];
+        float distance = dx * dx + dy * dy + dz * dz;
+        if (distance < scratch->best_distances[cell]) {
+            scratch->best_distances[cell] = distance;
+            scratch->representatives[cell] = v;
+        }
+    }
+
+    float largest = 0.0f;
+    for (uint32_t v = 0; v < vertex_count; v++) {
+        const float* p = &positions[v * 3];
+        const float* r = &positions[scratch->representatives[scratch->vertex_cells[v]] * 3];
+        float dx = p[0] - r[0];
+        float dy = p[1] - r[1];
+        float dz = p[2] - r[2];
+        largest = std::max(largest, dx * dx + dy * dy + dz * dz);
+    }
+    *error = sqrtf(largest);
+
+    uint32_t count = 0;
+    for (uint32_t i = 0; i + 2 < index_count; i += 3) {
+        uint32_t a = scratch->representatives[scratch->vertex_cells[indices[i]]];
+        uint32_t b = scratch->representatives[scratch->vertex_cells[indices[i + 1]]];
+        uint32_t c = scratch->representatives[scratch->vertex_cells[indices[i + 2]]];
+        if (a != b && b != c && a != c) {
+            output[count++] = a;
+            output[count++] = b;
+            output[count++] = c;
+        }
+    }
+    return count;
+}
+
+struct Lod_Build {
+    uint32_t* indices;
+    uint32_t index_count;
+    float error;
+    Mesh_Lod_Report report;
+};
+
+struct Lod_Job {
+    const Mesh_Build_Config* config;
+    const float* positions;
+    uint32_t vertex_count;
+    const uint32_t* indices;    // clockwise source
+    uint32_t index_count;
+    float min[3];
+    float extent;
+    float center[3];
+    float radius;
+    Lod_Build lods[MAX_MESH_LODS];
+};
+
+// Grid sizes are searched for, the triangle count a grid leaves depends on the surface. Keeps
+// the result closest to the target without overshooting it by much.
+static void simplify_level(Lod_Job* job, uint32_t level, Lod_Build* lod) {
+    uint32_t source_triangles = job->index_count / 3;
+    uint32_t target = std::max(1u, (uint32_t)(source_triangles * powf(job->config->lod_triangle_ratio, (float)level)));
+
+    Cluster_Scratch scratch;
+    scratch.table_size = next_power_of_two(job->vertex_count * 2);
+    scratch.table_keys = (uint64_t*)malloc(sizeof(uint64_t) * scratch.table_size);
+    scratch.table_cells = (uint32_t*)malloc(sizeof(uint32_t) * scratch.table_size);
+    scratch.vertex_cells = (uint32_t*)malloc(sizeof(uint32_t) * job->vertex_count);
+    scratch.cell_sums = (float*)malloc(sizeof(float) * 4 * job->vertex_count);
+    scratch.representatives = (uint32_t*)malloc(sizeof(uint32_t) * job->vertex_count);
+    scratch.best_distances = (float*)malloc(sizeof(float) * job->vertex_count);
+
+    uint32_t* attempt = (uint32_t*)malloc(sizeof(uint32_t) * job->index_count);
+    lod->indices = (uint32_t*)malloc(sizeof(uint32_t) * job->index_count);
+    lod->index_count = UINT32_MAX;
+
+    uint32_t grid = std::max(2u, (uint32_t)sqrtf(target * 0.5f));
+    for (uint32_t i = 0; i < SIMPLIFY_ATTEMPTS; i++) {
+        float error;
+        uint32_t count = cluster_vertices(job->positions, job->vertex_count, job->indices, job->index_count,
+            job->min, job->extent / grid, grid, &scratch, attempt, &error);
+        uint32_t triangles = count / 3;
+
+        bool fits = triangles <= target + target / 4;
+        bool kept_fits = lod->index_count / 3 <= target + target / 4;
+        bool better = lod->index_count == UINT32_MAX || (fits && (!kept_fits || count > lod->index_count)) ||
+            (!fits && !kept_fits && count < lod->index_count);
+        if (better) {
+            std::swap(attempt, lod->indices);
+            lod->index_count = count;
+            lod->error = error / job->radius;
+        }
+        if (fits && triangles >= target - target / 5) {
+            break;
+        }
+
+        float scale = sqrtf((float)target / (float)std::max(triangles, 1u));
+        uint32_t next_grid = std::clamp((uint32_t)(grid * scale), 1u, 1u << 16);
+        if (next_grid == grid) {
+            next_grid = scale > 1.0f ? grid + 1 : grid - 1;
+        }
+        if (next_grid == 0) {
+            break;
+        }
+        grid = next_grid;
+    }
+
+    free(attempt);
+    free(scratch.table_keys);
+    free(scratch.table_cells);
+    free(scratch.vertex_cells);
+    free(scratch.cell_sums);
+    free(scratch.representatives);
+    free(scratch.best_distances);
+}
+
+static void build_lod(uint32_t level, uint32_t, void* data) {
+    Lod_Job* job = (Lod_Job*)data;
+    Lod_Build* lod = &job->lods[level];
+    const Mesh_Build_Config* config = job->config;
+
+    if (level == 0) {
+        lod->indices = (uint32_t*)malloc(sizeof(uint32_t) * job->index_count);
+        memcpy(lod->indices, job->indices, sizeof(uint32_t) * job->index_count);
+        lod->index_count = job->index_count;
+        lod->error = 0.0f;
+    } else {
+        simplify_level(job, level, lod);
+    }
+
+    uint32_t triangles = lod->index_count / 3;
+    uint32_t* timestamps = (uint32_t*)calloc(job->vertex_count, sizeof(uint32_t));
+    uint32_t misses_before = simulate_vertex_cache(lod->indices, lod->index_count, config->cache_size, timestamps);
+
+    optimize_vertex_cache(lod->indices, lod->index_count, job->vertex_count, config->cache_size);
+    lod->report.overdraw_clusters = optimize_overdraw(lod->indices, lod->index_count, job->positions, job->vertex_count,
+        job->center, config);
+
+    memset(timestamps, 0, sizeof(uint32_t) * job->vertex_count);
+    uint32_t misses = simulate_vertex_cache(lod->indices, lod->index_count, config->cache_size, timestamps);
+    uint32_t referenced = 0;
+    for (uint32_t v = 0; v < job->vertex_count; v++) {
+        referenced += timestamps[v] != 0;
+    }
+    free(timestamps);
+
+    lod->report.triangle_count = triangles;
+    lod->report.acmr_before = triangles ? (float)misses_before / triangles : 0.0f;
+    lod->report.acmr = triangles ? (float)misses / triangles : 0.0f;
+    lod->report.atvr = referenced ? (float)misses / referenced : 0.0f;
+}
+
+// Bytes pulled through a small vertex cache to draw the indices once, post-transform cache
+// misses only. `timestamps` holds one zeroed entry per vertex.
+static uint64_t simulate_vertex_fetch(const uint32_t* indices, uint32_t index_count, uint32_t cache_size, uint32_t stride, uint32_t* timestamps) {
+    uint64_t tags[FETCH_CACHE_LINES];
+    memset(tags, 0xff, sizeof(tags));
+    uint64_t bytes = 0;
+    uint32_t time = cache_size + 1;
+    for (uint32_t i = 0; i < index_count; i++) {
+        uint32_t vertex = indices[i];
+        if (time - timestamps[vertex] <= cache_size) {
+            continue;
+        }
+        timestamps[vertex] = time++;
+        uint64_t first_line = (uint64_t)vertex * stride / FETCH_LINE_SIZE;
+        uint64_t last_line = ((uint64_t)vertex * stride + stride - 1) / FETCH_LINE_SIZE;
+        for (uint64_t line = first_line; line <= last_line; line++) {
+            uint64_t* tag = &tags[line % FETCH_CACHE_LINES];
+            if (*tag != line) {
+                *tag = line;
+                bytes += FETCH_LINE_SIZE;
+            }
+        }
+    }
+    return bytes;
+}
+
+// ---------------------------------------------------------------------------------------------
+// Quantization
+
+struct Quantize_Job {
+    const float* positions;
+    const float* normals;
+    const float* uvs;
+    const uint32_t* order;      // new vertex -> source vertex
+    uint32_t vertex_count;
+    float center[3];
+    float scale;                // 1 / radius
+    Mesh_Vertex* vertices;
+};
+
+static int16_t quantize_snorm16(float value) {
+    value = std::clamp(value, -1.0f, 1.0f);
+    return (int16_t)lrintf(value * 32767.0f);
+}
+
+// Round to nearest even, with subnormals, infinities and NaN.
+static uint16_t float_to_half(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = (bits >> 16) & 0x8000;
+    uint32_t biased = (bits >> 23) & 0xff;
+    uint32_t mantissa = bits & 0x7fffff;
+    if (biased == 0xff) {
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    }
+    int32_t exponent = (int32_t)biased - 127 + 15;
+    if (exponent >= 31) {
+        return sign | 0x7c00;
+    }
+    if (exponent <= 0) {
+        if (exponent < -10) {
+            return sign;
+        }
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1))) {
+            half++;
+        }
+        return sign | half;
+    }
+    // A carry out of the mantissa bumps the exponent, which is the correct rounding.
+    uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+    uint32_t rest = mantissa & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        half++;
+    }
+    return half;
+}
+
+// Octahedral: project onto |x| + |y| + |z| = 1 and fold the lower half over the diagonals.
+static void encode_octahedral(const float* n, int16_t out[2]) {
+    float length = std::max(fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]), 1e-20f);
+    float x = n[0] / length;
+    float y = n[1] / length;
+    if (n[2] < 0.0f) {
+        float folded_x = copysignf(1.0f - fabsf(y), x);
+        float folded_y = copysignf(1.0f - fabsf(x), y);
+        x = folded_x;
+        y = folded_y;
+    }
+    out[0] = quantize_snorm16(x);
+    out[1] = quantize_snorm16(y);
+}
+
+static void quantize_position(const Quantize_Job* job, uint32_t i) {
+    const float* p = &job->positions[job->order[i] * 3];
+    int16_t* out = job->vertices[i].position;
+#if MESH_SIMD_SSE2
+    __m128 v = _mm_set_ps(0.0f, p[2], p[1], p[0]);
+    v = _mm_mul_ps(_mm_sub_ps(v, _mm_set_ps(0.0f, job->center[2], job->center[1], job->center[0])), _mm_set1_ps(job->scale));
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-1.0f)), _mm_set1_ps(1.0f));
+    __m128i q = _mm_cvtps_epi32(_mm_mul_ps(v, _mm_set1_ps(32767.0f)));
+    _mm_storel_epi64((__m128i*)out, _mm_packs_epi32(q, q));
+#else
+    for (uint32_t k = 0; k < 3; k++) {
+        out[k] = quantize_snorm16((p[k] - job->center[k]) * job->scale);
+    }
+    out[3] = 0;
+#endif
+}
+
+#if MESH_SIMD_SSE2
+// Four normals at a time, the same math as encode_octahedral() in lanes.
+static void encode_normals_sse2(const Quantize_Job* job, uint32_t i) {
+    const float* n[4];
+    for (uint32_t k = 0; k < 4; k++) {
+        n[k] = &job->normals[job->order[i + k] * 3];
+    }
+    __m128 x = _mm_set_ps(n[3][0], n[2][0], n[1][0], n[0][0]);
+    __m128 y = _mm_set_ps(n[3][1], n[2][1], n[1][1], n[0][1]);
+    __m128 z = _mm_set_ps(n[3][2], n[2][2], n[1][2], n[0][2]);
+
+    __m128 sign_mask = _mm_set1_ps(-0.0f);
+    __m128 one = _mm_set1_ps(1.0f);
+    __m128 length = _mm_add_ps(_mm_add_ps(_mm_andnot_ps(sign_mask, x), _mm_andnot_ps(sign_mask, y)), _mm_andnot_ps(sign_mask, z));
+    length = _mm_max_ps(length, _mm_set1_ps(1e-20f));
+    x = _mm_div_ps(x, length);
+    y = _mm_div_ps(y, length);
+
+    __m128 folded_x = _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, y)), _mm_and_ps(x, sign_mask));
+    __m128 folded_y = _mm_or_ps(_mm_sub_ps(one, _mm_andnot_ps(sign_mask, x)), _mm_and_ps(y, sign_mask));
+    __m128 lower = _mm_cmplt_ps(z, _mm_setzero_ps());
+    x = _mm_or_ps(_mm_and_ps(lower, folded_x), _mm_andnot_ps(lower, x));
+    y = _mm_or_ps(_mm_and_ps(lower, folded_y), _mm_andnot_ps(lower, y));
+
+    __m128 scale = _mm_set1_ps(32767.0f);
+    __m128i ix = _mm_cvtps_epi32(_mm_mul_ps(x, scale));
+    __m128i iy = _mm_cvtps_epi32(_mm_mul_ps(y, scale));
+    __m128i packed = _mm_packs_epi32(_mm_unpacklo_epi32(ix, iy), _mm_unpackhi_epi32(ix, iy));
+
+    uint32_t words[4];
+    _mm_storeu_si128((__m128i*)words, packed);
+    for (uint32_t k = 0; k < 4; k++) {
+        memcpy(job->vertices[i + k].normal, &words[k], sizeof(uint32_t));
+    }
+}
+#endif
+
+#if MESH_SIMD_AVX2
+// Eight normals at a time. Unpack and pack work within 128-bit lanes, which keeps the output in
+// vertex order: lane 0 holds vertices 0-3, lane 1 vertices 4-7.
+static void encode_normals_avx2(const Quantize_Job* job, uint32_t i) {
+    const float* n[8];
+    for (uint32_t k = 0; k < 8; k++) {
+        n[k] = &job->normals[job->order[i + k] * 3];
+    }
+    __m256 x = _mm256_set_ps(n[7][0], n[6][0], n[5][0], n[4][0], n[3][0], n[2][0], n[1][0], n[0][0]);
+    __m256 y = _mm256_set_ps(n[7][1], n[6][1], n[5][1], n[4][1], n[3][1], n[2][1], n[1][1], n[0][1]);
+    __m256 z = _mm256_set_ps(n[7][2], n[6][2], n[5][2], n[4][2], n[3][2], n[2][2], n[1][2], n[0][2]);
+
+    __m256 sign_mask = _mm256_set1_ps(-0.0f);
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 length = _mm256_add_ps(_mm256_add_ps(_mm256_andnot_ps(sign_mask, x), _mm256_andnot_ps(sign_mask, y)), _mm256_andnot_ps(sign_mask, z));
+    length = _mm256_max_ps(length, _mm256_set1_ps(1e-20f));
+    x = _mm256_div_ps(x, length);
+    y = _mm256_div_ps(y, length);
+
+    __m256 folded_x = _mm256_or_ps(_mm256_sub_ps(one, _mm256_andnot_ps(sign_mask, y)), _mm256_and_ps(x, sign_mask));
+    __m256 folded_y = _mm256_or_ps(_mm256_sub_ps(one, _mm256_andnot_ps(sign_mask, x)), _mm256_and_ps(y, sign_mask));
+    __m256 lower = _mm256_cmp_ps(z, _mm256_setzero_ps(), _CMP_LT_OQ);
+    x = _mm256_blendv_ps(x, folded_x, lower);
+    y = _mm256_blendv_ps(y, folded_y, lower);
+
+    __m256 scale = _mm256_set1_ps(32767.0f);
+    __m256i ix = _mm256_cvtps_epi32(_mm256_mul_ps(x, scale));
+    __m256i iy = _mm256_cvtps_epi32(_mm256_mul_ps(y, scale));
+    __m256i packed = _mm256_packs_epi32(_mm256_unpacklo_epi32(ix, iy), _mm256_unpackhi_epi32(ix, iy));
+
+    uint32_t words[8];
+    _mm256_storeu_si256((__m256i*)words, packed);
+    for (uint32_t k = 0; k < 8; k++) {
+        memcpy(job->vertices[i + k].normal, &words[k], sizeof(uint32_t));
+    }
+}
+
+// Four texture coordinates through F16C.
+static void encode_uvs_f16c(const Quantize_Job* job, uint32_t i) {
+    const float* uv[4];
+    for (uint32_t k = 0; k < 4; k++) {
+        uv[k] = &job->uvs[job->order[i + k] * 2];
+    }
+    __m256 values = _mm256_set_ps(uv[3][1], uv[3][0], uv[2][1], uv[2][0], uv[1][1], uv[1][0], uv[0][1], uv[0][0]);
+    __m128i halves = _mm256_cvtps_ph(values, _MM_FROUND_TO_NEAREST_INT);
+
+    uint32_t words[4];
+    _mm_storeu_si128((__m128i*)words, halves);
+    for (uint32_t k = 0; k < 4; k++) {
+        memcpy(job->vertices[i + k].uv, &words[k], sizeof(uint32_t));
+    }
+}
+#endif
+
+static void quantize_chunk(uint32_t index, uint32_t, void* data) {
+    Quantize_Job* job = (Quantize_Job*)data;
+    uint32_t begin = index * QUANTIZE_CHUNK;
+    uint32_t end = std::min(begin + QUANTIZE_CHUNK, job->vertex_count);
+
+    for (uint32_t i = begin; i < end; i++) {
+        quantize_position(job, i);
+    }
+
+    uint32_t i = begin;
+#if MESH_SIMD_AVX2
+    for (; i + 8 <= end; i += 8) {
+        encode_normals_avx2(job, i);
+    }
+#endif
+#if MESH_SIMD_SSE2
+    for (; i + 4 <= end; i += 4) {
+        encode_normals_sse2(job, i);
+    }
+#endif
+    for (; i < end; i++) {
+        encode_octahedral(&job->normals[job->order[i] * 3], job->vertices[i].normal);
+    }
+
+    if (!job->uvs) {
+        for (i = begin; i < end; i++) {
+            job->vertices[i].uv[0] = 0;
+            job->vertices[i].uv[1] = 0;
+        }
+        return;
+    }
+    i = begin;
+#if MESH_SIMD_AVX2
+    for (; i + 4 <= end; i += 4) {
+        encode_uvs_f16c(job, i);
+    }
+#endif
+    for (; i < end; i++) {
+        const float* uv = &job->uvs[job->order[i] * 2];
+        job->vertices[i].uv[0] = float_to_half(uv[0]);
+        job->vertices[i].uv[1] = float_to_half(uv[1]);
+    }
+}
+
+// ---------------------------------------------------------------------------------------------
+
+void mesh_build(const Mesh_Source* source, const Mesh_Build_Config* config, Mesh* mesh) {
+    PROFILE_SCOPE("mesh_build");
+    *mesh = {};
+
+    Mesh_Build_Config clamped = *config;
+    clamped.lod_count = std::clamp(config->lod_count, 1u, MAX_MESH_LODS);
+    clamped.cache_size = std::clamp(config->cache_size, 4u, MAX_CACHE_SIZE);
+    config = &clamped;
+
+    uint32_t vertex_count = source->vertex_count;
+    uint32_t index_count = source->index_count / 3 * 3;
+
+    compute_bounds(source->positions, vertex_count, mesh->center, &mesh->radius);
+    if (mesh->radius <= 0.0f) {
+        mesh->radius = 1.0f;
+    }
+    float* computed_normals = source->normals ? nullptr : compute_normals(source->positions, vertex_count, source->indices, index_count);
+    const float* normals = source->normals ? source->normals : computed_normals;
+
+    Lod_Job* job = new Lod_Job();
+    job->config = config;
+    job->positions = source->positions;
+    job->vertex_count = vertex_count;
+    job->index_count = index_count;
+    job->radius = mesh->radius;
+    memcpy(job->center, mesh->center, sizeof(job->center));
+    // The clustering grid is a cube around the bounding sphere.
+    for (uint32_t k = 0; k < 3; k++) {
+        job->min[k] = mesh->center[k] - mesh->radius;
+    }
+    job->extent = mesh->radius * 2.0f;
+
+    uint32_t* clockwise = (uint32_t*)malloc(sizeof(uint32_t) * index_count);
+    for (uint32_t i = 0; i < index_count; i += 3) {
+        clockwise[i] = source->indices[i];
+        clockwise[i + 1] = source->indices[i + 2];
+        clockwise[i + 2] = source->indices[i + 1];
+    }
+    job->indices = clockwise;
+
+    uint64_t lod_begin_ns = profiler_now_ns();
+    jobs_parallel_for(config->lod_count, build_lod, job);
+    mesh->report.lod_ms = (profiler_now_ns() - lod_begin_ns) / 1e6;
+    free(clockwise);
+
+    // Keep levels that actually got coarser.
+    uint32_t kept[MAX_MESH_LODS];
+    uint32_t kept_count = 0;
+    for (uint32_t level = 0; level < config->lod_count; level++) {
+        Lod_Build* lod = &job->lods[level];
+        if (level == 0 || (lod->index_count > 0 && lod->index_count < job->lods[kept[kept_count - 1]].index_count * 9 / 10)) {
+            kept[kept_count++] = level;
+        }
+    }
+
+    // Vertices in order of first use, finest level first. Unreferenced ones are dropped.
+    uint32_t* remap = (uint32_t*)malloc(sizeof(uint32_t) * vertex_count);
+    uint32_t* order = (uint32_t*)malloc(sizeof(uint32_t) * vertex_count);
+    memset(remap, 0xff, sizeof(uint32_t) * vertex_count);
+    uint32_t used_count = 0;
+    uint32_t total_indices = 0;
+    for (uint32_t i = 0; i < kept_count; i++) {
+        Lod_Build* lod = &job->lods[kept[i]];
+        for (uint32_t k = 0; k < lod->index_count; k++) {
+            uint32_t v = lod->indices[k];
+            if (remap[v] == UINT32_MAX) {
+                order[used_count] = v;
+                remap[v] = used_count++;
+            }
+        }
+        total_indices += lod->index_count;
+    }
+
+    mesh->indices = (uint32_t*)malloc(sizeof(uint32_t) * std::max(total_indices, 1u));
+    mesh->index_count = total_indices;
+    mesh->lod_count = kept_count;
+    uint32_t first_index = 0;
+    for (uint32_t i = 0; i < kept_count; i++) {
+        Lod_Build* lod = &job->lods[kept[i]];
+        for (uint32_t k = 0; k < lod->index_count; k++) {
+            mesh->indices[first_index + k] = remap[lod->indices[k]];
+        }
+        mesh->lods[i] = {first_index, lod->index_count, lod->error};
+        mesh->report.lods[i] = lod->report;
+        first_index += lod->index_count;
+    }
+    for (uint32_t level = 0; level < config->lod_count; level++) {
+        free(job->lods[level].indices);
+    }
+    delete job;
+    free(remap);
+
+    uint64_t quantize_begin_ns = profiler_now_ns();
+    mesh->vertex_count = used_count;
+    mesh->vertices = (Mesh_Vertex*)malloc(sizeof(Mesh_Vertex) * std::max(used_count, 1u));
+    Quantize_Job quantize_job;
+    quantize_job.positions = source->positions;
+    quantize_job.normals = normals;
+    quantize_job.uvs = source->uvs;
+    quantize_job.order = order;
+    quantize_job.vertex_count = used_count;
+    memcpy(quantize_job.center, mesh->center, sizeof(quantize_job.center));
+    quantize_job.scale = 1.0f / mesh->radius;
+    quantize_job.vertices = mesh->vertices;
+    jobs_parallel_for((used_count + QUANTIZE_CHUNK - 1) / QUANTIZE_CHUNK, quantize_chunk, &quantize_job);
+    mesh->report.quantize_ms = (profiler_now_ns() - quantize_begin_ns) / 1e6;
+    free(order);
+    free(computed_normals);
+
+    Mesh_Report* report = &mesh->report;
+    report->vertex_count = used_count;
+    report->vertex_bytes = used_count * sizeof(Mesh_Vertex);
+    report->source_vertex_bytes = used_count * sizeof(float) * (source->uvs ? 8 : 6);
+    report->index_bytes = total_indices * sizeof(uint32_t);
+    report->position_step = mesh->radius / 32767.0f;
+    report->lod_count = kept_count;
+#if MESH_SIMD_AVX2
+    report->simd = "AVX2/F16C";
+#elif MESH_SIMD_SSE2
+    report->simd = "SSE2";
+#else
+    report->simd = "scalar";
+#endif
+
+    uint32_t* timestamps = (uint32_t*)malloc(sizeof(uint32_t) * std::max(used_count, 1u));
+    for (uint32_t i = 0; i < kept_count; i++) {
+        const Mesh_Lod* lod = &mesh->lods[i];
+        Mesh_Lod_Report* lod_report = &report->lods[i];
+        memset(timestamps, 0, sizeof(uint32_t) * used_count);
+        uint64_t vertex_fetch = simulate_vertex_fetch(&mesh->indices[lod->first_index], lod->index_count,
+            config->cache_size, sizeof(Mesh_Vertex), timestamps);
+        uint32_t referenced = 0;
+        for (uint32_t v = 0; v < used_count; v++) {
+            referenced += timestamps[v] != 0;
+        }
+        lod_report->overfetch = referenced ? (float)vertex_fetch / (referenced * sizeof(Mesh_Vertex)) : 0.0f;
+        lod_report->fetch_bytes = vertex_fetch + lod->index_count * sizeof(uint32_t);
+    }
+    free(timestamps);
+}
+
+void mesh_free(Mesh* mesh) {
+    free(mesh->vertices);
+    free(mesh->indices);
+    *mesh = {};
+}
+
+void mesh_log_report(const char* name, const Mesh* mesh) {
+    const Mesh_Report* report = &mesh->report;
+    LOG_INFO(LOG_CATEGORY_ASSETS, "• Mesh %s: %u vertices at %u B (%u B as floats), %u KiB vertices + %u KiB indices, position step %.3g.\n",
+        name, report->vertex_count, (uint32_t)sizeof(Mesh_Vertex),
+        report->vertex_count ? report->source_vertex_bytes / report->vertex_count : 0,
+        report->vertex_bytes / 1024, report->index_bytes / 1024, report->position_step);
+    LOG_INFO(LOG_CATEGORY_ASSETS, "•   Built with %s kernels: %.2f ms levels and reordering, %.2f ms quantizing.\n",
+        report->simd, report->lod_ms, report->quantize_ms);
+    for (uint32_t i = 0; i < report->lod_count; i++) {
+        const Mesh_Lod_Report* lod = &report->lods[i];
+        LOG_INFO(LOG_CATEGORY_ASSETS, "•   LOD %u: %u triangles, error %.3f%%, ACMR %.3f -> %.3f, ATVR %.3f, %u overdraw clusters, "
+            "overfetch %.2f, %.1f KiB and %u vertex invocations per draw.\n",
+            i, lod->triangle_count, mesh->lods[i].error * 100.0f, lod->acmr_before, lod->acmr, lod->atvr, lod->overdraw_clusters,
+            lod->overfetch, lod->fetch_bytes / 1024.0, (uint32_t)(lod->acmr * lod->triangle_count + 0.5f));
+    }
+}
+
+uint32_t mesh_select_lod(const Mesh* mesh, float radius, float distance, float max_error) {
+    uint32_t lod = 0;
+    for (uint32_t i = 1; i < mesh->lod_count; i++) {
+        if (mesh->lods[i].error * radius <= max_error * distance) {
+            lod = i;
+        }
+    }
+    return lod;
+}
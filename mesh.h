@@ -0,0 +1,98 @@
+#pragma once
+#include "render.h"
+
+// Turns raw triangle meshes into what the GPU wants to read, at load time on the job system:
+//
+//   1. Levels of detail by vertex clustering, every level built from the source in parallel.
+//      All levels index the same vertices, so a mesh is one vertex buffer and one index buffer.
+//   2. Per level, triangles reordered for the post-transform vertex cache (Forsyth), then
+//      clusters of them sorted outside in to cut overdraw (after Sander et al., Tipsify).
+//   3. Vertices reordered by first use, so fetches walk the vertex buffer front to back.
+//   4. Attributes quantized into 16 byte Mesh_Vertex, with SSE2 or AVX2/F16C kernels when the
+//      build enables them (see MESH_AVX2 in CMakeLists.txt).
+//
+// Source triangles are counter-clockwise, as exported by most tools. Output triangles are
+// clockwise to match the renderer's front face under the Y flipped projection.
+
+static constexpr uint32_t MAX_MESH_LODS = 8;
+
+// Unpacked input, one entry per vertex. mesh_load_obj() fills it with malloc'ed arrays.
+struct Mesh_Source {
+    float* positions;       // xyz
+    float* normals;         // xyz, nullptr to compute area weighted normals
+    float* uvs;             // uv, nullptr for none
+    uint32_t vertex_count;
+    uint32_t* indices;
+    uint32_t index_count;
+};
+
+struct Mesh_Build_Config {
+    // Levels including the full detail one, each aiming for `lod_triangle_ratio` of the triangles
+    // of the one before. Levels stop early once simplification stalls.
+    uint32_t lod_count = 4;
+    float lod_triangle_ratio = 0.5f;
+    // FIFO entries the reordering optimizes for and the report simulates.
+    uint32_t cache_size = 16;
+    // The overdraw pass cuts the cache order into clusters of at least this many triangles, at
+    // points where the cache restarts anyway or where the cluster so far has an ACMR within
+    // `overdraw_threshold` of the whole level's. Higher thresholds cut more finely and sort
+    // better, at some cost in ACMR.
+    uint32_t overdraw_cluster_triangles = 128;
+    float overdraw_threshold = 1.05f;
+};
+
+struct Mesh_Lod {
+    uint32_t first_index;
+    uint32_t index_count;
+    float error;            // largest vertex displacement, relative to the bounding radius
+};
+
+struct Mesh_Lod_Report {
+    uint32_t triangle_count;
+    float acmr_before;      // vertex shader invocations per triangle in source order
+    float acmr;             // after reordering, 0.5 is the limit for regular grids
+    float atvr;             // invocations per vertex referenced, 1 is ideal
+    float overfetch;        // bytes fetched / bytes of the vertices referenced, 64 byte lines
+    uint64_t fetch_bytes;   // indices plus vertex bytes fetched to draw the level once
+    uint32_t overdraw_clusters;
+};
+
+struct Mesh_Report {
+    uint32_t vertex_count;
+    uint32_t vertex_bytes;          // packed
+    uint32_t source_vertex_bytes;   // the same vertices as 32-bit floats
+    uint32_t index_bytes;           // every level
+    float position_step;            // quantization step in source units
+    uint32_t lod_count;
+    Mesh_Lod_Report lods[MAX_MESH_LODS];
+    double lod_ms;                  // simplification and reordering, all levels in parallel
+    double quantize_ms;
+    const char* simd;
+};
+
+struct Mesh {
+    Mesh_Vertex* vertices;
+    uint32_t vertex_count;
+    uint32_t* indices;      // every level back to back, finest first
+    uint32_t index_count;
+    Mesh_Lod lods[MAX_MESH_LODS];
+    uint32_t lod_count;
+    // Bounding sphere in source units, Mesh_Vertex positions are relative to it.
+    float center[3];
+    float radius;
+    Mesh_Report report;
+};
+
+// Positions, normals and texture coordinates of a Wavefront OBJ, polygons fanned into triangles.
+// Returns false if the file can't be read or holds no faces.
+bool mesh_load_obj(const char* path, Mesh_Source* source);
+void mesh_free_source(Mesh_Source* source);
+
+// Uses jobs_parallel_for(), so the job system must be running (render_init() starts it).
+void mesh_build(const Mesh_Source* source, const Mesh_Build_Config* config, Mesh* mesh);
+void mesh_free(Mesh* mesh);
+void mesh_log_report(const char* name, const Mesh* mesh);
+
+// The coarsest level whose error, drawn with bounding radius `radius` at `distance`, stays under
+// `max_error` as a fraction of the distance (roughly the error in radians).
+uint32_t mesh_select_lod(const Mesh* mesh, float radius, float distance, float max_error);
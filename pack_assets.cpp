@@ -0,0 +1,125 @@
+// Build-time tool: packs files into one asset archive (see asset_archive.h).
+//
+//   pack_assets <output> <root directory> <relative path>...
+//
+// Each file is stored under its path relative to the root, e.g. "shaders/triangle.vert.spv".
+
+#include "asset_archive.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) {
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+static void* read_file(const char* path, uint64_t* size) {
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        return nullptr;
+    }
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    void* data = malloc(*size ? *size : 1);
+    bool read = fread(data, 1, *size, file) == *size;
+    fclose(file);
+    if (!read) {
+        free(data);
+        return nullptr;
+    }
+    return data;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s <output> <root directory> <relative path>...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char* output_path = argv[1];
+    const char* root = argv[2];
+    uint32_t entry_count = argc - 3;
+
+    Asset_Archive_Entry* entries = (Asset_Archive_Entry*)calloc(entry_count, sizeof(Asset_Archive_Entry));
+    void** contents = (void**)calloc(entry_count, sizeof(void*));
+
+    uint64_t offset = align_up(sizeof(Asset_Archive_Header) + sizeof(Asset_Archive_Entry) * entry_count, ASSET_ARCHIVE_ALIGNMENT);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        const char* name = argv[3 + i];
+        if (strlen(name) >= ASSET_NAME_SIZE) {
+            fprintf(stderr, "🔸Asset name too long (max %u): %s\n", ASSET_NAME_SIZE - 1, name);
+            return EXIT_FAILURE;
+        }
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", root, name);
+        uint64_t size = 0;
+        contents[i] = read_file(path, &size);
+        if (!contents[i]) {
+            fprintf(stderr, "🔸Failed to read asset: %s\n", path);
+            return EXIT_FAILURE;
+        }
+
+        Asset_Archive_Entry* entry = &entries[i];
+        strcpy(entry->name, name);
+        entry->name_hash = asset_hash(name, strlen(name));
+        entry->offset = offset;
+        entry->size = size;
+        entry->content_hash = asset_hash(contents[i], size);
+        offset = align_up(offset + size, ASSET_ARCHIVE_ALIGNMENT);
+    }
+
+    // The loader binary searches on the name hash. The blobs keep command line order on disk, so
+    // sort an index and write the table through it.
+    uint32_t* order = (uint32_t*)malloc(sizeof(uint32_t) * entry_count);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        order[i] = i;
+    }
+    std::sort(order, order + entry_count, [&](uint32_t a, uint32_t b) {
+        return entries[a].name_hash < entries[b].name_hash;
+    });
+
+    Asset_Archive_Entry* table = (Asset_Archive_Entry*)malloc(sizeof(Asset_Archive_Entry) * entry_count);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        table[i] = entries[order[i]];
+    }
+
+    Asset_Archive_Header header{};
+    header.magic = ASSET_ARCHIVE_MAGIC;
+    header.version = ASSET_ARCHIVE_VERSION;
+    header.entry_count = entry_count;
+    header.file_size = offset;
+    header.toc_hash = asset_hash(table, sizeof(Asset_Archive_Entry) * entry_count);
+
+    FILE* file = fopen(output_path, "wb");
+    if (!file) {
+        fprintf(stderr, "🔸Failed to write archive: %s\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    static const uint8_t zeros[ASSET_ARCHIVE_ALIGNMENT] = {};
+    uint64_t written = 0;
+    written += fwrite(&header, 1, sizeof(header), file);
+    written += fwrite(table, 1, sizeof(Asset_Archive_Entry) * entry_count, file);
+    for (uint32_t i = 0; i < entry_count; i++) {
+        written += fwrite(zeros, 1, entries[i].offset - written, file);
+        written += fwrite(contents[i], 1, entries[i].size, file);
+        free(contents[i]);
+    }
+    written += fwrite(zeros, 1, offset - written, file);
+
+    if (fclose(file) != 0 || written != offset) {
+        fprintf(stderr, "🔸Failed to write archive: %s\n", output_path);
+        return EXIT_FAILURE;
+    }
+
+    printf("• Packed %u assets into %s (%llu bytes).\n", entry_count, output_path, (unsigned long long)offset);
+
+    free(table);
+    free(order);
+    free(contents);
+    free(entries);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,143 @@
+#include "pipeline_cache.h"
+#include "log.h"
+
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Our own header in front of the driver blob. The driver header only identifies the device, it
+// says nothing about the driver version or whether the file was cut short.
+struct Pipeline_Cache_File_Header {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+    uint64_t data_size;
+    uint64_t data_hash;
+};
+
+static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x48434350; // "PCCH"
+static constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+static uint64_t hash_fnv1a(const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static bool validate_blob(const Pipeline_Cache_File_Header* header, const void* data, const VkPhysicalDeviceProperties* properties) {
+    if (header->magic != PIPELINE_CACHE_MAGIC || header->version != PIPELINE_CACHE_VERSION) {
+        return false;
+    }
+    if (header->vendor_id != properties->vendorID || header->device_id != properties->deviceID ||
+        header->driver_version != properties->driverVersion ||
+        memcmp(header->pipeline_cache_uuid, properties->pipelineCacheUUID, VK_UUID_SIZE) != 0) {
+        return false;
+    }
+    if (header->data_hash != hash_fnv1a(data, header->data_size)) {
+        return false;
+    }
+
+    // The driver checks its own header as well, but a mismatch there would only be reported as an
+    // empty cache, so reject it here to get the miss logged.
+    VkPipelineCacheHeaderVersionOne driver_header;
+    if (header->data_size < sizeof(driver_header)) {
+        return false;
+    }
+    memcpy(&driver_header, data, sizeof(driver_header));
+    return driver_header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+        memcmp(driver_header.pipelineCacheUUID, properties->pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
+
+VkPipelineCache pipeline_cache_load(VkDevice device, VkPhysicalDevice physical_device, const char* path, bool* loaded) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    *loaded = false;
+    void* data = nullptr;
+    size_t data_size = 0;
+
+    FILE* file = path ? fopen(path, "rb") : nullptr;
+    if (file) {
+        Pipeline_Cache_File_Header header;
+        if (fread(&header, sizeof(header), 1, file) == 1 && header.data_size < (1ull << 31)) {
+            data = malloc(header.data_size);
+            if (fread(data, 1, header.data_size, file) == header.data_size && validate_blob(&header, data, &properties)) {
+                data_size = header.data_size;
+                *loaded = true;
+            }
+        }
+        fclose(file);
+
+        if (!*loaded) {
+            LOG_INFO(LOG_CATEGORY_PIPELINE, "• Pipeline cache %s is stale or corrupt, starting empty.\n", path);
+        }
+    }
+
+    VkPipelineCacheCreateInfo create_info{};
+    create_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    create_info.initialDataSize = data_size;
+    create_info.pInitialData = data_size ? data : nullptr;
+
+    VkPipelineCache cache;
+    vkCreatePipelineCache(device, &create_info, nullptr, &cache);
+    free(data);
+
+    if (*loaded) {
+        LOG_INFO(LOG_CATEGORY_PIPELINE, "• Pipeline cache loaded from %s (%zu bytes).\n", path, data_size);
+    }
+    return cache;
+}
+
+void pipeline_cache_save(VkDevice device, VkPhysicalDevice physical_device, VkPipelineCache cache, const char* path) {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+
+    size_t data_size = 0;
+    vkGetPipelineCacheData(device, cache, &data_size, nullptr);
+    void* data = malloc(data_size);
+    vkGetPipelineCacheData(device, cache, &data_size, data);
+
+    Pipeline_Cache_File_Header header{};
+    header.magic = PIPELINE_CACHE_MAGIC;
+    header.version = PIPELINE_CACHE_VERSION;
+    header.vendor_id = properties.vendorID;
+    header.device_id = properties.deviceID;
+    header.driver_version = properties.driverVersion;
+    memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+    header.data_size = data_size;
+    header.data_hash = hash_fnv1a(data, data_size);
+
+    char temp_path[1024];
+    snprintf(temp_path, sizeof(temp_path), "%s.tmp", path);
+
+    FILE* file = fopen(temp_path, "wb");
+    if (!file) {
+        LOG_ERROR(LOG_CATEGORY_PIPELINE, "🔸Failed to write pipeline cache: %s\n", temp_path);
+        free(data);
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, 1, data_size, file) == data_size;
+    written = fclose(file) == 0 && written;
+    free(data);
+
+    std::error_code error;
+    if (written) {
+        // Replaces the old file in one step on both POSIX and Windows.
+        std::filesystem::rename(temp_path, path, error);
+    }
+    if (!written || error) {
+        LOG_ERROR(LOG_CATEGORY_PIPELINE, "🔸Failed to write pipeline cache: %s\n", path);
+        std::filesystem::remove(temp_path, error);
+        return;
+    }
+
+    LOG_INFO(LOG_CATEGORY_PIPELINE, "• Pipeline cache saved to %s (%zu bytes).\n", path, data_size);
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <vulkan/vulkan_core.h>
+
+// Creates a pipeline cache seeded from the blob at `path`. The blob is only used if it was written
+// by the same device and driver, otherwise an empty cache is created. `loaded` reports which.
+VkPipelineCache pipeline_cache_load(VkDevice device, VkPhysicalDevice physical_device, const char* path, bool* loaded);
+
+// Writes the cache contents to `path`. The file is written next to the target and renamed over
+// it, so a crash mid-write never leaves a truncated cache behind.
+void pipeline_cache_save(VkDevice device, VkPhysicalDevice physical_device, VkPipelineCache cache, const char* path);
@@ -0,0 +1,307 @@
+#include "profiler.h"
+#include "jobs.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Trace_Event {
+    const char* name;
+    uint64_t begin_ns;
+    uint64_t duration_ns;
+    uint32_t thread;
+    bool gpu;
+};
+
+// Queries per frame slot, two per zone. Zone 0 is always the whole GPU frame.
+static constexpr uint32_t MAX_GPU_ZONES = 512;
+
+struct Gpu_Slot {
+    VkQueryPool query_pool;
+    const char* names[MAX_GPU_ZONES];
+    std::atomic<uint32_t> zone_count;
+    uint64_t frame_number;
+    uint64_t submit_ns;
+    uint64_t input_ns;
+    bool pending;
+};
+
+// Oldest events are overwritten once the ring is full, so a long run keeps its most recent history.
+static constexpr uint32_t TRACE_CAPACITY = 1 << 16;
+static constexpr uint32_t STATS_WINDOW = 512;
+
+static VkDevice device;
+static uint64_t start_ns;
+
+static std::mutex trace_mutex;
+static Trace_Event* trace_events;
+static uint32_t trace_head;
+static uint32_t trace_count;
+static uint32_t trace_max_thread;
+
+static Gpu_Slot* gpu_slots;
+static uint32_t gpu_slot_count;
+static uint32_t current_slot;
+static bool gpu_enabled;
+static double timestamp_period_ns;
+static uint64_t timestamp_mask;
+// Added to GPU times to put them on the CPU timeline. A GPU frame cannot start before it was
+// submitted, so the smallest offset satisfying that for every frame seen so far is the estimate.
+static int64_t gpu_to_cpu_offset_ns;
+static bool gpu_offset_known;
+
+static uint64_t last_frame_begin_ns;
+static double cpu_frame_ms[STATS_WINDOW];
+static double gpu_frame_ms[STATS_WINDOW];
+static double latency_ms[STATS_WINDOW];
+static double cpu_wait_ms[STATS_WINDOW];
+static uint32_t cpu_frame_count;
+static uint32_t gpu_frame_count;
+static uint32_t latency_frame_count;
+static uint32_t cpu_wait_count;
+static uint64_t last_gpu_frame_number;
+static double last_gpu_frame_ms;
+static bool last_gpu_frame_valid;
+
+static void push_event(const char* name, uint64_t begin_ns, uint64_t duration_ns, uint32_t thread, bool gpu) {
+    std::lock_guard<std::mutex> lock(trace_mutex);
+
+    trace_events[trace_head] = {name, begin_ns, duration_ns, thread, gpu};
+    trace_head = (trace_head + 1) % TRACE_CAPACITY;
+    if (trace_count < TRACE_CAPACITY) {
+        trace_count++;
+    }
+    if (thread > trace_max_thread) {
+        trace_max_thread = thread;
+    }
+}
+
+void profiler_init(VkDevice vk_device, VkPhysicalDevice physical_device, uint32_t queue_family_index, uint32_t frame_slots) {
+    device = vk_device;
+    start_ns = profiler_now_ns();
+    trace_events = (Trace_Event*)malloc(sizeof(Trace_Event) * TRACE_CAPACITY);
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
+    timestamp_period_ns = properties.limits.timestampPeriod;
+
+    uint32_t family_count = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, nullptr);
+    VkQueueFamilyProperties* families = (VkQueueFamilyProperties*)malloc(sizeof(VkQueueFamilyProperties) * family_count);
+    vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &family_count, families);
+    uint32_t valid_bits = families[queue_family_index].timestampValidBits;
+    free(families);
+
+    gpu_enabled = valid_bits != 0;
+    timestamp_mask = valid_bits >= 64 ? UINT64_MAX : (1ull << valid_bits) - 1;
+
+    gpu_slot_count = frame_slots;
+    gpu_slots = new Gpu_Slot[frame_slots]();
+    if (gpu_enabled) {
+        VkQueryPoolCreateInfo pool_info{};
+        pool_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        pool_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+        pool_info.queryCount = MAX_GPU_ZONES * 2;
+
+        for (uint32_t i = 0; i < frame_slots; i++) {
+            vkCreateQueryPool(device, &pool_info, nullptr, &gpu_slots[i].query_pool);
+        }
+    }
+}
+
+void profiler_shutdown() {
+    for (uint32_t i = 0; i < gpu_slot_count; i++) {
+        vkDestroyQueryPool(device, gpu_slots[i].query_pool, nullptr);
+    }
+    delete[] gpu_slots;
+    free(trace_events);
+}
+
+uint64_t profiler_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void profiler_cpu_zone(const char* name, uint64_t begin_ns, uint64_t end_ns) {
+    push_event(name, begin_ns, end_ns - begin_ns, jobs_thread_index(), false);
+}
+
+void profiler_begin_frame() {
+    uint64_t now = profiler_now_ns();
+    if (last_frame_begin_ns != 0) {
+        cpu_frame_ms[cpu_frame_count % STATS_WINDOW] = (now - last_frame_begin_ns) / 1e6;
+        cpu_frame_count++;
+    }
+    last_frame_begin_ns = now;
+}
+
+void profiler_cpu_wait(uint64_t wait_ns) {
+    cpu_wait_ms[cpu_wait_count % STATS_WINDOW] = wait_ns / 1e6;
+    cpu_wait_count++;
+}
+
+void profiler_collect_gpu(uint32_t slot_index) {
+    Gpu_Slot* slot = &gpu_slots[slot_index];
+    if (!gpu_enabled || !slot->pending) {
+        return;
+    }
+    slot->pending = false;
+
+    uint32_t zone_count = std::min(slot->zone_count.load(std::memory_order_relaxed), MAX_GPU_ZONES);
+
+    // Value and availability per query. Zones whose queries were never written are skipped.
+    static uint64_t results[MAX_GPU_ZONES * 2][2];
+    vkGetQueryPoolResults(device, slot->query_pool, 0, zone_count * 2, sizeof(results), results, sizeof(results[0]),
+        VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    if (!results[0][1] || !results[1][1]) {
+        return;
+    }
+    uint64_t frame_begin_ns = (uint64_t)((results[0][0] & timestamp_mask) * timestamp_period_ns);
+    uint64_t frame_end_ns = (uint64_t)((results[1][0] & timestamp_mask) * timestamp_period_ns);
+
+    int64_t offset = (int64_t)slot->submit_ns - (int64_t)frame_begin_ns;
+    if (!gpu_offset_known || offset > gpu_to_cpu_offset_ns) {
+        gpu_to_cpu_offset_ns = offset;
+        gpu_offset_known = true;
+    }
+
+    gpu_frame_ms[gpu_frame_count % STATS_WINDOW] = (frame_end_ns - frame_begin_ns) / 1e6;
+    gpu_frame_count++;
+    last_gpu_frame_number = slot->frame_number;
+    last_gpu_frame_ms = (frame_end_ns - frame_begin_ns) / 1e6;
+    last_gpu_frame_valid = true;
+
+    int64_t frame_end_cpu_ns = (int64_t)frame_end_ns + gpu_to_cpu_offset_ns;
+    if (slot->input_ns != 0 && frame_end_cpu_ns > (int64_t)slot->input_ns) {
+        latency_ms[latency_frame_count % STATS_WINDOW] = (frame_end_cpu_ns - (int64_t)slot->input_ns) / 1e6;
+        latency_frame_count++;
+    }
+
+    for (uint32_t zone = 0; zone < zone_count; zone++) {
+        uint64_t* begin = results[zone * 2];
+        uint64_t* end = results[zone * 2 + 1];
+        if (!begin[1] || !end[1]) {
+            continue;
+        }
+        uint64_t begin_ns = (uint64_t)((begin[0] & timestamp_mask) * timestamp_period_ns);
+        uint64_t end_ns = (uint64_t)((end[0] & timestamp_mask) * timestamp_period_ns);
+        push_event(slot->names[zone], begin_ns + gpu_to_cpu_offset_ns, end_ns > begin_ns ? end_ns - begin_ns : 0, 0, true);
+    }
+}
+
+void profiler_gpu_frame_begin(VkCommandBuffer command_buffer, uint32_t slot_index, uint64_t frame_number, uint64_t input_ns) {
+    current_slot = slot_index;
+    if (!gpu_enabled) {
+        return;
+    }
+
+    Gpu_Slot* slot = &gpu_slots[slot_index];
+    slot->frame_number = frame_number;
+    slot->input_ns = input_ns;
+    slot->names[0] = "frame";
+    slot->zone_count.store(1, std::memory_order_relaxed);
+
+    vkCmdResetQueryPool(command_buffer, slot->query_pool, 0, MAX_GPU_ZONES * 2);
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot->query_pool, 0);
+}
+
+void profiler_gpu_frame_end(VkCommandBuffer command_buffer) {
+    if (!gpu_enabled) {
+        return;
+    }
+
+    Gpu_Slot* slot = &gpu_slots[current_slot];
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, slot->query_pool, 1);
+    slot->submit_ns = profiler_now_ns();
+    slot->pending = true;
+}
+
+uint32_t profiler_gpu_begin(VkCommandBuffer command_buffer, const char* name) {
+    if (!gpu_enabled) {
+        return PROFILER_INVALID_ZONE;
+    }
+
+    Gpu_Slot* slot = &gpu_slots[current_slot];
+    uint32_t zone = slot->zone_count.fetch_add(1, std::memory_order_relaxed);
+    if (zone >= MAX_GPU_ZONES) {
+        return PROFILER_INVALID_ZONE;
+    }
+
+    slot->names[zone] = name;
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, slot->query_pool, zone * 2);
+    return zone;
+}
+
+void profiler_gpu_end(VkCommandBuffer command_buffer, uint32_t zone) {
+    if (zone == PROFILER_INVALID_ZONE) {
+        return;
+    }
+    vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, gpu_slots[current_slot].query_pool, zone * 2 + 1);
+}
+
+static void percentiles(const double* window, uint32_t frame_count, double out[3]) {
+    uint32_t count = std::min(frame_count, STATS_WINDOW);
+    if (count == 0) {
+        out[0] = out[1] = out[2] = 0.0;
+        return;
+    }
+
+    double sorted[STATS_WINDOW];
+    std::copy(window, window + count, sorted);
+    std::sort(sorted, sorted + count);
+
+    const double ranks[3] = {0.50, 0.95, 0.99};
+    for (uint32_t i = 0; i < 3; i++) {
+        out[i] = sorted[(uint32_t)(ranks[i] * (count - 1) + 0.5)];
+    }
+}
+
+void profiler_get_stats(Profiler_Stats* stats) {
+    stats->cpu_frame_count = std::min(cpu_frame_count, STATS_WINDOW);
+    stats->gpu_frame_count = std::min(gpu_frame_count, STATS_WINDOW);
+    percentiles(cpu_frame_ms, cpu_frame_count, stats->cpu_ms);
+    percentiles(gpu_frame_ms, gpu_frame_count, stats->gpu_ms);
+    stats->latency_frame_count = std::min(latency_frame_count, STATS_WINDOW);
+    percentiles(latency_ms, latency_frame_count, stats->latency_ms);
+    percentiles(cpu_wait_ms, cpu_wait_count, stats->cpu_wait_ms);
+}
+
+bool profiler_last_gpu_frame(uint64_t* frame_number, double* gpu_ms) {
+    *frame_number = last_gpu_frame_number;
+    *gpu_ms = last_gpu_frame_ms;
+    return last_gpu_frame_valid;
+}
+
+bool profiler_write_trace(const char* path) {
+    FILE* file = fopen(path, "w");
+    if (!file) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(trace_mutex);
+
+    // pid 1 is the CPU with one track per job system thread, pid 2 is the GPU queue.
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":2,\"args\":{\"name\":\"GPU\"}},\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"main\"}},\n");
+    for (uint32_t thread = 1; thread <= trace_max_thread; thread++) {
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"worker %u\"}},\n", thread, thread);
+    }
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":2,\"tid\":0,\"args\":{\"name\":\"graphics queue\"}}");
+
+    uint32_t first = (trace_head + TRACE_CAPACITY - trace_count) % TRACE_CAPACITY;
+    for (uint32_t i = 0; i < trace_count; i++) {
+        Trace_Event* event = &trace_events[(first + i) % TRACE_CAPACITY];
+        double ts_us = ((int64_t)event->begin_ns - (int64_t)start_ns) / 1e3;
+        fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+            event->name, event->gpu ? 2 : 1, event->thread, ts_us, event->duration_ns / 1e3);
+    }
+
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+    return true;
+}
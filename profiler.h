@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include <vulkan/vulkan_core.h>
+
+// Frame profiler. CPU zones are timed with a steady clock on whichever thread runs them. GPU zones
+// are pairs of timestamp queries in one query pool per frame slot; a slot is read back only after
+// its frame is known to have finished, so GPU results arrive a few frames late but never stall.
+// Everything lands in a ring of trace events that can be written out as Chrome trace JSON, which
+// chrome://tracing and ui.perfetto.dev both open.
+
+static constexpr uint32_t PROFILER_INVALID_ZONE = UINT32_MAX;
+
+struct Profiler_Stats {
+    uint32_t cpu_frame_count;   // frames in the rolling window
+    uint32_t gpu_frame_count;
+    double cpu_ms[3];           // p50, p95, p99
+    double gpu_ms[3];
+    uint32_t latency_frame_count;
+    double latency_ms[3];       // input sample to the end of the GPU frame
+    double cpu_wait_ms[3];      // CPU blocked waiting for a free frame slot
+};
+
+// GPU zones are disabled if the queue family has no timestamp support.
+void profiler_init(VkDevice device, VkPhysicalDevice physical_device, uint32_t queue_family_index, uint32_t frame_slots);
+void profiler_shutdown();
+
+uint64_t profiler_now_ns();
+void profiler_cpu_zone(const char* name, uint64_t begin_ns, uint64_t end_ns);
+
+// Times the enclosing scope as a CPU zone. `name` must outlive the profiler, use string literals.
+struct Profile_Scope {
+    const char* name;
+    uint64_t begin_ns;
+
+    Profile_Scope(const char* name) : name(name), begin_ns(profiler_now_ns()) {}
+    ~Profile_Scope() { profiler_cpu_zone(name, begin_ns, profiler_now_ns()); }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) Profile_Scope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+
+// Starts a CPU frame, the time since the previous call feeds the CPU frame time stats.
+void profiler_begin_frame();
+
+// Records how long the CPU was blocked on the GPU before it could start a frame.
+void profiler_cpu_wait(uint64_t wait_ns);
+
+// Reads back the GPU zones last recorded into `slot`. Its frame must have finished on the GPU.
+void profiler_collect_gpu(uint32_t slot);
+// Resets the slot's queries and timestamps the start of the GPU frame. Must be recorded outside
+// any rendering, at the top of the frame's command buffer. `input_ns` is when the input this frame
+// reacts to was sampled (profiler_now_ns() time, 0 = none), for the latency stats.
+void profiler_gpu_frame_begin(VkCommandBuffer command_buffer, uint32_t slot, uint64_t frame_number, uint64_t input_ns);
+// Timestamps the end of the GPU frame. Call right before the submit, its CPU time is used to line
+// the GPU clock up with the CPU timeline.
+void profiler_gpu_frame_end(VkCommandBuffer command_buffer);
+
+// Safe from any thread recording into the current frame, including into secondaries. Returns
+// PROFILER_INVALID_ZONE when GPU zones are off or the frame's queries have run out.
+uint32_t profiler_gpu_begin(VkCommandBuffer command_buffer, const char* name);
+void profiler_gpu_end(VkCommandBuffer command_buffer, uint32_t zone);
+
+void profiler_get_stats(Profiler_Stats* stats);
+// The newest GPU frame time read back and the frame number it was recorded as. False until the
+// first one arrives, and always without GPU timestamps.
+bool profiler_last_gpu_frame(uint64_t* frame_number, double* gpu_ms);
+bool profiler_write_trace(const char* path);
@@ -0,0 +1,49 @@
+#include "radix_sort.h"
+
+#include <string.h>
+
+void radix_sort_keys(uint32_t count, const uint32_t* keys, uint32_t* order, uint32_t* scratch) {
+    // One histogram per byte, all built in a single pass over the keys.
+    uint32_t histograms[4][256];
+    memset(histograms, 0, sizeof(histograms));
+    for (uint32_t i = 0; i < count; i++) {
+        uint32_t key = keys[i];
+        histograms[0][key & 0xff]++;
+        histograms[1][(key >> 8) & 0xff]++;
+        histograms[2][(key >> 16) & 0xff]++;
+        histograms[3][key >> 24]++;
+        order[i] = i;
+    }
+
+    uint32_t* source = order;
+    uint32_t* destination = scratch;
+    for (uint32_t pass = 0; pass < 4; pass++) {
+        uint32_t* histogram = histograms[pass];
+        uint32_t shift = pass * 8;
+
+        // Every key shares this digit, the pass would not move anything.
+        if (count == 0 || histogram[(keys[0] >> shift) & 0xff] == count) {
+            continue;
+        }
+
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < 256; digit++) {
+            uint32_t digit_count = histogram[digit];
+            histogram[digit] = offset;
+            offset += digit_count;
+        }
+
+        for (uint32_t i = 0; i < count; i++) {
+            uint32_t index = source[i];
+            destination[histogram[(keys[index] >> shift) & 0xff]++] = index;
+        }
+
+        uint32_t* swap = source;
+        source = destination;
+        destination = swap;
+    }
+
+    if (source != order) {
+        memcpy(order, source, sizeof(uint32_t) * count);
+    }
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <stdint.h>
+
+// Stable LSD radix sort over 32-bit keys. Writes the indices of `keys` in sorted order to `order`.
+// `scratch` must hold `count` entries. Byte passes where every key has the same digit are skipped,
+// so keys that only use their low bits cost a single pass.
+void radix_sort_keys(uint32_t count, const uint32_t* keys, uint32_t* order, uint32_t* scratch);
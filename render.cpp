@@ -1,41 +1,207 @@
 #include "render.h"
-
+#include "arena.h"
+#include "bindless.h"
+#include "culling.h"
+#include "frame_graph.h"
+#include "gpu_memory.h"
+#include "handle_pool.h"
+#include "jobs.h"
+#include "log.h"
+#include "pipeline_cache.h"
+#include "profiler.h"
+#include "radix_sort.h"
+#include "shader_variant.h"
+#include "streaming.h"
+#include "texture.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cstdint>
+#include <math.h>
+#include <mutex>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
+#include <thread>
 #include <vulkan/vulkan_core.h>
 
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
-struct Shader {
-    VkShaderModule frag_module;
-    VkShaderModule vert_module;
+// Shaders and materials are pools of fixed capacity, one array per field indexed by the handle's
+// slot. Fixed, because workers compiling pipelines write into the arrays while the main thread
+// creates more.
+static constexpr uint32_t MAX_SHADERS = 256;
+static constexpr uint32_t MAX_MATERIALS = 4096;
+
+static Handle_Pool shader_pool;
+static VkShaderModule shader_vert_modules[MAX_SHADERS];
+static VkShaderModule shader_frag_modules[MAX_SHADERS];
+
+// The draw path reads the first three for every batch. The slot doubles as the material part of
+// draw sort keys.
+static Handle_Pool material_pool;
+static VkPipeline material_pipelines[MAX_MATERIALS];
+static uint32_t material_indices[MAX_MATERIALS][MATERIAL_INDEX_COUNT];     // pushed, the way into the bindless table
+static std::atomic<bool> material_ready[MAX_MATERIALS];                     // set once the pipeline exists
+static Texture* material_textures[MAX_MATERIALS][MATERIAL_INDEX_COUNT];     // whose slot the index follows
+// Only read while creating the pipeline.
+static uint32_t material_shaders[MAX_MATERIALS];                            // shader slot
+static Vertex_Layout material_vertex_layouts[MAX_MATERIALS];
+static Shader_Variant material_variants[MAX_MATERIALS];
+
+// A destroyed material keeps its slot and pipeline until every frame that may have drawn with it
+// has retired.
+struct Retired_Material {
+    uint32_t slot;
+    uint64_t retire_serial;
+};
+
+static Retired_Material* retired_materials;
+static uint32_t retired_material_count;
+static uint32_t retired_material_capacity;
+
+// Init time temporaries, such as the arrays Vulkan enumerations fill in. Only touched by one
+// thread at a time: the swapchain job uses it once the main thread is done with it.
+static Arena scratch;
+static constexpr size_t SCRATCH_SIZE = 256 * 1024;
+
+// Validation layer and debug utils messenger, on in debug builds unless the build says otherwise
+// (see RENDER_VALIDATION in CMakeLists.txt).
+#ifndef RENDER_VALIDATION
+#ifdef NDEBUG
+#define RENDER_VALIDATION 0
+#else
+#define RENDER_VALIDATION 1
+#endif
+#endif
+
+// Startup timing, see Startup_Stats. Taken when the executable's statics are initialized, which is
+// as close to process start as portable code gets.
+static const uint64_t process_start_ns = profiler_now_ns();
+static const char* startup_stage_names[MAX_STARTUP_STAGES];
+static double startup_stage_ms[MAX_STARTUP_STAGES];
+static std::atomic<uint32_t> startup_stage_count;     // stages finishing on workers take a slot too
+static double startup_init_ms;
+static std::atomic<uint64_t> first_frame_ns;       // written by the render thread when there is one
+
+// Init work running on the job workers while render_init() carries on. The pipeline cache is
+// waited for before render_init() returns, the swapchain only by the first call that needs it,
+// so the caller's asset loading and material creation overlap it as well.
+static std::atomic<bool> pipeline_cache_pending;
+static std::atomic<bool> swapchain_pending;
+
+struct Buffer {
+    VkBuffer buffer;
+    Gpu_Allocation allocation;
+    uint64_t size;
+    VkBufferUsageFlags usage;
+    Memory_Location location;
+    // Position in live_buffers, defragmentation walks that list.
+    uint32_t live_index;
+    // False while a streamed upload into it is in flight.
+    std::atomic<bool> ready;
+    uint32_t bindless_index;
+    Frame_Graph_State graph_state;
+};
+
+struct Image {
+    VkImage image;
+    VkImageView image_view;
+    Gpu_Allocation allocation;
+    VkFormat format;
+    uint32_t texel_size;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_levels;
+    std::atomic<bool> ready;
+    uint32_t bindless_index;
+    Frame_Graph_State graph_state;
 };
 
-struct Material {
-    VkPipeline pipeline;
-    VkPipelineLayout pipeline_layout;
+// Per-frame arrays are sized for the most frames in flight Render_Config allows.
+static constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 4;
+
+// CPU side of a GPU-driven scene. Every material gets a bucket, and every bucket a contiguous range
+// of indirect commands as long as its object count, laid out in bucket order.
+struct Scene {
+    Buffer* index_buffer;
+    Buffer* vertex_buffer;
+    uint32_t max_objects;
+    Buffer* objects;            // Gpu_Scene_Object per slot
+    Buffer* commands;           // VkDrawIndexedIndirectCommand, written by cull.comp
+    Buffer* counts;             // one draw count per bucket
+    Buffer* count_readbacks[MAX_FRAMES_IN_FLIGHT];
+    bool readback_pending[MAX_FRAMES_IN_FLIGHT];
+
+    Gpu_Scene_Object* shadow;   // what `objects` should hold
+    uint32_t* bucket_order;     // slots sorted by bucket, the CPU path walks it like the command ranges
+    uint8_t* visible;           // CPU cull result per slot
+    uint32_t object_count;
+    // Slots the GPU copy is valid for. Culling never reads past it, so objects added but not yet
+    // uploaded are skipped rather than read as garbage.
+    uint32_t uploaded_count;
+    // Slots still to copy. Adding an object shifts the command ranges of the buckets after its
+    // own, which makes everything dirty.
+    uint32_t dirty_begin;
+    uint32_t dirty_end;
+    bool layout_dirty;
+
+    Material materials[MAX_SCENE_MATERIALS];
+    uint32_t bucket_counts[MAX_SCENE_MATERIALS];
+    uint32_t bucket_bases[MAX_SCENE_MATERIALS];
+    uint32_t material_count;
+
+    uint32_t gpu_visible;       // from the last count readback
 };
 
 // NOTE: We use dynamic rendering everywhere possible, so no render passes or framebuffers are created.
 
-static constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+static uint32_t frames_in_flight;
 
 static GLFWwindow* window;
 static VkInstance instance;
+static VkDebugUtilsMessengerEXT debug_messenger;
+static bool validation_enabled;
 static VkPhysicalDevice physical_device;
 static VkSurfaceKHR surface;
 static VkDevice device;
 static VkQueue graphics_queue;
 static uint32_t graphics_queue_family_index;
+// Transfer-only family when the device has one, otherwise a second graphics queue or, failing
+// that, graphics_queue itself. Submits to a queue the streaming thread shares take the mutex.
+static VkQueue transfer_queue;
+static uint32_t transfer_queue_family_index;
+static bool memory_budget_supported;
+// Without it GPU culling can't size its draws, scenes fall back to CPU culling.
+static bool draw_indirect_count_supported;
+static std::mutex graphics_queue_mutex;
+static std::mutex transfer_queue_mutex;
+static uint64_t stream_wait_value;
 static VkSwapchainKHR swapchain;
 
-static VkCommandPool command_pool;
+// Every frame in flight owns one pool for its primary command buffer plus one pool per recording
+// thread for secondaries. Pools are reset as a whole once the frame has finished on the GPU, and the
+// secondaries allocated from them are reused from frame to frame.
+struct alignas(64) Thread_Command_Pool {
+    VkCommandPool pool;
+    VkCommandBuffer* buffers;
+    uint32_t buffer_count;
+    uint32_t used_count;
+};
+
+static VkCommandPool frame_command_pools[MAX_FRAMES_IN_FLIGHT];
 static VkCommandBuffer command_buffers[MAX_FRAMES_IN_FLIGHT];
+static Thread_Command_Pool* thread_command_pools[MAX_FRAMES_IN_FLIGHT];
+static uint32_t record_thread_count;
 
-static VkFence image_available_fences[MAX_FRAMES_IN_FLIGHT];
+// Every submitted frame signals the frame timeline with its serial, frame_number + 1. Reusing a
+// frame slot, retiring resources and CPU/GPU overlap are all questions about which serial the
+// timeline has reached.
+static VkSemaphore frame_timeline;
 
 static VkSemaphore image_available_semaphores[MAX_FRAMES_IN_FLIGHT];
 static VkSemaphore render_finished_semaphores[MAX_FRAMES_IN_FLIGHT];
@@ -43,14 +209,311 @@ static VkSemaphore render_finished_semaphores[MAX_FRAMES_IN_FLIGHT];
 static uint32_t swapchain_image_count = 0;
 static VkImage* swapchain_images;
 static VkImageView* swapchain_image_views;
+static Present_Mode present_mode;       // what the swapchain actually uses
+static Present_Mode requested_present_mode;
+// Set by resizes, out of date or suboptimal results and present mode changes. The swapchain is
+// rebuilt at the start of the next frame.
+static std::atomic<bool> swapchain_dirty;
+// Kept up to date by the resize callback on the main thread, the only one allowed to ask GLFW,
+// and read wherever the swapchain gets rebuilt.
+static std::atomic<uint32_t> framebuffer_width;
+static std::atomic<uint32_t> framebuffer_height;
+
+// A replaced swapchain stays alive until every frame that rendered to it has retired. Recreation
+// passes it as oldSwapchain and moves on without waiting for the device.
+struct Retired_Swapchain {
+    VkSwapchainKHR swapchain;
+    VkImage* images;
+    VkImageView* image_views;
+    uint32_t image_count;
+    // The Hi-Z pyramid is sized with it and retired along with it. The swapchain is null when a
+    // resize found none to replace.
+    Buffer* hiz_buffer;
+    uint64_t retire_serial;     // done with once the frame timeline reaches this
+};
+
+static Retired_Swapchain* retired_swapchains;
+static uint32_t retired_swapchain_count;
+static uint32_t retired_swapchain_capacity;
+
+// No image could be acquired (minimized window), the frame records and submits nothing.
+static bool frame_skipped;
+// When input was last polled. The frame recorded after it carries it to the GPU for the
+// input-to-present latency stats.
+static uint64_t input_sample_ns;
+
+// Adaptive pacing: how long render_should_close() sleeps before polling input. Tuned every frame
+// so the wait for a free frame slot settles just above PACING_MARGIN_NS.
+static constexpr uint64_t PACING_MARGIN_NS = 1000000;
+static constexpr uint64_t MAX_PACING_DELAY_NS = 100000000;
+static uint64_t pacing_delay_ns;
+
+// Render thread (see Render_Config::render_thread). The calling thread declares each frame into a
+// Frame_Commands, the render thread replays it into the draw lists, then records and submits as
+// usual. One producer and one consumer: the producer only moves frame_queue_tail and the consumer
+// only frame_queue_head, frame k lives in frame_queue[k % frame_queue_size]. Frame k is always
+// submitted with serial k + 1, skipped frames included, so the calling thread knows every serial.
+struct Scene_Update {
+    Scene* scene;
+    uint32_t slot;
+    Scene_Object object;
+};
+
+// A frame's bump cursor into its upload partition (see the upload ring below), claimed along with
+// the frame. With a render thread the frame being declared and the frame being recorded differ, so
+// each allocates from its own cursor.
+struct Upload_Cursor {
+    uint32_t partition;
+    std::atomic<uint64_t> head;     // bytes handed out from the partition
+};
+
+struct Frame_Commands {
+    Upload_Cursor upload;
+    uint32_t* draw_materials;       // slots, resolved when the draw was queued
+    uint32_t* draw_uniform_offsets;
+    uint32_t draw_count;
+    uint32_t draw_capacity;
+    Scene_Update* scene_updates;
+    uint32_t scene_update_count;
+    uint32_t scene_update_capacity;
+    Scene* scenes[MAX_SCENE_DRAWS];
+    float view_projections[MAX_SCENE_DRAWS][16];
+    uint32_t scene_count;
+    uint64_t input_sample_ns;
+};
+
+static constexpr uint32_t MAX_FRAME_QUEUE_SIZE = 3;
+static constexpr uint32_t SKIPPED_FRAME_SLEEP_MS = 10;
+
+static std::thread render_thread;
+static Frame_Commands frame_queue[MAX_FRAME_QUEUE_SIZE];
+static uint32_t frame_queue_size;
+static Frame_Commands* building_frame;          // between render_begin_frame() and render_end_frame()
+static std::atomic<uint64_t> frame_queue_head;  // frames the render thread is done with
+static std::atomic<uint64_t> frame_queue_tail;  // frames queued
+// Bumped for every queued frame and to stop, the render thread sleeps on it.
+static std::atomic<uint32_t> render_thread_wake;
+static std::atomic<bool> render_thread_stop;
+
+static uint64_t render_thread_start_ns;
+static uint64_t main_wait_ns;                       // calling thread
+static std::atomic<uint64_t> render_idle_ns;        // render thread
+static std::atomic<uint64_t> render_gpu_wait_ns;
+static std::atomic<uint64_t> render_thread_frames;
 
 static uint32_t current_frame = 0;
 static uint32_t current_image_index = 0;
+static uint64_t frame_number = 0;
+
+static Render_Config config;
+static VkExtent2D render_extent;    // the output, swapchain or headless image
+static const VkFormat color_format = VK_FORMAT_B8G8R8A8_SRGB;
+
+// Dynamic resolution (see Render_Config). The scene renders into the top left scene_extent of a
+// target_extent sized target, which is then blitted over the output. Without it both equal
+// render_extent and the scene renders straight into the output.
+static VkExtent2D target_extent;
+static VkExtent2D scene_extent;
+static float render_scale = 1.0f;
+static uint64_t render_scale_frame;     // first frame rendered at render_scale
+static uint32_t render_scale_changes;
+static double render_scale_gpu_ms;
+static VkFilter upscale_filter = VK_FILTER_LINEAR;
+static constexpr double SCALE_DEAD_BAND = 0.85;     // of the target, below it the scale grows
+static constexpr double SCALE_HEADROOM = 0.92;
+static constexpr float SCALE_STEPS = 64.0f;
+
+// Headless mode renders into one offscreen image per frame in flight and copies each finished
+// frame into a persistently mapped readback buffer. The copy for a frame is read back the next
+// time its slot comes around, after the frame has finished, so the frame loop never stalls on it.
+struct Headless_Target {
+    Image* image;
+    Buffer* readback;
+    bool readback_pending;
+    uint64_t readback_frame_number;
+};
+
+static Headless_Target headless_targets[MAX_FRAMES_IN_FLIGHT];
+
+// Every live buffer, so defragmentation can find the ones sitting in blocks being evacuated.
+static std::mutex live_buffers_mutex;
+static Buffer** live_buffers;
+static uint32_t live_buffer_count;
+static uint32_t live_buffer_capacity;
+
+// A destroyed buffer or image keeps its memory until every frame that may have used it has
+// retired. Buffers are destroyed from the render thread as well, hence the mutex.
+struct Retired_Resource {
+    VkBuffer buffer;
+    VkImage image;
+    VkImageView image_view;
+    Gpu_Allocation allocation;
+    uint64_t retire_serial;
+};
+
+static std::mutex retired_resources_mutex;
+static Retired_Resource* retired_resources;
+static uint32_t retired_resource_count;
+static uint32_t retired_resource_capacity;
+
+// One-off command buffer for work outside the frame loop, such as defragmentation copies.
+static VkCommandPool immediate_command_pool;
+static VkCommandBuffer immediate_command_buffer;
+static VkFence immediate_fence;
+
+static VkPipelineCache pipeline_cache;
+static bool pipeline_cache_loaded;
+
+// Pipelines are compiled on worker threads, so the stats are kept as atomics.
+static std::atomic<uint32_t> pipeline_cache_hits;
+static std::atomic<uint32_t> pipeline_cache_misses;
+static std::atomic<uint32_t> pipeline_cache_unknown;
+static std::atomic<uint64_t> pipeline_compile_ns;
+
+static Material placeholder_material;
+
+// The slot to draw `material` with: its own once its pipeline is ready, else the placeholder's,
+// else UINT32_MAX to skip the draw. Destroyed handles skip too.
+static uint32_t drawable_material(Material material) {
+    if (render_material_ready(material)) {
+        return handle_slot(material.handle);
+    }
+    if (handle_pool_valid(&material_pool, material.handle) && render_material_ready(placeholder_material)) {
+        return handle_slot(placeholder_material.handle);
+    }
+    return UINT32_MAX;
+}
+
+// render_draw() only appends a packet here. At render_end_frame() the packets are sorted by key
+// and recorded with redundant binds dropped and repeated draws merged into instanced draws.
+// Sort key layout: [31:24] layer (unused, 0), [23:0] material slot.
+static uint32_t draw_packet_count;
+static uint32_t draw_packet_capacity;
+static uint32_t* draw_packet_keys;
+static uint32_t* draw_packet_materials;     // slots
+static uint32_t* draw_packet_uniform_offsets;
+static uint32_t* draw_packet_order;
+static uint32_t* draw_packet_scratch;
+
+// After sorting, runs of the same material collapse into batches (one instanced draw each). The
+// batches are split into contiguous chunks that are recorded into secondaries in parallel and
+// executed in chunk order, so the result does not depend on which thread recorded what.
+struct Draw_Batch {
+    uint32_t material;      // slot
+    uint32_t uniform_offset;
+    uint32_t instance_count;
+};
+
+struct Record_Chunk {
+    uint32_t first_batch;
+    uint32_t batch_count;
+    uint32_t pipeline_binds;
+    VkCommandBuffer command_buffer;
+};
+
+static constexpr uint32_t MIN_BATCHES_PER_CHUNK = 128;
+
+static Draw_Batch* draw_batches;
+static Record_Chunk* record_chunks;
+
+static Draw_Stats draw_stats;
+
+static uint64_t frame_begin_ns;
+
+// Per-frame dynamic data is bump allocated out of one persistently mapped buffer, split into one
+// partition per frame in flight. A partition is rewound once its frame has finished on the GPU, so
+// per-draw data costs no allocations and no map calls. The buffer sits in the bindless table at
+// UPLOAD_RING_BUFFER_INDEX and draws get their byte offset as a push constant.
+static constexpr uint32_t NO_UNIFORMS = UINT32_MAX;
+
+static VkBuffer upload_buffer;
+static Gpu_Allocation upload_allocation;
+static uint64_t upload_partition_size;
+static uint64_t upload_alignment;
+static Upload_Cursor direct_upload;                     // the only cursor without a render thread
+static Upload_Cursor* declaring_upload = &direct_upload; // calling thread, render_upload_allocate()
+static Upload_Cursor* recording_upload = &direct_upload; // recording thread, the frame graph's passes
+
+// Every material shares one layout: the bindless set plus Draw_Push_Constants. Pipelines only
+// differ in shaders and state, so switching them never disturbs the bound set or push constants.
+static VkPipelineLayout pipeline_layout;
+
+// The depth buffer is a frame graph transient, frames run one after the other on the queue so
+// one placement serves every frame slot. It doubles as the occlusion culling input: after the
+// main pass it is reduced into the Hi-Z pyramid the next frame's cull reads. The Hi-Z build reads
+// it through a bindless slot, rewritten whenever the graph hands out a new view.
+static const VkFormat depth_format = VK_FORMAT_D32_SFLOAT;
+static uint32_t depth_resource;
+// The frame's output is a swapchain image or this slot's headless image. Swapchain images come back
+// from every acquire undefined, so their graph state is rebuilt each frame. With dynamic
+// resolution the main pass renders into a transient instead, blitted to the output after.
+static uint32_t output_resource;
+static uint32_t color_resource;
+static Frame_Graph_State swapchain_graph_state;
+static VkImageView depth_bindless_view;
+static uint32_t depth_bindless_index = BINDLESS_INVALID_INDEX;
+static Buffer* hiz_buffer;
+static uint32_t hiz_level_count;
+static uint32_t hiz_widths[MAX_HIZ_LEVELS];
+static uint32_t hiz_heights[MAX_HIZ_LEVELS];
+static uint32_t hiz_offsets[MAX_HIZ_LEVELS];
+// False until a pyramid has been built from a frame, and again after a resize or mode change.
+static bool hiz_valid;
+
+// Scenes queued by render_draw_scene(), culled and drawn at render_end_frame().
+struct Scene_Draw {
+    Scene* scene;
+    float view_projection[16];
+    uint32_t view_offset;       // Scene_View in the upload ring
+    bool culled;                // false if the upload ring ran out, the scene is skipped
+};
+
+static Scene_Draw scene_draws[MAX_SCENE_DRAWS];
+static uint32_t scene_draw_count;
+static Cull_Mode cull_mode;
+static Cull_Stats cull_stats;
+
+static void on_framebuffer_resize(GLFWwindow*, int width, int height) {
+    framebuffer_width.store(width, std::memory_order_relaxed);
+    framebuffer_height.store(height, std::memory_order_relaxed);
+    swapchain_dirty = true;
+}
 
 static void init_window() {
     glfwInit();
     glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    window = glfwCreateWindow(800, 600, "Vulkan Window", nullptr, nullptr);
+    window = glfwCreateWindow(render_extent.width, render_extent.height, "Vulkan Window", nullptr, nullptr);
+    glfwSetFramebufferSizeCallback(window, on_framebuffer_resize);
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    framebuffer_width.store(width, std::memory_order_relaxed);
+    framebuffer_height.store(height, std::memory_order_relaxed);
+}
+
+static constexpr uint32_t MAX_INSTANCE_EXTENSIONS = 16;
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL on_validation_message(VkDebugUtilsMessageSeverityFlagBitsEXT severity,
+    VkDebugUtilsMessageTypeFlagsEXT, const VkDebugUtilsMessengerCallbackDataEXT* data, void*) {
+    if (severity & VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT) {
+        LOG_ERROR(LOG_CATEGORY_RENDER, "🔸%s\n", data->pMessage);
+    } else {
+        LOG_WARN(LOG_CATEGORY_RENDER, "🔸%s\n", data->pMessage);
+    }
+    return VK_FALSE;
+}
+
+static bool validation_layer_available(const char* name) {
+    uint32_t layer_count = 0;
+    vkEnumerateInstanceLayerProperties(&layer_count, nullptr);
+    size_t mark = arena_mark(&scratch);
+    VkLayerProperties* layers = arena_push_array<VkLayerProperties>(&scratch, layer_count);
+    vkEnumerateInstanceLayerProperties(&layer_count, layers);
+    bool found = false;
+    for (uint32_t i = 0; i < layer_count && !found; i++) {
+        found = strcmp(layers[i].layerName, name) == 0;
+    }
+    arena_reset(&scratch, mark);
+    return found;
 }
 
 static void init_vulkan_instance() {
@@ -61,14 +524,34 @@ static void init_vulkan_instance() {
     uint32_t major = VK_VERSION_MAJOR(api_version);
     uint32_t minor = VK_VERSION_MINOR(api_version);
     uint32_t patch = VK_VERSION_PATCH(api_version);
-    printf("• Vulkan library version: %d.%d.%d\n", major, minor, patch);
-
-    const char* required_layers[] = {
-        "VK_LAYER_KHRONOS_validation"
-    };
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Vulkan library version: %d.%d.%d\n", major, minor, patch);
 
+    // Headless mode never touches GLFW, so it needs no surface extensions.
+    const char* extensions[MAX_INSTANCE_EXTENSIONS];
     uint32_t extension_count = 0;
-    const char** required_extensions = glfwGetRequiredInstanceExtensions(&extension_count);
+    if (!config.headless) {
+        uint32_t glfw_count = 0;
+        const char** glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_count);
+        for (uint32_t i = 0; i < glfw_count && extension_count < MAX_INSTANCE_EXTENSIONS - 1; i++) {
+            extensions[extension_count++] = glfw_extensions[i];
+        }
+    }
+
+    const char* validation_layer = "VK_LAYER_KHRONOS_validation";
+    VkDebugUtilsMessengerCreateInfoEXT messenger_info{};
+    messenger_info.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+    messenger_info.messageSeverity = VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+    messenger_info.messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT | VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+        VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+    messenger_info.pfnUserCallback = on_validation_message;
+    if (RENDER_VALIDATION) {
+        validation_enabled = validation_layer_available(validation_layer);
+        if (validation_enabled) {
+            extensions[extension_count++] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+        } else {
+            LOG_WARN(LOG_CATEGORY_RENDER, "🔸%s not installed, running without validation.\n", validation_layer);
+        }
+    }
 
     VkApplicationInfo appInfo{};
     appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
@@ -77,69 +560,103 @@ static void init_vulkan_instance() {
     VkInstanceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
     createInfo.pApplicationInfo = &appInfo;
-    createInfo.enabledLayerCount = 1;
-    createInfo.ppEnabledLayerNames = required_layers;
     createInfo.enabledExtensionCount = extension_count;
-    createInfo.ppEnabledExtensionNames = required_extensions;
+    createInfo.ppEnabledExtensionNames = extensions;
+    if (validation_enabled) {
+        // Chained in as well so instance creation and destruction are covered.
+        createInfo.enabledLayerCount = 1;
+        createInfo.ppEnabledLayerNames = &validation_layer;
+        createInfo.pNext = &messenger_info;
+    }
 
     vkCreateInstance(&createInfo, nullptr, &instance);
-    printf("• Vulkan instance created.\n");
+
+    if (validation_enabled) {
+        auto create_messenger = (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkCreateDebugUtilsMessengerEXT");
+        if (create_messenger) {
+            create_messenger(instance, &messenger_info, nullptr, &debug_messenger);
+        }
+    }
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Vulkan instance created (validation %s).\n", validation_enabled ? "on" : "off");
 }
 
 void init_vulkan_physical_device() {
     uint32_t device_count = 0;
     vkEnumeratePhysicalDevices(instance, &device_count, nullptr);
     if (device_count == 0) {
-        fprintf(stderr, "🔸Failed to find GPUs with Vulkan support!\n");
+        LOG_ERROR(LOG_CATEGORY_RENDER, "🔸Failed to find GPUs with Vulkan support!\n");
+        log_flush();
         exit(EXIT_FAILURE);
     }
 
-    VkPhysicalDevice* devices = (VkPhysicalDevice*)malloc(sizeof(VkPhysicalDevice) * device_count);
+    size_t mark = arena_mark(&scratch);
+    VkPhysicalDevice* devices = arena_push_array<VkPhysicalDevice>(&scratch, device_count);
     vkEnumeratePhysicalDevices(instance, &device_count, devices);
 
     physical_device = devices[0];
-    free(devices);
+    arena_reset(&scratch, mark);
 
     VkPhysicalDeviceProperties deviceProperties;
     vkGetPhysicalDeviceProperties(physical_device, &deviceProperties);
-    printf("• Selected GPU: %s\n", deviceProperties.deviceName);
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Selected GPU: %s\n", deviceProperties.deviceName);
 }
 
 static void init_vulkan_surface() {
     if (glfwCreateWindowSurface(instance, window, nullptr, &surface) != VK_SUCCESS) {
-        fprintf(stderr, "🔸Failed to create window surface\n");
+        LOG_ERROR(LOG_CATEGORY_RENDER, "🔸Failed to create window surface\n");
+        log_flush();
         exit(EXIT_FAILURE);
     }
-    printf("• Vulkan surface created.\n");
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Vulkan surface created.\n");
 
     VkSurfaceCapabilitiesKHR surfaceCapabilities;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &surfaceCapabilities);
-    printf("  - Min image count: %u\n", surfaceCapabilities.minImageCount);
-    printf("  - Max image count: %u\n", surfaceCapabilities.maxImageCount);
-    printf("  - Current extent: %d x %d\n", surfaceCapabilities.currentExtent.width, surfaceCapabilities.currentExtent.height);
+    LOG_INFO(LOG_CATEGORY_RENDER, "  - Min image count: %u\n", surfaceCapabilities.minImageCount);
+    LOG_INFO(LOG_CATEGORY_RENDER, "  - Max image count: %u\n", surfaceCapabilities.maxImageCount);
+    LOG_INFO(LOG_CATEGORY_RENDER, "  - Current extent: %d x %d\n", surfaceCapabilities.currentExtent.width, surfaceCapabilities.currentExtent.height);
 
     uint32_t formatCount;
     vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &formatCount, nullptr);
-    VkSurfaceFormatKHR* formats = (VkSurfaceFormatKHR*)malloc(sizeof(VkSurfaceFormatKHR) * formatCount);
+    size_t mark = arena_mark(&scratch);
+    VkSurfaceFormatKHR* formats = arena_push_array<VkSurfaceFormatKHR>(&scratch, formatCount);
     vkGetPhysicalDeviceSurfaceFormatsKHR(physical_device, surface, &formatCount, formats);
-    printf("  - Supported formats:\n");
+    LOG_INFO(LOG_CATEGORY_RENDER, "  - Supported formats:\n");
     for (uint32_t i = 0; i < formatCount; i++) {
-        printf("    • Format ID: %d, Color Space ID: %d\n", formats[i].format, formats[i].colorSpace);
+        LOG_INFO(LOG_CATEGORY_RENDER, "    • Format ID: %d, Color Space ID: %d\n", formats[i].format, formats[i].colorSpace);
     }
-    free(formats);
+    arena_reset(&scratch, mark);
 }
 
 static void init_vulkan_device() {
 
-    const char* device_extensions[] = {
-        VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-        VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME
-    };
+    // Headless mode has no swapchain to present to, only dynamic rendering is needed.
+    const char* device_extensions[3];
+    uint32_t device_extension_count = 0;
+    if (!config.headless) {
+        device_extensions[device_extension_count++] = VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    }
+    device_extensions[device_extension_count++] = VK_KHR_DYNAMIC_RENDERING_EXTENSION_NAME;
+
+    // Texture residency tracks device memory against the driver's budget when it reports one.
+    uint32_t available_count = 0;
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &available_count, nullptr);
+    size_t extensions_mark = arena_mark(&scratch);
+    VkExtensionProperties* available = arena_push_array<VkExtensionProperties>(&scratch, available_count);
+    vkEnumerateDeviceExtensionProperties(physical_device, nullptr, &available_count, available);
+    for (uint32_t i = 0; i < available_count; i++) {
+        if (strcmp(available[i].extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0) {
+            memory_budget_supported = true;
+            device_extensions[device_extension_count++] = VK_EXT_MEMORY_BUDGET_EXTENSION_NAME;
+            break;
+        }
+    }
+    arena_reset(&scratch, extensions_mark);
 
     // Find a suitable queue family
     uint32_t queue_family_count = 0;
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, nullptr);
-    VkQueueFamilyProperties* queueFamilies = (VkQueueFamilyProperties*)malloc(sizeof(VkQueueFamilyProperties) * queue_family_count);
+    size_t mark = arena_mark(&scratch);
+    VkQueueFamilyProperties* queueFamilies = arena_push_array<VkQueueFamilyProperties>(&scratch, queue_family_count);
     vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &queue_family_count, queueFamilies);
 
     for (uint32_t i = 0; i < queue_family_count; i++) {
@@ -149,54 +666,266 @@ static void init_vulkan_device() {
         }
     }
 
-    float queuePriority = 1.0f;
-    VkDeviceQueueCreateInfo queueCreateInfo{};
-    queueCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queueCreateInfo.queueFamilyIndex = graphics_queue_family_index;
-    queueCreateInfo.queueCount = 1;
-    queueCreateInfo.pQueuePriorities = &queuePriority;
-
-    // Enable dynamic rendering feature (required for vkCmdBeginRendering/vkCmdEndRendering)
-    VkPhysicalDeviceDynamicRenderingFeatures dynamic_rendering_feats{};
-    dynamic_rendering_feats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES;
-    dynamic_rendering_feats.dynamicRendering = VK_TRUE;
+    // Prefer a pure copy engine for streaming, then any non-graphics family that can transfer.
+    transfer_queue_family_index = graphics_queue_family_index;
+    for (uint32_t i = 0; i < queue_family_count; i++) {
+        VkQueueFlags flags = queueFamilies[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+            transfer_queue_family_index = i;
+            break;
+        }
+        if ((flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) && !(flags & VK_QUEUE_GRAPHICS_BIT) &&
+            transfer_queue_family_index == graphics_queue_family_index) {
+            transfer_queue_family_index = i;
+        }
+    }
+    bool second_graphics_queue = transfer_queue_family_index == graphics_queue_family_index &&
+        queueFamilies[graphics_queue_family_index].queueCount > 1;
+    arena_reset(&scratch, mark);
+
+    float queuePriorities[] = {1.0f, 0.5f};
+    VkDeviceQueueCreateInfo queueCreateInfos[2]{};
+    queueCreateInfos[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfos[0].queueFamilyIndex = graphics_queue_family_index;
+    queueCreateInfos[0].queueCount = second_graphics_queue ? 2 : 1;
+    queueCreateInfos[0].pQueuePriorities = queuePriorities;
+    queueCreateInfos[1].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queueCreateInfos[1].queueFamilyIndex = transfer_queue_family_index;
+    queueCreateInfos[1].queueCount = 1;
+    queueCreateInfos[1].pQueuePriorities = &queuePriorities[1];
+
+    VkPhysicalDeviceVulkan12Features supported_12{};
+    supported_12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    VkPhysicalDeviceVulkan13Features supported_13{};
+    supported_13.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    supported_13.pNext = &supported_12;
+    VkPhysicalDeviceFeatures2 supported{};
+    supported.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    supported.pNext = &supported_13;
+    vkGetPhysicalDeviceFeatures2(physical_device, &supported);
+
+    struct Required_Feature {
+        VkBool32 supported;
+        const char* name;
+    };
+    Required_Feature required_features[] = {
+        {supported_12.timelineSemaphore, "timelineSemaphore"},
+        {supported_12.descriptorIndexing, "descriptorIndexing"},
+        {supported_12.runtimeDescriptorArray, "runtimeDescriptorArray"},
+        {supported_12.descriptorBindingPartiallyBound, "descriptorBindingPartiallyBound"},
+        {supported_12.descriptorBindingUpdateUnusedWhilePending, "descriptorBindingUpdateUnusedWhilePending"},
+        {supported_12.descriptorBindingSampledImageUpdateAfterBind, "descriptorBindingSampledImageUpdateAfterBind"},
+        {supported_12.descriptorBindingStorageBufferUpdateAfterBind, "descriptorBindingStorageBufferUpdateAfterBind"},
+        {supported_12.shaderSampledImageArrayNonUniformIndexing, "shaderSampledImageArrayNonUniformIndexing"},
+        {supported_12.shaderStorageBufferArrayNonUniformIndexing, "shaderStorageBufferArrayNonUniformIndexing"},
+        {supported_13.dynamicRendering, "dynamicRendering"},
+        {supported_13.synchronization2, "synchronization2"},
+        {supported.features.multiDrawIndirect, "multiDrawIndirect"},
+        {supported.features.drawIndirectFirstInstance, "drawIndirectFirstInstance"},
+    };
+    bool missing_feature = false;
+    for (const Required_Feature& feature : required_features) {
+        if (!feature.supported) {
+            LOG_ERROR(LOG_CATEGORY_RENDER, "🔸The device does not support %s\n", feature.name);
+            missing_feature = true;
+        }
+    }
+    if (missing_feature) {
+        log_flush();
+        exit(EXIT_FAILURE);
+    }
+    draw_indirect_count_supported = supported_12.drawIndirectCount;
+
+    // Timeline semaphores hand streamed uploads from the transfer queue to the graphics queue.
+    VkPhysicalDeviceVulkan12Features vulkan12_feats{};
+    vulkan12_feats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+    vulkan12_feats.timelineSemaphore = VK_TRUE;
+    // The bindless table: runtime sized arrays, written while bound, indexed per draw.
+    vulkan12_feats.descriptorIndexing = VK_TRUE;
+    vulkan12_feats.runtimeDescriptorArray = VK_TRUE;
+    vulkan12_feats.descriptorBindingPartiallyBound = VK_TRUE;
+    vulkan12_feats.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    vulkan12_feats.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    vulkan12_feats.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    vulkan12_feats.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+    vulkan12_feats.shaderStorageBufferArrayNonUniformIndexing = VK_TRUE;
+    // GPU-driven scenes: the draw count comes from a buffer, many draws per call, and
+    // firstInstance carries the object index.
+    vulkan12_feats.drawIndirectCount = draw_indirect_count_supported;
+    VkPhysicalDeviceFeatures device_feats{};
+    device_feats.multiDrawIndirect = VK_TRUE;
+    device_feats.drawIndirectFirstInstance = VK_TRUE;
+    // Block compressed textures, whichever families the device samples.
+    device_feats.textureCompressionBC = supported.features.textureCompressionBC;
+    device_feats.textureCompressionASTC_LDR = supported.features.textureCompressionASTC_LDR;
+
+    // Dynamic rendering (vkCmdBeginRendering/vkCmdEndRendering) and synchronization2, which the
+    // frame graph records its barriers with.
+    VkPhysicalDeviceVulkan13Features vulkan13_feats{};
+    vulkan13_feats.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES;
+    vulkan13_feats.dynamicRendering = VK_TRUE;
+    vulkan13_feats.synchronization2 = VK_TRUE;
+    vulkan13_feats.pNext = &vulkan12_feats;
 
     VkDeviceCreateInfo createInfo{};
     createInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-    createInfo.queueCreateInfoCount = 1;
-    createInfo.pQueueCreateInfos = &queueCreateInfo;
-    createInfo.enabledExtensionCount = 2;
+    createInfo.queueCreateInfoCount = transfer_queue_family_index != graphics_queue_family_index ? 2 : 1;
+    createInfo.pQueueCreateInfos = queueCreateInfos;
+    createInfo.enabledExtensionCount = device_extension_count;
     createInfo.ppEnabledExtensionNames = device_extensions;
-    createInfo.pNext = &dynamic_rendering_feats;
+    createInfo.pNext = &vulkan13_feats;
+    createInfo.pEnabledFeatures = &device_feats;
 
     vkCreateDevice(physical_device, &createInfo, nullptr, &device);
 
     vkGetDeviceQueue(device, graphics_queue_family_index, 0, &graphics_queue);
+    if (transfer_queue_family_index != graphics_queue_family_index) {
+        vkGetDeviceQueue(device, transfer_queue_family_index, 0, &transfer_queue);
+    } else {
+        vkGetDeviceQueue(device, graphics_queue_family_index, second_graphics_queue ? 1 : 0, &transfer_queue);
+    }
 
-    printf("• Logical device created.\n");
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Logical device created (BC %s, ASTC %s, memory budget %s, draw indirect count %s).\n",
+        device_feats.textureCompressionBC ? "yes" : "no", device_feats.textureCompressionASTC_LDR ? "yes" : "no",
+        memory_budget_supported ? "yes" : "no", draw_indirect_count_supported ? "yes" : "no");
 }
 
-void init_vulkan_swapchain() {
+static VkPresentModeKHR to_vk_present_mode(Present_Mode mode) {
+    switch (mode) {
+    case PRESENT_MODE_FIFO_RELAXED: return VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+    case PRESENT_MODE_MAILBOX: return VK_PRESENT_MODE_MAILBOX_KHR;
+    case PRESENT_MODE_IMMEDIATE: return VK_PRESENT_MODE_IMMEDIATE_KHR;
+    default: return VK_PRESENT_MODE_FIFO_KHR;
+    }
+}
+
+static const char* present_mode_name(Present_Mode mode) {
+    switch (mode) {
+    case PRESENT_MODE_FIFO_RELAXED: return "fifo relaxed";
+    case PRESENT_MODE_MAILBOX: return "mailbox";
+    case PRESENT_MODE_IMMEDIATE: return "immediate";
+    default: return "fifo";
+    }
+}
+
+// Walks from the requested mode towards FIFO, which every surface supports. The two low latency
+// modes stand in for each other before giving up on them.
+static Present_Mode choose_present_mode(Present_Mode requested) {
+    uint32_t mode_count = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &mode_count, nullptr);
+    size_t mark = arena_mark(&scratch);
+    VkPresentModeKHR* modes = arena_push_array<VkPresentModeKHR>(&scratch, mode_count);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physical_device, surface, &mode_count, modes);
+
+    Present_Mode candidates[3] = {requested, PRESENT_MODE_FIFO, PRESENT_MODE_FIFO};
+    if (requested == PRESENT_MODE_MAILBOX) {
+        candidates[1] = PRESENT_MODE_IMMEDIATE;
+    } else if (requested == PRESENT_MODE_IMMEDIATE) {
+        candidates[1] = PRESENT_MODE_MAILBOX;
+    }
 
+    Present_Mode chosen = PRESENT_MODE_FIFO;
+    for (uint32_t c = 0; c < 3 && chosen == PRESENT_MODE_FIFO; c++) {
+        for (uint32_t i = 0; i < mode_count; i++) {
+            if (modes[i] == to_vk_present_mode(candidates[c])) {
+                chosen = candidates[c];
+                break;
+            }
+        }
+    }
+    arena_reset(&scratch, mark);
+
+    if (chosen != requested) {
+        LOG_WARN(LOG_CATEGORY_RENDER, "🔸Present mode %s not supported, using %s.\n", present_mode_name(requested), present_mode_name(chosen));
+    }
+    return chosen;
+}
+
+// The upscale is a blit, check the color format can be blitted and filtered before promising it.
+static void init_dynamic_resolution() {
+    if (!config.dynamic_resolution) {
+        return;
+    }
+    config.min_render_scale = std::clamp(config.min_render_scale, 0.1f, 1.0f);
+    config.max_render_scale = std::clamp(config.max_render_scale, config.min_render_scale, 1.0f);
+    render_scale = config.max_render_scale;
+
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, color_format, &properties);
+    VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT;
+    if ((properties.optimalTilingFeatures & blit) != blit) {
+        LOG_WARN(LOG_CATEGORY_RENDER, "🔸Color format can't be blitted, dynamic resolution disabled\n");
+        config.dynamic_resolution = false;
+        return;
+    }
+    upscale_filter = (properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+}
+
+// Follows render_extent and render_scale. The target only changes with the output.
+static void update_scene_extent() {
+    if (!config.dynamic_resolution) {
+        target_extent = render_extent;
+        scene_extent = render_extent;
+        return;
+    }
+    target_extent.width = std::max((uint32_t)ceilf(render_extent.width * config.max_render_scale), 1u);
+    target_extent.height = std::max((uint32_t)ceilf(render_extent.height * config.max_render_scale), 1u);
+    scene_extent.width = std::clamp((uint32_t)(render_extent.width * render_scale + 0.5f), 1u, target_extent.width);
+    scene_extent.height = std::clamp((uint32_t)(render_extent.height * render_scale + 0.5f), 1u, target_extent.height);
+}
+
+// Creates the swapchain for the surface's current size, retiring `old_swapchain` if there is one.
+// Returns false without touching anything while the window has no area, e.g. when minimized.
+static bool create_swapchain(VkSwapchainKHR old_swapchain) {
     VkSurfaceCapabilitiesKHR surfaceCapabilities;
     vkGetPhysicalDeviceSurfaceCapabilitiesKHR(physical_device, surface, &surfaceCapabilities);
 
+    // A current extent of UINT32_MAX means the window size decides.
+    VkExtent2D extent = surfaceCapabilities.currentExtent;
+    if (extent.width == UINT32_MAX) {
+        uint32_t width = framebuffer_width.load(std::memory_order_relaxed);
+        uint32_t height = framebuffer_height.load(std::memory_order_relaxed);
+        extent.width = std::clamp(width, surfaceCapabilities.minImageExtent.width, surfaceCapabilities.maxImageExtent.width);
+        extent.height = std::clamp(height, surfaceCapabilities.minImageExtent.height, surfaceCapabilities.maxImageExtent.height);
+    }
+    if (extent.width == 0 || extent.height == 0) {
+        return false;
+    }
+
+    uint32_t image_count = config.swapchain_images ? config.swapchain_images : surfaceCapabilities.minImageCount;
+    image_count = std::max(image_count, surfaceCapabilities.minImageCount);
+    if (surfaceCapabilities.maxImageCount != 0) {
+        image_count = std::min(image_count, surfaceCapabilities.maxImageCount);
+    }
+
+    present_mode = choose_present_mode(requested_present_mode);
+
     VkSwapchainCreateInfoKHR create_info{};
     create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     create_info.surface = surface;
-    create_info.minImageCount = surfaceCapabilities.minImageCount;
-    create_info.imageFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    create_info.minImageCount = image_count;
+    create_info.imageFormat = color_format;
     create_info.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
-    create_info.imageExtent = {800, 600};
+    create_info.imageExtent = extent;
     create_info.imageArrayLayers = 1;
     create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    // The upscale blits into it.
+    if (config.dynamic_resolution && (surfaceCapabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_DST_BIT)) {
+        create_info.imageUsage |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    } else if (config.dynamic_resolution) {
+        LOG_WARN(LOG_CATEGORY_RENDER, "🔸Swapchain images can't be blitted to, dynamic resolution disabled\n");
+        config.dynamic_resolution = false;
+    }
     create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
     create_info.preTransform = VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR;
     create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    create_info.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    create_info.presentMode = to_vk_present_mode(present_mode);
     create_info.clipped = VK_TRUE;
+    create_info.oldSwapchain = old_swapchain;
 
     vkCreateSwapchainKHR(device, &create_info, nullptr, &swapchain);
+    render_extent = extent;
+    update_scene_extent();
 
     vkGetSwapchainImagesKHR(device, swapchain, &swapchain_image_count, nullptr);
     swapchain_images = (VkImage*)malloc(sizeof(VkImage) * swapchain_image_count);
@@ -208,7 +937,7 @@ void init_vulkan_swapchain() {
         view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
         view_info.image = swapchain_images[i];
         view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        view_info.format = VK_FORMAT_B8G8R8A8_SRGB;
+        view_info.format = color_format;
         view_info.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
         view_info.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
         view_info.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -222,271 +951,1898 @@ void init_vulkan_swapchain() {
         vkCreateImageView(device, &view_info, nullptr, &swapchain_image_views[i]);
     }
 
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Swapchain created (%u x %u, %u images, %s).\n", extent.width, extent.height, swapchain_image_count, present_mode_name(present_mode));
+    return true;
+}
 
-    printf("• Swapchain created.\n");
+void init_vulkan_swapchain() {
+    requested_present_mode = config.present_mode;
+    swapchain_dirty = !create_swapchain(VK_NULL_HANDLE);
 }
 
-static void init_vulkan_command_buffers() {
-    VkCommandPoolCreateInfo pool_info{};
-    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-    pool_info.queueFamilyIndex = graphics_queue_family_index;
+static void destroy_swapchain_images(VkImage* images, VkImageView* image_views, uint32_t image_count) {
+    for (uint32_t i = 0; i < image_count; ++i) {
+        vkDestroyImageView(device, image_views[i], nullptr);
+    }
+    free(image_views);
+    free(images);
+}
 
-    vkCreateCommandPool(device, &pool_info, nullptr, &command_pool);
+static uint64_t completed_serial();
+static void reset_hiz();
+
+// Destroys the retired swapchains no frame in flight is still using.
+static void destroy_retired_swapchains(bool all) {
+    uint64_t completed = all ? UINT64_MAX : completed_serial();
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < retired_swapchain_count; i++) {
+        Retired_Swapchain* retired = &retired_swapchains[i];
+        if (retired->retire_serial <= completed) {
+            destroy_swapchain_images(retired->images, retired->image_views, retired->image_count);
+            vkDestroySwapchainKHR(device, retired->swapchain, nullptr);
+            if (retired->hiz_buffer) {
+                render_destroy_buffer(retired->hiz_buffer);
+            }
+        } else {
+            retired_swapchains[kept++] = *retired;
+        }
+    }
+    retired_swapchain_count = kept;
+}
 
-    VkCommandBufferAllocateInfo alloc_info{};
-    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    alloc_info.commandPool = command_pool;
-    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    alloc_info.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+// Destroys the retired materials no frame in flight may still draw with, and frees their slots.
+static void destroy_retired_materials(bool all) {
+    uint64_t completed = all ? UINT64_MAX : completed_serial();
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < retired_material_count; i++) {
+        Retired_Material* retired = &retired_materials[i];
+        if (retired->retire_serial <= completed) {
+            vkDestroyPipeline(device, material_pipelines[retired->slot], nullptr);
+            material_pipelines[retired->slot] = VK_NULL_HANDLE;
+            handle_pool_release(&material_pool, retired->slot);
+        } else {
+            retired_materials[kept++] = *retired;
+        }
+    }
+    retired_material_count = kept;
+}
 
-    vkAllocateCommandBuffers(device, &alloc_info, command_buffers);
+static void retire_resource(const Retired_Resource* resource) {
+    std::lock_guard<std::mutex> lock(retired_resources_mutex);
+    if (retired_resource_count == retired_resource_capacity) {
+        retired_resource_capacity = retired_resource_capacity ? retired_resource_capacity * 2 : 64;
+        retired_resources = (Retired_Resource*)realloc(retired_resources, sizeof(Retired_Resource) * retired_resource_capacity);
+    }
+    retired_resources[retired_resource_count++] = *resource;
+}
 
-    printf("• Command buffers allocated.\n");
+// Destroys the retired buffers and images no frame in flight may still read or write.
+static void destroy_retired_resources(bool all) {
+    uint64_t completed = all ? UINT64_MAX : completed_serial();
+    std::lock_guard<std::mutex> lock(retired_resources_mutex);
+    uint32_t kept = 0;
+    for (uint32_t i = 0; i < retired_resource_count; i++) {
+        Retired_Resource* retired = &retired_resources[i];
+        if (retired->retire_serial <= completed) {
+            vkDestroyImageView(device, retired->image_view, nullptr);
+            vkDestroyImage(device, retired->image, nullptr);
+            vkDestroyBuffer(device, retired->buffer, nullptr);
+            gpu_memory_free(&retired->allocation);
+        } else {
+            retired_resources[kept++] = *retired;
+        }
+    }
+    retired_resource_count = kept;
 }
 
-static void init_vulkan_sync_objects() {
-    VkSemaphoreCreateInfo semInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
-    VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
-    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // start signaled
+static bool recreate_swapchain() {
+    VkSwapchainKHR old_swapchain = swapchain;
+    VkImage* old_images = swapchain_images;
+    VkImageView* old_image_views = swapchain_image_views;
+    uint32_t old_image_count = swapchain_image_count;
 
-    for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-        vkCreateSemaphore(device, &semInfo, nullptr, &image_available_semaphores[i]);
-        vkCreateSemaphore(device, &semInfo, nullptr, &render_finished_semaphores[i]);
-        vkCreateFence(device, &fenceInfo, nullptr, &image_available_fences[i]);
+    if (!create_swapchain(old_swapchain)) {
+        return false;
+    }
+    swapchain_dirty = false;
+
+    if (retired_swapchain_count == retired_swapchain_capacity) {
+        retired_swapchain_capacity = retired_swapchain_capacity ? retired_swapchain_capacity * 2 : 4;
+        retired_swapchains = (Retired_Swapchain*)realloc(retired_swapchains, sizeof(Retired_Swapchain) * retired_swapchain_capacity);
     }
+    // The last frame to render into it is the one before this, its serial is frame_number.
+    retired_swapchains[retired_swapchain_count++] = {old_swapchain, old_images, old_image_views, old_image_count,
+        hiz_buffer, frame_number};
+    reset_hiz();
+    return true;
+}
 
-    printf("• Synchronization objects created.\n");
+// The depth buffer follows the target extent by itself, the frame graph places it every frame. The
+// Hi-Z pyramid is created lazily, only occlusion culling needs it.
+static void reset_hiz() {
+    hiz_buffer = nullptr;
+    hiz_valid = false;
 }
 
-void render_init() {
-    init_window();
-    init_vulkan_instance();
-    init_vulkan_physical_device();
-    init_vulkan_device();
-    init_vulkan_surface();
-    init_vulkan_swapchain();
-    init_vulkan_command_buffers();
-    init_vulkan_sync_objects();
+static void init_vulkan_headless_targets() {
+    uint64_t readback_size = (uint64_t)render_extent.width * render_extent.height * 4;
+
+    // With dynamic resolution the scene is rendered smaller and blitted up into the target.
+    uint32_t usage = IMAGE_USAGE_COLOR_ATTACHMENT | IMAGE_USAGE_TRANSFER_SRC;
+    if (config.dynamic_resolution) {
+        usage |= IMAGE_USAGE_TRANSFER_DST;
+    }
+
+    for (uint32_t i = 0; i < frames_in_flight; ++i) {
+        Headless_Target* target = &headless_targets[i];
+
+        render_create_image(&target->image, render_extent.width, render_extent.height, 1, IMAGE_FORMAT_BGRA8_SRGB, usage);
+
+        // Readback memory is host cached where available, host reads from uncached memory are very slow.
+        render_create_buffer(&target->readback, readback_size, BUFFER_USAGE_TRANSFER_DST, MEMORY_READBACK);
+    }
+
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Headless render targets created (%u x %u, %u frames).\n", render_extent.width, render_extent.height, frames_in_flight);
 }
 
-void render_begin_frame() {
-    vkWaitForFences(device, 1, &image_available_fences[current_frame], VK_TRUE, UINT64_MAX);
-    vkResetFences(device, 1, &image_available_fences[current_frame]);
+static void init_vulkan_command_buffers() {
+    // Buffers are never reset individually, only through their pool.
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = graphics_queue_family_index;
 
-    vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &current_image_index);
+    // The main thread records too, so it gets a pool next to the workers.
+    record_thread_count = jobs_worker_count() + 1;
 
-    VkCommandBuffer command_buffer = command_buffers[current_frame];
+    for (uint32_t i = 0; i < frames_in_flight; ++i) {
+        vkCreateCommandPool(device, &pool_info, nullptr, &frame_command_pools[i]);
 
-    vkResetCommandBuffer(command_buffer, 0);
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = frame_command_pools[i];
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        alloc_info.commandBufferCount = 1;
 
-    VkCommandBufferBeginInfo begin_info{};
-    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+        vkAllocateCommandBuffers(device, &alloc_info, &command_buffers[i]);
 
-    vkBeginCommandBuffer(command_buffer, &begin_info);
-  // Transition swapchain image from UNDEFINED -> COLOR_ATTACHMENT_OPTIMAL before rendering.
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    barrier.newLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = swapchain_images[current_image_index];
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-
-    vkCmdPipelineBarrier(
-        command_buffer,
-        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier
-    );
-
-    // Begin dynamic rendering and clear the color attachment.
-    VkRenderingAttachmentInfo color_attachment{};
-    color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
-    color_attachment.imageView = swapchain_image_views[current_image_index];
-    color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-    color_attachment.clearValue.color = { {0.1f, 0.0f, 0.0f, 1.0f} }; // clear to black (RGBA)
+        thread_command_pools[i] = new Thread_Command_Pool[record_thread_count]();
+        for (uint32_t thread = 0; thread < record_thread_count; ++thread) {
+            vkCreateCommandPool(device, &pool_info, nullptr, &thread_command_pools[i][thread].pool);
+        }
+    }
 
-    VkRenderingInfo rendering_info{};
-    rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
-    rendering_info.renderArea.offset = {0, 0};
-    rendering_info.renderArea.extent = {800, 600};
-    rendering_info.layerCount = 1;
-    rendering_info.colorAttachmentCount = 1;
-    rendering_info.pColorAttachments = &color_attachment;
+    vkCreateCommandPool(device, &pool_info, nullptr, &immediate_command_pool);
 
-    vkCmdBeginRendering(command_buffer, &rendering_info);
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = immediate_command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = 1;
 
-    printf("• Frame %d image index %d: Command buffer recording started.\n", current_frame, current_image_index);
+    vkAllocateCommandBuffers(device, &alloc_info, &immediate_command_buffer);
+
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Command buffers allocated (%u recording threads).\n", record_thread_count);
 }
 
-void render_end_frame() {
-    VkCommandBuffer command_buffer = command_buffers[current_frame];
+static VkCommandBuffer begin_immediate_commands() {
+    vkResetCommandPool(device, immediate_command_pool, 0);
 
-    vkCmdEndRendering(command_buffer);
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-      // Transition the swapchain image to VK_IMAGE_LAYOUT_PRESENT_SRC_KHR before presenting.
-    // Record an image memory barrier into the current command buffer.
-    VkImageMemoryBarrier barrier{};
-    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL; // assumed previous layout
-    barrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
-    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-    barrier.image = swapchain_images[current_image_index];
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    barrier.subresourceRange.baseMipLevel = 0;
-    barrier.subresourceRange.levelCount = 1;
-    barrier.subresourceRange.baseArrayLayer = 0;
-    barrier.subresourceRange.layerCount = 1;
-    barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
-    barrier.dstAccessMask = 0;
-
-    vkCmdPipelineBarrier(
-        command_buffer,
-        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-        VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-        0,
-        0, nullptr,
-        0, nullptr,
-        1, &barrier
-    );
-    vkEndCommandBuffer(command_buffer);
+    vkBeginCommandBuffer(immediate_command_buffer, &begin_info);
+    return immediate_command_buffer;
+}
+
+// Submits the immediate command buffer and blocks until the GPU has executed it.
+static void end_immediate_commands() {
+    vkEndCommandBuffer(immediate_command_buffer);
 
     VkSubmitInfo submit_info{};
     submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-
-    VkSemaphore wait_semaphores[] = { image_available_semaphores[current_frame] };
-    VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT };
-    submit_info.waitSemaphoreCount = 1;
-    submit_info.pWaitSemaphores = wait_semaphores;
-    submit_info.pWaitDstStageMask = wait_stages;
-
     submit_info.commandBufferCount = 1;
-    submit_info.pCommandBuffers = &command_buffer;
+    submit_info.pCommandBuffers = &immediate_command_buffer;
 
-    VkSemaphore signal_semaphores[] = { render_finished_semaphores[current_frame] };
-    submit_info.signalSemaphoreCount = 1;
-    submit_info.pSignalSemaphores = signal_semaphores;
+    vkResetFences(device, 1, &immediate_fence);
+    {
+        std::lock_guard<std::mutex> lock(graphics_queue_mutex);
+        vkQueueSubmit(graphics_queue, 1, &submit_info, immediate_fence);
+    }
+    vkWaitForFences(device, 1, &immediate_fence, VK_TRUE, UINT64_MAX);
+}
 
-    vkQueueSubmit(graphics_queue, 1, &submit_info, image_available_fences[current_frame]);
+// Hands out the next free secondary from the calling thread's pool for this frame.
+static VkCommandBuffer acquire_secondary_command_buffer(uint32_t thread_index) {
+    Thread_Command_Pool* thread_pool = &thread_command_pools[current_frame][thread_index];
 
-    VkPresentInfoKHR present_info{};
-    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+    if (thread_pool->used_count == thread_pool->buffer_count) {
+        uint32_t new_count = thread_pool->buffer_count ? thread_pool->buffer_count * 2 : 4;
+        thread_pool->buffers = (VkCommandBuffer*)realloc(thread_pool->buffers, sizeof(VkCommandBuffer) * new_count);
 
-    present_info.waitSemaphoreCount = 1;
-    present_info.pWaitSemaphores = signal_semaphores;
+        VkCommandBufferAllocateInfo alloc_info{};
+        alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+        alloc_info.commandPool = thread_pool->pool;
+        alloc_info.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        alloc_info.commandBufferCount = new_count - thread_pool->buffer_count;
 
-    VkSwapchainKHR swapchains[] = { swapchain };
-    present_info.swapchainCount = 1;
-    present_info.pSwapchains = swapchains;
-    present_info.pImageIndices = &current_image_index;
+        vkAllocateCommandBuffers(device, &alloc_info, &thread_pool->buffers[thread_pool->buffer_count]);
+        thread_pool->buffer_count = new_count;
+    }
 
-    vkQueuePresentKHR(graphics_queue, &present_info);
+    return thread_pool->buffers[thread_pool->used_count++];
+}
 
-    printf("• Frame %d presented.\n", current_frame);
+static bool create_vk_buffer(uint64_t size, VkBufferUsageFlags usage, Memory_Location location, VkBuffer* buffer, Gpu_Allocation* allocation);
 
-    current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
-}
+static void init_upload_ring() {
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physical_device, &properties);
 
-bool render_should_close() {
-    glfwPollEvents();
-    return glfwWindowShouldClose(window);
-}
+    upload_alignment = std::max<uint64_t>(properties.limits.minStorageBufferOffsetAlignment, 16);
+    upload_partition_size = (config.upload_buffer_size + upload_alignment - 1) & ~(upload_alignment - 1);
 
-void render_create_shader(Shader **shader, Shader_Data *shader_data) {
-    *shader = new Shader();
+    uint64_t buffer_size = upload_partition_size * frames_in_flight;
+    VkBufferUsageFlags usage = VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+        VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
 
-    VkShaderModuleCreateInfo vert_create_info{};
-    vert_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    vert_create_info.codeSize = shader_data->vert_size;
-    vert_create_info.pCode = (const uint32_t*)shader_data->vert_source;
+    // Not a render_create_buffer() buffer: defragmentation must never move it out from under the
+    // mapped pointers handed out this frame.
+    if (!create_vk_buffer(buffer_size, usage, MEMORY_UPLOAD, &upload_buffer, &upload_allocation)) {
+        LOG_ERROR(LOG_CATEGORY_MEMORY, "🔸Out of GPU memory creating the upload ring\n");
+        log_flush();
+        exit(EXIT_FAILURE);
+    }
 
-    vkCreateShaderModule(device, &vert_create_info, nullptr, &(*shader)->vert_module);
-    VkShaderModuleCreateInfo frag_create_info{};
-    frag_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-    frag_create_info.codeSize = shader_data->frag_size;
-    frag_create_info.pCode = (const uint32_t*)shader_data->frag_source;
+    // First buffer slot handed out, so it lands on UPLOAD_RING_BUFFER_INDEX.
+    uint32_t index = bindless_allocate(BINDLESS_BUFFER, 0);
+    bindless_write_buffer(index, upload_buffer, VK_WHOLE_SIZE);
 
-    vkCreateShaderModule(device, &frag_create_info, nullptr, &(*shader)->frag_module);
+    LOG_INFO(LOG_CATEGORY_MEMORY, "• Upload ring created (%u x %llu KiB).\n", frames_in_flight, (unsigned long long)upload_partition_size / 1024);
 }
 
-void render_destroy_shader(Shader *shader) {
-    vkDestroyShaderModule(device, shader->vert_module, nullptr);
-    vkDestroyShaderModule(device, shader->frag_module, nullptr);
-    delete shader;
-}
+static void init_pipeline_layout() {
+    VkDescriptorSetLayout set_layout = bindless_set_layout();
 
-void render_create_material(Material **material, Shader *shader) {
-    *material = new Material();
+    VkPushConstantRange push_constants{};
+    push_constants.stageFlags = VK_SHADER_STAGE_ALL;
+    push_constants.offset = 0;
+    push_constants.size = sizeof(Draw_Push_Constants);
 
-    // Create empty pipeline layout (no descriptor sets or push constants for now)
     VkPipelineLayoutCreateInfo layout_info{};
     layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    layout_info.setLayoutCount = 0;
-    layout_info.pSetLayouts = nullptr;
-    layout_info.pushConstantRangeCount = 0;
-    layout_info.pPushConstantRanges = nullptr;
+    layout_info.setLayoutCount = 1;
+    layout_info.pSetLayouts = &set_layout;
+    layout_info.pushConstantRangeCount = 1;
+    layout_info.pPushConstantRanges = &push_constants;
 
-    vkCreatePipelineLayout(device, &layout_info, nullptr, &(*material)->pipeline_layout);
+    vkCreatePipelineLayout(device, &layout_info, nullptr, &pipeline_layout);
+}
 
-    // Shader stages
-    VkPipelineShaderStageCreateInfo vert_stage{};
-    vert_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    vert_stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
-    vert_stage.module = shader->vert_module;
-    vert_stage.pName = "main";
+// Makes a frame's uploads visible to the GPU. A no-op on coherent memory.
+static void flush_upload_partition(const Upload_Cursor* cursor) {
+    uint64_t used = cursor->head.load(std::memory_order_relaxed);
+    if (used > upload_partition_size) {
+        used = upload_partition_size;
+    }
+    if (used > 0) {
+        gpu_memory_flush(&upload_allocation, upload_partition_size * cursor->partition, used);
+    }
+}
 
-    VkPipelineShaderStageCreateInfo frag_stage{};
-    frag_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-    frag_stage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-    frag_stage.module = shader->frag_module;
-    frag_stage.pName = "main";
+static void reset_upload_cursor(Upload_Cursor* cursor, uint32_t partition) {
+    cursor->partition = partition;
+    cursor->head.store(0, std::memory_order_relaxed);
+}
 
-    VkPipelineShaderStageCreateInfo shader_stages[2] = { vert_stage, frag_stage };
+static bool upload_allocate(Upload_Cursor* cursor, uint32_t size, Upload_Allocation* allocation) {
+    uint64_t aligned_size = (size + upload_alignment - 1) & ~(upload_alignment - 1);
+    uint64_t offset = cursor->head.fetch_add(aligned_size, std::memory_order_relaxed);
+    if (offset + aligned_size > upload_partition_size) {
+        return false;
+    }
 
-    // No vertex input (we'll use vertex id in shader)
-    VkPipelineVertexInputStateCreateInfo vertex_input{};
-    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-    vertex_input.vertexBindingDescriptionCount = 0;
-    vertex_input.vertexAttributeDescriptionCount = 0;
+    offset += upload_partition_size * cursor->partition;
+    allocation->pointer = (char*)upload_allocation.mapped + offset;
+    allocation->offset = (uint32_t)offset;
+    return true;
+}
 
-    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
-    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    input_assembly.primitiveRestartEnable = VK_FALSE;
+static void init_vulkan_sync_objects() {
+    VkSemaphoreCreateInfo semInfo{VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+    VkFenceCreateInfo fenceInfo{VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
+    fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT; // start signaled
 
-    VkPipelineViewportStateCreateInfo viewport_state{};
-    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewport_state.viewportCount = 1;
-    viewport_state.scissorCount = 1;
+    // The swapchain only takes binary semaphores, so acquire and present keep theirs.
+    for (size_t i = 0; i < frames_in_flight; ++i) {
+        vkCreateSemaphore(device, &semInfo, nullptr, &image_available_semaphores[i]);
+        vkCreateSemaphore(device, &semInfo, nullptr, &render_finished_semaphores[i]);
+    }
+    vkCreateFence(device, &fenceInfo, nullptr, &immediate_fence);
+
+    VkSemaphoreTypeCreateInfo timeline_type{};
+    timeline_type.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    timeline_type.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    timeline_type.initialValue = 0;
+    VkSemaphoreCreateInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    timeline_info.pNext = &timeline_type;
+    vkCreateSemaphore(device, &timeline_info, nullptr, &frame_timeline);
+
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Synchronization objects created.\n");
+}
 
-    VkPipelineRasterizationStateCreateInfo raster{};
-    raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    raster.depthClampEnable = VK_FALSE;
-    raster.rasterizerDiscardEnable = VK_FALSE;
-    raster.polygonMode = VK_POLYGON_MODE_FILL;
-    raster.cullMode = VK_CULL_MODE_BACK_BIT;
-    raster.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    raster.depthBiasEnable = VK_FALSE;
-    raster.lineWidth = 1.0f;
+static void start_render_thread();
+static void stop_render_thread();
+
+// Records a finished startup stage begun at `begin_ns`. Returns the end time, the next stage's start.
+static uint64_t end_startup_stage(const char* name, uint64_t begin_ns) {
+    uint64_t end_ns = profiler_now_ns();
+    double ms = (end_ns - begin_ns) / 1e6;
+    uint32_t index = startup_stage_count.fetch_add(1, std::memory_order_relaxed);
+    if (index < MAX_STARTUP_STAGES) {
+        startup_stage_names[index] = name;
+        startup_stage_ms[index] = ms;
+    }
+    LOG_INFO(LOG_CATEGORY_RENDER, "  - Init %s: %.2f ms\n", name, ms);
+    return end_ns;
+}
+
+static void load_pipeline_cache_job(void*) {
+    uint64_t begin_ns = profiler_now_ns();
+    pipeline_cache = pipeline_cache_load(device, physical_device, config.pipeline_cache_path, &pipeline_cache_loaded);
+    end_startup_stage("pipeline cache", begin_ns);
+    pipeline_cache_pending.store(false, std::memory_order_release);
+    pipeline_cache_pending.notify_all();
+}
+
+static void create_swapchain_job(void*) {
+    uint64_t begin_ns = profiler_now_ns();
+    init_vulkan_swapchain();
+    end_startup_stage("swapchain", begin_ns);
+    swapchain_pending.store(false, std::memory_order_release);
+    swapchain_pending.notify_all();
+}
+
+// Everything reading the swapchain, the extents or the window state from the main thread waits
+// here first.
+static void wait_for_swapchain() {
+    swapchain_pending.wait(true, std::memory_order_acquire);
+}
+
+void render_init(const Render_Config* render_config) {
+    uint64_t init_begin_ns = profiler_now_ns();
+    log_init();
+    startup_stage_count.store(0, std::memory_order_relaxed);
+    first_frame_ns.store(0, std::memory_order_relaxed);
+
+    if (render_config) {
+        config = *render_config;
+    }
+    render_extent = {config.width, config.height};
+    frames_in_flight = std::clamp(config.frames_in_flight, 1u, MAX_FRAMES_IN_FLIGHT);
+    arena_init(&scratch, SCRATCH_SIZE);
+    handle_pool_init(&shader_pool, MAX_SHADERS);
+    handle_pool_init(&material_pool, MAX_MATERIALS);
+
+    // Workers first, they take the pipeline cache and the swapchain off the main thread.
+    jobs_init(config.worker_threads);
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Job system started with %u workers.\n", jobs_worker_count());
+
+    uint64_t stage_ns = profiler_now_ns();
+    if (!config.headless) {
+        init_window();
+        stage_ns = end_startup_stage("window", stage_ns);
+    }
+    init_vulkan_instance();
+    stage_ns = end_startup_stage("instance", stage_ns);
+    init_vulkan_physical_device();
+    init_vulkan_device();
+    stage_ns = end_startup_stage("device", stage_ns);
+
+    // Reads the cache file and hands it to the driver while the rest is set up.
+    pipeline_cache_pending.store(true, std::memory_order_relaxed);
+    jobs_submit(load_pipeline_cache_job, nullptr);
+
+    init_dynamic_resolution();
+    gpu_memory_init(device, physical_device, memory_budget_supported);
+    if (config.headless) {
+        init_vulkan_headless_targets();
+        update_scene_extent();
+        stage_ns = end_startup_stage("headless targets", stage_ns);
+    } else {
+        init_vulkan_surface();
+        stage_ns = end_startup_stage("surface", stage_ns);
+        // Nothing below touches the swapchain, the extents or the scratch arena.
+        swapchain_pending.store(true, std::memory_order_relaxed);
+        jobs_submit(create_swapchain_job, nullptr);
+    }
+
+    init_vulkan_command_buffers();
+    init_vulkan_sync_objects();
+    bindless_init(device, physical_device);
+    init_upload_ring();
+    init_pipeline_layout();
+    frame_graph_init(device, frame_timeline);
+    cull_mode = config.cull_mode;
+    profiler_init(device, physical_device, graphics_queue_family_index, frames_in_flight);
+    stage_ns = end_startup_stage("frame resources", stage_ns);
+
+    Streaming_Init streaming_info{};
+    streaming_info.device = device;
+    streaming_info.graphics_family = graphics_queue_family_index;
+    streaming_info.transfer_family = transfer_queue_family_index;
+    streaming_info.transfer_queue = transfer_queue;
+    streaming_info.transfer_queue_mutex = transfer_queue == graphics_queue ? &graphics_queue_mutex : &transfer_queue_mutex;
+    streaming_info.staging_size = config.staging_buffer_size;
+    streaming_init(&streaming_info);
+
+    Textures_Init textures_info{};
+    textures_info.device = device;
+    textures_info.physical_device = physical_device;
+    textures_info.texture_budget = config.texture_budget_bytes;
+    textures_init(&textures_info);
+    stage_ns = end_startup_stage("streaming", stage_ns);
+
+    if (config.render_thread) {
+        start_render_thread();
+    }
+
+    // Materials created from here on compile against the cache.
+    pipeline_cache_pending.wait(true, std::memory_order_acquire);
+    startup_init_ms = (profiler_now_ns() - init_begin_ns) / 1e6;
+    LOG_INFO(LOG_CATEGORY_RENDER, "• render_init: %.2f ms, %.2f ms after process start.\n",
+        startup_init_ms, (profiler_now_ns() - process_start_ns) / 1e6);
+}
+
+void render_shutdown() {
+    wait_for_swapchain();
+    if (config.render_thread) {
+        stop_render_thread();
+    }
+    // Finish any pipeline still compiling so its result makes it into the cache.
+    jobs_shutdown();
+    streaming_shutdown();
+    textures_shutdown();
+
+    if (config.pipeline_cache_path) {
+        pipeline_cache_save(device, physical_device, pipeline_cache, config.pipeline_cache_path);
+    }
+    vkDestroyPipelineCache(device, pipeline_cache, nullptr);
+
+    destroy_retired_materials(true);
+    free(retired_materials);
+    if (material_pool.live_count || shader_pool.live_count) {
+        LOG_WARN(LOG_CATEGORY_RENDER, "🔸%u materials and %u shaders still alive at shutdown.\n", material_pool.live_count, shader_pool.live_count);
+    }
+    handle_pool_shutdown(&material_pool);
+    handle_pool_shutdown(&shader_pool);
+
+    for (uint32_t i = 0; i < frames_in_flight; ++i) {
+        vkDestroySemaphore(device, image_available_semaphores[i], nullptr);
+        vkDestroySemaphore(device, render_finished_semaphores[i], nullptr);
+    }
+    vkDestroySemaphore(device, frame_timeline, nullptr);
+    vkDestroyFence(device, immediate_fence, nullptr);
+    vkDestroyCommandPool(device, immediate_command_pool, nullptr);
+    for (uint32_t i = 0; i < frames_in_flight; ++i) {
+        for (uint32_t thread = 0; thread < record_thread_count; ++thread) {
+            vkDestroyCommandPool(device, thread_command_pools[i][thread].pool, nullptr);
+            free(thread_command_pools[i][thread].buffers);
+        }
+        delete[] thread_command_pools[i];
+        vkDestroyCommandPool(device, frame_command_pools[i], nullptr);
+    }
+
+    free(draw_packet_keys);
+    free(draw_packet_materials);
+    free(draw_packet_uniform_offsets);
+    free(draw_packet_order);
+    free(draw_packet_scratch);
+    free(draw_batches);
+    free(record_chunks);
+
+    if (config.headless) {
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            render_destroy_image(headless_targets[i].image);
+            render_destroy_buffer(headless_targets[i].readback);
+        }
+    } else {
+        destroy_retired_swapchains(true);
+        free(retired_swapchains);
+        destroy_swapchain_images(swapchain_images, swapchain_image_views, swapchain_image_count);
+        vkDestroySwapchainKHR(device, swapchain, nullptr);
+        vkDestroySurfaceKHR(instance, surface, nullptr);
+    }
+
+    frame_graph_shutdown();
+    if (hiz_buffer) {
+        render_destroy_buffer(hiz_buffer);
+    }
+    destroy_retired_resources(true);
+    free(retired_resources);
+    profiler_shutdown();
+
+    culling_shutdown();
+    vkDestroyPipelineLayout(device, pipeline_layout, nullptr);
+    bindless_shutdown();
+    vkDestroyBuffer(device, upload_buffer, nullptr);
+    gpu_memory_free(&upload_allocation);
+
+    free(live_buffers);
+    gpu_memory_shutdown();
+
+    vkDestroyDevice(device, nullptr);
+    if (debug_messenger) {
+        auto destroy_messenger = (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(instance, "vkDestroyDebugUtilsMessengerEXT");
+        destroy_messenger(instance, debug_messenger, nullptr);
+    }
+    vkDestroyInstance(instance, nullptr);
+    arena_free(&scratch);
+
+    if (!config.headless) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+
+    log_shutdown();
+}
+
+void render_get_startup_stats(Startup_Stats* stats) {
+    wait_for_swapchain();
+    stats->validation = validation_enabled;
+    stats->stage_count = std::min(startup_stage_count.load(std::memory_order_relaxed), MAX_STARTUP_STAGES);
+    for (uint32_t i = 0; i < stats->stage_count; i++) {
+        stats->stage_names[i] = startup_stage_names[i];
+        stats->stage_ms[i] = startup_stage_ms[i];
+    }
+    stats->init_ms = startup_init_ms;
+    uint64_t frame_ns = first_frame_ns.load(std::memory_order_relaxed);
+    stats->first_frame_ms = frame_ns ? (frame_ns - process_start_ns) / 1e6 : 0.0;
+}
+
+void render_get_pipeline_cache_stats(Pipeline_Cache_Stats* stats) {
+    stats->loaded_from_disk = pipeline_cache_loaded;
+    stats->hits = pipeline_cache_hits.load(std::memory_order_relaxed);
+    stats->misses = pipeline_cache_misses.load(std::memory_order_relaxed);
+    stats->unknown = pipeline_cache_unknown.load(std::memory_order_relaxed);
+    stats->compile_ms = pipeline_compile_ns.load(std::memory_order_relaxed) / 1e6;
+}
+
+// Hands a completed headless frame to the readback callback. Must only be called once the
+// frame has finished on the GPU.
+static void deliver_readback(Headless_Target* target) {
+    if (!target->readback_pending) {
+        return;
+    }
+    target->readback_pending = false;
+
+    if (!config.on_frame_readback) {
+        return;
+    }
+
+    gpu_memory_invalidate(&target->readback->allocation, 0, VK_WHOLE_SIZE);
+
+    Frame_Readback frame{};
+    frame.pixels = target->readback->allocation.mapped;
+    frame.width = render_extent.width;
+    frame.height = render_extent.height;
+    frame.row_pitch = render_extent.width * 4;
+    frame.frame_number = target->readback_frame_number;
+    config.on_frame_readback(&frame, config.readback_user_data);
+}
+
+static VkImage current_target_image() {
+    return config.headless ? headless_targets[current_frame].image->image : swapchain_images[current_image_index];
+}
+
+static VkImageView current_target_image_view() {
+    return config.headless ? headless_targets[current_frame].image->image_view : swapchain_image_views[current_image_index];
+}
+
+static uint64_t completed_serial() {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(device, frame_timeline, &value);
+    return value;
+}
+
+static void wait_for_serial(uint64_t serial) {
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &frame_timeline;
+    wait_info.pValues = &serial;
+    vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+}
+
+// A long wait means the CPU is running ahead and its frames sit in the queue, which is latency:
+// grow the delay before the input poll by half the excess. A wait near zero means the GPU is
+// about to run dry, back off fast.
+static void update_pacing(uint64_t wait_ns) {
+    if (!config.adaptive_pacing) {
+        return;
+    }
+    if (wait_ns > PACING_MARGIN_NS) {
+        pacing_delay_ns = std::min(pacing_delay_ns + (wait_ns - PACING_MARGIN_NS) / 2, MAX_PACING_DELAY_NS);
+    } else if (wait_ns < PACING_MARGIN_NS / 4) {
+        pacing_delay_ns /= 2;
+    } else {
+        pacing_delay_ns -= std::min(pacing_delay_ns, (PACING_MARGIN_NS - wait_ns) / 2);
+    }
+}
+
+// GPU time goes roughly with pixel count, so the scale moves by the square root of the time ratio,
+// aiming a little under the target. Only half the step is taken and nothing happens inside the
+// dead band, which keeps the scale from hunting on noisy frames. A measurement counts only once
+// the frame it came from was rendered at the current scale.
+static void update_render_scale() {
+    if (!config.dynamic_resolution) {
+        return;
+    }
+    uint64_t measured_frame;
+    double gpu_ms;
+    if (!profiler_last_gpu_frame(&measured_frame, &gpu_ms) || measured_frame < render_scale_frame || gpu_ms <= 0.0) {
+        return;
+    }
+    render_scale_gpu_ms = gpu_ms;
+    double target_ms = config.target_gpu_ms;
+    if (gpu_ms <= target_ms && gpu_ms >= target_ms * SCALE_DEAD_BAND) {
+        return;
+    }
+    float ideal = render_scale * (float)sqrt(target_ms * SCALE_HEADROOM / gpu_ms);
+    float scale = render_scale + (ideal - render_scale) * 0.5f;
+    scale = roundf(scale * SCALE_STEPS) / SCALE_STEPS;
+    scale = std::clamp(scale, config.min_render_scale, config.max_render_scale);
+    if (scale == render_scale) {
+        return;
+    }
+    render_scale = scale;
+    render_scale_frame = frame_number;
+    render_scale_changes++;
+    update_scene_extent();
+}
+
+// Material indices that follow a texture get its current slot. Everything else writing them
+// syncs with the render thread first.
+static void refresh_material_textures() {
+    for (uint32_t slot = 0; slot < MAX_MATERIALS; slot++) {
+        for (uint32_t i = 0; i < MATERIAL_INDEX_COUNT; i++) {
+            if (material_textures[slot][i]) {
+                material_indices[slot][i] = textures_index(material_textures[slot][i]);
+            }
+        }
+    }
+}
+
+// Everything from here to end_frame() runs on the render thread when there is one.
+static void begin_frame(uint64_t input_ns) {
+    profiler_begin_frame();
+    frame_begin_ns = profiler_now_ns();
+
+    // The slot is free once the frame that last used it, frames_in_flight back, has finished.
+    uint64_t serial = frame_number + 1;
+    if (serial > frames_in_flight) {
+        PROFILE_SCOPE("wait_frame");
+        uint64_t wait_begin_ns = profiler_now_ns();
+        wait_for_serial(serial - frames_in_flight);
+        uint64_t wait_ns = profiler_now_ns() - wait_begin_ns;
+        profiler_cpu_wait(wait_ns);
+        if (config.render_thread) {
+            render_gpu_wait_ns.fetch_add(wait_ns, std::memory_order_relaxed);
+        } else {
+            update_pacing(wait_ns);
+        }
+    }
+
+    // This slot's queries from frames_in_flight frames ago are complete now, no stall.
+    profiler_collect_gpu(current_frame);
+    update_render_scale();
+
+    if (config.headless) {
+        // The last frame rendered in this slot is complete, hand its pixels over before reusing it.
+        deliver_readback(&headless_targets[current_frame]);
+    } else {
+        PROFILE_SCOPE("acquire");
+        destroy_retired_swapchains(false);
+
+        // Out of date means the acquire signalled nothing, so the semaphore can go straight into
+        // the retry. Suboptimal still hands out an image, use it and rebuild next frame.
+        VkResult result = VK_ERROR_OUT_OF_DATE_KHR;
+        for (uint32_t attempt = 0; attempt < 2 && result == VK_ERROR_OUT_OF_DATE_KHR; attempt++) {
+            if (swapchain_dirty && !recreate_swapchain()) {
+                break;
+            }
+            result = vkAcquireNextImageKHR(device, swapchain, UINT64_MAX, image_available_semaphores[current_frame], VK_NULL_HANDLE, &current_image_index);
+            if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+                swapchain_dirty = true;
+            }
+        }
+
+        // Nothing to render to, typically a minimized window. Sleep until something happens
+        // instead of spinning, the frame is retried with the same serial. The render thread
+        // can't wait for events, see replay_frame().
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            frame_skipped = true;
+            if (!config.render_thread) {
+                glfwWaitEvents();
+            }
+            return;
+        }
+    }
+
+    // The frame's previous submission is done, recycle all of its command memory at once.
+    vkResetCommandPool(device, frame_command_pools[current_frame], 0);
+    for (uint32_t thread = 0; thread < record_thread_count; ++thread) {
+        vkResetCommandPool(device, thread_command_pools[current_frame][thread].pool, 0);
+        thread_command_pools[current_frame][thread].used_count = 0;
+    }
+
+    VkCommandBuffer command_buffer = command_buffers[current_frame];
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+    profiler_gpu_frame_begin(command_buffer, current_frame, frame_number, input_ns);
+
+    // Take ownership of finished streamed uploads before any draw can use them, then let textures
+    // build mips for theirs and settle residency changes.
+    stream_wait_value = streaming_acquire(command_buffer);
+    if (textures_update(command_buffer, serial, completed_serial())) {
+        refresh_material_textures();
+    }
+
+    LOG_DEBUG(LOG_CATEGORY_FRAME, "• Frame %d image index %d: Command buffer recording started.\n", current_frame, current_image_index);
+}
+
+// Starts a secondary for the main pass with viewport, scissor and the bindless set in place.
+static VkCommandBuffer begin_secondary(uint32_t thread_index) {
+    VkCommandBuffer command_buffer = acquire_secondary_command_buffer(thread_index);
+
+    VkCommandBufferInheritanceRenderingInfo inheritance_rendering{};
+    inheritance_rendering.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO;
+    inheritance_rendering.colorAttachmentCount = 1;
+    inheritance_rendering.pColorAttachmentFormats = &color_format;
+    inheritance_rendering.depthAttachmentFormat = depth_format;
+    inheritance_rendering.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+
+    VkCommandBufferInheritanceInfo inheritance{};
+    inheritance.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+    inheritance.pNext = &inheritance_rendering;
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    begin_info.pInheritanceInfo = &inheritance;
+
+    vkBeginCommandBuffer(command_buffer, &begin_info);
+
+    // Dynamic state is not inherited, every secondary sets its own viewport and scissor.
+    VkViewport viewport{};
+    viewport.x = 0.0f;
+    viewport.y = (float)scene_extent.height;
+    viewport.width = (float)scene_extent.width;
+    viewport.height = -(float)scene_extent.height;
+    viewport.minDepth = 0.0f;
+    viewport.maxDepth = 1.0f;
+    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+    VkRect2D scissor{};
+    scissor.offset = {0, 0};
+    scissor.extent = scene_extent;
+    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+    // The one descriptor bind of the command buffer, everything after it goes by index.
+    VkDescriptorSet descriptor_set = bindless_set();
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+    return command_buffer;
+}
+
+static void record_chunk(uint32_t index, uint32_t thread_index, void*) {
+    PROFILE_SCOPE("record_chunk");
+    Record_Chunk* chunk = &record_chunks[index];
+    VkCommandBuffer command_buffer = begin_secondary(thread_index);
+
+    VkPipeline bound_pipeline = VK_NULL_HANDLE;
+    Draw_Push_Constants pushed{};
+    bool any_pushed = false;
+    for (uint32_t i = chunk->first_batch; i < chunk->first_batch + chunk->batch_count; i++) {
+        Draw_Batch* batch = &draw_batches[i];
+
+        VkPipeline pipeline = material_pipelines[batch->material];
+        if (pipeline != bound_pipeline) {
+            vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+            bound_pipeline = pipeline;
+            chunk->pipeline_binds++;
+        }
+
+        Draw_Push_Constants push_constants;
+        push_constants.uniform_offset = batch->uniform_offset;
+        memcpy(push_constants.material_indices, material_indices[batch->material], sizeof(push_constants.material_indices));
+        if (!any_pushed || memcmp(&push_constants, &pushed, sizeof(pushed)) != 0) {
+            vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_ALL, 0, sizeof(push_constants), &push_constants);
+            pushed = push_constants;
+            any_pushed = true;
+        }
+
+        uint32_t draw_zone = config.profile_draws ? profiler_gpu_begin(command_buffer, "draw") : PROFILER_INVALID_ZONE;
+        // Issue a simple draw call (3 vertices -> triangle)
+        vkCmdDraw(command_buffer, 3, batch->instance_count, 0, 0);
+        profiler_gpu_end(command_buffer, draw_zone);
+    }
+
+    vkEndCommandBuffer(command_buffer);
+    chunk->command_buffer = command_buffer;
+}
+
+static void flush_draw_packets(VkCommandBuffer command_buffer) {
+    PROFILE_SCOPE("record");
+    uint32_t count = draw_packet_count;
+    draw_packet_count = 0;
+
+    draw_stats = {};
+    draw_stats.draws = count;
+    if (count == 0) {
+        return;
+    }
+
+    radix_sort_keys(count, draw_packet_keys, draw_packet_order, draw_packet_scratch);
+
+    // Sorting put every draw of a material next to each other, merge them into instanced draws.
+    // Draws only merge when they also share their uniforms.
+    uint32_t batch_count = 0;
+    uint32_t i = 0;
+    while (i < count) {
+        uint32_t material = draw_packet_materials[draw_packet_order[i]];
+        uint32_t uniform_offset = draw_packet_uniform_offsets[draw_packet_order[i]];
+
+        uint32_t instance_count = 1;
+        while (i + instance_count < count &&
+            draw_packet_materials[draw_packet_order[i + instance_count]] == material &&
+            draw_packet_uniform_offsets[draw_packet_order[i + instance_count]] == uniform_offset) {
+            instance_count++;
+        }
+
+        draw_batches[batch_count++] = {material, uniform_offset, instance_count};
+        i += instance_count;
+    }
+
+    uint32_t chunk_count = (batch_count + MIN_BATCHES_PER_CHUNK - 1) / MIN_BATCHES_PER_CHUNK;
+    if (chunk_count > record_thread_count) {
+        chunk_count = record_thread_count;
+    }
+    uint32_t batches_per_chunk = batch_count / chunk_count;
+    uint32_t remainder = batch_count % chunk_count;
+
+    uint32_t first_batch = 0;
+    for (uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+        record_chunks[chunk] = {};
+        record_chunks[chunk].first_batch = first_batch;
+        record_chunks[chunk].batch_count = batches_per_chunk + (chunk < remainder ? 1 : 0);
+        first_batch += record_chunks[chunk].batch_count;
+    }
+
+    jobs_parallel_for(chunk_count, record_chunk, nullptr);
+
+    VkCommandBuffer secondaries[64];
+    for (uint32_t begin = 0; begin < chunk_count; begin += 64) {
+        uint32_t execute_count = chunk_count - begin < 64 ? chunk_count - begin : 64;
+        for (uint32_t chunk = 0; chunk < execute_count; chunk++) {
+            secondaries[chunk] = record_chunks[begin + chunk].command_buffer;
+            draw_stats.pipeline_binds += record_chunks[begin + chunk].pipeline_binds;
+        }
+        vkCmdExecuteCommands(command_buffer, execute_count, secondaries);
+    }
+
+    draw_stats.draw_calls = batch_count;
+    draw_stats.secondary_command_buffers = chunk_count;
+}
+
+// For ordering steps inside a pass, the frame graph takes care of everything between passes.
+static void memory_barrier(VkCommandBuffer command_buffer, VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access,
+    VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access) {
+    VkMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = src_stages;
+    barrier.srcAccessMask = src_access;
+    barrier.dstStageMask = dst_stages;
+    barrier.dstAccessMask = dst_access;
+
+    VkDependencyInfo dependency_info{};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.memoryBarrierCount = 1;
+    dependency_info.pMemoryBarriers = &barrier;
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+// Lays the command ranges out again after objects were added: bucket bases, the slots in bucket
+// order and every object's command_base. Everything has to be uploaded again afterwards.
+static void update_scene_layout(Scene* scene) {
+    uint32_t next[MAX_SCENE_MATERIALS];
+    uint32_t base = 0;
+    for (uint32_t bucket = 0; bucket < scene->material_count; bucket++) {
+        scene->bucket_bases[bucket] = base;
+        next[bucket] = base;
+        base += scene->bucket_counts[bucket];
+    }
+    for (uint32_t slot = 0; slot < scene->object_count; slot++) {
+        Gpu_Scene_Object* object = &scene->shadow[slot];
+        object->command_base = scene->bucket_bases[object->bucket];
+        scene->bucket_order[next[object->bucket]++] = slot;
+    }
+    scene->dirty_begin = 0;
+    scene->dirty_end = scene->object_count;
+    scene->layout_dirty = false;
+}
+
+// Copies dirty objects through the upload ring. Whatever does not fit this frame goes next frame.
+static void upload_scene_objects(VkCommandBuffer command_buffer, Scene* scene) {
+    if (scene->layout_dirty) {
+        update_scene_layout(scene);
+    }
+
+    uint32_t count = scene->dirty_end - scene->dirty_begin;
+    Upload_Allocation allocation;
+    while (count > 0 && !upload_allocate(recording_upload, count * sizeof(Gpu_Scene_Object), &allocation)) {
+        count /= 2;
+    }
+    if (count == 0) {
+        return;
+    }
+
+    memcpy(allocation.pointer, &scene->shadow[scene->dirty_begin], count * sizeof(Gpu_Scene_Object));
+    VkBufferCopy region{};
+    region.srcOffset = allocation.offset;
+    region.dstOffset = (VkDeviceSize)scene->dirty_begin * sizeof(Gpu_Scene_Object);
+    region.size = (VkDeviceSize)count * sizeof(Gpu_Scene_Object);
+    vkCmdCopyBuffer(command_buffer, upload_buffer, scene->objects->buffer, 1, &region);
+
+    // Slots past uploaded_count are always dirty, so the copy starts at or before it.
+    scene->uploaded_count = std::max(scene->uploaded_count, scene->dirty_begin + count);
+    scene->dirty_begin += count;
+    if (scene->dirty_begin == scene->dirty_end) {
+        scene->dirty_begin = 0;
+        scene->dirty_end = 0;
+    }
+}
+
+// Reads the draw counts the GPU culled this slot's previous frame down to. The frame has finished.
+static void collect_scene_readback(Scene* scene) {
+    if (!scene->readback_pending[current_frame]) {
+        return;
+    }
+    scene->readback_pending[current_frame] = false;
+
+    Buffer* readback = scene->count_readbacks[current_frame];
+    gpu_memory_invalidate(&readback->allocation, 0, VK_WHOLE_SIZE);
+    const uint32_t* counts = (const uint32_t*)readback->allocation.mapped;
+    uint32_t visible = 0;
+    for (uint32_t bucket = 0; bucket < scene->material_count; bucket++) {
+        visible += counts[bucket];
+    }
+    scene->gpu_visible = visible;
+}
+
+// Frame graph pass, outside rendering: uploads changed objects and fills in every queued scene's
+// view. In CPU mode this is also where the scenes are culled.
+static void execute_scene_upload(VkCommandBuffer command_buffer, void*) {
+    PROFILE_SCOPE("cull");
+    uint64_t begin_ns = profiler_now_ns();
+    bool gpu = cull_stats.mode != CULL_MODE_CPU;
+
+    for (uint32_t i = 0; i < scene_draw_count; i++) {
+        Scene_Draw* draw = &scene_draws[i];
+        Scene* scene = draw->scene;
+
+        collect_scene_readback(scene);
+        upload_scene_objects(command_buffer, scene);
+        if (gpu) {
+            vkCmdFillBuffer(command_buffer, scene->counts->buffer, 0, VK_WHOLE_SIZE, 0);
+        }
+
+        Upload_Allocation view;
+        draw->culled = upload_allocate(recording_upload, sizeof(Scene_View), &view);
+        if (!draw->culled) {
+            continue;
+        }
+        Scene_View* scene_view = (Scene_View*)view.pointer;
+        memcpy(scene_view->view_projection, draw->view_projection, sizeof(scene_view->view_projection));
+        scene_view->objects_buffer = scene->objects->bindless_index;
+        draw->view_offset = view.offset;
+
+        cull_stats.objects += scene->uploaded_count;
+        if (!gpu) {
+            float planes[6][4];
+            culling_extract_planes(draw->view_projection, planes);
+            cull_stats.visible += culling_cpu(scene->shadow, scene->uploaded_count, planes, scene->visible);
+        }
+    }
+
+    cull_stats.cpu_ms += (profiler_now_ns() - begin_ns) / 1e6;
+}
+
+// Frame graph pass, GPU modes: the compute pass writing the indirect commands and counts the
+// main pass then draws.
+static void execute_cull(VkCommandBuffer command_buffer, void*) {
+    PROFILE_SCOPE("cull");
+    uint64_t begin_ns = profiler_now_ns();
+    bool occlusion = cull_stats.mode == CULL_MODE_GPU_OCCLUSION && hiz_valid;
+
+    uint32_t cull_zone = profiler_gpu_begin(command_buffer, "cull");
+    VkDescriptorSet descriptor_set = bindless_set();
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling_cull_pipeline(occlusion));
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+
+    for (uint32_t i = 0; i < scene_draw_count; i++) {
+        Scene_Draw* draw = &scene_draws[i];
+        Scene* scene = draw->scene;
+        Upload_Allocation params_allocation;
+        if (!draw->culled || scene->uploaded_count == 0) {
+            continue;
+        }
+        if (!upload_allocate(recording_upload, sizeof(Cull_Params), &params_allocation)) {
+            draw->culled = false;
+            continue;
+        }
+
+        Cull_Params* params = (Cull_Params*)params_allocation.pointer;
+        memcpy(params->view_projection, draw->view_projection, sizeof(params->view_projection));
+        culling_extract_planes(draw->view_projection, params->planes);
+        params->object_count = scene->uploaded_count;
+        params->objects_buffer = scene->objects->bindless_index;
+        params->commands_buffer = scene->commands->bindless_index;
+        params->counts_buffer = scene->counts->bindless_index;
+        params->hiz_buffer = occlusion ? hiz_buffer->bindless_index : BINDLESS_INVALID_INDEX;
+        params->hiz_width = hiz_widths[0];
+        params->hiz_height = hiz_heights[0];
+        params->hiz_levels = hiz_level_count;
+        memcpy(params->hiz_level_offsets, hiz_offsets, sizeof(params->hiz_level_offsets));
+
+        Draw_Push_Constants push_constants{};
+        push_constants.uniform_offset = params_allocation.offset;
+        vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_ALL, 0, sizeof(push_constants), &push_constants);
+        vkCmdDispatch(command_buffer, (scene->uploaded_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    }
+    profiler_gpu_end(command_buffer, cull_zone);
+
+    cull_stats.cpu_ms += (profiler_now_ns() - begin_ns) / 1e6;
+}
+
+// Frame graph pass, GPU modes: the counts come back to the CPU for the stats when this slot is
+// next used.
+static void execute_cull_readback(VkCommandBuffer command_buffer, void*) {
+    for (uint32_t i = 0; i < scene_draw_count; i++) {
+        Scene* scene = scene_draws[i].scene;
+        VkBufferCopy region{};
+        region.size = sizeof(uint32_t) * MAX_SCENE_MATERIALS;
+        vkCmdCopyBuffer(command_buffer, scene->counts->buffer, scene->count_readbacks[current_frame]->buffer, 1, &region);
+        scene->readback_pending[current_frame] = true;
+        cull_stats.visible += scene->gpu_visible;
+    }
+}
+
+// Inside the main pass, one secondary for every queued scene. The GPU path is a single indirect
+// draw per material whatever the object count, the CPU path one draw per visible object.
+static void draw_scenes(VkCommandBuffer command_buffer) {
+    if (scene_draw_count == 0) {
+        return;
+    }
+    bool gpu = cull_stats.mode != CULL_MODE_CPU;
+    VkCommandBuffer secondary = begin_secondary(jobs_thread_index());
+
+    VkPipeline bound_pipeline = VK_NULL_HANDLE;
+    for (uint32_t i = 0; i < scene_draw_count; i++) {
+        Scene_Draw* draw = &scene_draws[i];
+        Scene* scene = draw->scene;
+        if (!draw->culled) {
+            continue;
+        }
+        vkCmdBindIndexBuffer(secondary, scene->index_buffer->buffer, 0, VK_INDEX_TYPE_UINT32);
+        if (scene->vertex_buffer) {
+            VkDeviceSize vertex_offset = 0;
+            vkCmdBindVertexBuffers(secondary, 0, 1, &scene->vertex_buffer->buffer, &vertex_offset);
+        }
+
+        for (uint32_t bucket = 0; bucket < scene->material_count; bucket++) {
+            uint32_t base = scene->bucket_bases[bucket];
+            uint32_t count = scene->bucket_counts[bucket];
+            uint32_t material = drawable_material(scene->materials[bucket]);
+            if (material == UINT32_MAX || count == 0) {
+                continue;
+            }
+
+            VkPipeline pipeline = material_pipelines[material];
+            if (pipeline != bound_pipeline) {
+                vkCmdBindPipeline(secondary, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+                bound_pipeline = pipeline;
+                draw_stats.pipeline_binds++;
+            }
+            Draw_Push_Constants push_constants;
+            push_constants.uniform_offset = draw->view_offset;
+            memcpy(push_constants.material_indices, material_indices[material], sizeof(push_constants.material_indices));
+            vkCmdPushConstants(secondary, pipeline_layout, VK_SHADER_STAGE_ALL, 0, sizeof(push_constants), &push_constants);
+
+            if (gpu) {
+                vkCmdDrawIndexedIndirectCount(secondary, scene->commands->buffer, base * sizeof(VkDrawIndexedIndirectCommand),
+                    scene->counts->buffer, bucket * sizeof(uint32_t), count, sizeof(VkDrawIndexedIndirectCommand));
+                draw_stats.indirect_draw_calls++;
+                continue;
+            }
+            for (uint32_t k = base; k < base + count; k++) {
+                uint32_t slot = scene->bucket_order[k];
+                if (slot >= scene->uploaded_count || !scene->visible[slot]) {
+                    continue;
+                }
+                const Gpu_Scene_Object* object = &scene->shadow[slot];
+                vkCmdDrawIndexed(secondary, object->index_count, 1, object->first_index, object->vertex_offset, object->first_instance);
+                draw_stats.draw_calls++;
+            }
+        }
+    }
+
+    vkEndCommandBuffer(secondary);
+    vkCmdExecuteCommands(command_buffer, 1, &secondary);
+    draw_stats.secondary_command_buffers++;
+}
+
+// The swapchain clear and draw, as a frame graph pass: clears the frame's target and the depth
+// buffer, then draws the sorted draw list and the culled scenes into them. The graph has already
+// put both attachments in their layouts.
+static void execute_main_pass(VkCommandBuffer command_buffer, void*) {
+    VkRenderingAttachmentInfo color_attachment{};
+    color_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    color_attachment.imageView = frame_graph_image_view(color_resource);
+    color_attachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+    color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    color_attachment.clearValue.color = { {0.1f, 0.0f, 0.0f, 1.0f} }; // clear to black (RGBA)
+
+    // Reverse-Z, cleared to the far plane. Only stored when the Hi-Z build reads it.
+    VkRenderingAttachmentInfo depth_attachment{};
+    depth_attachment.sType = VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO;
+    depth_attachment.imageView = frame_graph_image_view(depth_resource);
+    depth_attachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
+    depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+    depth_attachment.storeOp = frame_graph_store_needed(depth_resource) ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+    depth_attachment.clearValue.depthStencil = {0.0f, 0};
+
+    VkRenderingInfo rendering_info{};
+    rendering_info.sType = VK_STRUCTURE_TYPE_RENDERING_INFO;
+    rendering_info.renderArea.offset = {0, 0};
+    rendering_info.renderArea.extent = scene_extent;
+    rendering_info.flags = VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT; // draws are recorded into secondaries
+    rendering_info.layerCount = 1;
+    rendering_info.colorAttachmentCount = 1;
+    rendering_info.pColorAttachments = &color_attachment;
+    rendering_info.pDepthAttachment = &depth_attachment;
+
+    uint32_t main_pass_zone = profiler_gpu_begin(command_buffer, "main_pass");
+    vkCmdBeginRendering(command_buffer, &rendering_info);
+    flush_draw_packets(command_buffer);
+    draw_scenes(command_buffer);
+    vkCmdEndRendering(command_buffer);
+    profiler_gpu_end(command_buffer, main_pass_zone);
+}
+
+// Frame graph pass after the main pass: reduces the depth buffer into the pyramid the next frame's
+// occlusion test reads. The pyramid is a frame old by then, so objects that just came into view
+// show up a frame late. Only declared while occlusion culling is in use.
+static void execute_hiz(VkCommandBuffer command_buffer, void*) {
+    // The graph places the depth buffer anew whenever the transients change, and the bindless
+    // slot follows. The old slot stays valid for the frames still using the old placement.
+    VkImageView depth_view = frame_graph_image_view(depth_resource);
+    if (depth_view != depth_bindless_view) {
+        if (depth_bindless_index != BINDLESS_INVALID_INDEX) {
+            bindless_free(BINDLESS_IMAGE, depth_bindless_index, frame_number);
+        }
+        depth_bindless_index = bindless_allocate(BINDLESS_IMAGE, completed_serial());
+        if (depth_bindless_index != BINDLESS_INVALID_INDEX) {
+            bindless_write_image(depth_bindless_index, depth_view);
+        }
+        depth_bindless_view = depth_view;
+    }
+    if (depth_bindless_index == BINDLESS_INVALID_INDEX) {
+        hiz_valid = false;
+        return;
+    }
+
+    // The pyramid covers the scene's part of the depth buffer, the next frame's cull reads it with
+    // this layout. The buffer was sized for the whole target, which is never smaller.
+    culling_hiz_layout(scene_extent.width, scene_extent.height, &hiz_level_count, hiz_widths, hiz_heights, hiz_offsets);
+
+    uint32_t hiz_zone = profiler_gpu_begin(command_buffer, "hiz");
+    VkDescriptorSet descriptor_set = bindless_set();
+    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, culling_hiz_pipeline());
+    vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_layout, 0, 1, &descriptor_set, 0, nullptr);
+
+    hiz_valid = true;
+    for (uint32_t level = 0; level < hiz_level_count; level++) {
+        Upload_Allocation allocation;
+        if (!upload_allocate(recording_upload, sizeof(Hiz_Params), &allocation)) {
+            hiz_valid = false;
+            break;
+        }
+        Hiz_Params* params = (Hiz_Params*)allocation.pointer;
+        params->source_width = level == 0 ? scene_extent.width : hiz_widths[level - 1];
+        params->source_height = level == 0 ? scene_extent.height : hiz_heights[level - 1];
+        params->source_offset = level == 0 ? 0 : hiz_offsets[level - 1];
+        params->destination_width = hiz_widths[level];
+        params->destination_height = hiz_heights[level];
+        params->destination_offset = hiz_offsets[level];
+        params->from_depth = level == 0;
+
+        Draw_Push_Constants push_constants{};
+        push_constants.uniform_offset = allocation.offset;
+        push_constants.material_indices[0] = depth_bindless_index;
+        push_constants.material_indices[1] = hiz_buffer->bindless_index;
+        vkCmdPushConstants(command_buffer, pipeline_layout, VK_SHADER_STAGE_ALL, 0, sizeof(push_constants), &push_constants);
+
+        if (level > 0) {
+            memory_barrier(command_buffer, VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT,
+                VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT);
+        }
+        vkCmdDispatch(command_buffer, (hiz_widths[level] + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+            (hiz_heights[level] + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+    }
+    profiler_gpu_end(command_buffer, hiz_zone);
+}
+
+// Frame graph pass with dynamic resolution: stretches the scene's part of the target over the output.
+static void execute_upscale(VkCommandBuffer command_buffer, void*) {
+    VkImageBlit region{};
+    region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.srcSubresource.layerCount = 1;
+    region.srcOffsets[1] = {(int32_t)scene_extent.width, (int32_t)scene_extent.height, 1};
+    region.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.dstSubresource.layerCount = 1;
+    region.dstOffsets[1] = {(int32_t)render_extent.width, (int32_t)render_extent.height, 1};
+
+    uint32_t upscale_zone = profiler_gpu_begin(command_buffer, "upscale");
+    vkCmdBlitImage(command_buffer, frame_graph_image(color_resource), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        frame_graph_image(output_resource), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region, upscale_filter);
+    profiler_gpu_end(command_buffer, upscale_zone);
+}
+
+// Frame graph pass, headless only: copies the finished image into this slot's readback buffer.
+static void execute_readback_copy(VkCommandBuffer command_buffer, void* data) {
+    Headless_Target* target = (Headless_Target*)data;
+
+    VkBufferImageCopy region{};
+    region.bufferOffset = 0;
+    region.bufferRowLength = 0; // tightly packed
+    region.bufferImageHeight = 0;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.mipLevel = 0;
+    region.imageSubresource.baseArrayLayer = 0;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {0, 0, 0};
+    region.imageExtent = {render_extent.width, render_extent.height, 1};
+
+    uint32_t readback_zone = profiler_gpu_begin(command_buffer, "readback_copy");
+    vkCmdCopyImageToBuffer(command_buffer, target->image->image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target->readback->buffer, 1, &region);
+    profiler_gpu_end(command_buffer, readback_zone);
+}
+
+static uint32_t import_buffer(const char* name, Buffer* buffer) {
+    return frame_graph_import_buffer(name, buffer->buffer, &buffer->graph_state);
+}
+
+// Declares everything between the frame's setup and its submit: scene uploads and culling, the
+// main pass into the frame's target, the Hi-Z build for the next frame, and the readback copy in
+// headless mode. Barriers, culling of unused passes and the depth buffer's memory are left to
+// the graph.
+static void build_frame_graph() {
+    frame_graph_begin(completed_serial());
+
+    Cull_Mode mode = cull_mode;
+    if (mode != CULL_MODE_CPU && (!culling_gpu_available() || !draw_indirect_count_supported)) {
+        mode = CULL_MODE_CPU;
+    }
+    cull_stats = {};
+    cull_stats.mode = mode;
+    bool gpu_cull = scene_draw_count > 0 && mode != CULL_MODE_CPU;
+    bool build_hiz = scene_draw_count > 0 && mode == CULL_MODE_GPU_OCCLUSION;
+    if (!build_hiz) {
+        hiz_valid = false;
+    } else if (!hiz_buffer) {
+        uint32_t level_count, widths[MAX_HIZ_LEVELS], heights[MAX_HIZ_LEVELS], offsets[MAX_HIZ_LEVELS];
+        uint32_t floats = culling_hiz_layout(target_extent.width, target_extent.height, &level_count, widths, heights, offsets);
+        render_create_buffer(&hiz_buffer, floats * sizeof(float), BUFFER_USAGE_STORAGE, MEMORY_GPU);
+        render_bindless_buffer(hiz_buffer);
+    }
+    uint32_t hiz = build_hiz ? import_buffer("hiz", hiz_buffer) : FRAME_GRAPH_INVALID;
+
+    // A swapchain image comes out of the acquire undefined, with the submit waiting on the
+    // acquire semaphore at color attachment output. Its transition has to wait there too.
+    if (config.headless) {
+        Image* image = headless_targets[current_frame].image;
+        output_resource = frame_graph_import_image("color", image->image, image->image_view, VK_IMAGE_ASPECT_COLOR_BIT, &image->graph_state);
+    } else {
+        swapchain_graph_state = {};
+        swapchain_graph_state.write_stages = VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT;
+        output_resource = frame_graph_import_image("swapchain", swapchain_images[current_image_index],
+            swapchain_image_views[current_image_index], VK_IMAGE_ASPECT_COLOR_BIT, &swapchain_graph_state);
+        frame_graph_export(output_resource, GRAPH_ACCESS_PRESENT);
+    }
+    color_resource = output_resource;
+    if (config.dynamic_resolution) {
+        color_resource = frame_graph_create_image("scene_color", target_extent.width, target_extent.height, color_format,
+            VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT);
+    }
+    depth_resource = frame_graph_create_image("depth", target_extent.width, target_extent.height, depth_format,
+        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
+
+    uint32_t objects[MAX_SCENE_DRAWS];
+    uint32_t commands[MAX_SCENE_DRAWS];
+    uint32_t counts[MAX_SCENE_DRAWS];
+    for (uint32_t i = 0; i < scene_draw_count; i++) {
+        Scene* scene = scene_draws[i].scene;
+        objects[i] = import_buffer("scene_objects", scene->objects);
+        commands[i] = import_buffer("scene_commands", scene->commands);
+        counts[i] = import_buffer("scene_counts", scene->counts);
+    }
+
+    if (scene_draw_count > 0) {
+        frame_graph_add_pass("scene_upload", execute_scene_upload, nullptr);
+        for (uint32_t i = 0; i < scene_draw_count; i++) {
+            frame_graph_write(objects[i], GRAPH_ACCESS_TRANSFER_WRITE);
+            if (gpu_cull) {
+                frame_graph_write(counts[i], GRAPH_ACCESS_TRANSFER_WRITE, true);
+            }
+        }
+    }
+
+    if (gpu_cull) {
+        frame_graph_add_pass("cull", execute_cull, nullptr);
+        for (uint32_t i = 0; i < scene_draw_count; i++) {
+            frame_graph_read(objects[i], GRAPH_ACCESS_COMPUTE_READ);
+            frame_graph_write(commands[i], GRAPH_ACCESS_COMPUTE_WRITE, true);
+            frame_graph_write(counts[i], GRAPH_ACCESS_COMPUTE_WRITE);
+        }
+        if (build_hiz && hiz_valid) {
+            frame_graph_read(hiz, GRAPH_ACCESS_COMPUTE_READ);
+        }
+
+        frame_graph_add_pass("cull_readback", execute_cull_readback, nullptr);
+        for (uint32_t i = 0; i < scene_draw_count; i++) {
+            uint32_t readback = import_buffer("scene_count_readback", scene_draws[i].scene->count_readbacks[current_frame]);
+            frame_graph_read(counts[i], GRAPH_ACCESS_TRANSFER_READ);
+            frame_graph_write(readback, GRAPH_ACCESS_TRANSFER_WRITE, true);
+            frame_graph_export(readback, GRAPH_ACCESS_HOST_READ);
+        }
+    }
+
+    frame_graph_add_pass("main", execute_main_pass, nullptr);
+    frame_graph_write(color_resource, GRAPH_ACCESS_COLOR_ATTACHMENT, true);
+    frame_graph_write(depth_resource, GRAPH_ACCESS_DEPTH_ATTACHMENT, true);
+    for (uint32_t i = 0; i < scene_draw_count; i++) {
+        frame_graph_read(objects[i], GRAPH_ACCESS_VERTEX_SHADER_READ);
+        if (gpu_cull) {
+            frame_graph_read(commands[i], GRAPH_ACCESS_INDIRECT_READ);
+            frame_graph_read(counts[i], GRAPH_ACCESS_INDIRECT_READ);
+        }
+    }
+
+    if (build_hiz) {
+        frame_graph_add_pass("hiz", execute_hiz, nullptr);
+        frame_graph_read(depth_resource, GRAPH_ACCESS_COMPUTE_READ);
+        frame_graph_write(hiz, GRAPH_ACCESS_COMPUTE_WRITE, true);
+        // Read by the next frame's cull.
+        frame_graph_export(hiz, GRAPH_ACCESS_NONE);
+    }
+
+    if (color_resource != output_resource) {
+        frame_graph_add_pass("upscale", execute_upscale, nullptr);
+        frame_graph_read(color_resource, GRAPH_ACCESS_TRANSFER_READ);
+        frame_graph_write(output_resource, GRAPH_ACCESS_TRANSFER_WRITE, true);
+    }
+
+    if (config.headless) {
+        Headless_Target* target = &headless_targets[current_frame];
+        uint32_t readback = import_buffer("readback", target->readback);
+        frame_graph_add_pass("readback_copy", execute_readback_copy, target);
+        frame_graph_read(output_resource, GRAPH_ACCESS_TRANSFER_READ);
+        frame_graph_write(readback, GRAPH_ACCESS_TRANSFER_WRITE, true);
+        frame_graph_export(readback, GRAPH_ACCESS_HOST_READ);
+    }
+}
+
+// The graph's passes write scene objects, views and culling parameters into the upload ring while
+// recording, so the partition is flushed after them, on the thread that recorded.
+static void record_frame(VkCommandBuffer command_buffer) {
+    build_frame_graph();
+    frame_graph_execute(command_buffer, frame_number + 1);
+    scene_draw_count = 0;
+    flush_upload_partition(recording_upload);
+}
+
+// Submitted, and presented unless headless.
+static void record_first_frame() {
+    uint64_t now_ns = profiler_now_ns();
+    first_frame_ns.store(now_ns, std::memory_order_relaxed);
+    LOG_INFO(LOG_CATEGORY_RENDER, "• First frame %s %.2f ms after process start.\n",
+        config.headless ? "submitted" : "presented", (now_ns - process_start_ns) / 1e6);
+}
+
+// Nothing to acquire or present, so signalling the frame timeline is the only synchronization
+// needed. The readback copy was the graph's last pass.
+static void end_headless_frame(VkCommandBuffer command_buffer) {
+    Headless_Target* target = &headless_targets[current_frame];
+
+    record_frame(command_buffer);
+    profiler_gpu_frame_end(command_buffer);
+    vkEndCommandBuffer(command_buffer);
+
+    VkSemaphore stream_semaphore = streaming_timeline_semaphore();
+    VkPipelineStageFlags stream_wait_stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    uint64_t serial = frame_number + 1;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = stream_wait_value ? 1 : 0;
+    timeline_info.pWaitSemaphoreValues = &stream_wait_value;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &serial;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    if (stream_wait_value) {
+        submit_info.waitSemaphoreCount = 1;
+        submit_info.pWaitSemaphores = &stream_semaphore;
+        submit_info.pWaitDstStageMask = &stream_wait_stage;
+    }
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &frame_timeline;
+
+    {
+        PROFILE_SCOPE("submit");
+        std::lock_guard<std::mutex> lock(graphics_queue_mutex);
+        vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+    }
+
+    target->readback_pending = true;
+    target->readback_frame_number = frame_number;
+
+    if (frame_number == 0) {
+        record_first_frame();
+    }
+    profiler_cpu_zone("frame", frame_begin_ns, profiler_now_ns());
+    frame_number++;
+    current_frame = (current_frame + 1) % frames_in_flight;
+}
+
+static void end_frame() {
+    if (frame_skipped) {
+        frame_skipped = false;
+        draw_packet_count = 0;
+        scene_draw_count = 0;
+        return;
+    }
+
+    VkCommandBuffer command_buffer = command_buffers[current_frame];
+
+    if (config.headless) {
+        end_headless_frame(command_buffer);
+        return;
+    }
+
+    record_frame(command_buffer);
+
+    // The graph left the swapchain image in PRESENT_SRC_KHR.
+    profiler_gpu_frame_end(command_buffer);
+    vkEndCommandBuffer(command_buffer);
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+
+    // The value for the binary acquire semaphore is ignored. The stream wait is only added when
+    // this frame took over uploads, and those are already complete.
+    VkSemaphore wait_semaphores[] = { image_available_semaphores[current_frame], streaming_timeline_semaphore() };
+    VkPipelineStageFlags wait_stages[] = { VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+    uint64_t wait_values[] = { 0, stream_wait_value };
+
+    // Same for the binary present semaphore on the signal side.
+    VkSemaphore signal_semaphores[] = { render_finished_semaphores[current_frame], frame_timeline };
+    uint64_t signal_values[] = { 0, frame_number + 1 };
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.waitSemaphoreValueCount = stream_wait_value ? 2 : 1;
+    timeline_info.pWaitSemaphoreValues = wait_values;
+    timeline_info.signalSemaphoreValueCount = 2;
+    timeline_info.pSignalSemaphoreValues = signal_values;
+
+    submit_info.pNext = &timeline_info;
+    submit_info.waitSemaphoreCount = stream_wait_value ? 2 : 1;
+    submit_info.pWaitSemaphores = wait_semaphores;
+    submit_info.pWaitDstStageMask = wait_stages;
+
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &command_buffer;
+
+    submit_info.signalSemaphoreCount = 2;
+    submit_info.pSignalSemaphores = signal_semaphores;
+
+    {
+        PROFILE_SCOPE("submit");
+        std::lock_guard<std::mutex> lock(graphics_queue_mutex);
+        vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+    }
+
+    VkPresentInfoKHR present_info{};
+    present_info.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+
+    present_info.waitSemaphoreCount = 1;
+    present_info.pWaitSemaphores = &render_finished_semaphores[current_frame];
+
+    VkSwapchainKHR swapchains[] = { swapchain };
+    present_info.swapchainCount = 1;
+    present_info.pSwapchains = swapchains;
+    present_info.pImageIndices = &current_image_index;
+
+    {
+        PROFILE_SCOPE("present");
+        std::lock_guard<std::mutex> lock(graphics_queue_mutex);
+        VkResult result = vkQueuePresentKHR(graphics_queue, &present_info);
+        if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            swapchain_dirty = true;
+        }
+    }
+
+    LOG_DEBUG(LOG_CATEGORY_FRAME, "• Frame %d presented.\n", current_frame);
+
+    if (frame_number == 0) {
+        record_first_frame();
+    }
+    profiler_cpu_zone("frame", frame_begin_ns, profiler_now_ns());
+    frame_number++;
+    current_frame = (current_frame + 1) % frames_in_flight;
+}
+
+static void push_draw_packet(uint32_t material, uint32_t uniform_offset);
+static void push_scene_draw(Scene* scene, const float view_projection[16]);
+static void update_scene_object(Scene* scene, uint32_t slot, const Scene_Object* object);
+
+// Only signals the frame timeline, so frame k still completes serial k + 1.
+static void submit_skipped_frame() {
+    uint64_t serial = frame_number + 1;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &serial;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &frame_timeline;
+    {
+        std::lock_guard<std::mutex> lock(graphics_queue_mutex);
+        vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+    }
+
+    frame_number++;
+    current_frame = (current_frame + 1) % frames_in_flight;
+}
+
+// A skipped frame can't be retried here like on the calling thread: waiting for window events
+// is the main thread's business. Its draws are dropped, and a short sleep stands in for the wait.
+static void replay_frame(Frame_Commands* commands) {
+    recording_upload = &commands->upload;
+    for (uint32_t i = 0; i < commands->scene_update_count; i++) {
+        const Scene_Update* update = &commands->scene_updates[i];
+        update_scene_object(update->scene, update->slot, &update->object);
+    }
+
+    begin_frame(commands->input_sample_ns);
+    if (frame_skipped) {
+        frame_skipped = false;
+        submit_skipped_frame();
+        std::this_thread::sleep_for(std::chrono::milliseconds(SKIPPED_FRAME_SLEEP_MS));
+        return;
+    }
+    for (uint32_t i = 0; i < commands->draw_count; i++) {
+        push_draw_packet(commands->draw_materials[i], commands->draw_uniform_offsets[i]);
+    }
+    for (uint32_t i = 0; i < commands->scene_count; i++) {
+        push_scene_draw(commands->scenes[i], commands->view_projections[i]);
+    }
+    end_frame();
+}
+
+static void render_thread_main() {
+    uint64_t head = 0;
+    for (;;) {
+        // Read before checking for work, so a frame queued in between makes the wait return.
+        uint32_t wake = render_thread_wake.load(std::memory_order_acquire);
+        if (frame_queue_tail.load(std::memory_order_acquire) == head) {
+            if (render_thread_stop.load(std::memory_order_acquire)) {
+                return;
+            }
+            uint64_t idle_begin_ns = profiler_now_ns();
+            render_thread_wake.wait(wake, std::memory_order_acquire);
+            render_idle_ns.fetch_add(profiler_now_ns() - idle_begin_ns, std::memory_order_relaxed);
+            continue;
+        }
+
+        replay_frame(&frame_queue[head % frame_queue_size]);
+        render_thread_frames.fetch_add(1, std::memory_order_relaxed);
+        frame_queue_head.store(++head, std::memory_order_release);
+        frame_queue_head.notify_all();
+    }
+}
+
+static void wake_render_thread() {
+    render_thread_wake.fetch_add(1, std::memory_order_release);
+    render_thread_wake.notify_one();
+}
+
+// Waits for the render thread to finish every queued frame and applies the scene updates of the
+// one being declared, after which the caller may touch anything the render thread reads.
+static void sync_render_thread() {
+    if (!config.render_thread) {
+        return;
+    }
+    uint64_t tail = frame_queue_tail.load(std::memory_order_relaxed);
+    for (uint64_t head = frame_queue_head.load(std::memory_order_acquire); head != tail; head = frame_queue_head.load(std::memory_order_acquire)) {
+        frame_queue_head.wait(head, std::memory_order_acquire);
+    }
+    if (building_frame) {
+        for (uint32_t i = 0; i < building_frame->scene_update_count; i++) {
+            const Scene_Update* update = &building_frame->scene_updates[i];
+            update_scene_object(update->scene, update->slot, &update->object);
+        }
+        building_frame->scene_update_count = 0;
+    }
+}
+
+// With a render thread this only claims a Frame_Commands. Blocking here is what bounds latency:
+// the calling thread gets at most frame_queue_size - 1 frames ahead of the render thread, and never
+// writes an upload partition the GPU may still read.
+void render_begin_frame() {
+    wait_for_swapchain();
+    if (!config.render_thread) {
+        begin_frame(input_sample_ns);
+        reset_upload_cursor(&direct_upload, current_frame);
+        destroy_retired_materials(false);
+        destroy_retired_resources(false);
+        return;
+    }
+
+    uint64_t index = frame_queue_tail.load(std::memory_order_relaxed);
+    uint64_t wait_begin_ns = profiler_now_ns();
+    {
+        PROFILE_SCOPE("wait_render_thread");
+        for (uint64_t head = frame_queue_head.load(std::memory_order_acquire); index - head >= frame_queue_size; head = frame_queue_head.load(std::memory_order_acquire)) {
+            frame_queue_head.wait(head, std::memory_order_acquire);
+        }
+        // The partition was last written for frame index - frames_in_flight.
+        if (index + 1 > frames_in_flight) {
+            wait_for_serial(index + 1 - frames_in_flight);
+        }
+    }
+    uint64_t wait_ns = profiler_now_ns() - wait_begin_ns;
+    main_wait_ns += wait_ns;
+    update_pacing(wait_ns);
+
+    building_frame = &frame_queue[index % frame_queue_size];
+    building_frame->draw_count = 0;
+    building_frame->scene_update_count = 0;
+    building_frame->scene_count = 0;
+    building_frame->input_sample_ns = input_sample_ns;
+    reset_upload_cursor(&building_frame->upload, index % frames_in_flight);
+    declaring_upload = &building_frame->upload;
+    destroy_retired_materials(false);
+    destroy_retired_resources(false);
+}
+
+void render_end_frame() {
+    if (!config.render_thread) {
+        end_frame();
+        return;
+    }
+    building_frame = nullptr;
+    frame_queue_tail.store(frame_queue_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    wake_render_thread();
+}
+
+static void start_render_thread() {
+    frame_queue_size = std::clamp(config.render_queue_frames, 2u, MAX_FRAME_QUEUE_SIZE);
+    render_thread_start_ns = profiler_now_ns();
+    render_thread = std::thread(render_thread_main);
+    LOG_INFO(LOG_CATEGORY_RENDER, "• Render thread started, up to %u frames queued.\n", frame_queue_size - 1);
+}
+
+static void stop_render_thread() {
+    sync_render_thread();
+    render_thread_stop.store(true, std::memory_order_release);
+    wake_render_thread();
+    render_thread.join();
+    for (uint32_t i = 0; i < MAX_FRAME_QUEUE_SIZE; i++) {
+        free(frame_queue[i].draw_materials);
+        free(frame_queue[i].draw_uniform_offsets);
+        free(frame_queue[i].scene_updates);
+    }
+}
+
+void render_get_render_thread_stats(Render_Thread_Stats* stats) {
+    *stats = {};
+    stats->enabled = config.render_thread;
+    if (!config.render_thread) {
+        return;
+    }
+    stats->frames = render_thread_frames.load(std::memory_order_relaxed);
+    stats->elapsed_ms = (profiler_now_ns() - render_thread_start_ns) / 1e6;
+    stats->main_wait_ms = main_wait_ns / 1e6;
+    stats->render_idle_ms = render_idle_ns.load(std::memory_order_relaxed) / 1e6;
+    stats->render_gpu_wait_ms = render_gpu_wait_ns.load(std::memory_order_relaxed) / 1e6;
+    if (stats->elapsed_ms > 0.0) {
+        stats->main_utilization = (float)(1.0 - stats->main_wait_ms / stats->elapsed_ms);
+        stats->render_utilization = (float)(1.0 - (stats->render_idle_ms + stats->render_gpu_wait_ms) / stats->elapsed_ms);
+    }
+}
+
+bool render_should_close() {
+    // Resize callbacks fire from the poll below and mark the swapchain dirty.
+    wait_for_swapchain();
+    if (config.adaptive_pacing && pacing_delay_ns > 0) {
+        PROFILE_SCOPE("pace");
+        std::this_thread::sleep_for(std::chrono::nanoseconds(pacing_delay_ns));
+    }
+
+    if (config.headless) {
+        input_sample_ns = profiler_now_ns();
+        return config.max_frames != 0 && render_frame_serial() - 1 >= config.max_frames;
+    }
+    glfwPollEvents();
+    input_sample_ns = profiler_now_ns();
+    return glfwWindowShouldClose(window);
+}
+
+uint64_t render_frame_serial() {
+    return (config.render_thread ? frame_queue_tail.load(std::memory_order_relaxed) : frame_number) + 1;
+}
+
+uint64_t render_completed_serial() {
+    return completed_serial();
+}
+
+void render_wait_for_serial(uint64_t serial) {
+    wait_for_serial(serial);
+}
+
+void render_set_present_mode(Present_Mode mode) {
+    wait_for_swapchain();
+    sync_render_thread();
+    if (mode != requested_present_mode) {
+        requested_present_mode = mode;
+        swapchain_dirty = true;
+    }
+}
+
+Present_Mode render_get_present_mode() {
+    wait_for_swapchain();
+    return present_mode;
+}
+
+void render_create_shader(Shader *shader, const Shader_Data *shader_data) {
+    shader->handle = handle_pool_allocate(&shader_pool);
+    if (!shader->handle) {
+        LOG_ERROR(LOG_CATEGORY_RENDER, "🔸Out of shader slots (%u).\n", MAX_SHADERS);
+        return;
+    }
+    uint32_t slot = handle_slot(shader->handle);
+
+    VkShaderModuleCreateInfo vert_create_info{};
+    vert_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    vert_create_info.codeSize = shader_data->vert_size;
+    vert_create_info.pCode = shader_data->vert_code;
+
+    vkCreateShaderModule(device, &vert_create_info, nullptr, &shader_vert_modules[slot]);
+    VkShaderModuleCreateInfo frag_create_info{};
+    frag_create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+    frag_create_info.codeSize = shader_data->frag_size;
+    frag_create_info.pCode = shader_data->frag_code;
+
+    vkCreateShaderModule(device, &frag_create_info, nullptr, &shader_frag_modules[slot]);
+}
+
+// Pipelines don't need their modules once created, so the modules go right away. Materials still
+// compiling from this shader must be waited on first.
+void render_destroy_shader(Shader shader) {
+    if (!handle_pool_valid(&shader_pool, shader.handle)) {
+        return;
+    }
+    uint32_t slot = handle_slot(shader.handle);
+    vkDestroyShaderModule(device, shader_vert_modules[slot], nullptr);
+    vkDestroyShaderModule(device, shader_frag_modules[slot], nullptr);
+    handle_pool_invalidate(&shader_pool, shader.handle);
+    handle_pool_release(&shader_pool, slot);
+}
+
+// Builds the material's pipeline. Only touches the material's slot and thread safe Vulkan calls, so
+// it runs on the calling thread for render_create_material() and on a worker for the async variant.
+static void create_material_pipeline(uint32_t material) {
+    uint32_t shader = material_shaders[material];
+
+    // Shader stages, both specialized the same way. A stage ignores constant ids it doesn't declare.
+    Pipeline_Specialization specialization;
+    const VkSpecializationInfo* specialization_info = pipeline_specialization(material_variants[material], &specialization);
+
+    VkPipelineShaderStageCreateInfo vert_stage{};
+    vert_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    vert_stage.stage = VK_SHADER_STAGE_VERTEX_BIT;
+    vert_stage.module = shader_vert_modules[shader];
+    vert_stage.pName = "main";
+    vert_stage.pSpecializationInfo = specialization_info;
+
+    VkPipelineShaderStageCreateInfo frag_stage{};
+    frag_stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    frag_stage.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+    frag_stage.module = shader_frag_modules[shader];
+    frag_stage.pName = "main";
+    frag_stage.pSpecializationInfo = specialization_info;
+
+    VkPipelineShaderStageCreateInfo shader_stages[2] = { vert_stage, frag_stage };
+
+    // Without a layout there is no vertex input, the shader uses the vertex id.
+    VkVertexInputBindingDescription mesh_binding{};
+    mesh_binding.binding = 0;
+    mesh_binding.stride = sizeof(Mesh_Vertex);
+    mesh_binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+
+    VkVertexInputAttributeDescription mesh_attributes[3] = {
+        {0, 0, VK_FORMAT_R16G16B16A16_SNORM, offsetof(Mesh_Vertex, position)},
+        {1, 0, VK_FORMAT_R16G16_SNORM, offsetof(Mesh_Vertex, normal)},
+        {2, 0, VK_FORMAT_R16G16_SFLOAT, offsetof(Mesh_Vertex, uv)},
+    };
+
+    VkPipelineVertexInputStateCreateInfo vertex_input{};
+    vertex_input.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    if (material_vertex_layouts[material] == VERTEX_LAYOUT_MESH) {
+        vertex_input.vertexBindingDescriptionCount = 1;
+        vertex_input.pVertexBindingDescriptions = &mesh_binding;
+        vertex_input.vertexAttributeDescriptionCount = 3;
+        vertex_input.pVertexAttributeDescriptions = mesh_attributes;
+    }
+
+    VkPipelineInputAssemblyStateCreateInfo input_assembly{};
+    input_assembly.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    input_assembly.primitiveRestartEnable = VK_FALSE;
+
+    VkPipelineViewportStateCreateInfo viewport_state{};
+    viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewport_state.viewportCount = 1;
+    viewport_state.scissorCount = 1;
+
+    VkPipelineRasterizationStateCreateInfo raster{};
+    raster.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    raster.depthClampEnable = VK_FALSE;
+    raster.rasterizerDiscardEnable = VK_FALSE;
+    raster.polygonMode = VK_POLYGON_MODE_FILL;
+    raster.cullMode = VK_CULL_MODE_BACK_BIT;
+    raster.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    raster.depthBiasEnable = VK_FALSE;
+    raster.lineWidth = 1.0f;
 
     VkPipelineMultisampleStateCreateInfo ms{};
     ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
     ms.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
+    // Reverse-Z: cleared to 0, nearer is larger.
+    VkPipelineDepthStencilStateCreateInfo depth_stencil{};
+    depth_stencil.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depth_stencil.depthTestEnable = VK_TRUE;
+    depth_stencil.depthWriteEnable = VK_TRUE;
+    depth_stencil.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL;
+
     VkPipelineColorBlendAttachmentState color_attachment{};
     color_attachment.blendEnable = VK_FALSE;
     color_attachment.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
@@ -503,12 +2859,12 @@ void render_create_material(Material **material, Shader *shader) {
     dynamic.pDynamicStates = dynamic_states;
 
     // Inform pipeline about dynamic rendering and the color format we will render into.
-    VkFormat color_format = VK_FORMAT_B8G8R8A8_SRGB;
     VkPipelineRenderingCreateInfo pipeline_rendering{};
     pipeline_rendering.sType = VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO;
     pipeline_rendering.viewMask = 0;
     pipeline_rendering.colorAttachmentCount = 1;
     pipeline_rendering.pColorAttachmentFormats = &color_format;
+    pipeline_rendering.depthAttachmentFormat = depth_format;
 
     VkGraphicsPipelineCreateInfo pipeline_info{};
     pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
@@ -520,44 +2876,779 @@ void render_create_material(Material **material, Shader *shader) {
     pipeline_info.pViewportState = &viewport_state;
     pipeline_info.pRasterizationState = &raster;
     pipeline_info.pMultisampleState = &ms;
+    pipeline_info.pDepthStencilState = &depth_stencil;
     pipeline_info.pColorBlendState = &color_blend;
     pipeline_info.pDynamicState = &dynamic;
-    pipeline_info.layout = (*material)->pipeline_layout;
+    pipeline_info.layout = pipeline_layout;
+
+    // Ask the driver whether the pipeline came out of the cache.
+    VkPipelineCreationFeedback feedback{};
+    VkPipelineCreationFeedbackCreateInfo feedback_info{};
+    feedback_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO;
+    feedback_info.pPipelineCreationFeedback = &feedback;
+    pipeline_rendering.pNext = &feedback_info;
+
+    auto start = std::chrono::steady_clock::now();
+    vkCreateGraphicsPipelines(device, pipeline_cache, 1, &pipeline_info, nullptr, &material_pipelines[material]);
+    auto end = std::chrono::steady_clock::now();
+
+    pipeline_compile_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    if (!(feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT)) {
+        pipeline_cache_unknown++;
+    } else if (feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT) {
+        pipeline_cache_hits++;
+    } else {
+        pipeline_cache_misses++;
+    }
 
-    vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, nullptr, &(*material)->pipeline);
+    material_ready[material].store(true, std::memory_order_release);
 }
 
-void render_destroy_material(Material *material) {
-    vkDestroyPipeline(device, material->pipeline, nullptr);
-    vkDestroyPipelineLayout(device, material->pipeline_layout, nullptr);
-    delete material;
+static void create_material_pipeline_job(void* data) {
+    create_material_pipeline((uint32_t)(uintptr_t)data);
 }
 
-void render_draw(Material* material) {
-    VkCommandBuffer command_buffer = command_buffers[current_frame];
+// Returns the slot, or UINT32_MAX with `material` left zero.
+static uint32_t create_material_common(Material* material, Shader shader, Vertex_Layout vertex_layout, Shader_Variant variant) {
+    material->handle = 0;
+    if (!handle_pool_valid(&shader_pool, shader.handle)) {
+        LOG_ERROR(LOG_CATEGORY_RENDER, "🔸Creating a material from a destroyed shader.\n");
+        return UINT32_MAX;
+    }
+    material->handle = handle_pool_allocate(&material_pool);
+    if (!material->handle) {
+        LOG_ERROR(LOG_CATEGORY_RENDER, "🔸Out of material slots (%u).\n", MAX_MATERIALS);
+        return UINT32_MAX;
+    }
+    uint32_t slot = handle_slot(material->handle);
+    material_pipelines[slot] = VK_NULL_HANDLE;
+    memset(material_indices[slot], 0, sizeof(material_indices[slot]));
+    memset(material_textures[slot], 0, sizeof(material_textures[slot]));
+    material_ready[slot].store(false, std::memory_order_relaxed);
+    material_shaders[slot] = handle_slot(shader.handle);
+    material_vertex_layouts[slot] = vertex_layout;
+    material_variants[slot] = variant;
+    return slot;
+}
+
+void render_create_material(Material *material, Shader shader, Vertex_Layout vertex_layout, Shader_Variant variant) {
+    uint32_t slot = create_material_common(material, shader, vertex_layout, variant);
+    if (slot != UINT32_MAX) {
+        create_material_pipeline(slot);
+    }
+}
 
-    // Bind the graphics pipeline
-    vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, material->pipeline);
+void render_create_material_async(Material *material, Shader shader, Vertex_Layout vertex_layout, Shader_Variant variant) {
+    uint32_t slot = create_material_common(material, shader, vertex_layout, variant);
+    if (slot != UINT32_MAX) {
+        jobs_submit(create_material_pipeline_job, (void*)(uintptr_t)slot);
+    }
+}
 
-    // Set dynamic viewport and scissor to match the rendering area (800x600)
-    VkViewport viewport{};
-    viewport.x = 0.0f;
-    viewport.y = 600.0f;
-    viewport.width = 800.0f;
-    viewport.height = -600.0f;
-    viewport.minDepth = 0.0f;
-    viewport.maxDepth = 1.0f;
-    vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+bool render_material_ready(Material material) {
+    return handle_pool_valid(&material_pool, material.handle) &&
+        material_ready[handle_slot(material.handle)].load(std::memory_order_acquire);
+}
 
-    VkRect2D scissor{};
-    scissor.offset = {0, 0};
-    scissor.extent = {800, 600};
-    vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+void render_set_placeholder_material(Material material) {
+    sync_render_thread();
+    placeholder_material = material;
+}
+
+void render_destroy_material(Material material) {
+    if (!handle_pool_valid(&material_pool, material.handle)) {
+        return;
+    }
+    sync_render_thread();
+    uint32_t slot = handle_slot(material.handle);
+    // A worker may still be compiling it, there is nothing to cancel so wait it out.
+    while (!material_ready[slot].load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+    if (placeholder_material.handle == material.handle) {
+        placeholder_material = {};
+    }
+    handle_pool_invalidate(&material_pool, material.handle);
 
-    // Issue a simple draw call (3 vertices -> triangle)
-    vkCmdDraw(command_buffer, 3, 1, 0, 0);
+    // Frames already recorded may still draw with the pipeline.
+    if (retired_material_count == retired_material_capacity) {
+        retired_material_capacity = retired_material_capacity ? retired_material_capacity * 2 : 16;
+        retired_materials = (Retired_Material*)realloc(retired_materials, sizeof(Retired_Material) * retired_material_capacity);
+    }
+    retired_materials[retired_material_count++] = {slot, render_frame_serial()};
 }
 
-void render_wait_idle() {
+void render_set_material_index(Material material, uint32_t slot, uint32_t index) {
+    sync_render_thread();
+    if (slot >= MATERIAL_INDEX_COUNT) {
+        LOG_ERROR(LOG_CATEGORY_RENDER, "🔸Material index slot %u out of range (%u).\n", slot, MATERIAL_INDEX_COUNT);
+        return;
+    }
+    if (handle_pool_valid(&material_pool, material.handle)) {
+        material_indices[handle_slot(material.handle)][slot] = index;
+        material_textures[handle_slot(material.handle)][slot] = nullptr;
+    }
+}
+
+void render_set_material_texture(Material material, uint32_t slot, Texture* texture) {
+    sync_render_thread();
+    if (slot >= MATERIAL_INDEX_COUNT) {
+        LOG_ERROR(LOG_CATEGORY_RENDER, "🔸Material index slot %u out of range (%u).\n", slot, MATERIAL_INDEX_COUNT);
+        return;
+    }
+    if (handle_pool_valid(&material_pool, material.handle)) {
+        material_indices[handle_slot(material.handle)][slot] = textures_index(texture);
+        material_textures[handle_slot(material.handle)][slot] = texture;
+    }
+}
+
+bool render_upload_allocate(uint32_t size, Upload_Allocation* allocation) {
+    return upload_allocate(declaring_upload, size, allocation);
+}
+
+static void push_draw_packet(uint32_t material, uint32_t uniform_offset) {
+    if (draw_packet_count == draw_packet_capacity) {
+        draw_packet_capacity = draw_packet_capacity ? draw_packet_capacity * 2 : 1024;
+        draw_packet_keys = (uint32_t*)realloc(draw_packet_keys, sizeof(uint32_t) * draw_packet_capacity);
+        draw_packet_materials = (uint32_t*)realloc(draw_packet_materials, sizeof(uint32_t) * draw_packet_capacity);
+        draw_packet_uniform_offsets = (uint32_t*)realloc(draw_packet_uniform_offsets, sizeof(uint32_t) * draw_packet_capacity);
+        draw_packet_order = (uint32_t*)realloc(draw_packet_order, sizeof(uint32_t) * draw_packet_capacity);
+        draw_packet_scratch = (uint32_t*)realloc(draw_packet_scratch, sizeof(uint32_t) * draw_packet_capacity);
+        draw_batches = (Draw_Batch*)realloc(draw_batches, sizeof(Draw_Batch) * draw_packet_capacity);
+        record_chunks = (Record_Chunk*)realloc(record_chunks, sizeof(Record_Chunk) * draw_packet_capacity);
+    }
+
+    draw_packet_keys[draw_packet_count] = material;
+    draw_packet_materials[draw_packet_count] = material;
+    draw_packet_uniform_offsets[draw_packet_count] = uniform_offset;
+    draw_packet_count++;
+}
+
+void render_draw(Material material, const Upload_Allocation* uniforms) {
+    uint32_t slot = drawable_material(material);
+    if (slot == UINT32_MAX) {
+        return;
+    }
+    uint32_t uniform_offset = uniforms ? uniforms->offset : NO_UNIFORMS;
+    if (!config.render_thread) {
+        push_draw_packet(slot, uniform_offset);
+        return;
+    }
+
+    Frame_Commands* commands = building_frame;
+    if (commands->draw_count == commands->draw_capacity) {
+        commands->draw_capacity = commands->draw_capacity ? commands->draw_capacity * 2 : 1024;
+        commands->draw_materials = (uint32_t*)realloc(commands->draw_materials, sizeof(uint32_t) * commands->draw_capacity);
+        commands->draw_uniform_offsets = (uint32_t*)realloc(commands->draw_uniform_offsets, sizeof(uint32_t) * commands->draw_capacity);
+    }
+    commands->draw_materials[commands->draw_count] = slot;
+    commands->draw_uniform_offsets[commands->draw_count] = uniform_offset;
+    commands->draw_count++;
+}
+
+void render_create_scene(Scene** scene, Buffer* index_buffer, Buffer* vertex_buffer, uint32_t max_objects) {
+    *scene = new Scene();
+    Scene* new_scene = *scene;
+    new_scene->index_buffer = index_buffer;
+    new_scene->vertex_buffer = vertex_buffer;
+    new_scene->max_objects = max_objects;
+
+    uint32_t capacity = max_objects ? max_objects : 1;
+    render_create_buffer(&new_scene->objects, sizeof(Gpu_Scene_Object) * capacity, BUFFER_USAGE_STORAGE, MEMORY_GPU);
+    render_create_buffer(&new_scene->commands, sizeof(VkDrawIndexedIndirectCommand) * capacity, BUFFER_USAGE_STORAGE | BUFFER_USAGE_INDIRECT, MEMORY_GPU);
+    render_create_buffer(&new_scene->counts, sizeof(uint32_t) * MAX_SCENE_MATERIALS, BUFFER_USAGE_STORAGE | BUFFER_USAGE_INDIRECT, MEMORY_GPU);
+    render_bindless_buffer(new_scene->objects);
+    render_bindless_buffer(new_scene->commands);
+    render_bindless_buffer(new_scene->counts);
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        render_create_buffer(&new_scene->count_readbacks[i], sizeof(uint32_t) * MAX_SCENE_MATERIALS, BUFFER_USAGE_TRANSFER_DST, MEMORY_READBACK);
+    }
+
+    new_scene->shadow = (Gpu_Scene_Object*)malloc(sizeof(Gpu_Scene_Object) * capacity);
+    new_scene->bucket_order = (uint32_t*)malloc(sizeof(uint32_t) * capacity);
+    new_scene->visible = (uint8_t*)malloc(capacity);
+}
+
+void render_destroy_scene(Scene* scene) {
+    sync_render_thread();
+    render_destroy_buffer(scene->objects);
+    render_destroy_buffer(scene->commands);
+    render_destroy_buffer(scene->counts);
+    for (uint32_t i = 0; i < frames_in_flight; i++) {
+        render_destroy_buffer(scene->count_readbacks[i]);
+    }
+    free(scene->shadow);
+    free(scene->bucket_order);
+    free(scene->visible);
+    delete scene;
+}
+
+static void set_scene_object(Gpu_Scene_Object* gpu_object, const Scene_Object* object) {
+    memcpy(gpu_object->center, object->center, sizeof(gpu_object->center));
+    gpu_object->radius = object->radius;
+    gpu_object->index_count = object->index_count;
+    gpu_object->first_index = object->first_index;
+    gpu_object->vertex_offset = object->vertex_offset;
+    gpu_object->first_instance = object->first_instance;
+}
+
+uint32_t render_scene_add(Scene* scene, Material material, const Scene_Object* object) {
+    sync_render_thread();
+    if (scene->object_count == scene->max_objects) {
+        return UINT32_MAX;
+    }
+    uint32_t bucket = 0;
+    while (bucket < scene->material_count && scene->materials[bucket].handle != material.handle) {
+        bucket++;
+    }
+    if (bucket == MAX_SCENE_MATERIALS) {
+        return UINT32_MAX;
+    }
+    if (bucket == scene->material_count) {
+        scene->materials[bucket] = material;
+        scene->bucket_counts[bucket] = 0;
+        scene->material_count++;
+    }
+
+    uint32_t slot = scene->object_count++;
+    Gpu_Scene_Object* gpu_object = &scene->shadow[slot];
+    *gpu_object = {};
+    set_scene_object(gpu_object, object);
+    gpu_object->bucket = bucket;
+    scene->bucket_counts[bucket]++;
+    scene->layout_dirty = true;
+    return slot;
+}
+
+static void update_scene_object(Scene* scene, uint32_t slot, const Scene_Object* object) {
+    set_scene_object(&scene->shadow[slot], object);
+    if (scene->dirty_begin == scene->dirty_end) {
+        scene->dirty_begin = slot;
+        scene->dirty_end = slot + 1;
+    } else {
+        scene->dirty_begin = std::min(scene->dirty_begin, slot);
+        scene->dirty_end = std::max(scene->dirty_end, slot + 1);
+    }
+}
+
+// Queued with the frame being declared, the render thread may be uploading the scene right now.
+void render_scene_update(Scene* scene, uint32_t slot, const Scene_Object* object) {
+    if (config.render_thread && building_frame) {
+        Frame_Commands* commands = building_frame;
+        if (commands->scene_update_count == commands->scene_update_capacity) {
+            commands->scene_update_capacity = commands->scene_update_capacity ? commands->scene_update_capacity * 2 : 256;
+            commands->scene_updates = (Scene_Update*)realloc(commands->scene_updates, sizeof(Scene_Update) * commands->scene_update_capacity);
+        }
+        commands->scene_updates[commands->scene_update_count++] = {scene, slot, *object};
+        return;
+    }
+    sync_render_thread();
+    update_scene_object(scene, slot, object);
+}
+
+void render_scene_clear(Scene* scene) {
+    sync_render_thread();
+    scene->object_count = 0;
+    scene->uploaded_count = 0;
+    scene->material_count = 0;
+    scene->dirty_begin = 0;
+    scene->dirty_end = 0;
+    scene->layout_dirty = false;
+}
+
+static void push_scene_draw(Scene* scene, const float view_projection[16]) {
+    if (scene_draw_count == MAX_SCENE_DRAWS) {
+        LOG_WARN(LOG_CATEGORY_FRAME, "🔸More than %u scenes drawn in one frame, skipping\n", MAX_SCENE_DRAWS);
+        return;
+    }
+    Scene_Draw* draw = &scene_draws[scene_draw_count++];
+    draw->scene = scene;
+    memcpy(draw->view_projection, view_projection, sizeof(draw->view_projection));
+    draw->view_offset = 0;
+    draw->culled = false;
+}
+
+void render_draw_scene(Scene* scene, const float view_projection[16]) {
+    if (!config.render_thread) {
+        push_scene_draw(scene, view_projection);
+        return;
+    }
+    Frame_Commands* commands = building_frame;
+    if (commands->scene_count == MAX_SCENE_DRAWS) {
+        LOG_WARN(LOG_CATEGORY_FRAME, "🔸More than %u scenes drawn in one frame, skipping\n", MAX_SCENE_DRAWS);
+        return;
+    }
+    commands->scenes[commands->scene_count] = scene;
+    memcpy(commands->view_projections[commands->scene_count], view_projection, sizeof(commands->view_projections[0]));
+    commands->scene_count++;
+}
+
+void render_init_gpu_culling(const Compute_Shader_Data* cull_shader, const Compute_Shader_Data* hiz_shader) {
+    culling_init(device, pipeline_cache, pipeline_layout, cull_shader, hiz_shader);
+}
+
+void render_set_cull_mode(Cull_Mode mode) {
+    sync_render_thread();
+    if (mode != cull_mode) {
+        cull_mode = mode;
+        hiz_valid = false;
+    }
+}
+
+void render_get_cull_stats(Cull_Stats* stats) {
+    *stats = cull_stats;
+}
+
+void render_get_draw_stats(Draw_Stats* stats) {
+    *stats = draw_stats;
+}
+
+void render_get_graph_stats(Graph_Stats* stats) {
+    frame_graph_get_stats(stats);
+}
+
+void render_get_resolution_stats(Resolution_Stats* stats) {
+    wait_for_swapchain();
+    stats->enabled = config.dynamic_resolution;
+    stats->render_scale = config.dynamic_resolution ? render_scale : 1.0f;
+    stats->width = scene_extent.width;
+    stats->height = scene_extent.height;
+    stats->output_width = render_extent.width;
+    stats->output_height = render_extent.height;
+    stats->scale_changes = render_scale_changes;
+    stats->last_gpu_ms = render_scale_gpu_ms;
+}
+
+void render_get_frame_time_stats(Frame_Time_Stats* stats) {
+    Profiler_Stats profiler_stats;
+    profiler_get_stats(&profiler_stats);
+
+    stats->cpu_frame_count = profiler_stats.cpu_frame_count;
+    stats->gpu_frame_count = profiler_stats.gpu_frame_count;
+    stats->cpu_p50_ms = profiler_stats.cpu_ms[0];
+    stats->cpu_p95_ms = profiler_stats.cpu_ms[1];
+    stats->cpu_p99_ms = profiler_stats.cpu_ms[2];
+    stats->gpu_p50_ms = profiler_stats.gpu_ms[0];
+    stats->gpu_p95_ms = profiler_stats.gpu_ms[1];
+    stats->gpu_p99_ms = profiler_stats.gpu_ms[2];
+    stats->latency_frame_count = profiler_stats.latency_frame_count;
+    stats->latency_p50_ms = profiler_stats.latency_ms[0];
+    stats->latency_p95_ms = profiler_stats.latency_ms[1];
+    stats->latency_p99_ms = profiler_stats.latency_ms[2];
+    stats->cpu_wait_p50_ms = profiler_stats.cpu_wait_ms[0];
+    stats->cpu_wait_p95_ms = profiler_stats.cpu_wait_ms[1];
+    stats->cpu_wait_p99_ms = profiler_stats.cpu_wait_ms[2];
+    stats->pacing_delay_ms = pacing_delay_ns / 1e6;
+}
+
+bool render_write_profile_trace(const char* path) {
+    return profiler_write_trace(path);
+}
+
+static VkBufferUsageFlags to_vk_buffer_usage(uint32_t usage) {
+    // Every buffer can be a copy source and destination so defragmentation can move it.
+    VkBufferUsageFlags flags = VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    if (usage & BUFFER_USAGE_VERTEX) flags |= VK_BUFFER_USAGE_VERTEX_BUFFER_BIT;
+    if (usage & BUFFER_USAGE_INDEX) flags |= VK_BUFFER_USAGE_INDEX_BUFFER_BIT;
+    if (usage & BUFFER_USAGE_UNIFORM) flags |= VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
+    if (usage & BUFFER_USAGE_STORAGE) flags |= VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
+    if (usage & BUFFER_USAGE_INDIRECT) flags |= VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT;
+    return flags;
+}
+
+static void memory_location_flags(Memory_Location location, VkMemoryPropertyFlags* required, VkMemoryPropertyFlags* preferred) {
+    switch (location) {
+    case MEMORY_GPU:
+        *required = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+        *preferred = 0;
+        break;
+    case MEMORY_UPLOAD:
+        *required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        *preferred = VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+        break;
+    case MEMORY_READBACK:
+        *required = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
+        *preferred = VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+        break;
+    }
+}
+
+// Creates the VkBuffer and places it in sub-allocated memory. Returns false if no memory was left.
+static bool create_vk_buffer(uint64_t size, VkBufferUsageFlags usage, Memory_Location location, VkBuffer* buffer, Gpu_Allocation* allocation) {
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = usage;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    vkCreateBuffer(device, &buffer_info, nullptr, buffer);
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, *buffer, &requirements);
+
+    VkMemoryPropertyFlags required, preferred;
+    memory_location_flags(location, &required, &preferred);
+
+    if (!gpu_memory_allocate(&requirements, required, preferred, GPU_RESOURCE_LINEAR, allocation)) {
+        vkDestroyBuffer(device, *buffer, nullptr);
+        return false;
+    }
+    vkBindBufferMemory(device, *buffer, allocation->memory, allocation->offset);
+    return true;
+}
+
+void render_create_buffer(Buffer** buffer, uint64_t size, uint32_t usage, Memory_Location location) {
+    *buffer = new Buffer();
+    (*buffer)->size = size;
+    (*buffer)->usage = to_vk_buffer_usage(usage);
+    (*buffer)->location = location;
+    (*buffer)->ready = true;
+    (*buffer)->bindless_index = BINDLESS_INVALID_INDEX;
+
+    if (!create_vk_buffer(size, (*buffer)->usage, location, &(*buffer)->buffer, &(*buffer)->allocation)) {
+        LOG_ERROR(LOG_CATEGORY_MEMORY, "🔸Out of GPU memory creating a %llu byte buffer\n", (unsigned long long)size);
+        log_flush();
+        exit(EXIT_FAILURE);
+    }
+
+    std::lock_guard<std::mutex> lock(live_buffers_mutex);
+    if (live_buffer_count == live_buffer_capacity) {
+        live_buffer_capacity = live_buffer_capacity ? live_buffer_capacity * 2 : 64;
+        live_buffers = (Buffer**)realloc(live_buffers, sizeof(Buffer*) * live_buffer_capacity);
+    }
+    (*buffer)->live_index = live_buffer_count;
+    live_buffers[live_buffer_count++] = *buffer;
+}
+
+void render_destroy_buffer(Buffer* buffer) {
+    {
+        std::lock_guard<std::mutex> lock(live_buffers_mutex);
+        Buffer* last = live_buffers[--live_buffer_count];
+        live_buffers[buffer->live_index] = last;
+        last->live_index = buffer->live_index;
+    }
+
+    // Frames in flight may still index the slot or read the buffer, both are only reused once they
+    // have finished.
+    bindless_free(BINDLESS_BUFFER, buffer->bindless_index, render_frame_serial());
+    Retired_Resource retired{};
+    retired.buffer = buffer->buffer;
+    retired.allocation = buffer->allocation;
+    retired.retire_serial = render_frame_serial();
+    retire_resource(&retired);
+    delete buffer;
+}
+
+void* render_buffer_mapped(Buffer* buffer) {
+    return buffer->allocation.mapped;
+}
+
+void render_buffer_flush(Buffer* buffer, uint64_t offset, uint64_t size) {
+    gpu_memory_flush(&buffer->allocation, offset, size);
+}
+
+static uint32_t texel_size(Image_Format format) {
+    switch (format) {
+    case IMAGE_FORMAT_RGBA16_FLOAT: return 8;
+    default: return 4;
+    }
+}
+
+static VkFormat to_vk_format(Image_Format format) {
+    switch (format) {
+    case IMAGE_FORMAT_RGBA8_UNORM: return VK_FORMAT_R8G8B8A8_UNORM;
+    case IMAGE_FORMAT_RGBA8_SRGB: return VK_FORMAT_R8G8B8A8_SRGB;
+    case IMAGE_FORMAT_BGRA8_SRGB: return VK_FORMAT_B8G8R8A8_SRGB;
+    case IMAGE_FORMAT_RGBA16_FLOAT: return VK_FORMAT_R16G16B16A16_SFLOAT;
+    case IMAGE_FORMAT_DEPTH32_FLOAT: return VK_FORMAT_D32_SFLOAT;
+    }
+    return VK_FORMAT_UNDEFINED;
+}
+
+static VkImageUsageFlags to_vk_image_usage(uint32_t usage) {
+    VkImageUsageFlags flags = 0;
+    if (usage & IMAGE_USAGE_SAMPLED) flags |= VK_IMAGE_USAGE_SAMPLED_BIT;
+    if (usage & IMAGE_USAGE_STORAGE) flags |= VK_IMAGE_USAGE_STORAGE_BIT;
+    if (usage & IMAGE_USAGE_COLOR_ATTACHMENT) flags |= VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+    if (usage & IMAGE_USAGE_DEPTH_ATTACHMENT) flags |= VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+    if (usage & IMAGE_USAGE_TRANSFER_SRC) flags |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+    if (usage & IMAGE_USAGE_TRANSFER_DST) flags |= VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    return flags;
+}
+
+void render_create_image(Image** image, uint32_t width, uint32_t height, uint32_t mip_levels, Image_Format format, uint32_t usage) {
+    *image = new Image();
+    (*image)->format = to_vk_format(format);
+    (*image)->texel_size = texel_size(format);
+    (*image)->ready = true;
+    (*image)->bindless_index = BINDLESS_INVALID_INDEX;
+    (*image)->width = width;
+    (*image)->height = height;
+    (*image)->mip_levels = mip_levels;
+
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = (*image)->format;
+    image_info.extent = {width, height, 1};
+    image_info.mipLevels = mip_levels;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = to_vk_image_usage(usage);
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    vkCreateImage(device, &image_info, nullptr, &(*image)->image);
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, (*image)->image, &requirements);
+
+    if (!gpu_memory_allocate(&requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, GPU_RESOURCE_OPTIMAL, &(*image)->allocation)) {
+        LOG_ERROR(LOG_CATEGORY_MEMORY, "🔸Out of GPU memory creating a %u x %u image\n", width, height);
+        log_flush();
+        exit(EXIT_FAILURE);
+    }
+    vkBindImageMemory(device, (*image)->image, (*image)->allocation.memory, (*image)->allocation.offset);
+
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = (*image)->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = (*image)->format;
+    view_info.subresourceRange.aspectMask = format == IMAGE_FORMAT_DEPTH32_FLOAT ? VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = mip_levels;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+
+    vkCreateImageView(device, &view_info, nullptr, &(*image)->image_view);
+}
+
+void render_destroy_image(Image* image) {
+    bindless_free(BINDLESS_IMAGE, image->bindless_index, render_frame_serial());
+    Retired_Resource retired{};
+    retired.image = image->image;
+    retired.image_view = image->image_view;
+    retired.allocation = image->allocation;
+    retired.retire_serial = render_frame_serial();
+    retire_resource(&retired);
+    delete image;
+}
+
+uint32_t render_bindless_buffer(Buffer* buffer) {
+    if (buffer->bindless_index == BINDLESS_INVALID_INDEX && (buffer->usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) {
+        buffer->bindless_index = bindless_allocate(BINDLESS_BUFFER, completed_serial());
+        if (buffer->bindless_index != BINDLESS_INVALID_INDEX) {
+            bindless_write_buffer(buffer->bindless_index, buffer->buffer, buffer->size);
+        }
+    }
+    return buffer->bindless_index;
+}
+
+uint32_t render_bindless_image(Image* image) {
+    if (image->bindless_index == BINDLESS_INVALID_INDEX) {
+        image->bindless_index = bindless_allocate(BINDLESS_IMAGE, completed_serial());
+        if (image->bindless_index != BINDLESS_INVALID_INDEX) {
+            bindless_write_image(image->bindless_index, image->image_view);
+        }
+    }
+    return image->bindless_index;
+}
+
+uint32_t render_create_sampler(Sampler_Filter filter, Sampler_Address address) {
+    VkFilter vk_filter = filter == SAMPLER_FILTER_LINEAR ? VK_FILTER_LINEAR : VK_FILTER_NEAREST;
+    VkSamplerAddressMode vk_address = address == SAMPLER_ADDRESS_REPEAT ? VK_SAMPLER_ADDRESS_MODE_REPEAT : VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    VkSamplerCreateInfo sampler_info{};
+    sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    sampler_info.magFilter = vk_filter;
+    sampler_info.minFilter = vk_filter;
+    sampler_info.mipmapMode = filter == SAMPLER_FILTER_LINEAR ? VK_SAMPLER_MIPMAP_MODE_LINEAR : VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler_info.addressModeU = vk_address;
+    sampler_info.addressModeV = vk_address;
+    sampler_info.addressModeW = vk_address;
+    sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+
+    uint32_t index = bindless_allocate(BINDLESS_SAMPLER, completed_serial());
+    if (index == BINDLESS_INVALID_INDEX) {
+        return index;
+    }
+    VkSampler sampler;
+    vkCreateSampler(device, &sampler_info, nullptr, &sampler);
+    bindless_write_sampler(index, sampler);
+    return index;
+}
+
+void render_destroy_sampler(uint32_t index) {
+    bindless_free(BINDLESS_SAMPLER, index, render_frame_serial());
+}
+
+void render_get_bindless_stats(Bindless_Stats* stats) {
+    bindless_get_stats(stats);
+}
+
+void render_stream_buffer(Buffer* buffer, const Stream_Source* source, Stream_Priority priority) {
+    Stream_Target target{};
+    target.buffer = buffer->buffer;
+    target.ready = &buffer->ready;
+    streaming_request(&target, source, priority);
+}
+
+void render_stream_image(Image* image, const Stream_Source* source, Stream_Priority priority) {
+    Stream_Target target{};
+    target.image = image->image;
+    target.width = image->width;
+    target.height = image->height;
+    target.mip_levels = image->mip_levels;
+    target.block_width = 1;
+    target.block_height = 1;
+    target.block_size = image->texel_size;
+    target.ready = &image->ready;
+    streaming_request(&target, source, priority);
+}
+
+bool render_buffer_ready(Buffer* buffer) {
+    return buffer->ready.load(std::memory_order_acquire);
+}
+
+bool render_image_ready(Image* image) {
+    return image->ready.load(std::memory_order_acquire);
+}
+
+void render_get_stream_stats(Stream_Stats* stats) {
+    streaming_get_stats(stats);
+}
+
+void render_create_texture(Texture** texture, const void* ktx2, uint64_t size, Stream_Priority priority) {
+    *texture = textures_create(ktx2, size, priority);
+}
+
+void render_destroy_texture(Texture* texture) {
+    sync_render_thread();
+    for (uint32_t slot = 0; slot < MAX_MATERIALS; slot++) {
+        for (uint32_t i = 0; i < MATERIAL_INDEX_COUNT; i++) {
+            if (material_textures[slot][i] == texture) {
+                material_textures[slot][i] = nullptr;
+                material_indices[slot][i] = BINDLESS_INVALID_INDEX;
+            }
+        }
+    }
+    textures_destroy(texture, render_frame_serial());
+}
+
+bool render_texture_ready(Texture* texture) {
+    return textures_index(texture) != BINDLESS_INVALID_INDEX;
+}
+
+void render_use_texture(Texture* texture) {
+    textures_use(texture, render_frame_serial());
+}
+
+void render_get_texture_stats(Texture_Stats* stats) {
+    textures_get_stats(stats);
+}
+
+void render_get_memory_stats(Memory_Stats* stats) {
+    Gpu_Memory_Stats gpu_stats;
+    gpu_memory_get_stats(&gpu_stats);
+
+    stats->block_count = gpu_stats.block_count;
+    stats->dedicated_count = gpu_stats.dedicated_count;
+    stats->allocation_count = gpu_stats.allocation_count;
+    stats->reserved_bytes = gpu_stats.block_bytes;
+    stats->used_bytes = gpu_stats.used_bytes;
+    stats->largest_free_range = gpu_stats.largest_free_range;
+
+    // 0 when all free space is one contiguous range, approaching 1 as it splinters.
+    uint64_t free_bytes = gpu_stats.block_bytes - gpu_stats.used_bytes;
+    stats->fragmentation = free_bytes ? 1.0f - (float)gpu_stats.largest_free_range / (float)free_bytes : 0.0f;
+
+    Gpu_Memory_Budget budget;
+    gpu_memory_get_budget(&budget);
+    stats->budget_bytes = budget.budget;
+    stats->budget_usage_bytes = budget.usage;
+    stats->driver_budget = budget.from_driver;
+}
+
+// vkDeviceWaitIdle needs every queue externally synchronized, the streaming thread may be submitting
+// to the transfer queue. When it shares the graphics queue its mutex is graphics_queue_mutex and
+// transfer_queue_mutex is simply never taken elsewhere.
+static void wait_device_idle() {
+    std::scoped_lock lock(graphics_queue_mutex, transfer_queue_mutex);
     vkDeviceWaitIdle(device);
+}
+
+uint32_t render_defragment_memory() {
+    sync_render_thread();
+    struct Buffer_Move {
+        Buffer* buffer;
+        VkBuffer new_buffer;
+        Gpu_Allocation new_allocation;
+    };
+
+    // Old buffers may still be referenced by frames in flight. Once idle, the retired ones can go
+    // too rather than pin blocks being evacuated.
+    wait_device_idle();
+    destroy_retired_resources(false);
+
+    std::lock_guard<std::mutex> lock(live_buffers_mutex);
+    gpu_memory_begin_defragment();
+
+    Buffer_Move* moves = (Buffer_Move*)malloc(sizeof(Buffer_Move) * (live_buffer_count ? live_buffer_count : 1));
+    uint32_t move_count = 0;
+
+    for (uint32_t i = 0; i < live_buffer_count; i++) {
+        Buffer* buffer = live_buffers[i];
+        // A buffer being streamed into is written by the transfer queue, leave it where it is.
+        if (!gpu_memory_is_evacuating(&buffer->allocation) || !buffer->ready) {
+            continue;
+        }
+
+        Buffer_Move* move = &moves[move_count];
+        if (create_vk_buffer(buffer->size, buffer->usage, buffer->location, &move->new_buffer, &move->new_allocation)) {
+            move->buffer = buffer;
+            move_count++;
+        }
+    }
+
+    if (move_count > 0) {
+        VkCommandBuffer command_buffer = begin_immediate_commands();
+        for (uint32_t i = 0; i < move_count; i++) {
+            VkBufferCopy region{};
+            region.size = moves[i].buffer->size;
+            vkCmdCopyBuffer(command_buffer, moves[i].buffer->buffer, moves[i].new_buffer, 1, &region);
+        }
+        end_immediate_commands();
+    }
+
+    for (uint32_t i = 0; i < move_count; i++) {
+        Buffer* buffer = moves[i].buffer;
+        vkDestroyBuffer(device, buffer->buffer, nullptr);
+        gpu_memory_free(&buffer->allocation);
+        buffer->buffer = moves[i].new_buffer;
+        buffer->allocation = moves[i].new_allocation;
+        if (buffer->bindless_index != BINDLESS_INVALID_INDEX) {
+            bindless_write_buffer(buffer->bindless_index, buffer->buffer, buffer->size);
+        }
+    }
+    free(moves);
+
+    gpu_memory_end_defragment();
+
+    LOG_INFO(LOG_CATEGORY_MEMORY, "• Defragmentation moved %u buffers.\n", move_count);
+    return move_count;
+}
+
+void render_wait_idle() {
+    wait_for_swapchain();
+    sync_render_thread();
+    wait_device_idle();
+
+    // Everything has retired, flush the outstanding readbacks oldest first.
+    if (config.headless) {
+        for (uint32_t i = 0; i < frames_in_flight; ++i) {
+            deliver_readback(&headless_targets[(current_frame + i) % frames_in_flight]);
+        }
+    }
 }
\ No newline at end of file
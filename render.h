@@ -1,18 +1,506 @@
 #pragma once
 #include "common.h"
 
-struct Material;
-struct Shader;
+struct Buffer;
+struct Image;
+struct Scene;
+struct Texture;
 
-void render_init();
+// Shaders and materials live in pools inside the renderer and are passed around by value as
+// 32-bit handles (see handle_pool.h). Destroying one makes its handle stop resolving, so a stale
+// handle is skipped rather than reaching whatever reuses the slot. Zero initialized means none.
+struct Shader {
+    uint32_t handle;
+};
+
+struct Material {
+    uint32_t handle;
+};
+
+enum Buffer_Usage : uint32_t {
+    BUFFER_USAGE_VERTEX = 1 << 0,
+    BUFFER_USAGE_INDEX = 1 << 1,
+    BUFFER_USAGE_UNIFORM = 1 << 2,
+    BUFFER_USAGE_STORAGE = 1 << 3,
+    BUFFER_USAGE_INDIRECT = 1 << 4,
+    BUFFER_USAGE_TRANSFER_DST = 1 << 5,
+};
+
+enum Memory_Location {
+    MEMORY_GPU,      // device local, not mappable
+    MEMORY_UPLOAD,   // host visible, written by the CPU and read by the GPU
+    MEMORY_READBACK, // host visible and cached where possible, written by the GPU and read by the CPU
+};
+
+enum Image_Format {
+    IMAGE_FORMAT_RGBA8_UNORM,
+    IMAGE_FORMAT_RGBA8_SRGB,
+    IMAGE_FORMAT_BGRA8_SRGB,
+    IMAGE_FORMAT_RGBA16_FLOAT,
+    IMAGE_FORMAT_DEPTH32_FLOAT,
+};
+
+enum Image_Usage : uint32_t {
+    IMAGE_USAGE_SAMPLED = 1 << 0,
+    IMAGE_USAGE_STORAGE = 1 << 1,
+    IMAGE_USAGE_COLOR_ATTACHMENT = 1 << 2,
+    IMAGE_USAGE_DEPTH_ATTACHMENT = 1 << 3,
+    IMAGE_USAGE_TRANSFER_SRC = 1 << 4,
+    IMAGE_USAGE_TRANSFER_DST = 1 << 5,
+};
+
+enum Stream_Priority {
+    STREAM_PRIORITY_LOW,
+    STREAM_PRIORITY_NORMAL,
+    STREAM_PRIORITY_HIGH,
+};
+
+// Where a streamed upload reads from: either `data`, which must stay valid until the target is
+// ready (an Asset_View into the archive for example), or `size` bytes at `offset` in the file at `path`.
+// Image levels are read from `mip_offsets`, one per level counted from `offset`, or back to back
+// from `offset` when it is nullptr.
+struct Stream_Source {
+    const void* data;
+    const char* path;
+    uint64_t offset;
+    uint64_t size;
+    const uint64_t* mip_offsets;
+};
+
+struct Stream_Stats {
+    uint32_t queued_requests;       // not yet fully submitted
+    uint32_t completed_requests;    // handed over to the graphics queue
+    uint64_t bytes_uploaded;
+    bool dedicated_transfer_queue;  // a separate queue family, with ownership transfers
+};
+
+// A finished frame handed back to the host in headless mode. The pixel pointer
+// is only valid for the duration of the callback.
+struct Frame_Readback {
+    const void* pixels;
+    uint32_t width;
+    uint32_t height;
+    uint32_t row_pitch;
+    uint64_t frame_number;
+};
+
+typedef void (*Frame_Readback_Callback)(const Frame_Readback* frame, void* user_data);
+
+// How finished frames reach the screen. A mode the surface does not support falls back to the
+// nearest one that it does, ending at FIFO which is always there.
+enum Present_Mode {
+    PRESENT_MODE_FIFO,          // vsync, frames queue up behind each other
+    PRESENT_MODE_FIFO_RELAXED,  // vsync, but a late frame tears instead of waiting another interval
+    PRESENT_MODE_MAILBOX,       // no tearing, a newer frame replaces the queued one; wants 3+ images
+    PRESENT_MODE_IMMEDIATE,     // no vsync, tears, lowest latency
+};
+
+// Slots in the global bindless table (bindless.h has the GLSL declarations).
+enum Bindless_Type {
+    BINDLESS_IMAGE,     // set 0, binding 0: sampled images
+    BINDLESS_BUFFER,    // set 0, binding 1: storage buffers
+    BINDLESS_SAMPLER,   // set 0, binding 2: samplers
+    BINDLESS_TYPE_COUNT,
+};
+
+static constexpr uint32_t BINDLESS_INVALID_INDEX = UINT32_MAX;
+// The upload ring is always the first storage buffer.
+static constexpr uint32_t UPLOAD_RING_BUFFER_INDEX = 0;
+static constexpr uint32_t MATERIAL_INDEX_COUNT = 4;
+static constexpr uint32_t MAX_SCENE_MATERIALS = 64;
+static constexpr uint32_t MAX_SCENE_DRAWS = 16;
+static constexpr uint32_t MAX_STARTUP_STAGES = 16;
+
+// Pushed before each batch, identical layout for every pipeline:
+//   layout(push_constant) uniform Draw { uint uniform_offset; uint material[4]; } draw;
+// uniform_offset is the byte offset of the draw's uniforms in bindless_buffers[UPLOAD_RING_BUFFER_INDEX],
+// 0xffffffff when it has none. What the material indices mean is up to the shader.
+struct Draw_Push_Constants {
+    uint32_t uniform_offset;
+    uint32_t material_indices[MATERIAL_INDEX_COUNT];
+};
+
+struct Bindless_Stats {
+    uint32_t used[BINDLESS_TYPE_COUNT];
+    uint32_t capacity[BINDLESS_TYPE_COUNT];
+};
+
+enum Sampler_Filter {
+    SAMPLER_FILTER_NEAREST,
+    SAMPLER_FILTER_LINEAR,
+};
+
+enum Sampler_Address {
+    SAMPLER_ADDRESS_REPEAT,
+    SAMPLER_ADDRESS_CLAMP_TO_EDGE,
+};
+
+// What a material's pipeline reads from the bound vertex buffer.
+enum Vertex_Layout {
+    VERTEX_LAYOUT_NONE,     // no vertex input, the shader builds vertices from gl_VertexIndex
+    VERTEX_LAYOUT_MESH,     // Mesh_Vertex at binding 0
+};
+
+// 16 bytes, written by mesh_build() and read through VERTEX_LAYOUT_MESH:
+//   location 0: position, R16G16B16A16_SNORM, relative to the bounding sphere (center + p * radius)
+//   location 1: normal, R16G16_SNORM, octahedral
+//   location 2: uv, R16G16_SFLOAT
+struct Mesh_Vertex {
+    int16_t position[4];
+    int16_t normal[2];
+    uint16_t uv[2];
+};
+
+// How render_draw_scene() decides what to draw.
+enum Cull_Mode {
+    CULL_MODE_CPU,              // frustum test on the CPU, one vkCmdDrawIndexed per visible object
+    CULL_MODE_GPU,              // frustum test in a compute pass, one vkCmdDrawIndexedIndirectCount per material
+    CULL_MODE_GPU_OCCLUSION,    // GPU, plus a test against a Hi-Z pyramid of the previous frame's depth
+};
+
+// One object of a GPU-driven scene. Drawn with the scene's index buffer, the shader sees
+// first_instance as gl_InstanceIndex, typically to look up per-object data.
+struct Scene_Object {
+    float center[3];    // world space bounding sphere
+    float radius;
+    uint32_t index_count;
+    uint32_t first_index;
+    int32_t vertex_offset;
+    uint32_t first_instance;
+};
+
+struct Render_Config {
+    uint32_t width = 800;
+    uint32_t height = 600;
+
+    Present_Mode present_mode = PRESENT_MODE_FIFO;
+    // Swapchain images to ask for, clamped to what the surface allows (0 = the surface minimum).
+    uint32_t swapchain_images = 0;
+    // Frames the CPU may record ahead of the GPU, 1 to 4. Fewer means lower latency, more
+    // absorbs spikes better.
+    uint32_t frames_in_flight = 2;
+    // Sleep before polling input by however long the CPU would otherwise block waiting for the
+    // GPU, adjusted every frame. Input is sampled later and frames spend less time queued, while
+    // the GPU is still kept busy.
+    bool adaptive_pacing = false;
+
+    // Render into a ring of offscreen images instead of a window swapchain.
+    // No window, surface or swapchain is created in this mode.
+    bool headless = false;
+    // Headless only: render_should_close() returns true after this many frames (0 = never).
+    uint64_t max_frames = 0;
+    // Headless only: called once a frame's pixels have landed in host memory.
+    Frame_Readback_Callback on_frame_readback = nullptr;
+    void* readback_user_data = nullptr;
+
+    // Pipeline cache blob loaded at init and written back by render_shutdown() (nullptr = no cache).
+    const char* pipeline_cache_path = "pipeline_cache.bin";
+
+    // Worker threads for background work such as pipeline compilation (0 = one per core minus one).
+    uint32_t worker_threads = 0;
+
+    // Bytes of per-frame dynamic data available to render_upload_allocate(), per frame in flight.
+    uint32_t upload_buffer_size = 4 * 1024 * 1024;
+
+    // Host visible ring that streamed uploads are copied through.
+    uint32_t staging_buffer_size = 32 * 1024 * 1024;
+
+    // Wrap every instanced draw in its own GPU timestamp zone. Fine grained but not free.
+    bool profile_draws = false;
+
+    // GPU modes need render_init_gpu_culling(), until then scenes are culled on the CPU.
+    Cull_Mode cull_mode = CULL_MODE_GPU;
+
+    // Render the scene into part of an offscreen target and blit it up to the output. The part is
+    // a render scale between the min and the max of the output size, adjusted every frame to hold
+    // the GPU frame time at target_gpu_ms. The target is allocated once at the max scale, changing
+    // scale never reallocates. Needs GPU timestamps, without them the scale stays at the max.
+    bool dynamic_resolution = false;
+    float target_gpu_ms = 16.0f;
+    float min_render_scale = 0.5f;
+    float max_render_scale = 1.0f;
+
+    // Record, submit and present on a dedicated render thread. render_begin_frame() through
+    // render_end_frame() then only queue the frame, so the caller builds the next one while the
+    // render thread works on this one. Window events are still polled by render_should_close() on
+    // the calling thread. Calls that change what the render thread reads, such as adding scene
+    // objects or destroying materials, first wait for it to finish the queued frames. Stats
+    // are whatever it last wrote, render_wait_idle() first for a settled view.
+    bool render_thread = false;
+    // Frames in the queue between the threads, counting the one being built: 2 (double
+    // buffered, the caller runs at most one frame ahead) or 3.
+    uint32_t render_queue_frames = 2;
+
+    // Device memory textures may take before the least recently used ones lose their top mips
+    // (0 = only hold device local memory within its budget, see texture.h).
+    uint64_t texture_budget_bytes = 0;
+};
+
+// Dynamic data for the current frame. The memory is reused a few frames later, so it must be
+// written fresh every frame.
+struct Upload_Allocation {
+    void* pointer;
+    uint32_t offset;    // byte offset into the upload ring, what render_draw() pushes
+};
+
+// render_init() stages in the order they finished. The pipeline cache and swapchain stages run on
+// job workers alongside the others, so the stages add up to more than init_ms.
+struct Startup_Stats {
+    uint32_t stage_count;
+    const char* stage_names[MAX_STARTUP_STAGES];
+    double stage_ms[MAX_STARTUP_STAGES];
+    double init_ms;             // render_init() call to return
+    double first_frame_ms;      // process start to the first frame presented (submitted headless), 0 until then
+    bool validation;            // built with RENDER_VALIDATION and the layer was found
+};
+
+struct Pipeline_Cache_Stats {
+    bool loaded_from_disk;
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t unknown;   // the driver gave no creation feedback
+    double compile_ms;  // time spent in vkCreateGraphicsPipelines, summed over all threads
+};
+
+// Counters for the draw list recorded by the last render_end_frame().
+struct Draw_Stats {
+    uint32_t draws;           // render_draw() calls that made it into the list
+    uint32_t draw_calls;      // vkCmdDraw calls after merging repeated draws into instances, plus CPU culled scene draws
+    uint32_t pipeline_binds;
+    uint32_t secondary_command_buffers; // recorded in parallel, one per chunk of draws
+    uint32_t indirect_draw_calls;       // vkCmdDrawIndexedIndirectCount, one per scene material
+};
+
+// Scene culling over the last render_end_frame(), summed over every scene drawn.
+struct Cull_Stats {
+    Cull_Mode mode;             // in effect, after falling back to the CPU
+    uint32_t objects;
+    // Survivors. Exact for the CPU, read back for the GPU modes and frames_in_flight frames old.
+    uint32_t visible;
+    double cpu_ms;              // CPU time spent culling, or preparing the cull dispatch
+};
+
+// The frame graph of the last render_end_frame().
+struct Graph_Stats {
+    uint32_t passes;                // declared
+    uint32_t culled_passes;         // nothing live read what they wrote
+    uint32_t barrier_batches;       // vkCmdPipelineBarrier2 calls
+    uint32_t image_barriers;
+    uint32_t memory_barriers;
+    uint32_t transient_images;
+    uint64_t transient_bytes;       // what the transients would take without aliasing
+    uint64_t transient_heap_bytes;  // what backs them
+};
+
+// Dynamic resolution as of the last render_end_frame().
+struct Resolution_Stats {
+    bool enabled;
+    float render_scale;         // of the output width and height
+    uint32_t width;             // scene resolution
+    uint32_t height;
+    uint32_t output_width;
+    uint32_t output_height;
+    uint32_t scale_changes;     // since init
+    double last_gpu_ms;         // the measurement the last decision was based on
+};
+
+// Where the two threads spent their time since render_init(), with Render_Config::render_thread.
+// Utilization is the share of the elapsed time a thread spent not waiting on the other or the GPU.
+struct Render_Thread_Stats {
+    bool enabled;
+    uint64_t frames;            // replayed by the render thread
+    double elapsed_ms;
+    double main_wait_ms;        // calling thread blocked in render_begin_frame(), on a full queue or the GPU
+    double render_idle_ms;      // render thread waiting for a frame to be queued
+    double render_gpu_wait_ms;  // render thread waiting for a free frame slot
+    float main_utilization;
+    float render_utilization;
+};
+
+// Rolling frame time percentiles over the last few hundred frames. GPU times come from timestamp
+// queries and lag the CPU by frames_in_flight frames. Latency runs from the input poll in
+// render_should_close() to the end of the frame's GPU work, when its present can go out. Time
+// the image then spends queued in the presentation engine is not visible to the API and not
+// included. Latency needs GPU timestamps, without them it stays empty.
+struct Frame_Time_Stats {
+    uint32_t cpu_frame_count;
+    uint32_t gpu_frame_count;
+    double cpu_p50_ms;
+    double cpu_p95_ms;
+    double cpu_p99_ms;
+    double gpu_p50_ms;
+    double gpu_p95_ms;
+    double gpu_p99_ms;
+    uint32_t latency_frame_count;
+    double latency_p50_ms;
+    double latency_p95_ms;
+    double latency_p99_ms;
+    // Time render_begin_frame() blocked waiting for the GPU to free a frame slot. Near zero when
+    // CPU bound, large when frames queue up behind the GPU.
+    double cpu_wait_p50_ms;
+    double cpu_wait_p95_ms;
+    double cpu_wait_p99_ms;
+    double pacing_delay_ms;     // current adaptive pacing sleep
+};
+
+struct Memory_Stats {
+    uint32_t block_count;         // shared VkDeviceMemory blocks
+    uint32_t dedicated_count;     // resources too large for a block, with their own memory
+    uint32_t allocation_count;
+    uint64_t reserved_bytes;      // allocated from the driver
+    uint64_t used_bytes;          // handed out to resources
+    uint64_t largest_free_range;
+    float fragmentation;          // 0 = free space is one range, towards 1 = free space is splintered
+    // Device local memory. With VK_EXT_memory_budget from the driver and counting the whole
+    // process, otherwise our own allocations against most of the heap.
+    uint64_t budget_bytes;
+    uint64_t budget_usage_bytes;
+    bool driver_budget;
+};
+
+struct Texture_Stats {
+    uint32_t textures;
+    uint32_t resident;          // sampleable, at full or reduced resolution
+    uint32_t reduced;           // with top mip levels dropped
+    uint32_t generated_mips;    // textures whose mips were generated on the GPU
+    uint64_t resident_bytes;    // device memory of the sampled images
+    uint64_t rgba8_bytes;       // what the same levels would take as uncompressed RGBA8
+    uint32_t levels_dropped;    // since init
+    uint32_t restores;          // textures streamed back to full resolution, since init
+};
+
+void render_init(const Render_Config* config = nullptr);
+void render_shutdown();
+// Also drains the render thread's queue.
 void render_wait_idle();
 bool render_should_close();
 void render_begin_frame();
 void render_end_frame();
 
-void render_create_shader(Shader** shader, Shader_Data* shader_data);
-void render_destroy_shader(Shader* shader);
+// render_init() returns before the swapchain exists, it is created on a worker while the caller
+// loads assets and creates materials. The first call that needs it waits.
+void render_get_startup_stats(Startup_Stats* stats);
+void render_get_pipeline_cache_stats(Pipeline_Cache_Stats* stats);
+void render_get_draw_stats(Draw_Stats* stats);
+void render_get_graph_stats(Graph_Stats* stats);
+void render_get_resolution_stats(Resolution_Stats* stats);
+void render_get_frame_time_stats(Frame_Time_Stats* stats);
+void render_get_render_thread_stats(Render_Thread_Stats* stats);
+
+// Frame serials. Every submitted frame gets the next one, starting at 1, and the GPU completes
+// them in order. Something last used by frame `serial` can be released once it has completed.
+uint64_t render_frame_serial();     // the frame being recorded
+uint64_t render_completed_serial();
+void render_wait_for_serial(uint64_t serial);
+
+// Switches present mode from the next frame on by recreating the swapchain.
+void render_set_present_mode(Present_Mode mode);
+// The mode actually in use after fallback.
+Present_Mode render_get_present_mode();
+// Writes the recorded CPU zones and GPU timestamps as Chrome trace JSON (chrome://tracing, Perfetto).
+bool render_write_profile_trace(const char* path);
+
+// Leaves `shader` zero if the pool is full.
+void render_create_shader(Shader* shader, const Shader_Data* shader_data);
+void render_destroy_shader(Shader shader);
+
+// `variant` picks the shader's features, usually through its generated key, e.g.
+// Mesh_Frag_Key{Mesh_Frag_Feature::LIT}. Every variant is its own pipeline and sort id. Leaves
+// `material` zero if the pool is full or the shader is gone.
+void render_create_material(Material* material, Shader shader, Vertex_Layout vertex_layout = VERTEX_LAYOUT_NONE, Shader_Variant variant = {});
+// Returns immediately and compiles the pipeline on a worker thread. The shader must stay alive
+// until render_material_ready() returns true. Until then render_draw() falls back to the
+// placeholder material, or skips the draw if there is none.
+void render_create_material_async(Material* material, Shader shader, Vertex_Layout vertex_layout = VERTEX_LAYOUT_NONE, Shader_Variant variant = {});
+bool render_material_ready(Material material);
+void render_set_placeholder_material(Material material);
+// The handle stops resolving at once. The pipeline is destroyed, and the slot reused, once the
+// frames that may have drawn with it have retired.
+void render_destroy_material(Material material);
+// Sets one of the material's MATERIAL_INDEX_COUNT push constant indices, typically a bindless
+// slot. Not while a frame using the material is being recorded.
+void render_set_material_index(Material material, uint32_t slot, uint32_t index);
+
+// Puts the resource in the bindless table, once, and returns its slot. BINDLESS_INVALID_INDEX if
+// the table is full or a buffer lacks BUFFER_USAGE_STORAGE. Images are read in shader read
+// layout, so they need IMAGE_USAGE_SAMPLED. The slot is released when the resource is destroyed.
+uint32_t render_bindless_buffer(Buffer* buffer);
+uint32_t render_bindless_image(Image* image);
+uint32_t render_create_sampler(Sampler_Filter filter, Sampler_Address address);
+void render_destroy_sampler(uint32_t index);
+void render_get_bindless_stats(Bindless_Stats* stats);
+// Bump allocates from the current frame's upload ring partition, aligned for storage buffer use.
+// Returns false when the partition is full. Safe to call from any thread between
+// render_begin_frame() and render_end_frame().
+bool render_upload_allocate(uint32_t size, Upload_Allocation* allocation);
+// Queues a draw. Draws are sorted by material and recorded at render_end_frame(), repeated draws
+// of the same material and uniforms become a single instanced draw. The shader finds `uniforms`
+// through Draw_Push_Constants::uniform_offset. No descriptor sets are bound per draw.
+void render_draw(Material material, const Upload_Allocation* uniforms = nullptr);
+
+// GPU-driven scenes. Objects and their bounds live in a storage buffer, the CPU only touches the
+// ones that change. Each frame they are culled according to the cull mode and drawn, grouped by
+// material, inside the main pass. The index buffer needs BUFFER_USAGE_INDEX and holds 32-bit
+// indices. The vertex buffer, if any, is bound at binding 0 for materials with a vertex layout,
+// otherwise vertices are up to the material's shader. The view projection is column major with
+// reverse-Z depth, near at 1, which the depth buffer is cleared and tested for.
+void render_create_scene(Scene** scene, Buffer* index_buffer, Buffer* vertex_buffer, uint32_t max_objects);
+// Not while a frame drawing it is still in flight, see render_frame_serial().
+void render_destroy_scene(Scene* scene);
+// Returns the object's slot, in the order added, or UINT32_MAX once the scene is full or already
+// uses MAX_SCENE_MATERIALS materials.
+uint32_t render_scene_add(Scene* scene, Material material, const Scene_Object* object);
+void render_scene_update(Scene* scene, uint32_t slot, const Scene_Object* object);
+void render_scene_clear(Scene* scene);
+// At most once per scene and MAX_SCENE_DRAWS scenes per frame.
+void render_draw_scene(Scene* scene, const float view_projection[16]);
+// The compute shaders for the GPU cull modes, cull.comp and hiz.comp.
+void render_init_gpu_culling(const Compute_Shader_Data* cull_shader, const Compute_Shader_Data* hiz_shader);
+void render_set_cull_mode(Cull_Mode mode);
+void render_get_cull_stats(Cull_Stats* stats);
+
+// Buffers and images are sub-allocated from large per memory type blocks rather than getting a
+// vkAllocateMemory each.
+void render_create_buffer(Buffer** buffer, uint64_t size, uint32_t usage, Memory_Location location);
+void render_destroy_buffer(Buffer* buffer);
+// Persistently mapped pointer for MEMORY_UPLOAD/MEMORY_READBACK buffers, nullptr for MEMORY_GPU.
+void* render_buffer_mapped(Buffer* buffer);
+// Makes CPU writes visible to the GPU, only needed if the memory turned out not to be coherent.
+void render_buffer_flush(Buffer* buffer, uint64_t offset, uint64_t size);
+
+void render_create_image(Image** image, uint32_t width, uint32_t height, uint32_t mip_levels, Image_Format format, uint32_t usage);
+void render_destroy_image(Image* image);
+
+// Fills the buffer or image in the background from `source`. Use render_*_ready() to see when it
+// can be drawn with. Image sources hold every mip level back to back, tightly packed, and the
+// image ends up in shader read layout, so it needs IMAGE_USAGE_TRANSFER_DST | IMAGE_USAGE_SAMPLED.
+// Do not destroy the target while its upload is in flight.
+void render_stream_buffer(Buffer* buffer, const Stream_Source* source, Stream_Priority priority);
+void render_stream_image(Image* image, const Stream_Source* source, Stream_Priority priority);
+bool render_buffer_ready(Buffer* buffer);
+bool render_image_ready(Image* image);
+void render_get_stream_stats(Stream_Stats* stats);
+
+// Textures from KTX2 files (see texture.h): BCn and ASTC payloads are uploaded and sampled
+// compressed, mips missing from the file are generated on the GPU where the format allows, and
+// the least recently used textures lose top mips when device memory runs short. `ktx2` is read
+// again to restore them, so it must stay valid until the texture is destroyed, such as an
+// Asset_View into the archive. Leaves `texture` nullptr if the file is not a 2D KTX2 texture in a
+// format the device can sample.
+void render_create_texture(Texture** texture, const void* ktx2, uint64_t size, Stream_Priority priority = STREAM_PRIORITY_NORMAL);
+// Materials pointing at it get BINDLESS_INVALID_INDEX.
+void render_destroy_texture(Texture* texture);
+bool render_texture_ready(Texture* texture);
+// Marks the texture as drawn this frame. Residency keeps recently used textures at full resolution.
+void render_use_texture(Texture* texture);
+// Sets a material index to the texture's bindless slot and keeps it there as the slot moves with
+// residency changes. BINDLESS_INVALID_INDEX until the texture is ready. Overridden by a later
+// render_set_material_index() on the same index.
+void render_set_material_texture(Material material, uint32_t slot, Texture* texture);
+void render_get_texture_stats(Texture_Stats* stats);
 
-void render_create_material(Material** material, Shader* shader);
-void render_destroy_material(Material* material);
-void render_draw(Material* material);
\ No newline at end of file
+void render_get_memory_stats(Memory_Stats* stats);
+// Packs buffers out of sparsely used blocks and releases the blocks that end up empty. Waits for
+// the GPU to go idle, so call it at a quiet moment such as a level load. Moved buffers get new
+// mapped pointers. Images are not moved. Returns the number of buffers moved.
+uint32_t render_defragment_memory();
\ No newline at end of file
@@ -0,0 +1,20 @@
+#include "shader_variant.h"
+
+const VkSpecializationInfo* pipeline_specialization(Shader_Variant variant, Pipeline_Specialization* specialization) {
+    uint32_t count = 0;
+    for (uint32_t id = 0; id < MAX_SHADER_FEATURES; id++) {
+        if (variant.features & (1u << id)) {
+            specialization->entries[count] = {id, count * (uint32_t)sizeof(VkBool32), sizeof(VkBool32)};
+            specialization->values[count] = VK_TRUE;
+            count++;
+        }
+    }
+    if (count == 0) {
+        return nullptr;
+    }
+    specialization->info.mapEntryCount = count;
+    specialization->info.pMapEntries = specialization->entries;
+    specialization->info.dataSize = count * sizeof(VkBool32);
+    specialization->info.pData = specialization->values;
+    return &specialization->info;
+}
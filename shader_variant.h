@@ -0,0 +1,16 @@
+#pragma once
+#include "common.h"
+
+#include <vulkan/vulkan_core.h>
+
+// Specialization constants for a shader variant, VK_TRUE for every feature it turns on. Features
+// it leaves off keep the shader's default of false. `info` points into the struct, fill it in
+// place and keep it alive until the pipeline is created.
+struct Pipeline_Specialization {
+    VkSpecializationMapEntry entries[MAX_SHADER_FEATURES];
+    VkBool32 values[MAX_SHADER_FEATURES];
+    VkSpecializationInfo info;
+};
+
+// nullptr for the empty variant, otherwise `specialization->info`.
+const VkSpecializationInfo* pipeline_specialization(Shader_Variant variant, Pipeline_Specialization* specialization);
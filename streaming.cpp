@@ -0,0 +1,655 @@
+#include "streaming.h"
+#include "gpu_memory.h"
+#include "log.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+
+static constexpr uint32_t MAX_IMAGE_MIPS = 16;
+
+struct Stream_Request {
+    Stream_Target target;
+    Stream_Source source;   // path is our own copy, mip_offsets is unused
+    uint64_t mip_offsets[MAX_IMAGE_MIPS];   // copied from the source, or packed level by level
+    Stream_Priority priority;
+    uint64_t sequence;
+};
+
+// A transfer submission and what it frees once the timeline reaches its value.
+struct Submit_Slot {
+    VkCommandBuffer command_buffer;
+    uint64_t timeline_value;
+    uint64_t staging_end;
+};
+
+struct Handoff {
+    Stream_Target target;
+    uint64_t timeline_value;
+};
+
+static constexpr uint32_t SUBMIT_SLOTS = 8;
+static constexpr uint64_t MAX_CHUNK_SIZE = 4ull << 20;
+static constexpr uint64_t STAGING_ALIGNMENT = 256;
+
+static VkDevice device;
+static uint32_t graphics_family;
+static uint32_t transfer_family;
+static VkQueue transfer_queue;
+static std::mutex* transfer_queue_mutex;
+
+static VkCommandPool command_pool;
+static Submit_Slot submit_slots[SUBMIT_SLOTS];
+static uint64_t submit_count;
+static uint64_t retired_count;
+static VkSemaphore timeline_semaphore;
+static uint64_t last_timeline_value;
+
+// Positions grow forever, the offset into the buffer is position % staging_size. Only the I/O
+// thread touches these.
+static VkBuffer staging_buffer;
+static Gpu_Allocation staging_allocation;
+static uint64_t staging_size;
+static uint64_t chunk_size;
+static uint64_t staging_head;
+static uint64_t staging_tail;
+
+static std::thread io_thread;
+static std::mutex request_mutex;
+static std::condition_variable request_condition;
+static bool stopping;
+static Stream_Request* requests;
+static uint32_t request_count;
+static uint32_t request_capacity;
+static uint64_t next_sequence;
+
+static std::mutex handoff_mutex;
+static Handoff* handoffs;
+static uint32_t handoff_count;
+static uint32_t handoff_capacity;
+
+static std::atomic<uint32_t> queued_requests;
+static std::atomic<uint32_t> completed_requests;
+static std::atomic<uint64_t> bytes_uploaded;
+
+static bool ownership_transfer() {
+    return transfer_family != graphics_family;
+}
+
+static void wait_timeline(uint64_t value) {
+    VkSemaphoreWaitInfo wait_info{};
+    wait_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    wait_info.semaphoreCount = 1;
+    wait_info.pSemaphores = &timeline_semaphore;
+    wait_info.pValues = &value;
+    vkWaitSemaphores(device, &wait_info, UINT64_MAX);
+}
+
+// Frees the staging space of every submission the GPU has finished.
+static void retire_submissions() {
+    uint64_t completed;
+    vkGetSemaphoreCounterValue(device, timeline_semaphore, &completed);
+
+    while (retired_count < submit_count) {
+        Submit_Slot* slot = &submit_slots[retired_count % SUBMIT_SLOTS];
+        if (slot->timeline_value > completed) {
+            break;
+        }
+        staging_tail = slot->staging_end;
+        retired_count++;
+    }
+}
+
+// Returns an offset into the staging buffer with `size` contiguous bytes, waiting for older
+// chunks to finish if the ring is full. `size` is at most chunk_size, half the ring.
+static uint64_t allocate_staging(uint64_t size) {
+    size = (size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+
+    for (;;) {
+        retire_submissions();
+        if (staging_tail == staging_head) {
+            // Empty, restart at the beginning of the buffer so the chunk never has to wrap.
+            staging_head = staging_tail = (staging_head + staging_size - 1) / staging_size * staging_size;
+        }
+
+        uint64_t position = staging_head;
+        uint64_t offset = position % staging_size;
+        if (offset + size > staging_size) {
+            position += staging_size - offset;
+            offset = 0;
+        }
+        if (position + size - staging_tail <= staging_size) {
+            staging_head = position + size;
+            return offset;
+        }
+
+        wait_timeline(submit_slots[retired_count % SUBMIT_SLOTS].timeline_value);
+    }
+}
+
+static VkCommandBuffer begin_submission() {
+    Submit_Slot* slot = &submit_slots[submit_count % SUBMIT_SLOTS];
+    if (submit_count - retired_count == SUBMIT_SLOTS) {
+        wait_timeline(submit_slots[retired_count % SUBMIT_SLOTS].timeline_value);
+        retire_submissions();
+    }
+
+    VkCommandBufferBeginInfo begin_info{};
+    begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    vkBeginCommandBuffer(slot->command_buffer, &begin_info);
+    return slot->command_buffer;
+}
+
+static uint64_t end_submission() {
+    Submit_Slot* slot = &submit_slots[submit_count % SUBMIT_SLOTS];
+    vkEndCommandBuffer(slot->command_buffer);
+
+    uint64_t signal_value = ++last_timeline_value;
+
+    VkTimelineSemaphoreSubmitInfo timeline_info{};
+    timeline_info.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+    timeline_info.signalSemaphoreValueCount = 1;
+    timeline_info.pSignalSemaphoreValues = &signal_value;
+
+    VkSubmitInfo submit_info{};
+    submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit_info.pNext = &timeline_info;
+    submit_info.commandBufferCount = 1;
+    submit_info.pCommandBuffers = &slot->command_buffer;
+    submit_info.signalSemaphoreCount = 1;
+    submit_info.pSignalSemaphores = &timeline_semaphore;
+
+    {
+        std::lock_guard<std::mutex> lock(*transfer_queue_mutex);
+        vkQueueSubmit(transfer_queue, 1, &submit_info, VK_NULL_HANDLE);
+    }
+
+    slot->timeline_value = signal_value;
+    slot->staging_end = staging_head;
+    submit_count++;
+    return signal_value;
+}
+
+// Absolute, with 64-bit offsets: long is 32 bits on Windows.
+static int seek_file(FILE* file, uint64_t offset) {
+#ifdef _WIN32
+    return _fseeki64(file, (__int64)offset, SEEK_SET);
+#else
+    return fseeko(file, (off_t)offset, SEEK_SET);
+#endif
+}
+
+// Copies `size` bytes at `source_offset` into mapped staging memory. Returns false if the file
+// could not be read.
+static bool read_source(Stream_Request* request, FILE* file, uint64_t source_offset, void* destination, uint64_t size) {
+    if (request->source.data) {
+        memcpy(destination, (const char*)request->source.data + source_offset, size);
+        return true;
+    }
+    if (seek_file(file, source_offset) != 0 || fread(destination, 1, size, file) != size) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Failed to read %llu bytes at %llu from stream source: %s\n",
+            (unsigned long long)size, (unsigned long long)source_offset, request->source.path);
+        return false;
+    }
+    return true;
+}
+
+// The target is never handed off, its ready flag stays false.
+static void fail_request(const Stream_Target* target) {
+    if (target->failed) {
+        target->failed->store(true, std::memory_order_release);
+    }
+}
+
+static void release_to_graphics(VkCommandBuffer command_buffer, const Stream_Target* target) {
+    if (target->buffer) {
+        // Same family: the timeline semaphore wait alone makes the writes visible.
+        if (!ownership_transfer()) {
+            return;
+        }
+        VkBufferMemoryBarrier barrier{};
+        barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        barrier.dstAccessMask = 0;
+        barrier.srcQueueFamilyIndex = transfer_family;
+        barrier.dstQueueFamilyIndex = graphics_family;
+        barrier.buffer = target->buffer;
+        barrier.offset = 0;
+        barrier.size = VK_WHOLE_SIZE;
+
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            0, nullptr, 1, &barrier, 0, nullptr);
+        return;
+    }
+
+    // The layout change rides on the release barrier, or is a plain transition within one family.
+    VkImageMemoryBarrier barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcQueueFamilyIndex = ownership_transfer() ? transfer_family : VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = ownership_transfer() ? graphics_family : VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = target->image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = 0;
+    barrier.subresourceRange.levelCount = target->mip_levels;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = 0;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        0, nullptr, 0, nullptr, 1, &barrier);
+}
+
+static uint32_t mip_extent(uint32_t size, uint32_t mip) {
+    return size >> mip ? size >> mip : 1;
+}
+
+// Bytes in one row of blocks and number of block rows of a level.
+static uint64_t mip_row_size(const Stream_Target* target, uint32_t mip) {
+    return (uint64_t)(mip_extent(target->width, mip) + target->block_width - 1) / target->block_width * target->block_size;
+}
+
+static uint32_t mip_rows(const Stream_Target* target, uint32_t mip) {
+    return (mip_extent(target->height, mip) + target->block_height - 1) / target->block_height;
+}
+
+static void upload_request(Stream_Request* request) {
+    Stream_Target* target = &request->target;
+    uint64_t total_size = request->source.size;
+    uint64_t source_end = request->source.size;
+    if (target->image) {
+        total_size = 0;
+        source_end = 0;
+        for (uint32_t mip = 0; mip < target->mip_levels && mip < MAX_IMAGE_MIPS; mip++) {
+            uint64_t size = mip_row_size(target, mip) * mip_rows(target, mip);
+            total_size += size;
+            source_end = std::max(source_end, request->mip_offsets[mip] + size);
+        }
+    }
+    if (request->source.size < source_end || (target->image && target->mip_levels > MAX_IMAGE_MIPS)) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Stream source too small for its target (%llu of %llu bytes)\n",
+            (unsigned long long)request->source.size, (unsigned long long)source_end);
+        fail_request(target);
+        return;
+    }
+
+    FILE* file = nullptr;
+    if (!request->source.data) {
+        file = fopen(request->source.path, "rb");
+        if (!file) {
+            LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Failed to open stream source: %s\n", request->source.path);
+            fail_request(target);
+            return;
+        }
+    }
+
+    // Image cursor: chunks hold whole rows of blocks, possibly of several small mips. Each region
+    // is read from where its level sits in the source.
+    uint32_t mip = 0;
+    uint32_t row = 0;
+    uint64_t uploaded = 0;
+    uint64_t timeline_value = 0;
+
+    while (uploaded < total_size) {
+        VkBufferImageCopy regions[MAX_IMAGE_MIPS];
+        uint64_t region_sources[MAX_IMAGE_MIPS];
+        uint64_t region_sizes[MAX_IMAGE_MIPS];
+        uint32_t region_count = 0;
+        uint64_t size = 0;
+
+        if (target->buffer) {
+            size = total_size - uploaded < chunk_size ? total_size - uploaded : chunk_size;
+        } else {
+            while (mip < target->mip_levels) {
+                uint32_t width = mip_extent(target->width, mip);
+                uint32_t height = mip_extent(target->height, mip);
+                uint32_t row_count = mip_rows(target, mip);
+                uint64_t row_size = mip_row_size(target, mip);
+
+                uint64_t rows = (chunk_size - size) / row_size;
+                if (rows == 0 && size == 0) {
+                    rows = 1;
+                }
+                if (rows == 0) {
+                    break;
+                }
+                if (rows > row_count - row) {
+                    rows = row_count - row;
+                }
+
+                // The last row of blocks may hang over the edge of the level, the extent stops at it.
+                uint32_t y = row * target->block_height;
+                uint32_t rows_height = std::min((uint32_t)rows * target->block_height, height - y);
+
+                region_sources[region_count] = request->mip_offsets[mip] + row * row_size;
+                region_sizes[region_count] = rows * row_size;
+                VkBufferImageCopy* region = &regions[region_count++];
+                *region = {};
+                region->bufferOffset = size;
+                region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                region->imageSubresource.mipLevel = mip;
+                region->imageSubresource.layerCount = 1;
+                region->imageOffset = {0, (int32_t)y, 0};
+                region->imageExtent = {width, rows_height, 1};
+
+                size += rows * row_size;
+                row += rows;
+                if (row == row_count) {
+                    mip++;
+                    row = 0;
+                }
+            }
+        }
+
+        uint64_t staging_offset = allocate_staging(size);
+        char* staging = (char*)staging_allocation.mapped + staging_offset;
+        bool read = true;
+        if (target->buffer) {
+            read = read_source(request, file, request->source.offset + uploaded, staging, size);
+        }
+        for (uint32_t i = 0; i < region_count && read; i++) {
+            read = read_source(request, file, request->source.offset + region_sources[i], staging + regions[i].bufferOffset, region_sizes[i]);
+        }
+        if (!read) {
+            // Chunks already submitted may still be writing the target, only report the failure once
+            // they are done. Nothing else is in flight then, so the staging ring starts over.
+            wait_timeline(last_timeline_value);
+            retire_submissions();
+            staging_tail = staging_head;
+            fclose(file);
+            fail_request(target);
+            return;
+        }
+        gpu_memory_flush(&staging_allocation, staging_offset, size);
+
+        VkCommandBuffer command_buffer = begin_submission();
+        if (target->buffer) {
+            VkBufferCopy region{};
+            region.srcOffset = staging_offset;
+            region.dstOffset = uploaded;
+            region.size = size;
+            vkCmdCopyBuffer(command_buffer, staging_buffer, target->buffer, 1, &region);
+        } else {
+            if (uploaded == 0) {
+                VkImageMemoryBarrier barrier{};
+                barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+                barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+                barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.image = target->image;
+                barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+                barrier.subresourceRange.baseMipLevel = 0;
+                barrier.subresourceRange.levelCount = target->mip_levels;
+                barrier.subresourceRange.baseArrayLayer = 0;
+                barrier.subresourceRange.layerCount = 1;
+                barrier.srcAccessMask = 0;
+                barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+
+                vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                    0, nullptr, 0, nullptr, 1, &barrier);
+            }
+            for (uint32_t i = 0; i < region_count; i++) {
+                regions[i].bufferOffset += staging_offset;
+            }
+            vkCmdCopyBufferToImage(command_buffer, staging_buffer, target->image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, region_count, regions);
+        }
+
+        uploaded += size;
+        if (uploaded == total_size) {
+            release_to_graphics(command_buffer, target);
+        }
+        timeline_value = end_submission();
+        bytes_uploaded.fetch_add(size, std::memory_order_relaxed);
+    }
+
+    if (file) {
+        fclose(file);
+    }
+
+    std::lock_guard<std::mutex> lock(handoff_mutex);
+    if (handoff_count == handoff_capacity) {
+        handoff_capacity = handoff_capacity ? handoff_capacity * 2 : 64;
+        handoffs = (Handoff*)realloc(handoffs, sizeof(Handoff) * handoff_capacity);
+    }
+    handoffs[handoff_count++] = {*target, timeline_value};
+}
+
+static void io_thread_main() {
+    for (;;) {
+        Stream_Request request;
+        {
+            std::unique_lock<std::mutex> lock(request_mutex);
+            request_condition.wait(lock, [] { return stopping || request_count > 0; });
+            if (stopping) {
+                return;
+            }
+
+            // Highest priority first, oldest first within a priority.
+            uint32_t best = 0;
+            for (uint32_t i = 1; i < request_count; i++) {
+                if (requests[i].priority > requests[best].priority ||
+                    (requests[i].priority == requests[best].priority && requests[i].sequence < requests[best].sequence)) {
+                    best = i;
+                }
+            }
+            request = requests[best];
+            requests[best] = requests[--request_count];
+        }
+
+        upload_request(&request);
+        free((void*)request.source.path);
+        queued_requests.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void streaming_init(const Streaming_Init* init) {
+    device = init->device;
+    graphics_family = init->graphics_family;
+    transfer_family = init->transfer_family;
+    transfer_queue = init->transfer_queue;
+    transfer_queue_mutex = init->transfer_queue_mutex;
+    staging_size = (init->staging_size + STAGING_ALIGNMENT - 1) & ~(STAGING_ALIGNMENT - 1);
+    chunk_size = staging_size / 2 < MAX_CHUNK_SIZE ? staging_size / 2 : MAX_CHUNK_SIZE;
+
+    VkSemaphoreTypeCreateInfo type_info{};
+    type_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    type_info.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    type_info.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphore_info{};
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphore_info.pNext = &type_info;
+
+    vkCreateSemaphore(device, &semaphore_info, nullptr, &timeline_semaphore);
+
+    VkCommandPoolCreateInfo pool_info{};
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = transfer_family;
+
+    vkCreateCommandPool(device, &pool_info, nullptr, &command_pool);
+
+    VkCommandBuffer command_buffers[SUBMIT_SLOTS];
+    VkCommandBufferAllocateInfo alloc_info{};
+    alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    alloc_info.commandPool = command_pool;
+    alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    alloc_info.commandBufferCount = SUBMIT_SLOTS;
+
+    vkAllocateCommandBuffers(device, &alloc_info, command_buffers);
+    for (uint32_t i = 0; i < SUBMIT_SLOTS; i++) {
+        submit_slots[i].command_buffer = command_buffers[i];
+    }
+
+    VkBufferCreateInfo buffer_info{};
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = staging_size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+    vkCreateBuffer(device, &buffer_info, nullptr, &staging_buffer);
+
+    VkMemoryRequirements requirements;
+    vkGetBufferMemoryRequirements(device, staging_buffer, &requirements);
+    if (!gpu_memory_allocate(&requirements, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            GPU_RESOURCE_LINEAR, &staging_allocation)) {
+        LOG_ERROR(LOG_CATEGORY_MEMORY, "🔸Out of GPU memory creating the staging ring\n");
+        log_flush();
+        exit(EXIT_FAILURE);
+    }
+    vkBindBufferMemory(device, staging_buffer, staging_allocation.memory, staging_allocation.offset);
+
+    stopping = false;
+    io_thread = std::thread(io_thread_main);
+
+    LOG_INFO(LOG_CATEGORY_ASSETS, "• Streaming started (%s transfer queue, %llu KiB staging).\n",
+        ownership_transfer() ? "dedicated" : "shared", (unsigned long long)staging_size / 1024);
+}
+
+void streaming_shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(request_mutex);
+        stopping = true;
+    }
+    request_condition.notify_one();
+    io_thread.join();
+
+    for (uint32_t i = 0; i < request_count; i++) {
+        free((void*)requests[i].source.path);
+    }
+    free(requests);
+    requests = nullptr;
+    request_count = request_capacity = 0;
+    free(handoffs);
+    handoffs = nullptr;
+    handoff_count = handoff_capacity = 0;
+
+    wait_timeline(last_timeline_value);
+
+    vkDestroyBuffer(device, staging_buffer, nullptr);
+    gpu_memory_free(&staging_allocation);
+    vkDestroyCommandPool(device, command_pool, nullptr);
+    vkDestroySemaphore(device, timeline_semaphore, nullptr);
+}
+
+void streaming_request(const Stream_Target* target, const Stream_Source* source, Stream_Priority priority) {
+    target->ready->store(false, std::memory_order_relaxed);
+    if (target->failed) {
+        target->failed->store(false, std::memory_order_relaxed);
+    }
+    queued_requests.fetch_add(1, std::memory_order_relaxed);
+
+    {
+        std::lock_guard<std::mutex> lock(request_mutex);
+        if (request_count == request_capacity) {
+            request_capacity = request_capacity ? request_capacity * 2 : 64;
+            requests = (Stream_Request*)realloc(requests, sizeof(Stream_Request) * request_capacity);
+        }
+
+        Stream_Request* request = &requests[request_count++];
+        request->target = *target;
+        request->source = *source;
+        request->source.path = source->data ? nullptr : strdup(source->path);
+        request->source.mip_offsets = nullptr;
+        uint64_t offset = 0;
+        for (uint32_t mip = 0; target->image && mip < target->mip_levels && mip < MAX_IMAGE_MIPS; mip++) {
+            request->mip_offsets[mip] = source->mip_offsets ? source->mip_offsets[mip] : offset;
+            offset += mip_row_size(target, mip) * mip_rows(target, mip);
+        }
+        request->priority = priority;
+        request->sequence = next_sequence++;
+    }
+    request_condition.notify_one();
+}
+
+uint64_t streaming_acquire(VkCommandBuffer command_buffer) {
+    uint64_t completed;
+    vkGetSemaphoreCounterValue(device, timeline_semaphore, &completed);
+
+    static constexpr uint32_t BARRIER_BATCH = 32;
+    VkBufferMemoryBarrier buffer_barriers[BARRIER_BATCH];
+    VkImageMemoryBarrier image_barriers[BARRIER_BATCH];
+    uint32_t buffer_barrier_count = 0;
+    uint32_t image_barrier_count = 0;
+    uint64_t wait_value = 0;
+
+    std::lock_guard<std::mutex> lock(handoff_mutex);
+
+    uint32_t i = 0;
+    while (i < handoff_count) {
+        Handoff* handoff = &handoffs[i];
+        // Only take uploads that are already done, so the frame's semaphore wait never stalls.
+        if (handoff->timeline_value > completed) {
+            i++;
+            continue;
+        }
+
+        if (ownership_transfer() && handoff->target.buffer) {
+            VkBufferMemoryBarrier* barrier = &buffer_barriers[buffer_barrier_count++];
+            *barrier = {};
+            barrier->sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+            barrier->srcAccessMask = 0;
+            barrier->dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+            barrier->srcQueueFamilyIndex = transfer_family;
+            barrier->dstQueueFamilyIndex = graphics_family;
+            barrier->buffer = handoff->target.buffer;
+            barrier->offset = 0;
+            barrier->size = VK_WHOLE_SIZE;
+        } else if (ownership_transfer()) {
+            VkImageMemoryBarrier* barrier = &image_barriers[image_barrier_count++];
+            *barrier = {};
+            barrier->sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+            barrier->oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+            barrier->newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+            barrier->srcQueueFamilyIndex = transfer_family;
+            barrier->dstQueueFamilyIndex = graphics_family;
+            barrier->image = handoff->target.image;
+            barrier->subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            barrier->subresourceRange.baseMipLevel = 0;
+            barrier->subresourceRange.levelCount = handoff->target.mip_levels;
+            barrier->subresourceRange.baseArrayLayer = 0;
+            barrier->subresourceRange.layerCount = 1;
+            barrier->srcAccessMask = 0;
+            barrier->dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+
+        if (handoff->timeline_value > wait_value) {
+            wait_value = handoff->timeline_value;
+        }
+        handoff->target.ready->store(true, std::memory_order_release);
+        completed_requests.fetch_add(1, std::memory_order_relaxed);
+        handoffs[i] = handoffs[--handoff_count];
+
+        if (buffer_barrier_count == BARRIER_BATCH || image_barrier_count == BARRIER_BATCH) {
+            vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                0, nullptr, buffer_barrier_count, buffer_barriers, image_barrier_count, image_barriers);
+            buffer_barrier_count = 0;
+            image_barrier_count = 0;
+        }
+    }
+
+    if (buffer_barrier_count + image_barrier_count > 0) {
+        vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+            0, nullptr, buffer_barrier_count, buffer_barriers, image_barrier_count, image_barriers);
+    }
+    return wait_value;
+}
+
+VkSemaphore streaming_timeline_semaphore() {
+    return timeline_semaphore;
+}
+
+void streaming_get_stats(Stream_Stats* stats) {
+    stats->queued_requests = queued_requests.load(std::memory_order_relaxed);
+    stats->completed_requests = completed_requests.load(std::memory_order_relaxed);
+    stats->bytes_uploaded = bytes_uploaded.load(std::memory_order_relaxed);
+    stats->dedicated_transfer_queue = ownership_transfer();
+}
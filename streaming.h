@@ -0,0 +1,54 @@
+#pragma once
+#include "render.h"
+
+#include <atomic>
+#include <mutex>
+#include <vulkan/vulkan_core.h>
+
+// Background uploads. One I/O thread takes requests highest priority first, reads each source in
+// chunks into a persistently mapped staging ring and copies the chunks on the transfer queue,
+// signalling a timeline semaphore per submission. Staging space is reclaimed as the semaphore
+// advances. When the transfer queue is a different family, the last chunk releases the resource
+// to the graphics family and streaming_acquire() records the matching acquire.
+
+struct Streaming_Init {
+    VkDevice device;
+    uint32_t graphics_family;
+    uint32_t transfer_family;
+    VkQueue transfer_queue;
+    // Held around transfer submits. Needed when the transfer queue is also the graphics queue.
+    std::mutex* transfer_queue_mutex;
+    uint64_t staging_size;
+};
+
+// What to fill. Exactly one of buffer or image is set. Image levels are copied in whole rows of
+// blocks, 1 x 1 for plain formats, 4 x 4 and up for block compressed ones.
+struct Stream_Target {
+    VkBuffer buffer;
+    VkImage image;
+    uint32_t width;
+    uint32_t height;
+    uint32_t mip_levels;
+    uint32_t block_width;
+    uint32_t block_height;
+    uint32_t block_size;    // bytes
+    // Set once the graphics queue owns the finished upload.
+    std::atomic<bool>* ready;
+    // Optional, set instead of `ready` when the source can't fill the target or can't be read.
+    // The target is no longer used by streaming then, but its contents are undefined.
+    std::atomic<bool>* failed;
+};
+
+void streaming_init(const Streaming_Init* init);
+// Drops requests that have not started and waits for submitted transfers to finish.
+void streaming_shutdown();
+
+void streaming_request(const Stream_Target* target, const Stream_Source* source, Stream_Priority priority);
+
+// Graphics side, once per frame and outside rendering. Hands over every upload whose transfer has
+// completed: records the acquire barriers and marks the targets ready. Returns the timeline value
+// the frame's submit has to wait on, 0 if nothing was handed over.
+uint64_t streaming_acquire(VkCommandBuffer command_buffer);
+VkSemaphore streaming_timeline_semaphore();
+
+void streaming_get_stats(Stream_Stats* stats);
@@ -0,0 +1,681 @@
+#include "texture.h"
+#include "bindless.h"
+#include "gpu_memory.h"
+#include "log.h"
+#include "streaming.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+
+// The streaming queue takes at most as many levels.
+static constexpr uint32_t MAX_TEXTURE_LEVELS = 16;
+// Shares of the budget: above the high one textures lose levels, below the low one they get them
+// back. The gap keeps a restore from pushing usage straight back over.
+static constexpr double HIGH_WATERMARK = 0.9;
+static constexpr double LOW_WATERMARK = 0.75;
+// Levels are never dropped below this many texels on the longer side.
+static constexpr uint32_t MIN_DROP_EXTENT = 64;
+// A reduced texture is only restored if it was used within this many frames.
+static constexpr uint64_t RESTORE_WINDOW = 120;
+
+static constexpr VkPipelineStageFlags2 SHADER_STAGES =
+    VK_PIPELINE_STAGE_2_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT;
+
+// KTX2 file layout: the header, then one index entry per level, base level first. Level data
+// itself is stored smallest level first, each entry says where.
+struct Ktx2_Header {
+    uint8_t identifier[12];
+    uint32_t vk_format;
+    uint32_t type_size;
+    uint32_t pixel_width;
+    uint32_t pixel_height;
+    uint32_t pixel_depth;
+    uint32_t layer_count;
+    uint32_t face_count;
+    uint32_t level_count;       // 0 = one level, the reader generates the rest
+    uint32_t supercompression_scheme;
+    uint32_t dfd_byte_offset;
+    uint32_t dfd_byte_length;
+    uint32_t kvd_byte_offset;
+    uint32_t kvd_byte_length;
+    uint64_t sgd_byte_offset;
+    uint64_t sgd_byte_length;
+};
+
+struct Ktx2_Level {
+    uint64_t byte_offset;
+    uint64_t byte_length;
+    uint64_t uncompressed_byte_length;
+};
+
+static_assert(sizeof(Ktx2_Header) == 80, "KTX2 header is 80 bytes");
+static_assert(sizeof(Ktx2_Level) == 24, "KTX2 level index entries are 24 bytes");
+
+struct Texture_Image {
+    VkImage image;
+    VkImageView image_view;
+    Gpu_Allocation allocation;
+    uint32_t base_level;        // level of the full chain the image starts at
+    uint32_t bindless_index;
+};
+
+struct Texture {
+    const uint8_t* data;
+    uint64_t size;
+    uint64_t level_offsets[MAX_TEXTURE_LEVELS];
+    VkFormat format;
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;       // full chain
+    uint32_t file_level_count;  // stored in the file, the rest are generated
+    uint32_t block_width;
+    uint32_t block_height;
+    uint32_t block_size;
+    Stream_Priority priority;
+
+    Texture_Image current;      // sampled, no image until the first upload is in
+    Texture_Image incoming;     // full size, being streamed
+    std::atomic<bool> incoming_ready;
+    std::atomic<bool> incoming_failed;  // nothing was streamed, the file doesn't hold its levels
+    std::atomic<uint32_t> bindless_index;
+    std::atomic<uint64_t> last_used;
+    bool upload_failed;
+    bool destroyed;
+    uint64_t retire_serial;
+};
+
+// Replaced images wait here until the frames that may sample them have completed.
+struct Retired_Image {
+    Texture_Image image;
+    uint64_t retire_serial;
+};
+
+static VkDevice device;
+static VkPhysicalDevice physical_device;
+static uint64_t texture_budget;
+
+// Textures are created and destroyed on the calling thread and updated on whichever thread
+// records frames.
+static std::mutex textures_mutex;
+static Texture** textures;
+static uint32_t texture_count;
+static uint32_t texture_capacity;
+
+static Retired_Image* retired_images;
+static uint32_t retired_image_count;
+static uint32_t retired_image_capacity;
+static uint64_t retiring_bytes;
+
+static uint32_t levels_dropped;
+static uint32_t restores;
+
+static bool format_blocks(VkFormat format, uint32_t* block_width, uint32_t* block_height, uint32_t* block_size) {
+    *block_width = 4;
+    *block_height = 4;
+    switch (format) {
+    case VK_FORMAT_R8G8B8A8_UNORM:
+    case VK_FORMAT_R8G8B8A8_SRGB:
+    case VK_FORMAT_B8G8R8A8_UNORM:
+    case VK_FORMAT_B8G8R8A8_SRGB:
+        *block_width = 1;
+        *block_height = 1;
+        *block_size = 4;
+        return true;
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    case VK_FORMAT_BC4_UNORM_BLOCK:
+    case VK_FORMAT_BC4_SNORM_BLOCK:
+        *block_size = 8;
+        return true;
+    case VK_FORMAT_BC2_UNORM_BLOCK:
+    case VK_FORMAT_BC2_SRGB_BLOCK:
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+    case VK_FORMAT_BC3_SRGB_BLOCK:
+    case VK_FORMAT_BC5_UNORM_BLOCK:
+    case VK_FORMAT_BC5_SNORM_BLOCK:
+    case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+    case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+    case VK_FORMAT_BC7_UNORM_BLOCK:
+    case VK_FORMAT_BC7_SRGB_BLOCK:
+        *block_size = 16;
+        return true;
+    default:
+        break;
+    }
+
+    // ASTC LDR, an UNORM and an SRGB format per block size, always 16 bytes a block.
+    static const uint8_t astc_blocks[][2] = {
+        {4, 4}, {5, 4}, {5, 5}, {6, 5}, {6, 6}, {8, 5}, {8, 6}, {8, 8}, {10, 5}, {10, 6}, {10, 8}, {10, 10}, {12, 10}, {12, 12},
+    };
+    if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+        uint32_t index = (format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2;
+        *block_width = astc_blocks[index][0];
+        *block_height = astc_blocks[index][1];
+        *block_size = 16;
+        return true;
+    }
+    return false;
+}
+
+static uint32_t level_extent(uint32_t size, uint32_t level) {
+    return size >> level ? size >> level : 1;
+}
+
+static uint64_t level_size(const Texture* texture, uint32_t level) {
+    uint64_t columns = (level_extent(texture->width, level) + texture->block_width - 1) / texture->block_width;
+    uint64_t rows = (level_extent(texture->height, level) + texture->block_height - 1) / texture->block_height;
+    return columns * rows * texture->block_size;
+}
+
+// Levels from `base_level` down, as uncompressed RGBA8.
+static uint64_t rgba8_size(const Texture* texture, uint32_t base_level) {
+    uint64_t size = 0;
+    for (uint32_t level = base_level; level < texture->level_count; level++) {
+        size += (uint64_t)level_extent(texture->width, level) * level_extent(texture->height, level) * 4;
+    }
+    return size;
+}
+
+static bool generates_mips(const Texture* texture) {
+    return texture->level_count > texture->file_level_count;
+}
+
+static bool parse_ktx2(Texture* texture, const uint8_t* data, uint64_t size) {
+    static const uint8_t identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+    Ktx2_Header header;
+    if (size < sizeof(header) || memcmp(data, identifier, sizeof(identifier)) != 0) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Not a KTX2 file\n");
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (header.pixel_width == 0 || header.pixel_height == 0 || header.pixel_depth > 1 || header.layer_count > 1 ||
+        header.face_count != 1 || header.supercompression_scheme != 0) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸Only 2D KTX2 textures without supercompression are supported\n");
+        return false;
+    }
+    texture->format = (VkFormat)header.vk_format;
+    if (!format_blocks(texture->format, &texture->block_width, &texture->block_height, &texture->block_size)) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸KTX2 format %u is not supported\n", header.vk_format);
+        return false;
+    }
+
+    texture->data = data;
+    texture->size = size;
+    texture->width = header.pixel_width;
+    texture->height = header.pixel_height;
+    texture->file_level_count = header.level_count ? header.level_count : 1;
+    uint32_t chain_levels = (uint32_t)std::bit_width(std::max(texture->width, texture->height));
+    if (texture->file_level_count > std::min(chain_levels, MAX_TEXTURE_LEVELS) ||
+        sizeof(header) + texture->file_level_count * sizeof(Ktx2_Level) > size) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸KTX2 file has an invalid level index\n");
+        return false;
+    }
+    texture->level_count = texture->file_level_count;
+
+    for (uint32_t level = 0; level < texture->file_level_count; level++) {
+        Ktx2_Level entry;
+        memcpy(&entry, data + sizeof(header) + level * sizeof(entry), sizeof(entry));
+        uint64_t expected = level_size(texture, level);
+        if (entry.byte_length < expected || entry.byte_offset > size || size - entry.byte_offset < expected) {
+            LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸KTX2 level %u is truncated\n", level);
+            return false;
+        }
+        texture->level_offsets[level] = entry.byte_offset;
+    }
+
+    // Mips the file lacks come from the GPU, when its blits can filter the format.
+    VkFormatProperties properties;
+    vkGetPhysicalDeviceFormatProperties(physical_device, texture->format, &properties);
+    VkFormatFeatureFlags needed = VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_SRC_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+    if ((properties.optimalTilingFeatures & needed) != needed) {
+        LOG_ERROR(LOG_CATEGORY_ASSETS, "🔸KTX2 format %u can't be sampled on this device\n", header.vk_format);
+        return false;
+    }
+    VkFormatFeatureFlags blit = VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT | VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+    if (texture->file_level_count == 1 && chain_levels > 1) {
+        if ((properties.optimalTilingFeatures & blit) == blit) {
+            texture->level_count = std::min(chain_levels, MAX_TEXTURE_LEVELS);
+        } else {
+            LOG_WARN(LOG_CATEGORY_ASSETS, "🔸%u x %u texture has no mips and its format can't be blitted, it keeps one level\n",
+                texture->width, texture->height);
+        }
+    }
+    return true;
+}
+
+// Without a bindless slot, the slot is taken when the image is about to be sampled.
+static bool create_image(const Texture* texture, uint32_t base_level, Texture_Image* image) {
+    *image = {};
+    image->base_level = base_level;
+    image->bindless_index = BINDLESS_INVALID_INDEX;
+
+    VkImageCreateInfo image_info{};
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = texture->format;
+    image_info.extent = {level_extent(texture->width, base_level), level_extent(texture->height, base_level), 1};
+    image_info.mipLevels = texture->level_count - base_level;
+    image_info.arrayLayers = 1;
+    image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+    vkCreateImage(device, &image_info, nullptr, &image->image);
+
+    VkMemoryRequirements requirements;
+    vkGetImageMemoryRequirements(device, image->image, &requirements);
+    if (!gpu_memory_allocate(&requirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, 0, GPU_RESOURCE_OPTIMAL, &image->allocation)) {
+        LOG_WARN(LOG_CATEGORY_MEMORY, "🔸Out of GPU memory creating a %u x %u texture\n", image_info.extent.width, image_info.extent.height);
+        vkDestroyImage(device, image->image, nullptr);
+        *image = {};
+        return false;
+    }
+    vkBindImageMemory(device, image->image, image->allocation.memory, image->allocation.offset);
+
+    VkImageViewCreateInfo view_info{};
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = image->image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = texture->format;
+    view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    view_info.subresourceRange.baseMipLevel = 0;
+    view_info.subresourceRange.levelCount = image_info.mipLevels;
+    view_info.subresourceRange.baseArrayLayer = 0;
+    view_info.subresourceRange.layerCount = 1;
+
+    vkCreateImageView(device, &view_info, nullptr, &image->image_view);
+    return true;
+}
+
+static bool allocate_slot(Texture_Image* image, uint64_t completed_serial) {
+    if (image->bindless_index == BINDLESS_INVALID_INDEX) {
+        image->bindless_index = bindless_allocate(BINDLESS_IMAGE, completed_serial);
+        if (image->bindless_index == BINDLESS_INVALID_INDEX) {
+            return false;
+        }
+        bindless_write_image(image->bindless_index, image->image_view);
+    }
+    return true;
+}
+
+static void destroy_image(Texture_Image* image) {
+    if (image->bindless_index != BINDLESS_INVALID_INDEX) {
+        bindless_free(BINDLESS_IMAGE, image->bindless_index, 0);
+    }
+    vkDestroyImageView(device, image->image_view, nullptr);
+    vkDestroyImage(device, image->image, nullptr);
+    gpu_memory_free(&image->allocation);
+    *image = {};
+}
+
+static void retire_image(Texture_Image* image, uint64_t retire_serial) {
+    if (!image->image) {
+        return;
+    }
+    if (image->bindless_index != BINDLESS_INVALID_INDEX) {
+        bindless_free(BINDLESS_IMAGE, image->bindless_index, retire_serial);
+        image->bindless_index = BINDLESS_INVALID_INDEX;
+    }
+    if (retired_image_count == retired_image_capacity) {
+        retired_image_capacity = retired_image_capacity ? retired_image_capacity * 2 : 16;
+        retired_images = (Retired_Image*)realloc(retired_images, sizeof(Retired_Image) * retired_image_capacity);
+    }
+    retired_images[retired_image_count++] = {*image, retire_serial};
+    retiring_bytes += image->allocation.size;
+    *image = {};
+}
+
+static void destroy_retired_images(uint64_t completed_serial, bool all) {
+    uint32_t i = 0;
+    while (i < retired_image_count) {
+        Retired_Image* retired = &retired_images[i];
+        if (!all && retired->retire_serial > completed_serial) {
+            i++;
+            continue;
+        }
+        retiring_bytes -= retired->image.allocation.size;
+        destroy_image(&retired->image);
+        retired_images[i] = retired_images[--retired_image_count];
+    }
+}
+
+// Streams every level the file has into a new full size image.
+static bool start_upload(Texture* texture) {
+    if (!create_image(texture, 0, &texture->incoming)) {
+        return false;
+    }
+
+    Stream_Target target{};
+    target.image = texture->incoming.image;
+    target.width = texture->width;
+    target.height = texture->height;
+    target.mip_levels = texture->file_level_count;
+    target.block_width = texture->block_width;
+    target.block_height = texture->block_height;
+    target.block_size = texture->block_size;
+    target.ready = &texture->incoming_ready;
+    target.failed = &texture->incoming_failed;
+
+    Stream_Source source = {texture->data, nullptr, 0, texture->size, texture->level_offsets};
+    streaming_request(&target, &source, texture->priority);
+    return true;
+}
+
+// From here on the image is what the texture samples. The one it replaces may still be read by
+// frames before `serial`, and by copies recorded in it.
+static void promote(Texture* texture, Texture_Image* image, uint64_t serial) {
+    retire_image(&texture->current, serial);
+    texture->current = *image;
+    texture->bindless_index.store(image->bindless_index, std::memory_order_release);
+    *image = {};
+}
+
+static VkImageMemoryBarrier2 image_barrier(VkImage image, uint32_t base_level, uint32_t level_count, VkImageLayout old_layout, VkImageLayout new_layout,
+    VkPipelineStageFlags2 src_stages, VkAccessFlags2 src_access, VkPipelineStageFlags2 dst_stages, VkAccessFlags2 dst_access) {
+    VkImageMemoryBarrier2 barrier{};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2;
+    barrier.srcStageMask = src_stages;
+    barrier.srcAccessMask = src_access;
+    barrier.dstStageMask = dst_stages;
+    barrier.dstAccessMask = dst_access;
+    barrier.oldLayout = old_layout;
+    barrier.newLayout = new_layout;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = image;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.baseMipLevel = base_level;
+    barrier.subresourceRange.levelCount = level_count;
+    barrier.subresourceRange.baseArrayLayer = 0;
+    barrier.subresourceRange.layerCount = 1;
+    return barrier;
+}
+
+static void pipeline_barrier(VkCommandBuffer command_buffer, const VkImageMemoryBarrier2* barriers, uint32_t barrier_count) {
+    VkDependencyInfo dependency_info{};
+    dependency_info.sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO;
+    dependency_info.imageMemoryBarrierCount = barrier_count;
+    dependency_info.pImageMemoryBarriers = barriers;
+    vkCmdPipelineBarrier2(command_buffer, &dependency_info);
+}
+
+// Level 0 arrives in shader read layout from the upload, the others are undefined. Each level is
+// a linear blit of the one above, and everything ends up in shader read layout.
+static void generate_mips(VkCommandBuffer command_buffer, const Texture* texture, const Texture_Image* image) {
+    VkImage vk_image = image->image;
+    uint32_t level_count = texture->level_count;
+
+    for (uint32_t level = 1; level < level_count; level++) {
+        VkImageMemoryBarrier2 barriers[2];
+        if (level == 1) {
+            barriers[0] = image_barrier(vk_image, 0, 1, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT, 0, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        } else {
+            barriers[0] = image_barrier(vk_image, level - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+        }
+        barriers[1] = image_barrier(vk_image, level, 1, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            VK_PIPELINE_STAGE_2_NONE, 0, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+        pipeline_barrier(command_buffer, barriers, 2);
+
+        VkImageBlit blit{};
+        blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.srcSubresource.mipLevel = level - 1;
+        blit.srcSubresource.layerCount = 1;
+        blit.srcOffsets[1] = {(int32_t)level_extent(texture->width, level - 1), (int32_t)level_extent(texture->height, level - 1), 1};
+        blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        blit.dstSubresource.mipLevel = level;
+        blit.dstSubresource.layerCount = 1;
+        blit.dstOffsets[1] = {(int32_t)level_extent(texture->width, level), (int32_t)level_extent(texture->height, level), 1};
+        vkCmdBlitImage(command_buffer, vk_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, vk_image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+            1, &blit, VK_FILTER_LINEAR);
+    }
+
+    VkImageMemoryBarrier2 barriers[2];
+    barriers[0] = image_barrier(vk_image, 0, level_count - 1, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT, 0, SHADER_STAGES, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+    barriers[1] = image_barrier(vk_image, level_count - 1, 1, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, SHADER_STAGES, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+    pipeline_barrier(command_buffer, barriers, 2);
+}
+
+static bool can_drop(const Texture* texture) {
+    uint32_t base_level = texture->current.base_level;
+    return base_level + 1 < texture->level_count &&
+        std::max(level_extent(texture->width, base_level), level_extent(texture->height, base_level)) > MIN_DROP_EXTENT;
+}
+
+// Copies every level but the top one into a smaller image, which takes over from this frame on.
+static bool drop_top_level(VkCommandBuffer command_buffer, Texture* texture, uint64_t serial, uint64_t completed_serial) {
+    Texture_Image smaller;
+    if (!create_image(texture, texture->current.base_level + 1, &smaller)) {
+        return false;
+    }
+    if (!allocate_slot(&smaller, completed_serial)) {
+        destroy_image(&smaller);
+        return false;
+    }
+    uint32_t level_count = texture->level_count - smaller.base_level;
+
+    // Earlier frames may still be sampling the old image, the copy waits for them.
+    VkImageMemoryBarrier2 barriers[2];
+    barriers[0] = image_barrier(texture->current.image, 1, level_count, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        SHADER_STAGES, 0, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT);
+    barriers[1] = image_barrier(smaller.image, 0, level_count, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_2_NONE, 0, VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT);
+    pipeline_barrier(command_buffer, barriers, 2);
+
+    // Whole levels, so compressed extents that aren't a multiple of the block still reach the edge.
+    VkImageCopy regions[MAX_TEXTURE_LEVELS];
+    for (uint32_t level = 0; level < level_count; level++) {
+        VkImageCopy* region = &regions[level];
+        *region = {};
+        region->srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region->srcSubresource.mipLevel = level + 1;
+        region->srcSubresource.layerCount = 1;
+        region->dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+        region->dstSubresource.mipLevel = level;
+        region->dstSubresource.layerCount = 1;
+        region->extent = {level_extent(texture->width, smaller.base_level + level), level_extent(texture->height, smaller.base_level + level), 1};
+    }
+    vkCmdCopyImage(command_buffer, texture->current.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, smaller.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        level_count, regions);
+
+    // The old image keeps its slot until the frame retires and may still be sampled through it
+    // this frame, so its levels go back to the layout its view is sampled in.
+    barriers[0] = image_barrier(smaller.image, 0, level_count, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT, SHADER_STAGES, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+    barriers[1] = image_barrier(texture->current.image, 1, level_count, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_TRANSFER_BIT, 0, SHADER_STAGES, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT);
+    pipeline_barrier(command_buffer, barriers, 2);
+
+    promote(texture, &smaller, serial);
+    return true;
+}
+
+void textures_init(const Textures_Init* init) {
+    device = init->device;
+    physical_device = init->physical_device;
+    texture_budget = init->texture_budget;
+
+    Gpu_Memory_Budget budget;
+    gpu_memory_get_budget(&budget);
+    LOG_INFO(LOG_CATEGORY_MEMORY, "• Texture residency: %llu MiB device local budget (%s)%s.\n",
+        (unsigned long long)(budget.budget >> 20), budget.from_driver ? "VK_EXT_memory_budget" : "heap size",
+        texture_budget ? ", texture limit set" : "");
+}
+
+void textures_shutdown() {
+    uint32_t alive = 0;
+    for (uint32_t i = 0; i < texture_count; i++) {
+        Texture* texture = textures[i];
+        alive += !texture->destroyed;
+        if (texture->current.image) {
+            destroy_image(&texture->current);
+        }
+        if (texture->incoming.image) {
+            destroy_image(&texture->incoming);
+        }
+        delete texture;
+    }
+    if (alive) {
+        LOG_WARN(LOG_CATEGORY_RENDER, "🔸%u textures still alive at shutdown.\n", alive);
+    }
+    free(textures);
+    textures = nullptr;
+    texture_count = texture_capacity = 0;
+
+    destroy_retired_images(0, true);
+    free(retired_images);
+    retired_images = nullptr;
+    retired_image_capacity = 0;
+}
+
+Texture* textures_create(const void* data, uint64_t size, Stream_Priority priority) {
+    Texture* texture = new Texture();
+    texture->priority = priority;
+    texture->bindless_index.store(BINDLESS_INVALID_INDEX, std::memory_order_relaxed);
+    if (!parse_ktx2(texture, (const uint8_t*)data, size) || !start_upload(texture)) {
+        delete texture;
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(textures_mutex);
+    if (texture_count == texture_capacity) {
+        texture_capacity = texture_capacity ? texture_capacity * 2 : 64;
+        textures = (Texture**)realloc(textures, sizeof(Texture*) * texture_capacity);
+    }
+    textures[texture_count++] = texture;
+    return texture;
+}
+
+void textures_destroy(Texture* texture, uint64_t retire_serial) {
+    std::lock_guard<std::mutex> lock(textures_mutex);
+    texture->destroyed = true;
+    texture->retire_serial = retire_serial;
+    texture->bindless_index.store(BINDLESS_INVALID_INDEX, std::memory_order_relaxed);
+}
+
+bool textures_update(VkCommandBuffer command_buffer, uint64_t serial, uint64_t completed_serial) {
+    std::lock_guard<std::mutex> lock(textures_mutex);
+    destroy_retired_images(completed_serial, false);
+
+    bool changed = false;
+    uint64_t resident_bytes = 0;
+    Texture* drop_candidate = nullptr;
+    Texture* restore_candidate = nullptr;
+
+    uint32_t i = 0;
+    while (i < texture_count) {
+        Texture* texture = textures[i];
+        bool incoming_ready = texture->incoming.image && texture->incoming_ready.load(std::memory_order_acquire);
+
+        // The transfer queue never touched it. Without an upload that works the texture stays as it
+        // is, not even restores are tried again.
+        if (texture->incoming.image && texture->incoming_failed.load(std::memory_order_acquire)) {
+            destroy_image(&texture->incoming);
+            texture->upload_failed = true;
+        }
+
+        if (texture->destroyed) {
+            // The transfer queue still writes the incoming image, and its ready flag.
+            if (texture->incoming.image && !incoming_ready) {
+                i++;
+                continue;
+            }
+            retire_image(&texture->current, texture->retire_serial);
+            retire_image(&texture->incoming, texture->retire_serial);
+            delete texture;
+            textures[i] = textures[--texture_count];
+            continue;
+        }
+
+        // The streaming acquire for it is already recorded in this command buffer.
+        if (incoming_ready && allocate_slot(&texture->incoming, completed_serial)) {
+            if (generates_mips(texture)) {
+                generate_mips(command_buffer, texture, &texture->incoming);
+            }
+            restores += texture->current.image != VK_NULL_HANDLE;
+            promote(texture, &texture->incoming, serial);
+            changed = true;
+        }
+
+        if (texture->current.image) {
+            resident_bytes += texture->current.allocation.size;
+        }
+        if (texture->current.image && !texture->incoming.image) {
+            uint64_t last_used = texture->last_used.load(std::memory_order_relaxed);
+            if (can_drop(texture) && (!drop_candidate || last_used < drop_candidate->last_used.load(std::memory_order_relaxed))) {
+                drop_candidate = texture;
+            }
+            if (texture->current.base_level > 0 && !texture->upload_failed && last_used + RESTORE_WINDOW >= serial &&
+                (!restore_candidate || last_used > restore_candidate->last_used.load(std::memory_order_relaxed))) {
+                restore_candidate = texture;
+            }
+        }
+        i++;
+    }
+
+    // Retired images are as good as freed, counting them would drop more levels while they wait.
+    Gpu_Memory_Budget budget;
+    gpu_memory_get_budget(&budget);
+    uint64_t usage = budget.usage - std::min(budget.usage, retiring_bytes);
+    bool over_budget = usage > budget.budget * HIGH_WATERMARK || (texture_budget && resident_bytes > texture_budget);
+
+    if (over_budget && drop_candidate) {
+        if (drop_top_level(command_buffer, drop_candidate, serial, completed_serial)) {
+            levels_dropped++;
+            changed = true;
+        }
+    } else if (!over_budget && restore_candidate) {
+        // Old and new image both exist until the new one lands.
+        uint64_t full_size = 0;
+        for (uint32_t level = 0; level < restore_candidate->level_count; level++) {
+            full_size += level_size(restore_candidate, level);
+        }
+        if (usage + full_size <= budget.budget * LOW_WATERMARK &&
+            (!texture_budget || resident_bytes + full_size <= texture_budget * (LOW_WATERMARK / HIGH_WATERMARK))) {
+            start_upload(restore_candidate);
+        }
+    }
+    return changed;
+}
+
+uint32_t textures_index(const Texture* texture) {
+    return texture->bindless_index.load(std::memory_order_acquire);
+}
+
+void textures_use(Texture* texture, uint64_t serial) {
+    texture->last_used.store(serial, std::memory_order_relaxed);
+}
+
+void textures_get_stats(Texture_Stats* stats) {
+    std::lock_guard<std::mutex> lock(textures_mutex);
+    *stats = {};
+    for (uint32_t i = 0; i < texture_count; i++) {
+        const Texture* texture = textures[i];
+        if (texture->destroyed) {
+            continue;
+        }
+        stats->textures++;
+        stats->generated_mips += generates_mips(texture);
+        if (texture->current.image) {
+            stats->resident++;
+            stats->reduced += texture->current.base_level > 0;
+            stats->resident_bytes += texture->current.allocation.size;
+            stats->rgba8_bytes += rgba8_size(texture, texture->current.base_level);
+        }
+    }
+    stats->levels_dropped = levels_dropped;
+    stats->restores = restores;
+}
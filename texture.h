@@ -0,0 +1,46 @@
+#pragma once
+#include "render.h"
+
+#include <vulkan/vulkan_core.h>
+
+// Textures from KTX2 files, sampled through the bindless table. Block compressed payloads (BC1-7,
+// ASTC LDR) are streamed as they are, straight out of the caller's data such as the mapped asset
+// archive, and stay compressed on the GPU: 4 to 8 bits a texel against 32 for RGBA8. A file with
+// a single level gets the rest of the chain from a blit chain on the graphics queue when its
+// format can be blitted with linear filtering, which leaves out the compressed formats.
+//
+// Residency follows a memory budget, device local usage against VK_EXT_memory_budget (see
+// gpu_memory_get_budget()) and optionally a byte limit for textures. Above the high watermark the
+// least recently used texture loses its top level: a smaller image is created, the remaining
+// levels are copied into it on the GPU and it takes a new bindless slot. Below the low watermark
+// the most recently used reduced texture is streamed in again at full size, and swaps slots once
+// it has landed. One texture changes per frame at most, so crossing the budget is spread over
+// frames instead of landing on one. Old images and slots are released once the frames that may
+// still sample them have completed.
+
+struct Textures_Init {
+    VkDevice device;
+    VkPhysicalDevice physical_device;
+    uint64_t texture_budget;    // 0 = device budget only
+};
+
+void textures_init(const Textures_Init* init);
+// The device must be idle, after streaming_shutdown().
+void textures_shutdown();
+
+// `data` is read again for restores and must outlive the texture. Returns nullptr if it isn't a 2D
+// KTX2 file without supercompression in a format the device can sample.
+Texture* textures_create(const void* data, uint64_t size, Stream_Priority priority);
+// `retire_serial` is the last frame that may sample it. An upload in flight is waited out first.
+void textures_destroy(Texture* texture, uint64_t retire_serial);
+
+// Graphics side, once per frame after streaming_acquire() and outside rendering: generates mips for
+// finished uploads, moves textures to their new images, starts at most one drop or restore and
+// releases what has retired. `serial` is the frame being recorded. Returns true when any bindless
+// slot changed, textures_index() then has to be read again.
+bool textures_update(VkCommandBuffer command_buffer, uint64_t serial, uint64_t completed_serial);
+
+// BINDLESS_INVALID_INDEX until the first upload is in.
+uint32_t textures_index(const Texture* texture);
+void textures_use(Texture* texture, uint64_t serial);
+void textures_get_stats(Texture_Stats* stats);